@@ -31,6 +31,8 @@ CHECK_FUNC poll -DHAS_POLL
 CHECK_FUNC fcntl -DHAS_FCNTL
 CHECK_FUNC inet_pton -DHAS_INET_PTON
 CHECK_FUNC inet_ntop -DHAS_INET_NTOP
+CHECK_FUNC recvmmsg -DHAS_RECVMMSG
+CHECK_FUNC sendmmsg -DHAS_SENDMMSG
 
 echo "#include <sys/socket.h>" > check_member.h
 $CC check_member.c -DTEST_STRUCT=msghdr -DTEST_FIELD=msg_flags \
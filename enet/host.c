@@ -110,6 +110,13 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
 
     host -> intercept = NULL;
 
+    host -> datagrams = NULL;
+    host -> datagramData = NULL;
+    host -> datagramCount = 0;
+    host -> datagramIndex = 0;
+    host -> receivedDatagrams = 0;
+    host -> sentDatagrams = 0;
+
     enet_list_clear (& host -> dispatchQueue);
 
     for (currentPeer = host -> peers;
@@ -156,6 +163,12 @@ enet_host_destroy (ENetHost * host)
     if (host -> compressor.context != NULL && host -> compressor.destroy)
       (* host -> compressor.destroy) (host -> compressor.context);
 
+    if (host -> datagrams != NULL)
+    {
+       enet_free (host -> datagrams);
+       enet_free (host -> datagramData);
+    }
+
     enet_free (host -> peers);
     enet_free (host);
 }
@@ -307,6 +320,65 @@ enet_host_channel_limit (ENetHost * host, size_t channelLimit)
     host -> channelLimit = channelLimit;
 }
 
+/** Enables or disables batched socket I/O on a host.
+    @param host host to adjust
+    @param datagramCount the maximum number of datagrams received or sent per system call; if 0 or 1, batching is disabled
+    @retval 0 on success
+    @retval < 0 if the batch buffers could not be allocated, or received datagrams are still waiting to be processed
+    @remarks where the platform has no batched socket calls, datagrams are still gathered into batches but
+    transferred one at a time, so batching should only be enabled on hosts that serve many peers.
+*/
+int
+enet_host_batch (ENetHost * host, size_t datagramCount)
+{
+    if (host -> datagramIndex < host -> receivedDatagrams)
+      return -1;
+
+    if (datagramCount <= 1)
+      datagramCount = 0;
+    else
+    if (datagramCount > ENET_HOST_MAXIMUM_BATCH_SIZE)
+      datagramCount = ENET_HOST_MAXIMUM_BATCH_SIZE;
+
+    if (datagramCount == host -> datagramCount)
+      return 0;
+
+    if (host -> datagrams != NULL)
+    {
+       enet_free (host -> datagrams);
+       enet_free (host -> datagramData);
+
+       host -> datagrams = NULL;
+       host -> datagramData = NULL;
+    }
+
+    host -> datagramCount = 0;
+    host -> datagramIndex = 0;
+    host -> receivedDatagrams = 0;
+    host -> sentDatagrams = 0;
+
+    if (datagramCount == 0)
+      return 0;
+
+    /* the first half of each array holds the receive batch, the second half the send batch */
+    host -> datagrams = (ENetDatagram *) enet_malloc (2 * datagramCount * sizeof (ENetDatagram));
+    if (host -> datagrams == NULL)
+      return -1;
+
+    host -> datagramData = (enet_uint8 *) enet_malloc (2 * datagramCount * ENET_HOST_DATAGRAM_SIZE);
+    if (host -> datagramData == NULL)
+    {
+       enet_free (host -> datagrams);
+       host -> datagrams = NULL;
+
+       return -1;
+    }
+
+    host -> datagramCount = datagramCount;
+
+    return 0;
+}
+
 
 /** Adjusts the bandwidth limits of a host.
     @param host host to adjust
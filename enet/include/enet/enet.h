@@ -92,6 +92,20 @@ typedef struct _ENetAddress
    enet_uint16 port;
 } ENetAddress;
 
+/**
+ * A single datagram for batched socket I/O.
+ *
+ * On receive, data and dataLength describe the buffer to fill, and dataLength and
+ * address are updated to the received datagram. On send, data and dataLength
+ * describe the datagram and address its destination.
+ */
+typedef struct _ENetDatagram
+{
+   ENetAddress address;
+   void *      data;
+   size_t      dataLength;
+} ENetDatagram;
+
 /**
  * Packet flag bit constants.
  *
@@ -143,6 +157,12 @@ typedef void (ENET_CALLBACK * ENetPacketFreeCallback) (struct _ENetPacket *);
  *    (instead of reliable) sends if it exceeds the MTU
  *
  *    ENET_PACKET_FLAG_SENT - whether the packet has been sent from all queues it has been entered into
+ *
+ * A packet created with enet_packet_create_split() references two user supplied
+ * segments: the first splitLength bytes are read from data and the remaining
+ * dataLength - splitLength bytes from splitData. Such packets are always
+ * ENET_PACKET_FLAG_NO_ALLOCATE and are gathered into the outgoing datagram
+ * without being copied.
    @sa ENetPacketFlag
  */
 typedef struct _ENetPacket
@@ -153,6 +173,8 @@ typedef struct _ENetPacket
    size_t                   dataLength;      /**< length of data */
    ENetPacketFreeCallback   freeCallback;    /**< function to be called when the packet is no longer in use */
    void *                   userData;        /**< application private data, may be freely modified */
+   enet_uint8 *             splitData;       /**< second data segment of a split packet, or NULL */
+   size_t                   splitLength;     /**< length of the first data segment of a split packet */
 } ENetPacket;
 
 typedef struct _ENetAcknowledgement
@@ -215,6 +237,8 @@ enum
    ENET_HOST_DEFAULT_MTU                  = 1400,
    ENET_HOST_DEFAULT_MAXIMUM_PACKET_SIZE  = 32 * 1024 * 1024,
    ENET_HOST_DEFAULT_MAXIMUM_WAITING_DATA = 32 * 1024 * 1024,
+   ENET_HOST_MAXIMUM_BATCH_SIZE           = 64,
+   ENET_HOST_DATAGRAM_SIZE                = ENET_PROTOCOL_MAXIMUM_MTU + sizeof (enet_uint32),
 
    ENET_PEER_DEFAULT_ROUND_TRIP_TIME      = 500,
    ENET_PEER_DEFAULT_PACKET_THROTTLE      = 32,
@@ -398,6 +422,12 @@ typedef struct _ENetHost
    size_t               duplicatePeers;              /**< optional number of allowed peers from duplicate IPs, defaults to ENET_PROTOCOL_MAXIMUM_PEER_ID */
    size_t               maximumPacketSize;           /**< the maximum allowable packet size that may be sent or received on a peer */
    size_t               maximumWaitingData;          /**< the maximum aggregate amount of buffer space a peer may use waiting for packets to be delivered */
+   ENetDatagram *       datagrams;                   /**< receive and send batches when batched socket I/O is enabled, see enet_host_batch() */
+   enet_uint8 *         datagramData;
+   size_t               datagramCount;               /**< maximum number of datagrams per batch, 0 if batching is disabled */
+   size_t               datagramIndex;               /**< next received datagram still to be processed */
+   size_t               receivedDatagrams;
+   size_t               sentDatagrams;               /**< datagrams queued for the next batched send */
 } ENetHost;
 
 /**
@@ -502,6 +532,8 @@ ENET_API ENetSocket enet_socket_accept (ENetSocket, ENetAddress *);
 ENET_API int        enet_socket_connect (ENetSocket, const ENetAddress *);
 ENET_API int        enet_socket_send (ENetSocket, const ENetAddress *, const ENetBuffer *, size_t);
 ENET_API int        enet_socket_receive (ENetSocket, ENetAddress *, ENetBuffer *, size_t);
+ENET_API int        enet_socket_send_batch (ENetSocket, const ENetDatagram *, size_t);
+ENET_API int        enet_socket_receive_batch (ENetSocket, ENetDatagram *, size_t);
 ENET_API int        enet_socket_wait (ENetSocket, enet_uint32 *, enet_uint32);
 ENET_API int        enet_socket_set_option (ENetSocket, ENetSocketOption, int);
 ENET_API int        enet_socket_get_option (ENetSocket, ENetSocketOption, int *);
@@ -558,6 +590,7 @@ ENET_API int enet_address_get_host (const ENetAddress * address, char * hostName
 /** @} */
 
 ENET_API ENetPacket * enet_packet_create (const void *, size_t, enet_uint32);
+ENET_API ENetPacket * enet_packet_create_split (const void *, size_t, const void *, size_t, enet_uint32);
 ENET_API void         enet_packet_destroy (ENetPacket *);
 ENET_API int          enet_packet_resize  (ENetPacket *, size_t);
 ENET_API enet_uint32  enet_crc32 (const ENetBuffer *, size_t);
@@ -572,6 +605,7 @@ ENET_API void       enet_host_broadcast (ENetHost *, enet_uint8, ENetPacket *);
 ENET_API void       enet_host_compress (ENetHost *, const ENetCompressor *);
 ENET_API int        enet_host_compress_with_range_coder (ENetHost * host);
 ENET_API void       enet_host_channel_limit (ENetHost *, size_t);
+ENET_API int        enet_host_batch (ENetHost *, size_t);
 ENET_API void       enet_host_bandwidth_limit (ENetHost *, enet_uint32, enet_uint32);
 extern   void       enet_host_bandwidth_throttle (ENetHost *);
 extern  enet_uint32 enet_host_random_seed (void);
@@ -46,6 +46,38 @@ enet_packet_create (const void * data, size_t dataLength, enet_uint32 flags)
     packet -> dataLength = dataLength;
     packet -> freeCallback = NULL;
     packet -> userData = NULL;
+    packet -> splitData = NULL;
+    packet -> splitLength = 0;
+
+    return packet;
+}
+
+/** Creates a packet whose contents are the concatenation of two user supplied segments.
+    The segments are not copied and must remain valid until the packet is destroyed.
+    @param data         first segment of the packet's data
+    @param dataLength   size of the first segment
+    @param splitData    second segment of the packet's data
+    @param splitLength  size of the second segment
+    @param flags        flags for this packet as described for the ENetPacket structure; ENET_PACKET_FLAG_NO_ALLOCATE is implied.
+    @returns the packet on success, NULL on failure
+*/
+ENetPacket *
+enet_packet_create_split (const void * data, size_t dataLength, const void * splitData, size_t splitLength, enet_uint32 flags)
+{
+    ENetPacket * packet;
+
+    if (dataLength <= 0)
+      return enet_packet_create (splitData, splitLength, flags | ENET_PACKET_FLAG_NO_ALLOCATE);
+
+    packet = enet_packet_create (data, dataLength + splitLength, flags | ENET_PACKET_FLAG_NO_ALLOCATE);
+    if (packet == NULL)
+      return NULL;
+
+    if (splitLength > 0)
+    {
+       packet -> splitData = (enet_uint8 *) splitData;
+       packet -> splitLength = dataLength;
+    }
 
     return packet;
 }
@@ -81,6 +113,8 @@ enet_packet_resize (ENetPacket * packet, size_t dataLength)
     if (dataLength <= packet -> dataLength || (packet -> flags & ENET_PACKET_FLAG_NO_ALLOCATE))
     {
        packet -> dataLength = dataLength;
+       if (packet -> splitData != NULL && dataLength <= packet -> splitLength)
+         packet -> splitData = NULL;
 
        return 0;
     }
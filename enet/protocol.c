@@ -1213,23 +1213,70 @@ commandError:
     return 0;
 }
  
+static int
+enet_protocol_receive_datagram (ENetHost * host)
+{
+    ENetDatagram * datagram;
+
+    do
+    {
+        if (host -> datagramIndex >= host -> receivedDatagrams)
+        {
+            size_t i;
+            int receivedDatagrams;
+
+            for (i = 0; i < host -> datagramCount; ++ i)
+            {
+                host -> datagrams [i].data = & host -> datagramData [i * ENET_HOST_DATAGRAM_SIZE];
+                host -> datagrams [i].dataLength = sizeof (host -> packetData [0]);
+            }
+
+            host -> datagramIndex = 0;
+            host -> receivedDatagrams = 0;
+
+            receivedDatagrams = enet_socket_receive_batch (host -> socket, host -> datagrams, host -> datagramCount);
+            if (receivedDatagrams <= 0)
+              return receivedDatagrams;
+
+            host -> receivedDatagrams = receivedDatagrams;
+        }
+
+        datagram = & host -> datagrams [host -> datagramIndex ++];
+    }
+    while (datagram -> dataLength == 0); /* an empty datagram must not be mistaken for the end of the batch */
+
+    host -> receivedAddress = datagram -> address;
+    host -> receivedData = (enet_uint8 *) datagram -> data;
+
+    return (int) datagram -> dataLength;
+}
+
 static int
 enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
 {
     int packets;
 
-    for (packets = 0; packets < 256; ++ packets)
+    /* a batch that was already taken off the socket is always finished, so no datagrams are left waiting
+       in the host while enet_host_service() sleeps on the socket */
+    for (packets = 0; packets < 256 || host -> datagramIndex < host -> receivedDatagrams; ++ packets)
     {
        int receivedLength;
        ENetBuffer buffer;
 
-       buffer.data = host -> packetData [0];
-       buffer.dataLength = sizeof (host -> packetData [0]);
+       if (host -> datagrams != NULL)
+         receivedLength = enet_protocol_receive_datagram (host);
+       else
+       {
+          buffer.data = host -> packetData [0];
+          buffer.dataLength = sizeof (host -> packetData [0]);
+
+          receivedLength = enet_socket_receive (host -> socket,
+                                                & host -> receivedAddress,
+                                                & buffer,
+                                                1);
 
-       receivedLength = enet_socket_receive (host -> socket,
-                                             & host -> receivedAddress,
-                                             & buffer,
-                                             1);
+          host -> receivedData = host -> packetData [0];
+       }
 
        if (receivedLength < 0)
          return -1;
@@ -1237,7 +1284,6 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
        if (receivedLength == 0)
          return 0;
 
-       host -> receivedData = host -> packetData [0];
        host -> receivedDataLength = receivedLength;
       
        host -> totalReceivedData += receivedLength;
@@ -1383,6 +1429,57 @@ enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * even
     return 0;
 }
 
+static size_t
+enet_protocol_packet_buffer_count (ENetOutgoingCommand * outgoingCommand)
+{
+    ENetPacket * packet = outgoingCommand -> packet;
+
+    if (packet != NULL &&
+        packet -> splitData != NULL &&
+        outgoingCommand -> fragmentOffset < packet -> splitLength &&
+        outgoingCommand -> fragmentOffset + outgoingCommand -> fragmentLength > packet -> splitLength)
+      return 2;
+
+    return 1;
+}
+
+static ENetBuffer *
+enet_protocol_packet_buffers (ENetBuffer * buffer, ENetOutgoingCommand * outgoingCommand)
+{
+    ENetPacket * packet = outgoingCommand -> packet;
+    size_t offset = outgoingCommand -> fragmentOffset,
+           length = outgoingCommand -> fragmentLength;
+
+    if (packet -> splitData == NULL)
+    {
+       buffer -> data = packet -> data + offset;
+       buffer -> dataLength = length;
+       return buffer;
+    }
+
+    if (offset < packet -> splitLength)
+    {
+       size_t headLength = packet -> splitLength - offset;
+       if (length <= headLength)
+       {
+          buffer -> data = packet -> data + offset;
+          buffer -> dataLength = length;
+          return buffer;
+       }
+
+       buffer -> data = packet -> data + offset;
+       buffer -> dataLength = headLength;
+       ++ buffer;
+
+       offset = packet -> splitLength;
+       length -= headLength;
+    }
+
+    buffer -> data = packet -> splitData + (offset - packet -> splitLength);
+    buffer -> dataLength = length;
+    return buffer;
+}
+
 static int
 enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer)
 {
@@ -1444,7 +1541,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer)
 
        commandSize = commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK];
        if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
-           buffer + 1 >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
+           buffer + enet_protocol_packet_buffer_count (outgoingCommand) >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
            peer -> mtu - host -> packetSize < commandSize ||
            (outgoingCommand -> packet != NULL && 
              (enet_uint16) (peer -> mtu - host -> packetSize) < (enet_uint16) (commandSize + outgoingCommand -> fragmentLength)))
@@ -1537,8 +1634,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer)
        {
           ++ buffer;
           
-          buffer -> data = outgoingCommand -> packet -> data + outgoingCommand -> fragmentOffset;
-          buffer -> dataLength = outgoingCommand -> fragmentLength;
+          buffer = enet_protocol_packet_buffers (buffer, outgoingCommand);
 
           host -> packetSize += outgoingCommand -> fragmentLength;
        }
@@ -1564,6 +1660,82 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer)
     return canPing;
 }
 
+static int
+enet_protocol_flush_datagrams (ENetHost * host)
+{
+    const ENetDatagram * datagrams;
+    size_t sentDatagrams = 0;
+
+    if (host -> sentDatagrams == 0)
+      return 0;
+
+    datagrams = & host -> datagrams [host -> datagramCount];
+
+    while (sentDatagrams < host -> sentDatagrams)
+    {
+        int result = enet_socket_send_batch (host -> socket, & datagrams [sentDatagrams], host -> sentDatagrams - sentDatagrams);
+        if (result < 0)
+        {
+            host -> sentDatagrams = 0;
+
+            return -1;
+        }
+
+        /* the socket buffer is full, so the rest would have been dropped one by one as well */
+        if (result == 0)
+          break;
+
+        sentDatagrams += result;
+    }
+
+    host -> sentDatagrams = 0;
+
+    return 0;
+}
+
+static int
+enet_protocol_queue_datagram (ENetHost * host, const ENetAddress * address)
+{
+    const ENetBuffer * buffer;
+    ENetDatagram * datagram;
+    enet_uint8 * data;
+    size_t length = 0;
+
+    for (buffer = host -> buffers; buffer < & host -> buffers [host -> bufferCount]; ++ buffer)
+      length += buffer -> dataLength;
+
+    if (length > ENET_HOST_DATAGRAM_SIZE)
+    {
+        if (enet_protocol_flush_datagrams (host) < 0)
+          return -1;
+
+        return enet_socket_send (host -> socket, address, host -> buffers, host -> bufferCount);
+    }
+
+    if (host -> sentDatagrams >= host -> datagramCount &&
+        enet_protocol_flush_datagrams (host) < 0)
+      return -1;
+
+    /* the buffers point into commands and packets that are reused or freed before the batch is sent */
+    datagram = & host -> datagrams [host -> datagramCount + host -> sentDatagrams];
+    data = & host -> datagramData [(host -> datagramCount + host -> sentDatagrams) * ENET_HOST_DATAGRAM_SIZE];
+
+    datagram -> address = * address;
+    datagram -> data = data;
+    datagram -> dataLength = length;
+
+    for (buffer = host -> buffers; buffer < & host -> buffers [host -> bufferCount]; ++ buffer)
+    {
+        memcpy (data, buffer -> data, buffer -> dataLength);
+
+        data += buffer -> dataLength;
+    }
+
+    ++ host -> sentDatagrams;
+
+    return (int) length;
+}
+
 static int
 enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
 {
@@ -1599,7 +1771,11 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
             enet_protocol_check_timeouts (host, currentPeer, event) == 1)
         {
             if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
-              return 1;
+            {
+                enet_protocol_flush_datagrams (host);
+
+                return 1;
+            }
             else
               continue;
         }
@@ -1686,7 +1862,10 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
 
         currentPeer -> lastSendTime = host -> serviceTime;
 
-        sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
+        if (host -> datagrams != NULL)
+          sentLength = enet_protocol_queue_datagram (host, & currentPeer -> address);
+        else
+          sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
 
         enet_protocol_remove_sent_unreliable_commands (currentPeer);
 
@@ -1697,7 +1876,7 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
         host -> totalSentPackets ++;
     }
    
-    return 0;
+    return enet_protocol_flush_datagrams (host);
 }
 
 /** Sends any queued packets on the host specified to its designated peers.
@@ -1855,6 +2034,15 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
        if (ENET_TIME_GREATER_EQUAL (host -> serviceTime, timeout))
          return 0;
 
+       if (host -> datagramIndex < host -> receivedDatagrams)
+       {
+          host -> serviceTime = enet_time_get ();
+
+          waitCondition = ENET_SOCKET_WAIT_RECEIVE;
+
+          continue;
+       }
+
        do
        {
           host -> serviceTime = enet_time_get ();
@@ -4,6 +4,10 @@
 */
 #ifndef _WIN32
 
+#if (defined(HAS_RECVMMSG) || defined(HAS_SENDMMSG)) && ! defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -512,6 +516,188 @@ enet_socket_receive (ENetSocket socket,
     return recvLength;
 }
 
+static int
+enet_socket_send_each (ENetSocket socket, const ENetDatagram * datagrams, size_t datagramCount)
+{
+    size_t sentDatagrams;
+
+    for (sentDatagrams = 0; sentDatagrams < datagramCount; ++ sentDatagrams)
+    {
+       ENetBuffer buffer;
+       int sentLength;
+
+       buffer.data = datagrams [sentDatagrams].data;
+       buffer.dataLength = datagrams [sentDatagrams].dataLength;
+
+       sentLength = enet_socket_send (socket, & datagrams [sentDatagrams].address, & buffer, 1);
+       if (sentLength <= 0)
+         return sentDatagrams > 0 ? (int) sentDatagrams : sentLength;
+    }
+
+    return (int) sentDatagrams;
+}
+
+static int
+enet_socket_receive_each (ENetSocket socket, ENetDatagram * datagrams, size_t datagramCount)
+{
+    size_t receivedDatagrams;
+
+    for (receivedDatagrams = 0; receivedDatagrams < datagramCount; ++ receivedDatagrams)
+    {
+       ENetBuffer buffer;
+       int receivedLength;
+
+       buffer.data = datagrams [receivedDatagrams].data;
+       buffer.dataLength = datagrams [receivedDatagrams].dataLength;
+
+       receivedLength = enet_socket_receive (socket, & datagrams [receivedDatagrams].address, & buffer, 1);
+       if (receivedLength <= 0)
+         return receivedDatagrams > 0 ? (int) receivedDatagrams : receivedLength;
+
+       datagrams [receivedDatagrams].dataLength = receivedLength;
+    }
+
+    return (int) receivedDatagrams;
+}
+
+int
+enet_socket_send_batch (ENetSocket socket,
+                        const ENetDatagram * datagrams,
+                        size_t datagramCount)
+{
+#ifdef HAS_SENDMMSG
+    static int unsupported = 0;
+    struct mmsghdr msgHdrs [ENET_HOST_MAXIMUM_BATCH_SIZE];
+    struct sockaddr_in sins [ENET_HOST_MAXIMUM_BATCH_SIZE];
+    struct iovec iovs [ENET_HOST_MAXIMUM_BATCH_SIZE];
+    size_t i;
+    int sentDatagrams;
+
+    if (unsupported)
+      return enet_socket_send_each (socket, datagrams, datagramCount);
+
+    if (datagramCount > ENET_HOST_MAXIMUM_BATCH_SIZE)
+      datagramCount = ENET_HOST_MAXIMUM_BATCH_SIZE;
+
+    memset (msgHdrs, 0, datagramCount * sizeof (struct mmsghdr));
+
+    for (i = 0; i < datagramCount; ++ i)
+    {
+        memset (& sins [i], 0, sizeof (struct sockaddr_in));
+
+        sins [i].sin_family = AF_INET;
+        sins [i].sin_port = ENET_HOST_TO_NET_16 (datagrams [i].address.port);
+        sins [i].sin_addr.s_addr = datagrams [i].address.host;
+
+        iovs [i].iov_base = datagrams [i].data;
+        iovs [i].iov_len = datagrams [i].dataLength;
+
+        msgHdrs [i].msg_hdr.msg_name = & sins [i];
+        msgHdrs [i].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+        msgHdrs [i].msg_hdr.msg_iov = & iovs [i];
+        msgHdrs [i].msg_hdr.msg_iovlen = 1;
+    }
+
+    sentDatagrams = sendmmsg (socket, msgHdrs, datagramCount, MSG_NOSIGNAL);
+
+    if (sentDatagrams == -1)
+    {
+       if (errno == EWOULDBLOCK)
+         return 0;
+
+       if (errno == ENOSYS)
+       {
+          unsupported = 1;
+
+          return enet_socket_send_each (socket, datagrams, datagramCount);
+       }
+
+       return -1;
+    }
+
+    return sentDatagrams;
+#else
+    return enet_socket_send_each (socket, datagrams, datagramCount);
+#endif
+}
+
+int
+enet_socket_receive_batch (ENetSocket socket,
+                           ENetDatagram * datagrams,
+                           size_t datagramCount)
+{
+#ifdef HAS_RECVMMSG
+    static int unsupported = 0;
+    struct mmsghdr msgHdrs [ENET_HOST_MAXIMUM_BATCH_SIZE];
+    struct sockaddr_in sins [ENET_HOST_MAXIMUM_BATCH_SIZE];
+    struct iovec iovs [ENET_HOST_MAXIMUM_BATCH_SIZE];
+    size_t i, receivedDatagrams;
+    int result;
+
+    if (unsupported)
+      return enet_socket_receive_each (socket, datagrams, datagramCount);
+
+    if (datagramCount > ENET_HOST_MAXIMUM_BATCH_SIZE)
+      datagramCount = ENET_HOST_MAXIMUM_BATCH_SIZE;
+
+    /* if every datagram of a batch was truncated, try again rather than report an empty read */
+    do
+    {
+        memset (msgHdrs, 0, datagramCount * sizeof (struct mmsghdr));
+
+        for (i = 0; i < datagramCount; ++ i)
+        {
+            iovs [i].iov_base = datagrams [i].data;
+            iovs [i].iov_len = datagrams [i].dataLength;
+
+            msgHdrs [i].msg_hdr.msg_name = & sins [i];
+            msgHdrs [i].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+            msgHdrs [i].msg_hdr.msg_iov = & iovs [i];
+            msgHdrs [i].msg_hdr.msg_iovlen = 1;
+        }
+
+        result = recvmmsg (socket, msgHdrs, datagramCount, MSG_NOSIGNAL, NULL);
+
+        if (result == -1)
+        {
+           if (errno == EWOULDBLOCK)
+             return 0;
+
+           if (errno == ENOSYS)
+           {
+              unsupported = 1;
+
+              return enet_socket_receive_each (socket, datagrams, datagramCount);
+           }
+
+           return -1;
+        }
+
+        /* truncated datagrams are dropped here rather than failing the whole batch,
+           so the remaining datagrams are moved down over them */
+        for (i = 0, receivedDatagrams = 0; i < (size_t) result; ++ i)
+        {
+            ENetDatagram * datagram = & datagrams [receivedDatagrams];
+
+            if (msgHdrs [i].msg_hdr.msg_flags & MSG_TRUNC)
+              continue;
+
+            datagram -> data = iovs [i].iov_base;
+            datagram -> dataLength = msgHdrs [i].msg_len;
+            datagram -> address.host = (enet_uint32) sins [i].sin_addr.s_addr;
+            datagram -> address.port = ENET_NET_TO_HOST_16 (sins [i].sin_port);
+
+            ++ receivedDatagrams;
+        }
+    }
+    while (receivedDatagrams == 0 && result > 0);
+
+    return (int) receivedDatagrams;
+#else
+    return enet_socket_receive_each (socket, datagrams, datagramCount);
+#endif
+}
+
 int
 enet_socketset_select (ENetSocket maxSocket, ENetSocketSet * readSet, ENetSocketSet * writeSet, enet_uint32 timeout)
 {
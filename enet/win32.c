@@ -389,6 +389,55 @@ enet_socket_receive (ENetSocket socket,
     return (int) recvLength;
 }
 
+/* Winsock has no batched datagram calls, so batches are transferred one datagram at a time */
+int
+enet_socket_send_batch (ENetSocket socket,
+                        const ENetDatagram * datagrams,
+                        size_t datagramCount)
+{
+    size_t sentDatagrams;
+
+    for (sentDatagrams = 0; sentDatagrams < datagramCount; ++ sentDatagrams)
+    {
+       ENetBuffer buffer;
+       int sentLength;
+
+       buffer.data = datagrams [sentDatagrams].data;
+       buffer.dataLength = datagrams [sentDatagrams].dataLength;
+
+       sentLength = enet_socket_send (socket, & datagrams [sentDatagrams].address, & buffer, 1);
+       if (sentLength <= 0)
+         return sentDatagrams > 0 ? (int) sentDatagrams : sentLength;
+    }
+
+    return (int) sentDatagrams;
+}
+
+int
+enet_socket_receive_batch (ENetSocket socket,
+                           ENetDatagram * datagrams,
+                           size_t datagramCount)
+{
+    size_t receivedDatagrams;
+
+    for (receivedDatagrams = 0; receivedDatagrams < datagramCount; ++ receivedDatagrams)
+    {
+       ENetBuffer buffer;
+       int receivedLength;
+
+       buffer.data = datagrams [receivedDatagrams].data;
+       buffer.dataLength = datagrams [receivedDatagrams].dataLength;
+
+       receivedLength = enet_socket_receive (socket, & datagrams [receivedDatagrams].address, & buffer, 1);
+       if (receivedLength <= 0)
+         return receivedDatagrams > 0 ? (int) receivedDatagrams : receivedLength;
+
+       datagrams [receivedDatagrams].dataLength = receivedLength;
+    }
+
+    return (int) receivedDatagrams;
+}
+
 int
 enet_socketset_select (ENetSocket maxSocket, ENetSocketSet * readSet, ENetSocketSet * writeSet, enet_uint32 timeout)
 {
@@ -17,15 +17,155 @@ enum
 
 VARN(numargs, _numargs, MAXARGS, 0, 0);
 
+// small script strings are carved out of chunks and recycled through per size class free lists instead of the heap
+enum
+{
+    STRBUCKETSIZE = 16,
+    NUMSTRBUCKETS = 16,
+    STRCHUNKSIZE = 64*1024
+};
+
+static scriptstring *freestrs[NUMSTRBUCKETS];
+static uchar *strchunk = NULL;
+static int strchunkleft = 0;
+static int numscriptstrs = 0, numstrchunks = 0;
+
+char *newscriptstr(size_t len)
+{
+    size_t size = sizeof(scriptstring) + len + 1;
+    scriptstring *h;
+    if(size > STRBUCKETSIZE*NUMSTRBUCKETS)
+    {
+        h = (scriptstring *)new uchar[size];
+        h->size = int(size);
+    }
+    else
+    {
+        int bucket = (size-1)/STRBUCKETSIZE;
+        h = freestrs[bucket];
+        if(h) freestrs[bucket] = *(scriptstring **)h->str();
+        else
+        {
+            int blocksize = (bucket+1)*STRBUCKETSIZE;
+            if(strchunkleft < blocksize)
+            {
+                strchunk = new uchar[STRCHUNKSIZE];
+                strchunkleft = STRCHUNKSIZE;
+                numstrchunks++;
+            }
+            h = (scriptstring *)strchunk;
+            strchunk += blocksize;
+            strchunkleft -= blocksize;
+        }
+        h->size = (bucket+1)*STRBUCKETSIZE;
+    }
+    h->refs = 1;
+    h->list = NULL;
+    numscriptstrs++;
+    return h->str();
+}
+
+static inline int scriptstrcapacity(const char *s)
+{
+    return scriptstring::get(s)->size - int(sizeof(scriptstring)) - 1;
+}
+
+// the empty string and all single character strings are interned and never freed
+static struct internedstr { scriptstring h; char s[2]; } internedstrs[256];
+
+char *newscriptstr(const char *s, size_t len)
+{
+    if(len <= 1)
+    {
+        internedstr &i = internedstrs[len ? uchar(s[0]) : 0];
+        if(!i.h.refs)
+        {
+            i.h.refs = 1<<30;
+            i.h.size = sizeof(internedstr);
+            i.s[0] = len ? s[0] : '\0';
+        }
+        return refscriptstr(i.s);
+    }
+    char *d = newscriptstr(len);
+    memcpy(d, s, len);
+    d[len] = '\0';
+    return d;
+}
+
+// list elements as offsets into the string they were parsed from, with a script string for each made on first use
+struct listelem
+{
+    int start, end, quotestart, quoteend;
+    char *str;
+};
+
+struct parsedlist
+{
+    vector<listelem> elems;
+
+    ~parsedlist()
+    {
+        loopv(elems) if(elems[i].str) freescriptstr(elems[i].str);
+    }
+
+    char *elemstr(const char *list, int i)
+    {
+        listelem &e = elems[i];
+        if(!e.str) e.str = newscriptstr(&list[e.start], e.end - e.start);
+        return refscriptstr(e.str);
+    }
+};
+
+static inline void dropparsedlist(char *s)
+{
+    scriptstring *h = scriptstring::get(s);
+    if(h->list) { delete h->list; h->list = NULL; }
+}
+
+void deletescriptstr(scriptstring *h)
+{
+    if(h->list) delete h->list;
+    numscriptstrs--;
+    if(h->size > STRBUCKETSIZE*NUMSTRBUCKETS) { delete[] (uchar *)h; return; }
+    int bucket = h->size/STRBUCKETSIZE - 1;
+    *(scriptstring **)h->str() = freestrs[bucket];
+    freestrs[bucket] = h;
+}
+
+ICOMMAND(scriptstrstats, "", (),
+{
+    conoutf("script strings: %d live, %d KB of chunks", numscriptstrs, numstrchunks*STRCHUNKSIZE/1024);
+});
+
+// commands are free to modify their string arguments in place, so they get their own copy of a shared one
+static inline char *ownstr(tagval &v)
+{
+    if(v.type == VAL_STR && v.s[0] && sharedscriptstr(v.s))
+    {
+        char *s = v.s;
+        v.s = newscriptstr(strlen(s));
+        strcpy(v.s, s);
+        freescriptstr(s);
+    }
+    else if(v.type == VAL_STR) dropparsedlist(v.s);
+    return v.s;
+}
+
 static inline void freearg(tagval &v)
 {
     switch(v.type)
     {
-        case VAL_STR: delete[] v.s; break;
+        case VAL_STR: freescriptstr(v.s); break;
         case VAL_CODE: if(v.code[-1] == CODE_START) delete[] (uchar *)&v.code[-1]; break;
     }
 }
 
+// a string copy of an alias' value, which just shares the value's string when it has one
+static inline char *getaliasstr(ident &id)
+{
+    return id.valtype == VAL_STR ? refscriptstr(id.val.s) : newscriptstr(id.getstr());
+}
+
 static inline void forcenull(tagval &v)
 {
     switch(v.type)
@@ -76,7 +216,7 @@ static inline const char *forcestr(tagval &v)
         case VAL_STR: case VAL_MACRO: return v.s;
     }
     freearg(v);
-    v.setstr(newstring(s));
+    v.setstr(newscriptstr(s));
     return s;
 }
 
@@ -104,7 +244,7 @@ static inline ident *forceident(tagval &v)
         case VAL_STR:
         {
             ident *id = newident(v.s, IDF_UNKNOWN);
-            delete[] v.s;
+            freescriptstr(v.s);
             v.setident(id);
             return id;
         }
@@ -163,11 +303,11 @@ void clearoverride(ident &i)
             if(i.valtype==VAL_STR)
             {
                 if(!i.val.s[0]) break;
-                delete[] i.val.s;
+                freescriptstr(i.val.s);
             }
             cleancode(i);
             i.valtype = VAL_STR;
-            i.val.s = newstring("");
+            i.val.s = newscriptstr("");
             break;
         case ID_VAR:
             *i.storage.i = i.overrideval.i;
@@ -325,7 +465,7 @@ static inline void poparg(ident &id)
 {
     if(!id.stack) return;
     identstack *stack = id.stack;
-    if(id.valtype == VAL_STR) delete[] id.val.s;
+    if(id.valtype == VAL_STR) freescriptstr(id.val.s);
     id.setval(*stack);
     cleancode(id);
     id.stack = stack->next;
@@ -417,7 +557,7 @@ static inline void setarg(ident &id, tagval &v)
 {
     if(aliasstack->usedargs&(1<<id.index))
     {
-        if(id.valtype == VAL_STR) delete[] id.val.s;
+        if(id.valtype == VAL_STR) freescriptstr(id.val.s);
         id.setval(v);
         cleancode(id);
     }
@@ -430,7 +570,7 @@ static inline void setarg(ident &id, tagval &v)
 
 static inline void setalias(ident &id, tagval &v)
 {
-    if(id.valtype == VAL_STR) delete[] id.val.s;
+    if(id.valtype == VAL_STR) freescriptstr(id.val.s);
     id.setval(v);
     cleancode(id);
     id.flags = (id.flags & identflags) | identflags;
@@ -465,7 +605,7 @@ static void setalias(const char *name, tagval &v)
 void alias(const char *name, const char *str)
 {
     tagval v;
-    v.setstr(newstring(str));
+    v.setstr(newscriptstr(str));
     setalias(name, v);
 }
 
@@ -832,7 +972,7 @@ static char *conc(tagval *v, int n, bool space, const char *prefix, int prefixle
     }
 overflow:
     if(space) len += max(prefix ? i : i-1, 0);
-    char *buf = newstring(len + numlen);
+    char *buf = newscriptstr(len + numlen);
     int offset = 0, numoffset = 0;
     if(prefix)
     {
@@ -856,7 +996,7 @@ overflow:
     if(i < n)
     {
         char *morebuf = conc(&v[i], n-i, space, buf, offset);
-        delete[] buf;
+        freescriptstr(buf);
         return morebuf;
     }
     return buf;
@@ -1009,8 +1149,8 @@ static inline void compilefloat(vector<uint> &code, const char *word = NULL)
     return compilefloat(code, word ? parsefloat(word) : 0.0f);
 }
 
-static bool compilearg(vector<uint> &code, const char *&p, int wordtype);
-static void compilestatements(vector<uint> &code, const char *&p, int rettype, int brak = '\0');
+static bool compilearg(vector<uint> &code, const char *&p, int wordtype, int prevargs);
+static void compilestatements(vector<uint> &code, const char *&p, int rettype, int brak = '\0', int prevargs = 0);
 
 static inline void compileval(vector<uint> &code, int wordtype, char *word, int wordlen)
 {
@@ -1037,9 +1177,42 @@ static inline void compileval(vector<uint> &code, int wordtype, char *word, int
     }
 }
 
-static bool compileword(vector<uint> &code, const char *&p, int wordtype, char *&word, int &wordlen);
+static bool compileword(vector<uint> &code, const char *&p, int wordtype, char *&word, int &wordlen, int prevargs);
+
+// words of inline data following an op
+static inline int opdatalen(uint op)
+{
+    switch(op&0xFF)
+    {
+        case CODE_MACRO:
+        case CODE_VAL|RET_STR:
+            return (op>>8)/sizeof(uint) + 1;
+        case CODE_VAL|RET_INT: case CODE_VAL|RET_FLOAT:
+        case CODE_COMI|RET_NULL: case CODE_COMI|RET_STR: case CODE_COMI|RET_INT: case CODE_COMI|RET_FLOAT:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// the last builtin command statement compiled, so a parenthesised call to it can be run in the caller's frame
+static struct { int start, end, numargs, maxargs; } lastcommand = { -1, -1, 0, 0 };
+
+// turns ENTER args... COM into args... COMI numargs, which pushes the command's result without entering a new frame
+static bool compileinline(vector<uint> &code, int start, int prevargs, int numargs, int maxargs, int rettype)
+{
+    if(prevargs + maxargs > MAXARGS || (code.last()&CODE_OP_MASK) != CODE_COM) return false;
+    memmove(&code[start], &code[start+1], (code.length() - (start+1))*sizeof(uint));
+    code.pop();
+    // blocks record their position so they can find the start of the code they belong to
+    for(int i = start; i < code.length(); i += opdatalen(code[i]) + 1)
+        if((code[i]&CODE_OP_MASK) == CODE_OFFSET) code[i] -= 0x100;
+    code.last() = CODE_COMI|(rettype < VAL_ANY ? rettype<<CODE_RET : 0)|(code.last()&~0xFF);
+    code.add(numargs);
+    return true;
+}
 
-static void compilelookup(vector<uint> &code, const char *&p, int ltype)
+static void compilelookup(vector<uint> &code, const char *&p, int ltype, int prevargs)
 {
     char *lookup = NULL;
     int lookuplen = 0;
@@ -1047,10 +1220,10 @@ static void compilelookup(vector<uint> &code, const char *&p, int ltype)
     {
         case '(':
         case '[':
-            if(!compileword(code, p, VAL_STR, lookup, lookuplen)) goto invalid;
+            if(!compileword(code, p, VAL_STR, lookup, lookuplen, prevargs)) goto invalid;
             break;
         case '$':
-            compilelookup(code, p, VAL_STR);
+            compilelookup(code, p, VAL_STR, prevargs);
             break;
         case '\"':
             lookup = cutstring(p, lookuplen);
@@ -1069,7 +1242,7 @@ static void compilelookup(vector<uint> &code, const char *&p, int ltype)
                 case ID_ALIAS: code.add((id->index < MAXARGS ? CODE_LOOKUPARG : CODE_LOOKUP)|((ltype >= VAL_ANY ? VAL_STR : ltype)<<CODE_RET)|(id->index<<8)); goto done;
                 case ID_COMMAND:
                 {
-                    int comtype = CODE_COM, numargs = 0;
+                    int comtype = CODE_COM, numargs = 0, start = code.length();
                     code.add(CODE_ENTER);
                     for(const char *fmt = id->args; *fmt; fmt++) switch(*fmt)
                     {
@@ -1091,7 +1264,8 @@ static void compilelookup(vector<uint> &code, const char *&p, int ltype)
                     }
                 endfmt:
                     code.add(comtype|(ltype < VAL_ANY ? ltype<<CODE_RET : 0)|(id->index<<8));
-                    code.add(CODE_EXIT|(ltype < VAL_ANY ? ltype<<CODE_RET : 0));
+                    if(comtype != CODE_COM || !compileinline(code, start, prevargs, numargs, numargs, ltype))
+                        code.add(CODE_EXIT|(ltype < VAL_ANY ? ltype<<CODE_RET : 0));
                     goto done;
                 }
                 default: goto invalid;
@@ -1167,17 +1341,17 @@ done:
     return true;
 }
 
-static bool compileblocksub(vector<uint> &code, const char *&p)
+static bool compileblocksub(vector<uint> &code, const char *&p, int prevargs)
 {
     char *lookup = NULL;
     int lookuplen = 0;
     switch(*p)
     {
         case '(':
-            if(!compilearg(code, p, VAL_STR)) return false;
+            if(!compilearg(code, p, VAL_STR, prevargs)) return false;
             break;
         case '[':
-            if(!compilearg(code, p, VAL_STR)) return false;
+            if(!compilearg(code, p, VAL_STR, prevargs)) return false;
             code.add(CODE_LOOKUPU|RET_STR);
             break;
         case '\"':
@@ -1248,7 +1422,7 @@ static void compileblock(vector<uint> &code, const char *&p, int wordtype)
                     concs = 1;
                 }
                 if(compileblockstr(code, start, esc-1, true)) concs++;
-                if(compileblocksub(code, p)) concs++;
+                if(compileblocksub(code, p, concs)) concs++;
                 if(!concs) code.pop();
                 else start = p;
                 break;
@@ -1304,24 +1478,29 @@ done:
     }
 }
 
-static bool compileword(vector<uint> &code, const char *&p, int wordtype, char *&word, int &wordlen)
+static bool compileword(vector<uint> &code, const char *&p, int wordtype, char *&word, int &wordlen, int prevargs)
 {
     skipcomments(p);
     switch(*p)
     {
         case '\"': word = cutstring(p, wordlen); break;
-        case '$': compilelookup(code, p, wordtype); return true;
+        case '$': compilelookup(code, p, wordtype, prevargs); return true;
         case '(':
+        {
             p++;
+            int start = code.length();
             code.add(CODE_ENTER);
-            compilestatements(code, p, VAL_ANY, ')');
-            code.add(CODE_EXIT|(wordtype < VAL_ANY ? wordtype<<CODE_RET : 0));
+            compilestatements(code, p, VAL_ANY, ')', prevargs);
+            if(lastcommand.end != code.length() || lastcommand.start != start+1 ||
+               !compileinline(code, start, prevargs, lastcommand.numargs, lastcommand.maxargs, wordtype))
+                code.add(CODE_EXIT|(wordtype < VAL_ANY ? wordtype<<CODE_RET : 0));
             switch(wordtype)
             {
                 case VAL_CODE: code.add(CODE_COMPILE); break;
                 case VAL_IDENT: code.add(CODE_IDENTU); break;
             }
             return true;
+        }
         case '[':
             p++;
             compileblock(code, p, wordtype);
@@ -1331,11 +1510,11 @@ static bool compileword(vector<uint> &code, const char *&p, int wordtype, char *
     return word!=NULL;
 }
 
-static inline bool compilearg(vector<uint> &code, const char *&p, int wordtype)
+static inline bool compilearg(vector<uint> &code, const char *&p, int wordtype, int prevargs)
 {
     char *word = NULL;
     int wordlen = 0;
-    bool more = compileword(code, p, wordtype, word, wordlen);
+    bool more = compileword(code, p, wordtype, word, wordlen, prevargs);
     if(!more) return false;
     if(word)
     {
@@ -1345,7 +1524,7 @@ static inline bool compilearg(vector<uint> &code, const char *&p, int wordtype)
     return true;
 }
 
-static void compilestatements(vector<uint> &code, const char *&p, int rettype, int brak)
+static void compilestatements(vector<uint> &code, const char *&p, int rettype, int brak, int prevargs)
 {
     const char *line = p;
     char *idname = NULL;
@@ -1356,7 +1535,8 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
     {
         skipcomments(p);
         idname = NULL;
-        bool more = compileword(code, p, VAL_ANY, idname, idlen);
+        int start = code.length();
+        bool more = compileword(code, p, VAL_ANY, idname, idlen, prevargs);
         if(!more) goto endstatement;
         skipcomments(p);
         if(p[0] == '=') switch(p[1])
@@ -1371,19 +1551,19 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
                     if(id) switch(id->type)
                     {
                         case ID_ALIAS:
-                            if(!(more = compilearg(code, p, VAL_ANY))) compilestr(code);
+                            if(!(more = compilearg(code, p, VAL_ANY, prevargs))) compilestr(code);
                             code.add((id->index < MAXARGS ? CODE_ALIASARG : CODE_ALIAS)|(id->index<<8));
                             goto endcommand;
                         case ID_VAR:
-                            if(!(more = compilearg(code, p, VAL_INT))) compileint(code);
+                            if(!(more = compilearg(code, p, VAL_INT, prevargs))) compileint(code);
                             code.add(CODE_IVAR1|(id->index<<8));
                             goto endcommand;
                         case ID_FVAR:
-                            if(!(more = compilearg(code, p, VAL_FLOAT))) compilefloat(code);
+                            if(!(more = compilearg(code, p, VAL_FLOAT, prevargs))) compilefloat(code);
                             code.add(CODE_FVAR1|(id->index<<8));
                             goto endcommand;
                         case ID_SVAR:
-                            if(!(more = compilearg(code, p, VAL_STR))) compilestr(code);
+                            if(!(more = compilearg(code, p, VAL_STR, prevargs))) compilestr(code);
                             code.add(CODE_SVAR1|(id->index<<8));
                             goto endcommand;
                         case ID_COMMAND:
@@ -1393,7 +1573,7 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
                     compilestr(code, idname, idlen, true);
                     delete[] idname;
                 }
-                if(!(more = compilearg(code, p, VAL_ANY))) compilestr(code);
+                if(!(more = compilearg(code, p, VAL_ANY, prevargs+1))) compilestr(code);
                 code.add(CODE_ALIASU);
                 goto endstatement;
         }
@@ -1402,7 +1582,7 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
         if(!idname)
         {
         noid:
-            while(numargs < MAXARGS && (more = compilearg(code, p, VAL_ANY))) numargs++;
+            while(numargs < MAXARGS && (more = compilearg(code, p, VAL_ANY, prevargs+1+numargs))) numargs++;
             code.add(CODE_CALLU);
         }
         else
@@ -1420,17 +1600,17 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
             else switch(id->type)
             {
                 case ID_ALIAS:
-                    while(numargs < MAXARGS && (more = compilearg(code, p, VAL_ANY))) numargs++;
+                    while(numargs < MAXARGS && (more = compilearg(code, p, VAL_ANY, prevargs+numargs))) numargs++;
                     code.add((id->index < MAXARGS ? CODE_CALLARG : CODE_CALL)|(id->index<<8));
                     break;
                 case ID_COMMAND:
                 {
-                    int comtype = CODE_COM, fakeargs = 0;
+                    int comtype = CODE_COM, fakeargs = 0, maxargs = 0;
                     bool rep = false;
                     for(const char *fmt = id->args; *fmt; fmt++) switch(*fmt)
                     {
                     case 's':
-                        if(more) more = compilearg(code, p, VAL_STR);
+                        if(more) more = compilearg(code, p, VAL_STR, prevargs+numargs);
                         if(!more)
                         {
                             if(rep) break;
@@ -1440,24 +1620,25 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
                         else if(!fmt[1])
                         {
                             int numconc = 0;
-                            while(numargs + numconc < MAXARGS && (more = compilearg(code, p, VAL_STR))) numconc++;
+                            while(numargs + numconc < MAXARGS && (more = compilearg(code, p, VAL_STR, prevargs+numargs+1+numconc))) numconc++;
                             if(numconc > 0) code.add(CODE_CONC|RET_STR|((numconc+1)<<8));
+                            maxargs = max(maxargs, numargs+1+numconc);
                         }
                         numargs++;
                         break;
-                    case 'i': if(more) more = compilearg(code, p, VAL_INT); if(!more) { if(rep) break; compileint(code); fakeargs++; } numargs++; break;
-                    case 'b': if(more) more = compilearg(code, p, VAL_INT); if(!more) { if(rep) break; compileint(code, INT_MIN); fakeargs++; } numargs++; break;
-                    case 'f': if(more) more = compilearg(code, p, VAL_FLOAT); if(!more) { if(rep) break; compilefloat(code); fakeargs++; } numargs++; break;
-                    case 't': if(more) more = compilearg(code, p, VAL_ANY); if(!more) { if(rep) break; compilenull(code); fakeargs++; } numargs++; break;
-                    case 'e': if(more) more = compilearg(code, p, VAL_CODE); if(!more) { if(rep) break; compileblock(code); fakeargs++; } numargs++; break;
-                    case 'r': if(more) more = compilearg(code, p, VAL_IDENT); if(!more) { if(rep) break; compileident(code); fakeargs++; } numargs++; break;
+                    case 'i': if(more) more = compilearg(code, p, VAL_INT, prevargs+numargs); if(!more) { if(rep) break; compileint(code); fakeargs++; } numargs++; break;
+                    case 'b': if(more) more = compilearg(code, p, VAL_INT, prevargs+numargs); if(!more) { if(rep) break; compileint(code, INT_MIN); fakeargs++; } numargs++; break;
+                    case 'f': if(more) more = compilearg(code, p, VAL_FLOAT, prevargs+numargs); if(!more) { if(rep) break; compilefloat(code); fakeargs++; } numargs++; break;
+                    case 't': if(more) more = compilearg(code, p, VAL_ANY, prevargs+numargs); if(!more) { if(rep) break; compilenull(code); fakeargs++; } numargs++; break;
+                    case 'e': if(more) more = compilearg(code, p, VAL_CODE, prevargs+numargs); if(!more) { if(rep) break; compileblock(code); fakeargs++; } numargs++; break;
+                    case 'r': if(more) more = compilearg(code, p, VAL_IDENT, prevargs+numargs); if(!more) { if(rep) break; compileident(code); fakeargs++; } numargs++; break;
                     case '$': compileident(code, id); numargs++; break;
                     case 'N': compileint(code, numargs-fakeargs); numargs++; break;
 #ifndef STANDALONE
                     case 'D': comtype = CODE_COMD; numargs++; break;
 #endif
-                    case 'C': comtype = CODE_COMC; if(more) while(numargs < MAXARGS && (more = compilearg(code, p, VAL_ANY))) numargs++; numargs = 1; goto endfmt;
-                    case 'V': comtype = CODE_COMV; if(more) while(numargs < MAXARGS && (more = compilearg(code, p, VAL_ANY))) numargs++; numargs = 2; goto endfmt;
+                    case 'C': comtype = CODE_COMC; if(more) while(numargs < MAXARGS && (more = compilearg(code, p, VAL_ANY, prevargs+numargs))) numargs++; numargs = 1; goto endfmt;
+                    case 'V': comtype = CODE_COMV; if(more) while(numargs < MAXARGS && (more = compilearg(code, p, VAL_ANY, prevargs+numargs))) numargs++; numargs = 2; goto endfmt;
                     case '1': case '2': case '3': case '4':
                         if(more && numargs < MAXARGS)
                         {
@@ -1465,34 +1646,41 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
                             fmt -= numrep;
                             rep = true;
                         }
-                        else for(; numargs > MAXARGS; numargs--) code.add(CODE_POP);
+                        else for(maxargs = max(maxargs, numargs); numargs > MAXARGS; numargs--) code.add(CODE_POP);
                         break;
                     }
                 endfmt:
                     code.add(comtype|(rettype < VAL_ANY ? rettype<<CODE_RET : 0)|(id->index<<8));
+                    if(comtype == CODE_COM)
+                    {
+                        lastcommand.start = start;
+                        lastcommand.end = code.length();
+                        lastcommand.numargs = numargs;
+                        lastcommand.maxargs = max(maxargs, numargs);
+                    }
                     break;
                 }
                 case ID_LOCAL:
-                    if(more) while(numargs < MAXARGS && (more = compilearg(code, p, VAL_IDENT))) numargs++;
-                    if(more) while((more = compilearg(code, p, VAL_ANY))) code.add(CODE_POP);
+                    if(more) while(numargs < MAXARGS && (more = compilearg(code, p, VAL_IDENT, prevargs+numargs))) numargs++;
+                    if(more) while((more = compilearg(code, p, VAL_ANY, prevargs+numargs))) code.add(CODE_POP);
                     code.add(CODE_LOCAL);
                     break;
                 case ID_VAR:
-                    if(!(more = compilearg(code, p, VAL_INT))) code.add(CODE_PRINT|(id->index<<8));
-                    else if(!(id->flags&IDF_HEX) || !(more = compilearg(code, p, VAL_INT))) code.add(CODE_IVAR1|(id->index<<8));
-                    else if(!(more = compilearg(code, p, VAL_INT))) code.add(CODE_IVAR2|(id->index<<8));
+                    if(!(more = compilearg(code, p, VAL_INT, prevargs))) code.add(CODE_PRINT|(id->index<<8));
+                    else if(!(id->flags&IDF_HEX) || !(more = compilearg(code, p, VAL_INT, prevargs+1))) code.add(CODE_IVAR1|(id->index<<8));
+                    else if(!(more = compilearg(code, p, VAL_INT, prevargs+2))) code.add(CODE_IVAR2|(id->index<<8));
                     else code.add(CODE_IVAR3|(id->index<<8));
                     break;
                 case ID_FVAR:
-                    if(!(more = compilearg(code, p, VAL_FLOAT))) code.add(CODE_PRINT|(id->index<<8));
+                    if(!(more = compilearg(code, p, VAL_FLOAT, prevargs))) code.add(CODE_PRINT|(id->index<<8));
                     else code.add(CODE_FVAR1|(id->index<<8));
                     break;
                 case ID_SVAR:
-                    if(!(more = compilearg(code, p, VAL_STR))) code.add(CODE_PRINT|(id->index<<8));
+                    if(!(more = compilearg(code, p, VAL_STR, prevargs))) code.add(CODE_PRINT|(id->index<<8));
                     else
                     {
                         int numconc = 0;
-                        while(numconc+1 < MAXARGS && (more = compilearg(code, p, VAL_ANY))) numconc++;
+                        while(numconc+1 < MAXARGS && (more = compilearg(code, p, VAL_ANY, prevargs+1+numconc))) numconc++;
                         if(numconc > 0) code.add(CODE_CONC|RET_STR|((numconc+1)<<8));
                         code.add(CODE_SVAR1|(id->index<<8));
                     }
@@ -1502,7 +1690,7 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
             delete[] idname;
         }
     endstatement:
-        if(more) while(compilearg(code, p, VAL_ANY)) code.add(CODE_POP);
+        if(more) while(compilearg(code, p, VAL_ANY, prevargs)) code.add(CODE_POP);
         p += strcspn(p, ")];/\n\0");
         int c = *p++;
         switch(c)
@@ -1662,13 +1850,6 @@ static const uint *skipcode(const uint *code, tagval &result)
         uint op = *code++;
         switch(op&0xFF)
         {
-            case CODE_MACRO:
-            case CODE_VAL|RET_STR:
-            {
-                uint len = op>>8;
-                code += len/sizeof(uint) + 1;
-                continue;
-            }
             case CODE_BLOCK:
             {
                 uint len = op>>8;
@@ -1686,6 +1867,9 @@ static const uint *skipcode(const uint *code, tagval &result)
                 }
                 --depth;
                 continue;
+            default:
+                code += opdatalen(op);
+                continue;
         }
     }
 }
@@ -1699,7 +1883,7 @@ static inline void callcommand(ident *id, tagval *args, int numargs, bool lookup
         case 'i': if(++i >= numargs) { if(rep) break; args[i].setint(0); fakeargs++; } else forceint(args[i]); break;
         case 'b': if(++i >= numargs) { if(rep) break; args[i].setint(INT_MIN); fakeargs++; } else forceint(args[i]); break;
         case 'f': if(++i >= numargs) { if(rep) break; args[i].setfloat(0.0f); fakeargs++; } else forcefloat(args[i]); break;
-        case 's': if(++i >= numargs) { if(rep) break; args[i].setstr(newstring("")); fakeargs++; } else forcestr(args[i]); break;
+        case 's': if(++i >= numargs) { if(rep) break; args[i].setstr(newscriptstr("")); fakeargs++; } else forcestr(args[i]); break;
         case 't': if(++i >= numargs) { if(rep) break; args[i].setnull(); fakeargs++; } break;
         case 'e':
             if(++i >= numargs)
@@ -1729,7 +1913,7 @@ static inline void callcommand(ident *id, tagval *args, int numargs, bool lookup
         case 'V': i = max(i+1, numargs); ((comfunv)id->fun)(args, i); goto cleanup;
         case '1': case '2': case '3': case '4': if(i+1 < numargs) { fmt -= *fmt-'0'+1; rep = true; } break;
     }
-    #define ARG(n) (id->argmask&(1<<n) ? (void *)args[n].s : (void *)&args[n].i)
+    #define ARG(n) (id->argmask&(1<<n) ? (void *)ownstr(args[n]) : (void *)&args[n].i)
     #define CALLCOM(n) \
         switch(n) \
         { \
@@ -1754,11 +1938,103 @@ cleanup:
     for(; i < numargs; i++) freearg(args[i]);
 }
 
+static inline void callcom(ident *id, tagval *args, int numargs)
+{
+    CALLCOM(numargs)
+}
+
 #define MAXRUNDEPTH 255
 static int rundepth = 0;
 
+// arguments of all running frames, each frame may use MAXARGS+1 slots above the current top
+static tagval argstack[(MAXRUNDEPTH+1)*(MAXARGS+1)];
+static tagval *argtop = argstack;
+
+// with GCC and Clang each op jumps straight to the next one's handler instead of going back through the switch
+#ifdef __GNUC__
+#define THREADEDCODE
+#define OPLABEL(name) op_##name:
+#define NEXTOP { op = *code++; goto *dispatch[op&0xFF]; }
+#else
+#define OPLABEL(name)
+#define NEXTOP continue
+#endif
+
 static const uint *runcode(const uint *code, tagval &result)
 {
+#ifdef THREADEDCODE
+    static void *dispatch[256] = { NULL };
+    if(!dispatch[CODE_START])
+    {
+        #define OPTARGET(op, name) dispatch[op] = &&op_##name;
+        #define OPTARGET4(op, name) OPTARGET(op|RET_NULL, name) OPTARGET(op|RET_STR, name) OPTARGET(op|RET_INT, name) OPTARGET(op|RET_FLOAT, name)
+        loopi(256) dispatch[i] = &&op_none;
+        OPTARGET(CODE_START, skip) OPTARGET(CODE_OFFSET, skip)
+        OPTARGET(CODE_POP, pop)
+        OPTARGET(CODE_ENTER, enter)
+        OPTARGET4(CODE_EXIT, exit)
+        OPTARGET(CODE_PRINT, print)
+        OPTARGET(CODE_LOCAL, local)
+        OPTARGET(CODE_MACRO, macro)
+        OPTARGET(CODE_VAL|RET_STR, val_str)
+        OPTARGET(CODE_VALI|RET_STR, vali_str)
+        OPTARGET(CODE_VAL|RET_NULL, val_null) OPTARGET(CODE_VALI|RET_NULL, val_null)
+        OPTARGET(CODE_VAL|RET_INT, val_int)
+        OPTARGET(CODE_VALI|RET_INT, vali_int)
+        OPTARGET(CODE_VAL|RET_FLOAT, val_float)
+        OPTARGET(CODE_VALI|RET_FLOAT, vali_float)
+        OPTARGET(CODE_FORCE|RET_STR, force_str)
+        OPTARGET(CODE_FORCE|RET_INT, force_int)
+        OPTARGET(CODE_FORCE|RET_FLOAT, force_float)
+        OPTARGET4(CODE_RESULT, result)
+        OPTARGET(CODE_BLOCK, block)
+        OPTARGET(CODE_COMPILE, compile)
+        OPTARGET(CODE_IDENT, ident)
+        OPTARGET(CODE_IDENTARG, identarg)
+        OPTARGET(CODE_IDENTU, identu)
+        OPTARGET(CODE_LOOKUPU|RET_STR, lookupu_str)
+        OPTARGET(CODE_LOOKUP|RET_STR, lookup_str)
+        OPTARGET(CODE_LOOKUPARG|RET_STR, lookuparg_str)
+        OPTARGET(CODE_LOOKUPU|RET_INT, lookupu_int)
+        OPTARGET(CODE_LOOKUP|RET_INT, lookup_int)
+        OPTARGET(CODE_LOOKUPARG|RET_INT, lookuparg_int)
+        OPTARGET(CODE_LOOKUPU|RET_FLOAT, lookupu_float)
+        OPTARGET(CODE_LOOKUP|RET_FLOAT, lookup_float)
+        OPTARGET(CODE_LOOKUPARG|RET_FLOAT, lookuparg_float)
+        OPTARGET(CODE_LOOKUPU|RET_NULL, lookupu_null)
+        OPTARGET(CODE_LOOKUP|RET_NULL, lookup_null)
+        OPTARGET(CODE_LOOKUPARG|RET_NULL, lookuparg_null)
+        OPTARGET(CODE_SVAR|RET_STR, svar_str) OPTARGET(CODE_SVAR|RET_NULL, svar_str)
+        OPTARGET(CODE_SVAR|RET_INT, svar_int)
+        OPTARGET(CODE_SVAR|RET_FLOAT, svar_float)
+        OPTARGET(CODE_SVAR1, svar1)
+        OPTARGET(CODE_IVAR|RET_INT, ivar_int) OPTARGET(CODE_IVAR|RET_NULL, ivar_int)
+        OPTARGET(CODE_IVAR|RET_STR, ivar_str)
+        OPTARGET(CODE_IVAR|RET_FLOAT, ivar_float)
+        OPTARGET(CODE_IVAR1, ivar1)
+        OPTARGET(CODE_IVAR2, ivar2)
+        OPTARGET(CODE_IVAR3, ivar3)
+        OPTARGET(CODE_FVAR|RET_FLOAT, fvar_float) OPTARGET(CODE_FVAR|RET_NULL, fvar_float)
+        OPTARGET(CODE_FVAR|RET_STR, fvar_str)
+        OPTARGET(CODE_FVAR|RET_INT, fvar_int)
+        OPTARGET(CODE_FVAR1, fvar1)
+        OPTARGET4(CODE_COM, com)
+#ifndef STANDALONE
+        OPTARGET4(CODE_COMD, comd)
+#endif
+        OPTARGET4(CODE_COMI, comi)
+        OPTARGET4(CODE_COMV, comv)
+        OPTARGET4(CODE_COMC, comc)
+        OPTARGET4(CODE_CONC, conc) OPTARGET4(CODE_CONCW, conc)
+        OPTARGET4(CODE_CONCM, concm)
+        OPTARGET(CODE_ALIAS, alias)
+        OPTARGET(CODE_ALIASARG, aliasarg)
+        OPTARGET(CODE_ALIASU, aliasu)
+        OPTARGET4(CODE_CALL, call)
+        OPTARGET4(CODE_CALLARG, callarg)
+        OPTARGET4(CODE_CALLU, callu)
+    }
+#endif
     result.setnull();
     if(rundepth >= MAXRUNDEPTH)
     {
@@ -1768,28 +2044,33 @@ static const uint *runcode(const uint *code, tagval &result)
     ++rundepth;
     ident *id = NULL;
     int numargs = 0;
-    tagval args[MAXARGS+1], *prevret = commandret;
+    tagval *args = argtop, *prevret = commandret;
+    argtop = &args[MAXARGS+1];
     commandret = &result;
+    uint op;
     for(;;)
     {
-        uint op = *code++;
+        op = *code++;
         switch(op&0xFF)
         {
-            case CODE_START: case CODE_OFFSET: continue;
+            case CODE_START: case CODE_OFFSET: OPLABEL(skip) NEXTOP;
 
-            case CODE_POP:
+            case CODE_POP: OPLABEL(pop)
                 freearg(args[--numargs]);
-                continue;
-            case CODE_ENTER:
+                NEXTOP;
+            case CODE_ENTER: OPLABEL(enter)
+                // a nested frame only needs to stay clear of the arguments pushed so far
+                argtop = &args[numargs+1];
                 code = runcode(code, args[numargs++]);
-                continue;
-            case CODE_EXIT|RET_NULL: case CODE_EXIT|RET_STR: case CODE_EXIT|RET_INT: case CODE_EXIT|RET_FLOAT:
+                argtop = &args[MAXARGS+1];
+                NEXTOP;
+            case CODE_EXIT|RET_NULL: case CODE_EXIT|RET_STR: case CODE_EXIT|RET_INT: case CODE_EXIT|RET_FLOAT: OPLABEL(exit)
                 forcearg(result, op&CODE_RET_MASK);
                 goto exit;
-            case CODE_PRINT:
+            case CODE_PRINT: OPLABEL(print)
                 printvar(identmap[op>>8]);
-                continue;
-            case CODE_LOCAL:
+                NEXTOP;
+            case CODE_LOCAL: OPLABEL(local)
             {
                 identstack locals[MAXARGS];
                 freearg(result);
@@ -1799,55 +2080,55 @@ static const uint *runcode(const uint *code, tagval &result)
                 goto exit;
             }
 
-            case CODE_MACRO:
+            case CODE_MACRO: OPLABEL(macro)
             {
                 uint len = op>>8;
                 args[numargs++].setmacro(code);
                 code += len/sizeof(uint) + 1;
-                continue;
+                NEXTOP;
             }
 
-            case CODE_VAL|RET_STR:
+            case CODE_VAL|RET_STR: OPLABEL(val_str)
             {
                 uint len = op>>8;
-                args[numargs++].setstr(newstring((const char *)code, len));
+                args[numargs++].setstr(newscriptstr((const char *)code, len));
                 code += len/sizeof(uint) + 1;
-                continue;
+                NEXTOP;
             }
-            case CODE_VALI|RET_STR:
+            case CODE_VALI|RET_STR: OPLABEL(vali_str)
             {
                 char s[4] = { char((op>>8)&0xFF), char((op>>16)&0xFF), char((op>>24)&0xFF), '\0' };
-                args[numargs++].setstr(newstring(s));
-                continue;
+                args[numargs++].setstr(newscriptstr(s));
+                NEXTOP;
             }
             case CODE_VAL|RET_NULL:
-            case CODE_VALI|RET_NULL: args[numargs++].setnull(); continue;
-            case CODE_VAL|RET_INT: args[numargs++].setint(int(*code++)); continue;
-            case CODE_VALI|RET_INT: args[numargs++].setint(int(op)>>8); continue;
-            case CODE_VAL|RET_FLOAT: args[numargs++].setfloat(*(const float *)code++); continue;
-            case CODE_VALI|RET_FLOAT: args[numargs++].setfloat(float(int(op)>>8)); continue;
+            case CODE_VALI|RET_NULL: OPLABEL(val_null) args[numargs++].setnull(); NEXTOP;
+            case CODE_VAL|RET_INT: OPLABEL(val_int) args[numargs++].setint(int(*code++)); NEXTOP;
+            case CODE_VALI|RET_INT: OPLABEL(vali_int) args[numargs++].setint(int(op)>>8); NEXTOP;
+            case CODE_VAL|RET_FLOAT: OPLABEL(val_float) args[numargs++].setfloat(*(const float *)code++); NEXTOP;
+            case CODE_VALI|RET_FLOAT: OPLABEL(vali_float) args[numargs++].setfloat(float(int(op)>>8)); NEXTOP;
 
-            case CODE_FORCE|RET_STR: forcestr(args[numargs-1]); continue;
-            case CODE_FORCE|RET_INT: forceint(args[numargs-1]); continue;
-            case CODE_FORCE|RET_FLOAT: forcefloat(args[numargs-1]); continue;
+            case CODE_FORCE|RET_STR: OPLABEL(force_str) forcestr(args[numargs-1]); NEXTOP;
+            case CODE_FORCE|RET_INT: OPLABEL(force_int) forceint(args[numargs-1]); NEXTOP;
+            case CODE_FORCE|RET_FLOAT: OPLABEL(force_float) forcefloat(args[numargs-1]); NEXTOP;
 
-            case CODE_RESULT|RET_NULL: case CODE_RESULT|RET_STR: case CODE_RESULT|RET_INT: case CODE_RESULT|RET_FLOAT:
+            case CODE_RESULT|RET_NULL: case CODE_RESULT|RET_STR: case CODE_RESULT|RET_INT: case CODE_RESULT|RET_FLOAT: OPLABEL(result)
             litval:
                 freearg(result);
                 result = args[0];
                 forcearg(result, op&CODE_RET_MASK);
                 args[0].setnull();
                 freeargs(args, numargs, 0);
-                continue;
+                NEXTOP;
 
-            case CODE_BLOCK:
+            case CODE_BLOCK: OPLABEL(block)
             {
                 uint len = op>>8;
                 args[numargs++].setcode(code+1);
                 code += len;
-                continue;
+                NEXTOP;
             }
-            case CODE_COMPILE:
+            case CODE_COMPILE: OPLABEL(compile)
             {
                 tagval &arg = args[numargs-1];
                 vector<uint> buf;
@@ -1860,13 +2141,13 @@ static const uint *runcode(const uint *code, tagval &result)
                 }
                 arg.setcode(buf.getbuf()+1);
                 buf.disown();
-                continue;
+                NEXTOP;
             }
 
-            case CODE_IDENT:
+            case CODE_IDENT: OPLABEL(ident)
                 args[numargs++].setident(identmap[op>>8]);
-                continue;
-            case CODE_IDENTARG:
+                NEXTOP;
+            case CODE_IDENTARG: OPLABEL(identarg)
             {
                 ident *id = identmap[op>>8];
                 if(!(aliasstack->usedargs&(1<<id->index)))
@@ -1875,9 +2156,9 @@ static const uint *runcode(const uint *code, tagval &result)
                     aliasstack->usedargs |= 1<<id->index;
                 }
                 args[numargs++].setident(id);
-                continue;
+                NEXTOP;
             }
-            case CODE_IDENTU:
+            case CODE_IDENTU: OPLABEL(identu)
             {
                 tagval &arg = args[numargs-1];
                 ident *id = arg.type == VAL_STR || arg.type == VAL_MACRO ? newident(arg.s, IDF_UNKNOWN) : dummyident;
@@ -1888,25 +2169,25 @@ static const uint *runcode(const uint *code, tagval &result)
                 }
                 freearg(arg);
                 arg.setident(id);
-                continue;
+                NEXTOP;
             }
 
-            case CODE_LOOKUPU|RET_STR:
+            case CODE_LOOKUPU|RET_STR: OPLABEL(lookupu_str)
                 #define LOOKUPU(aval, sval, ival, fval, nval) { \
                     tagval &arg = args[numargs-1]; \
-                    if(arg.type != VAL_STR && arg.type != VAL_MACRO) continue; \
+                    if(arg.type != VAL_STR && arg.type != VAL_MACRO) NEXTOP; \
                     id = idents.access(arg.s); \
                     if(id) switch(id->type) \
                     { \
                         case ID_ALIAS: \
                             if(id->flags&IDF_UNKNOWN) break; \
                             freearg(arg); \
-                            if(id->index < MAXARGS && !(aliasstack->usedargs&(1<<id->index))) { nval; continue; } \
+                            if(id->index < MAXARGS && !(aliasstack->usedargs&(1<<id->index))) { nval; NEXTOP; } \
                             aval; \
-                            continue; \
-                        case ID_SVAR: freearg(arg); sval; continue; \
-                        case ID_VAR: freearg(arg); ival; continue; \
-                        case ID_FVAR: freearg(arg); fval; continue; \
+                            NEXTOP; \
+                        case ID_SVAR: freearg(arg); sval; NEXTOP; \
+                        case ID_VAR: freearg(arg); ival; NEXTOP; \
+                        case ID_FVAR: freearg(arg); fval; NEXTOP; \
                         case ID_COMMAND: \
                         { \
                             freearg(arg); \
@@ -1916,85 +2197,85 @@ static const uint *runcode(const uint *code, tagval &result)
                             callcommand(id, buf, 0, true); \
                             forcearg(arg, op&CODE_RET_MASK); \
                             commandret = &result; \
-                            continue; \
+                            NEXTOP; \
                         } \
-                        default: freearg(arg); nval; continue; \
+                        default: freearg(arg); nval; NEXTOP; \
                     } \
                     debugcode("unknown alias lookup: %s", arg.s); \
                     freearg(arg); \
                     nval; \
-                    continue; \
+                    NEXTOP; \
                 }
-                LOOKUPU(arg.setstr(newstring(id->getstr())),
-                        arg.setstr(newstring(*id->storage.s)),
-                        arg.setstr(newstring(intstr(*id->storage.i))),
-                        arg.setstr(newstring(floatstr(*id->storage.f))),
-                        arg.setstr(newstring("")));
-            case CODE_LOOKUP|RET_STR:
+                LOOKUPU(arg.setstr(getaliasstr(*id)),
+                        arg.setstr(newscriptstr(*id->storage.s)),
+                        arg.setstr(newscriptstr(intstr(*id->storage.i))),
+                        arg.setstr(newscriptstr(floatstr(*id->storage.f))),
+                        arg.setstr(newscriptstr("")));
+            case CODE_LOOKUP|RET_STR: OPLABEL(lookup_str)
                 #define LOOKUP(aval) { \
                     id = identmap[op>>8]; \
                     if(id->flags&IDF_UNKNOWN) debugcode("unknown alias lookup: %s", id->name); \
                     aval; \
-                    continue; \
+                    NEXTOP; \
                 }
-                LOOKUP(args[numargs++].setstr(newstring(id->getstr())));
-            case CODE_LOOKUPARG|RET_STR:
+                LOOKUP(args[numargs++].setstr(getaliasstr(*id)));
+            case CODE_LOOKUPARG|RET_STR: OPLABEL(lookuparg_str)
                 #define LOOKUPARG(aval, nval) { \
                     id = identmap[op>>8]; \
-                    if(!(aliasstack->usedargs&(1<<id->index))) { nval; continue; } \
+                    if(!(aliasstack->usedargs&(1<<id->index))) { nval; NEXTOP; } \
                     aval; \
-                    continue; \
+                    NEXTOP; \
                 }
-                LOOKUPARG(args[numargs++].setstr(newstring(id->getstr())), args[numargs++].setstr(newstring("")));
-            case CODE_LOOKUPU|RET_INT:
+                LOOKUPARG(args[numargs++].setstr(getaliasstr(*id)), args[numargs++].setstr(newscriptstr("")));
+            case CODE_LOOKUPU|RET_INT: OPLABEL(lookupu_int)
                 LOOKUPU(arg.setint(id->getint()),
                         arg.setint(parseint(*id->storage.s)),
                         arg.setint(*id->storage.i),
                         arg.setint(int(*id->storage.f)),
                         arg.setint(0));
-            case CODE_LOOKUP|RET_INT:
+            case CODE_LOOKUP|RET_INT: OPLABEL(lookup_int)
                 LOOKUP(args[numargs++].setint(id->getint()));
-            case CODE_LOOKUPARG|RET_INT:
+            case CODE_LOOKUPARG|RET_INT: OPLABEL(lookuparg_int)
                 LOOKUPARG(args[numargs++].setint(id->getint()), args[numargs++].setint(0));
-            case CODE_LOOKUPU|RET_FLOAT:
+            case CODE_LOOKUPU|RET_FLOAT: OPLABEL(lookupu_float)
                 LOOKUPU(arg.setfloat(id->getfloat()),
                         arg.setfloat(parsefloat(*id->storage.s)),
                         arg.setfloat(float(*id->storage.i)),
                         arg.setfloat(*id->storage.f),
                         arg.setfloat(0.0f));
-            case CODE_LOOKUP|RET_FLOAT:
+            case CODE_LOOKUP|RET_FLOAT: OPLABEL(lookup_float)
                 LOOKUP(args[numargs++].setfloat(id->getfloat()));
-            case CODE_LOOKUPARG|RET_FLOAT:
+            case CODE_LOOKUPARG|RET_FLOAT: OPLABEL(lookuparg_float)
                 LOOKUPARG(args[numargs++].setfloat(id->getfloat()), args[numargs++].setfloat(0.0f));
-            case CODE_LOOKUPU|RET_NULL:
+            case CODE_LOOKUPU|RET_NULL: OPLABEL(lookupu_null)
                 LOOKUPU(id->getval(arg),
-                        arg.setstr(newstring(*id->storage.s)),
+                        arg.setstr(newscriptstr(*id->storage.s)),
                         arg.setint(*id->storage.i),
                         arg.setfloat(*id->storage.f),
                         arg.setnull());
-            case CODE_LOOKUP|RET_NULL:
+            case CODE_LOOKUP|RET_NULL: OPLABEL(lookup_null)
                 LOOKUP(id->getval(args[numargs++]));
-            case CODE_LOOKUPARG|RET_NULL:
+            case CODE_LOOKUPARG|RET_NULL: OPLABEL(lookuparg_null)
                 LOOKUPARG(id->getval(args[numargs++]), args[numargs++].setnull());
 
-            case CODE_SVAR|RET_STR: case CODE_SVAR|RET_NULL: args[numargs++].setstr(newstring(*identmap[op>>8]->storage.s)); continue;
-            case CODE_SVAR|RET_INT: args[numargs++].setint(parseint(*identmap[op>>8]->storage.s)); continue;
-            case CODE_SVAR|RET_FLOAT: args[numargs++].setfloat(parsefloat(*identmap[op>>8]->storage.s)); continue;
-            case CODE_SVAR1: setsvarchecked(identmap[op>>8], args[0].s); freeargs(args, numargs, 0); continue;
+            case CODE_SVAR|RET_STR: case CODE_SVAR|RET_NULL: OPLABEL(svar_str) args[numargs++].setstr(newscriptstr(*identmap[op>>8]->storage.s)); NEXTOP;
+            case CODE_SVAR|RET_INT: OPLABEL(svar_int) args[numargs++].setint(parseint(*identmap[op>>8]->storage.s)); NEXTOP;
+            case CODE_SVAR|RET_FLOAT: OPLABEL(svar_float) args[numargs++].setfloat(parsefloat(*identmap[op>>8]->storage.s)); NEXTOP;
+            case CODE_SVAR1: OPLABEL(svar1) setsvarchecked(identmap[op>>8], args[0].s); freeargs(args, numargs, 0); NEXTOP;
 
-            case CODE_IVAR|RET_INT: case CODE_IVAR|RET_NULL: args[numargs++].setint(*identmap[op>>8]->storage.i); continue;
-            case CODE_IVAR|RET_STR: args[numargs++].setstr(newstring(intstr(*identmap[op>>8]->storage.i))); continue;
-            case CODE_IVAR|RET_FLOAT: args[numargs++].setfloat(float(*identmap[op>>8]->storage.i)); continue;
-            case CODE_IVAR1: setvarchecked(identmap[op>>8], args[0].i); numargs = 0; continue;
-            case CODE_IVAR2: setvarchecked(identmap[op>>8], (args[0].i<<16)|(args[1].i<<8)); numargs = 0; continue;
-            case CODE_IVAR3: setvarchecked(identmap[op>>8], (args[0].i<<16)|(args[1].i<<8)|args[2].i); numargs = 0; continue;
+            case CODE_IVAR|RET_INT: case CODE_IVAR|RET_NULL: OPLABEL(ivar_int) args[numargs++].setint(*identmap[op>>8]->storage.i); NEXTOP;
+            case CODE_IVAR|RET_STR: OPLABEL(ivar_str) args[numargs++].setstr(newscriptstr(intstr(*identmap[op>>8]->storage.i))); NEXTOP;
+            case CODE_IVAR|RET_FLOAT: OPLABEL(ivar_float) args[numargs++].setfloat(float(*identmap[op>>8]->storage.i)); NEXTOP;
+            case CODE_IVAR1: OPLABEL(ivar1) setvarchecked(identmap[op>>8], args[0].i); numargs = 0; NEXTOP;
+            case CODE_IVAR2: OPLABEL(ivar2) setvarchecked(identmap[op>>8], (args[0].i<<16)|(args[1].i<<8)); numargs = 0; NEXTOP;
+            case CODE_IVAR3: OPLABEL(ivar3) setvarchecked(identmap[op>>8], (args[0].i<<16)|(args[1].i<<8)|args[2].i); numargs = 0; NEXTOP;
 
-            case CODE_FVAR|RET_FLOAT: case CODE_FVAR|RET_NULL: args[numargs++].setfloat(*identmap[op>>8]->storage.f); continue;
-            case CODE_FVAR|RET_STR: args[numargs++].setstr(newstring(floatstr(*identmap[op>>8]->storage.f))); continue;
-            case CODE_FVAR|RET_INT: args[numargs++].setint(int(*identmap[op>>8]->storage.f)); continue;
-            case CODE_FVAR1: setfvarchecked(identmap[op>>8], args[0].f); numargs = 0; continue;
+            case CODE_FVAR|RET_FLOAT: case CODE_FVAR|RET_NULL: OPLABEL(fvar_float) args[numargs++].setfloat(*identmap[op>>8]->storage.f); NEXTOP;
+            case CODE_FVAR|RET_STR: OPLABEL(fvar_str) args[numargs++].setstr(newscriptstr(floatstr(*identmap[op>>8]->storage.f))); NEXTOP;
+            case CODE_FVAR|RET_INT: OPLABEL(fvar_int) args[numargs++].setint(int(*identmap[op>>8]->storage.f)); NEXTOP;
+            case CODE_FVAR1: OPLABEL(fvar1) setfvarchecked(identmap[op>>8], args[0].f); numargs = 0; NEXTOP;
 
-            case CODE_COM|RET_NULL: case CODE_COM|RET_STR: case CODE_COM|RET_FLOAT: case CODE_COM|RET_INT:
+            case CODE_COM|RET_NULL: case CODE_COM|RET_STR: case CODE_COM|RET_FLOAT: case CODE_COM|RET_INT: OPLABEL(com)
                 id = identmap[op>>8];
 #ifndef STANDALONE
             callcom:
@@ -2004,20 +2285,34 @@ static const uint *runcode(const uint *code, tagval &result)
             forceresult:
                 freeargs(args, numargs, 0);
                 forcearg(result, op&CODE_RET_MASK);
-                continue;
+                NEXTOP;
 #ifndef STANDALONE
-            case CODE_COMD|RET_NULL: case CODE_COMD|RET_STR: case CODE_COMD|RET_FLOAT: case CODE_COMD|RET_INT:
+            case CODE_COMD|RET_NULL: case CODE_COMD|RET_STR: case CODE_COMD|RET_FLOAT: case CODE_COMD|RET_INT: OPLABEL(comd)
                 id = identmap[op>>8];
                 args[numargs].setint(addreleaseaction(conc(args, numargs, true, id->name)) ? 1 : 0);
                 numargs++;
                 goto callcom;
 #endif
-            case CODE_COMV|RET_NULL: case CODE_COMV|RET_STR: case CODE_COMV|RET_FLOAT: case CODE_COMV|RET_INT:
+            case CODE_COMI|RET_NULL: case CODE_COMI|RET_STR: case CODE_COMI|RET_FLOAT: case CODE_COMI|RET_INT: OPLABEL(comi)
+            {
+                id = identmap[op>>8];
+                int offset = numargs - int(*code++);
+                tagval ret;
+                ret.setnull();
+                commandret = &ret;
+                callcom(id, &args[offset], numargs - offset);
+                commandret = &result;
+                freeargs(args, numargs, offset);
+                forcearg(ret, op&CODE_RET_MASK);
+                args[numargs++] = ret;
+                NEXTOP;
+            }
+            case CODE_COMV|RET_NULL: case CODE_COMV|RET_STR: case CODE_COMV|RET_FLOAT: case CODE_COMV|RET_INT: OPLABEL(comv)
                 id = identmap[op>>8];
                 forcenull(result);
                 ((comfunv)id->fun)(args, numargs);
                 goto forceresult;
-            case CODE_COMC|RET_NULL: case CODE_COMC|RET_STR: case CODE_COMC|RET_FLOAT: case CODE_COMC|RET_INT:
+            case CODE_COMC|RET_NULL: case CODE_COMC|RET_STR: case CODE_COMC|RET_FLOAT: case CODE_COMC|RET_INT: OPLABEL(comc)
                 id = identmap[op>>8];
                 forcenull(result);
                 {
@@ -2028,41 +2323,41 @@ static const uint *runcode(const uint *code, tagval &result)
                 goto forceresult;
 
             case CODE_CONC|RET_NULL: case CODE_CONC|RET_STR: case CODE_CONC|RET_FLOAT: case CODE_CONC|RET_INT:
-            case CODE_CONCW|RET_NULL: case CODE_CONCW|RET_STR: case CODE_CONCW|RET_FLOAT: case CODE_CONCW|RET_INT:
+            case CODE_CONCW|RET_NULL: case CODE_CONCW|RET_STR: case CODE_CONCW|RET_FLOAT: case CODE_CONCW|RET_INT: OPLABEL(conc)
             {
                 int numconc = op>>8;
                 char *s = conc(&args[numargs-numconc], numconc, (op&CODE_OP_MASK)==CODE_CONC);
                 freeargs(args, numargs, numargs-numconc);
                 args[numargs++].setstr(s);
                 forcearg(args[numargs-1], op&CODE_RET_MASK);
-                continue;
+                NEXTOP;
             }
 
-            case CODE_CONCM|RET_NULL: case CODE_CONCM|RET_STR: case CODE_CONCM|RET_FLOAT: case CODE_CONCM|RET_INT:
+            case CODE_CONCM|RET_NULL: case CODE_CONCM|RET_STR: case CODE_CONCM|RET_FLOAT: case CODE_CONCM|RET_INT: OPLABEL(concm)
             {
                 int numconc = op>>8;
                 char *s = conc(&args[numargs-numconc], numconc, false);
                 freeargs(args, numargs, numargs-numconc);
                 result.setstr(s);
                 forcearg(result, op&CODE_RET_MASK);
-                continue;
+                NEXTOP;
             }
 
-            case CODE_ALIAS:
+            case CODE_ALIAS: OPLABEL(alias)
                 setalias(*identmap[op>>8], args[--numargs]);
                 freeargs(args, numargs, 0);
-                continue;
-            case CODE_ALIASARG:
+                NEXTOP;
+            case CODE_ALIASARG: OPLABEL(aliasarg)
                 setarg(*identmap[op>>8], args[--numargs]);
                 freeargs(args, numargs, 0);
-                continue;
-            case CODE_ALIASU:
+                NEXTOP;
+            case CODE_ALIASU: OPLABEL(aliasu)
                 forcestr(args[0]);
                 setalias(args[0].s, args[--numargs]);
                 freeargs(args, numargs, 0);
-                continue;
+                NEXTOP;
 
-            case CODE_CALL|RET_NULL: case CODE_CALL|RET_STR: case CODE_CALL|RET_FLOAT: case CODE_CALL|RET_INT:
+            case CODE_CALL|RET_NULL: case CODE_CALL|RET_STR: case CODE_CALL|RET_FLOAT: case CODE_CALL|RET_INT: OPLABEL(call)
                 #define CALLALIAS(offset) { \
                     identstack argstack[MAXARGS]; \
                     for(int i = 0; i < numargs-offset; i++) \
@@ -2097,15 +2392,15 @@ static const uint *runcode(const uint *code, tagval &result)
                     goto forceresult;
                 }
                 CALLALIAS(0);
-                continue;
-            case CODE_CALLARG|RET_NULL: case CODE_CALLARG|RET_STR: case CODE_CALLARG|RET_FLOAT: case CODE_CALLARG|RET_INT:
+                NEXTOP;
+            case CODE_CALLARG|RET_NULL: case CODE_CALLARG|RET_STR: case CODE_CALLARG|RET_FLOAT: case CODE_CALLARG|RET_INT: OPLABEL(callarg)
                 forcenull(result);
                 id = identmap[op>>8];
                 if(!(aliasstack->usedargs&(1<<id->index))) goto forceresult;
                 CALLALIAS(0);
-                continue;
+                NEXTOP;
 
-            case CODE_CALLU|RET_NULL: case CODE_CALLU|RET_STR: case CODE_CALLU|RET_FLOAT: case CODE_CALLU|RET_INT:
+            case CODE_CALLU|RET_NULL: case CODE_CALLU|RET_STR: case CODE_CALLU|RET_FLOAT: case CODE_CALLU|RET_INT: OPLABEL(callu)
                 if(args[0].type != VAL_STR) goto litval;
                 id = idents.access(args[0].s);
                 if(!id)
@@ -2124,7 +2419,7 @@ static const uint *runcode(const uint *code, tagval &result)
                         callcommand(id, args+1, numargs-1);
                         forcearg(result, op&CODE_RET_MASK);
                         numargs = 0;
-                        continue;
+                        NEXTOP;
                     case ID_LOCAL:
                     {
                         identstack locals[MAXARGS];
@@ -2148,13 +2443,17 @@ static const uint *runcode(const uint *code, tagval &result)
                         if(id->valtype==VAL_NULL) goto noid;
                         freearg(args[0]);
                         CALLALIAS(1);
-                        continue;
+                        NEXTOP;
                     default:
                         goto forceresult;
                 }
+
+            default: OPLABEL(none)
+                NEXTOP;
         }
     }
 exit:
+    argtop = args;
     commandret = prevret;
     --rundepth;
     return code;
@@ -2361,11 +2660,308 @@ bool execidentbool(const char *name, bool noid, bool lookup)
     return id ? executebool(id, NULL, 0, lookup) : noid;
 }
 
+// compiled script cache: execfile keeps the bytecode of the files it ran, keyed by a hash of their contents, and can
+// also append it to a file in the home directory so later runs skip parsing; ident references are stored by name
+// and relocated against the current ident table when first used
+
+VAR(scriptcache, 0, 1, 2); // 0 = off, 1 = in memory, 2 = in memory and on disk
+VAR(scriptcachesize, 0, 4096, 1<<20); // KB of bytecode kept in memory
+
+#define SCRIPTCACHEFILE "scriptcache.dat"
+#define SCRIPTCACHEMAGIC "SAUERSCC"
+#define SCRIPTCACHEVERSION 2
+
+struct scriptkey
+{
+    ullong hash;
+    uint len;
+};
+
+static inline uint hthash(const scriptkey &k) { return uint(k.hash) ^ uint(k.hash>>32) ^ k.len; }
+static inline bool htcmp(const scriptkey &x, const scriptkey &y) { return x.hash == y.hash && x.len == y.len; }
+
+struct scriptref
+{
+    int offset, type, name;
+};
+
+struct cachedscript
+{
+    uint *code; // relocated bytecode the cache holds a reference to, NULL until an entry loaded from disk is first used
+    vector<uint> words;
+    vector<scriptref> refs;
+    vector<char> names;
+
+    cachedscript() : code(NULL) {}
+    ~cachedscript() { freecode(code); }
+};
+
+static hashtable<scriptkey, cachedscript> cachedscripts;
+static int cachedwords = 0, scripthits = 0, scriptmisses = 0, scriptloads = 0;
+static uint compilemicros = 0, relocatemicros = 0;
+static bool scriptcacheloaded = false;
+
+static inline ullong hashscript(const char *p, size_t len, ullong h = 14695981039346656037ULL)
+{
+    loopi(len) h = (h ^ uchar(p[i])) * 1099511628211ULL;
+    return h;
+}
+
+// the builtin idents the compiler consults, so cached code is only reused by a binary with the same commands and variables
+static ullong scriptsignature()
+{
+    static ullong sig = 0;
+    if(sig) return sig;
+    sig = hashscript(SCRIPTCACHEMAGIC, strlen(SCRIPTCACHEMAGIC));
+    loopv(identmap)
+    {
+        ident &id = *identmap[i];
+        if(id.type == ID_ALIAS) continue;
+        uchar info[2] = { uchar(id.type), uchar(id.flags&(IDF_HEX|IDF_EMUVAR)) };
+        sig = hashscript(id.name, strlen(id.name)+1, sig);
+        sig = hashscript((const char *)info, sizeof(info), sig);
+        if(id.type == ID_COMMAND) sig = hashscript(id.args, strlen(id.args)+1, sig);
+    }
+    return sig;
+}
+
+static inline bool isidentop(uint op)
+{
+    switch(op&CODE_OP_MASK)
+    {
+        case CODE_IDENT: case CODE_IDENTARG:
+        case CODE_COM: case CODE_COMD: case CODE_COMC: case CODE_COMV: case CODE_COMI:
+        case CODE_SVAR: case CODE_SVAR1:
+        case CODE_IVAR: case CODE_IVAR1: case CODE_IVAR2: case CODE_IVAR3:
+        case CODE_FVAR: case CODE_FVAR1:
+        case CODE_LOOKUP: case CODE_LOOKUPARG: case CODE_ALIAS: case CODE_ALIASARG: case CODE_CALL: case CODE_CALLARG:
+        case CODE_PRINT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static inline bool isargop(uint op)
+{
+    switch(op&CODE_OP_MASK)
+    {
+        case CODE_IDENTARG: case CODE_LOOKUPARG: case CODE_ALIASARG: case CODE_CALLARG: return true;
+        default: return false;
+    }
+}
+
+// finds the words holding ident indices, fails unless the ops line up with the end of the code
+static bool findidentrefs(const uint *code, int len, vector<int> &offsets)
+{
+    int i = 0;
+    while(i < len)
+    {
+        if(isidentop(code[i])) offsets.add(i);
+        i += opdatalen(code[i]) + 1;
+    }
+    return i == len;
+}
+
+static void writescriptheader(stream *f)
+{
+    f->write(SCRIPTCACHEMAGIC, strlen(SCRIPTCACHEMAGIC));
+    f->putlil<int>(SCRIPTCACHEVERSION);
+}
+
+static void savescript(const scriptkey &key, const uint *code, int len)
+{
+    vector<int> offsets;
+    if(!findidentrefs(code, len, offsets)) return;
+    stream *f = openfile(SCRIPTCACHEFILE, "ab");
+    if(!f) return;
+    if(!f->tell()) writescriptheader(f);
+    f->putlil<ullong>(key.hash);
+    f->putlil<uint>(key.len);
+    f->putlil<ullong>(scriptsignature());
+    f->putlil<int>(len);
+    f->putlil<int>(offsets.length());
+    int namelen = 0;
+    loopv(offsets) namelen += strlen(identmap[code[offsets[i]]>>8]->name) + 1;
+    f->putlil<int>(namelen);
+    loopi(len) f->putlil<uint>(i ? code[i] : code[i]&0xFF);
+    namelen = 0;
+    loopv(offsets)
+    {
+        ident &id = *identmap[code[offsets[i]]>>8];
+        f->putlil<int>(offsets[i]);
+        f->putlil<int>(id.type);
+        f->putlil<int>(namelen);
+        namelen += strlen(id.name) + 1;
+    }
+    loopv(offsets)
+    {
+        const char *name = identmap[code[offsets[i]]>>8]->name;
+        f->write(name, strlen(name) + 1);
+    }
+    delete f;
+}
+
+static void resetscriptcachefile()
+{
+    stream *f = openfile(SCRIPTCACHEFILE, "wb");
+    if(f) { writescriptheader(f); delete f; }
+}
+
+static void clearscriptcache(int disk)
+{
+    cachedscripts.clear();
+    cachedwords = 0;
+    if(disk) resetscriptcachefile();
+}
+ICOMMAND(clearscriptcache, "i", (int *disk), clearscriptcache(*disk));
+
+static void loadscriptcache()
+{
+    scriptcacheloaded = true;
+    stream *f = openfile(SCRIPTCACHEFILE, "rb");
+    if(!f) return;
+    char magic[8];
+    if(f->read(magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, SCRIPTCACHEMAGIC, sizeof(magic)) || f->getlil<int>() != SCRIPTCACHEVERSION)
+    {
+        delete f;
+        resetscriptcachefile(); // left by an incompatible version
+        return;
+    }
+    ullong sig = scriptsignature();
+    for(;;)
+    {
+        scriptkey key;
+        key.hash = f->getlil<ullong>();
+        key.len = f->getlil<uint>();
+        ullong entrysig = f->getlil<ullong>();
+        int len = f->getlil<int>(), numrefs = f->getlil<int>(), namelen = f->getlil<int>();
+        if(f->end() || len <= 0 || numrefs < 0 || namelen < 0 || len > (1<<24) || numrefs > len || namelen > (1<<24)) break;
+        if(cachedwords + len > scriptcachesize*1024/int(sizeof(uint)))
+        {
+            // entries are only ever appended, so start over once stale ones have piled up past the memory budget
+            delete f;
+            resetscriptcachefile();
+            return;
+        }
+        if(entrysig != sig || cachedscripts.access(key))
+        {
+            if(!f->seek(len*sizeof(uint) + numrefs*3*sizeof(int) + namelen, SEEK_CUR)) break;
+            continue;
+        }
+        cachedscript &s = cachedscripts[key];
+        loopi(len) s.words.add(f->getlil<uint>());
+        loopi(numrefs)
+        {
+            scriptref &r = s.refs.add();
+            r.offset = f->getlil<int>();
+            r.type = f->getlil<int>();
+            r.name = f->getlil<int>();
+        }
+        s.names.growbuf(namelen);
+        s.names.advance(f->read(s.names.getbuf(), namelen));
+        bool valid = s.names.length() == namelen && (!namelen || !s.names.last());
+        loopv(s.refs) if(s.refs[i].offset <= 0 || s.refs[i].offset >= len || s.refs[i].name < 0 || s.refs[i].name >= namelen) valid = false;
+        if(!valid) { cachedscripts.remove(key); break; }
+        cachedwords += len;
+    }
+    delete f;
+}
+
+static uint *relocatescript(cachedscript &s)
+{
+    uint *code = new uint[s.words.length()];
+    memcpy(code, s.words.getbuf(), s.words.length()*sizeof(uint));
+    loopv(s.refs)
+    {
+        scriptref &r = s.refs[i];
+        const char *name = &s.names[r.name];
+        uint &op = code[r.offset];
+        ident *id = idents.access(name);
+        if(!id && r.type == ID_ALIAS) id = newident(name, IDF_UNKNOWN);
+        if(!id || id->type != r.type || !isidentop(op) || isargop(op) != (id->index < MAXARGS)) { delete[] code; return NULL; }
+        op = (op&0xFF) | (id->index<<8);
+    }
+    code[0] = (code[0]&0xFF) + 0x100;
+    return code;
+}
+
+ICOMMAND(scriptcachestats, "", (),
+{
+    conoutf("script cache: %d scripts, %d KB, %d hits, %d misses, %d loaded from disk", cachedscripts.numelems, int(cachedwords*sizeof(uint)/1024), scripthits, scriptmisses, scriptloads);
+    conoutf("compiling took %.1f ms, relocating cached scripts took %.1f ms", compilemicros/1000.0, relocatemicros/1000.0);
+});
+
+// returns the compiled code for a script with a reference held for the caller
+static uint *compilecached(const char *p, size_t len)
+{
+    if(scriptcache >= 2 && !scriptcacheloaded) loadscriptcache();
+    scriptkey key;
+    key.hash = hashscript(p, len);
+    key.len = uint(len);
+    cachedscript *s = cachedscripts.access(key);
+    if(s && !s->code)
+    {
+        uint start = getmicros();
+        s->code = relocatescript(*s);
+        relocatemicros += getmicros() - start;
+        if(s->code)
+        {
+            s->words.setsize(0);
+            s->refs.setsize(0);
+            s->names.setsize(0);
+            scriptloads++;
+        }
+        else
+        {
+            cachedwords -= s->words.length();
+            cachedscripts.remove(key);
+            s = NULL;
+        }
+    }
+    if(s)
+    {
+        scripthits++;
+        keepcode(s->code);
+        return s->code;
+    }
+
+    scriptmisses++;
+    uint start = getmicros();
+    vector<uint> buf;
+    buf.reserve(64);
+    compilemain(buf, p, VAL_INT);
+    compilemicros += getmicros() - start;
+    if(cachedwords + buf.length() > scriptcachesize*1024/int(sizeof(uint))) { cachedscripts.clear(); cachedwords = 0; }
+    uint *code = new uint[buf.length()];
+    memcpy(code, buf.getbuf(), buf.length()*sizeof(uint));
+    code[0] += 0x100;
+    if(buf.length() <= scriptcachesize*1024/int(sizeof(uint)))
+    {
+        cachedscript &e = cachedscripts[key];
+        e.code = code;
+        code[0] += 0x100; // reference held by the cache
+        cachedwords += buf.length();
+        if(scriptcache >= 2) savescript(key, code, buf.length());
+    }
+    return code;
+}
+
+static void executecached(const char *p, size_t len)
+{
+    uint *code = compilecached(p, len);
+    tagval result;
+    runcode(code+1, result);
+    freearg(result);
+    freecode(code);
+}
+
 bool execfile(const char *cfgfile, bool msg)
 {
     string s;
     copystring(s, cfgfile);
-    char *buf = loadfile(path(s), NULL);
+    size_t len = 0;
+    char *buf = loadfile(path(s), &len);
     if(!buf)
     {
         if(msg) conoutf(CON_ERROR, "could not read \"%s\"", cfgfile);
@@ -2374,7 +2970,8 @@ bool execfile(const char *cfgfile, bool msg)
     const char *oldsourcefile = sourcefile, *oldsourcestr = sourcestr;
     sourcefile = cfgfile;
     sourcestr = buf;
-    execute(buf);
+    if(scriptcache) executecached(buf, len);
+    else execute(buf);
     sourcefile = oldsourcefile;
     sourcestr = oldsourcestr;
     delete[] buf;
@@ -2407,7 +3004,7 @@ ICOMMAND(escape, "s", (char *s), result(escapestring(s)));
 ICOMMAND(unescape, "s", (char *s),
 {
     int len = strlen(s);
-    char *d = newstring(len);
+    char *d = newscriptstr(len);
     d[unescapestring(d, s, &s[len])] = '\0';
     stringret(d);
 });
@@ -2550,7 +3147,7 @@ void loopiter(ident *id, identstack &stack, const tagval &v)
     }
     else
     {
-        if(id->valtype == VAL_STR) delete[] id->val.s;
+        if(id->valtype == VAL_STR) freescriptstr(id->val.s);
         cleancode(*id);
         id->setval(v);
     }
@@ -2567,7 +3164,7 @@ static inline void setiter(ident &id, int i, identstack &stack)
     {
         if(id.valtype != VAL_INT)
         {
-            if(id.valtype == VAL_STR) delete[] id.val.s;
+            if(id.valtype == VAL_STR) freescriptstr(id.val.s);
             cleancode(id);
             id.valtype = VAL_INT;
         }
@@ -2623,7 +3220,7 @@ char *loopconc(ident *id, int n, uint *body, bool space)
     }
     if(n > 0) poparg(*id);
     s.add('\0');
-    return newstring(s.getbuf(), s.length()-1);
+    return newscriptstr(s.getbuf(), s.length()-1);
 }
 
 ICOMMAND(loopconcat, "rie", (ident *id, int *n, uint *body),
@@ -2661,8 +3258,24 @@ void append(ident *id, tagval *v, bool space)
     {
         const char *prefix = id->getstr();
         if(!prefix[0]) goto noprefix;
+        const char *str = v->getstr();
+        int prefixlen = strlen(prefix), len = prefixlen + (space ? 1 : 0) + strlen(str);
+        // a value only this alias holds is extended in place while it has room, otherwise it grows with some slack
+        bool inplace = id->valtype == VAL_STR && id->index >= MAXARGS && !sharedscriptstr(id->val.s) && len <= scriptstrcapacity(id->val.s);
+        char *d = inplace ? id->val.s : newscriptstr(len + len/2);
+        if(!inplace) memcpy(d, prefix, prefixlen);
+        char *end = &d[prefixlen];
+        if(space) *end++ = ' ';
+        strcpy(end, str);
+        if(inplace)
+        {
+            dropparsedlist(d);
+            cleancode(*id);
+            id->flags = (id->flags & identflags) | identflags;
+            return;
+        }
         tagval r;
-        r.setstr(conc(v, 1, space, prefix));
+        r.setstr(d);
         if(id->index < MAXARGS) setarg(*id, r); else setalias(*id, r);
     }
 }
@@ -2682,7 +3295,7 @@ void stringret(char *s)
 
 void result(const char *s)
 {
-    commandret->setstr(newstring(s));
+    commandret->setstr(newscriptstr(s));
 }
 
 ICOMMAND(result, "t", (tagval *v),
@@ -2693,6 +3306,7 @@ ICOMMAND(result, "t", (tagval *v),
 
 void format(tagval *args, int numargs)
 {
+    if(!numargs) return;
     vector<char> s;
     const char *f = args[0].getstr();
     while(*f)
@@ -2763,6 +3377,66 @@ static bool parselist(const char *&s, const char *&start = liststart, const char
     return true;
 }
 
+VAR(listcache, 0, 1, 1);
+
+enum { MINLISTCACHE = 64 }; // smaller lists are just parsed again whenever they are used
+
+// a list held by an alias or passed around keeps its elements parsed, so indexing and iterating it again is linear in what is used
+static parsedlist *getparsedlist(tagval &v)
+{
+    if(!listcache || v.type != VAL_STR || !sharedscriptstr(v.s) || scriptstrcapacity(v.s) < MINLISTCACHE) return NULL;
+    scriptstring *h = scriptstring::get(v.s);
+    if(!h->list)
+    {
+        h->list = new parsedlist;
+        for(const char *s = v.s, *start, *end, *quotestart, *quoteend; parselist(s, start, end, quotestart, quoteend);)
+        {
+            listelem &e = h->list->elems.add();
+            e.start = int(start - v.s);
+            e.end = int(end - v.s);
+            e.quotestart = int(quotestart - v.s);
+            e.quoteend = int(quoteend - v.s);
+            e.str = NULL;
+        }
+    }
+    return h->list;
+}
+
+// steps through the elements of a list argument, using its parsed elements when it has them
+struct listwalker
+{
+    const char *list, *s, *start, *end, *quotestart, *quoteend;
+    parsedlist *parsed;
+    int index;
+
+    listwalker(tagval &v) : index(-1)
+    {
+        forcestr(v);
+        list = s = v.s;
+        parsed = getparsedlist(v);
+    }
+
+    bool next()
+    {
+        if(!parsed) return parselist(s, start, end, quotestart, quoteend) && ++index >= 0;
+        if(++index >= parsed->elems.length()) return false;
+        const listelem &e = parsed->elems[index];
+        start = &list[e.start];
+        end = &list[e.end];
+        quotestart = &list[e.quotestart];
+        quoteend = &list[e.quoteend];
+        return true;
+    }
+
+    void skip(int n)
+    {
+        if(parsed) index = min(index + n, parsed->elems.length() - 1);
+        else while(n-- > 0 && parselist(s)) index++;
+    }
+
+    char *elem() { return parsed ? parsed->elemstr(list, index) : newscriptstr(start, end-start); }
+};
+
 void explodelist(const char *s, vector<char *> &elems, int limit)
 {
     const char *start, *end;
@@ -2783,27 +3457,48 @@ int listlen(const char *s)
     while(parselist(s)) n++;
     return n;
 }
-ICOMMAND(listlen, "s", (char *s), intret(listlen(s)));
+ICOMMAND(listlen, "t", (tagval *v),
+{
+    parsedlist *parsed = getparsedlist(*v);
+    intret(parsed ? parsed->elems.length() : listlen(forcestr(*v)));
+});
 
 void at(tagval *args, int numargs)
 {
     if(!numargs) return;
-    const char *start = args[0].getstr(), *end = start + strlen(start);
-    for(int i = 1; i < numargs; i++)
+    const char *start, *end;
+    int i = 1;
+    parsedlist *parsed = numargs > 1 ? getparsedlist(args[0]) : NULL;
+    if(parsed)
+    {
+        int pos = max(args[1].getint(), 0);
+        if(pos >= parsed->elems.length()) { commandret->setstr(newscriptstr("")); return; }
+        if(numargs == 2) { commandret->setstr(parsed->elemstr(args[0].s, pos)); return; }
+        const listelem &e = parsed->elems[pos];
+        start = &args[0].s[e.start];
+        end = &args[0].s[e.end];
+        i = 2;
+    }
+    else
+    {
+        start = args[0].getstr();
+        end = start + strlen(start);
+    }
+    for(; i < numargs; i++)
     {
         const char *list = start;
         int pos = args[i].getint();
         for(; pos > 0; pos--) if(!parselist(list)) break;
         if(pos > 0 || !parselist(list, start, end)) start = end = "";
     }
-    commandret->setstr(newstring(start, end-start));
+    commandret->setstr(newscriptstr(start, end-start));
 }
 COMMAND(at, "si1V");
 
 void substr(char *s, int *start, int *count, int *numargs)
 {
     int len = strlen(s), offset = clamp(*start, 0, len);
-    commandret->setstr(newstring(&s[offset], *numargs >= 3 ? clamp(*count, 0, len - offset) : len - offset));
+    commandret->setstr(newscriptstr(&s[offset], *numargs >= 3 ? clamp(*count, 0, len - offset) : len - offset));
 }
 COMMAND(substr, "siiN");
 
@@ -2814,7 +3509,7 @@ void chopstr(char *s, int *lim, char *ellipsis)
     {
         int elen = strlen(ellipsis);
         maxlen = max(maxlen, elen);
-        char *chopped = newstring(maxlen);
+        char *chopped = newscriptstr(maxlen);
         if(*lim < 0)
         {
             memcpy(chopped, ellipsis, elen);
@@ -2836,17 +3531,17 @@ void sublist(const char *s, int *skip, int *count, int *numargs)
 {
     int offset = max(*skip, 0), len = *numargs >= 3 ? max(*count, 0) : -1;
     loopi(offset) if(!parselist(s)) break;
-    if(len < 0) { if(offset > 0) skiplist(s); commandret->setstr(newstring(s)); return; }
+    if(len < 0) { if(offset > 0) skiplist(s); commandret->setstr(newscriptstr(s)); return; }
     const char *list = s, *start, *end, *qstart, *qend = s;
     if(len > 0 && parselist(s, start, end, list, qend)) while(--len > 0 && parselist(s, start, end, qstart, qend));
-    commandret->setstr(newstring(list, qend - list));
+    commandret->setstr(newscriptstr(list, qend - list));
 }
 COMMAND(sublist, "siiN");
 
 ICOMMAND(stripcolors, "s", (char *s),
 {
     int len = strlen(s);
-    char *d = newstring(len);
+    char *d = newscriptstr(len);
     filtertext(d, s, true, false, len);
     stringret(d);
 });
@@ -2855,7 +3550,7 @@ static inline void setiter(ident &id, char *val, identstack &stack)
 {
     if(id.stack == &stack)
     {
-        if(id.valtype == VAL_STR) delete[] id.val.s;
+        if(id.valtype == VAL_STR) freescriptstr(id.val.s);
         else id.valtype = VAL_STR;
         cleancode(id);
         id.val.s = val;
@@ -2869,64 +3564,62 @@ static inline void setiter(ident &id, char *val, identstack &stack)
     }
 }
 
-void listfind(ident *id, const char *list, const uint *body)
+void listfind(ident *id, tagval *list, const uint *body)
 {
     if(id->type!=ID_ALIAS) { intret(-1); return; }
     identstack stack;
     int n = -1;
-    for(const char *s = list, *start, *end; parselist(s, start, end);)
+    for(listwalker l(*list); l.next();)
     {
         ++n;
-        char *val = newstring(start, end-start);
-        setiter(*id, val, stack);
+        setiter(*id, l.elem(), stack);
         if(executebool(body)) { intret(n); goto found; }
     }
     intret(-1);
 found:
     if(n >= 0) poparg(*id);
 }
-COMMAND(listfind, "rse");
+COMMAND(listfind, "rte");
 
-void looplist(ident *id, const char *list, const uint *body)
+void looplist(ident *id, tagval *list, const uint *body)
 {
     if(id->type!=ID_ALIAS) return;
     identstack stack;
     int n = 0;
-    for(const char *s = list, *start, *end; parselist(s, start, end); n++)
+    for(listwalker l(*list); l.next(); n++)
     {
-        char *val = newstring(start, end-start);
-        setiter(*id, val, stack);
+        setiter(*id, l.elem(), stack);
         execute(body);
     }
     if(n) poparg(*id);
 }
-COMMAND(looplist, "rse");
+COMMAND(looplist, "rte");
 
-void loopsublist(ident *id, const char *list, int *skip, int *count, const uint *body)
+void loopsublist(ident *id, tagval *list, int *skip, int *count, const uint *body)
 {
     if(id->type!=ID_ALIAS) return;
     identstack stack;
     int n = 0, offset = max(*skip, 0), len = *count < 0 ? INT_MAX : offset + *count;
-    for(const char *s = list, *start, *end; parselist(s, start, end) && n < len; n++) if(n >= offset)
+    listwalker l(*list);
+    l.skip(offset);
+    for(; n < len - offset && l.next(); n++)
     {
-        char *val = newstring(start, end-start);
-        setiter(*id, val, stack);
+        setiter(*id, l.elem(), stack);
         execute(body);
     }
     if(n) poparg(*id);
 }
-COMMAND(loopsublist, "rsiie");
+COMMAND(loopsublist, "rtiie");
 
-void looplistconc(ident *id, const char *list, const uint *body, bool space)
+void looplistconc(ident *id, tagval *list, const uint *body, bool space)
 {
     if(id->type!=ID_ALIAS) return;
     identstack stack;
     vector<char> r;
     int n = 0;
-    for(const char *s = list, *start, *end; parselist(s, start, end); n++)
+    for(listwalker l(*list); l.next(); n++)
     {
-        char *val = newstring(start, end-start);
-        setiter(*id, val, stack);
+        setiter(*id, l.elem(), stack);
 
         if(n && space) r.add(' ');
 
@@ -2939,33 +3632,32 @@ void looplistconc(ident *id, const char *list, const uint *body, bool space)
     }
     if(n) poparg(*id);
     r.add('\0');
-    commandret->setstr(newstring(r.getbuf(), r.length()-1));
+    commandret->setstr(newscriptstr(r.getbuf(), r.length()-1));
 }
-ICOMMAND(looplistconcat, "rse", (ident *id, char *list, uint *body), looplistconc(id, list, body, true));
-ICOMMAND(looplistconcatword, "rse", (ident *id, char *list, uint *body), looplistconc(id, list, body, false));
+ICOMMAND(looplistconcat, "rte", (ident *id, tagval *list, uint *body), looplistconc(id, list, body, true));
+ICOMMAND(looplistconcatword, "rte", (ident *id, tagval *list, uint *body), looplistconc(id, list, body, false));
 
-void listfilter(ident *id, const char *list, const uint *body)
+void listfilter(ident *id, tagval *list, const uint *body)
 {
     if(id->type!=ID_ALIAS) return;
     identstack stack;
     vector<char> r;
     int n = 0;
-    for(const char *s = list, *start, *end, *quotestart, *quoteend; parselist(s, start, end, quotestart, quoteend); n++)
+    for(listwalker l(*list); l.next(); n++)
     {
-        char *val = newstring(start, end-start);
-        setiter(*id, val, stack);
+        setiter(*id, l.elem(), stack);
 
         if(executebool(body))
         {
             if(r.length()) r.add(' ');
-            r.put(quotestart, quoteend-quotestart);
+            r.put(l.quotestart, l.quoteend-l.quotestart);
         }
     }
     if(n) poparg(*id);
     r.add('\0');
-    commandret->setstr(newstring(r.getbuf(), r.length()-1));
+    commandret->setstr(newscriptstr(r.getbuf(), r.length()-1));
 }
-COMMAND(listfilter, "rse");
+COMMAND(listfilter, "rte");
 
 void prettylist(const char *s, const char *conj)
 {
@@ -3001,7 +3693,15 @@ int listincludes(const char *list, const char *needle, int needlelen)
     }
     return -1;
 }
-ICOMMAND(indexof, "ss", (char *list, char *elem), intret(listincludes(list, elem, strlen(elem))));
+ICOMMAND(indexof, "ts", (tagval *list, char *elem),
+{
+    int len = strlen(elem);
+    for(listwalker l(*list); l.next();)
+    {
+        if(len == l.end - l.start && !strncmp(elem, l.start, len)) { intret(l.index); return; }
+    }
+    intret(-1);
+});
 
 char *listdel(const char *s, const char *del)
 {
@@ -3015,7 +3715,7 @@ char *listdel(const char *s, const char *del)
         }
     }
     p.add('\0');
-    return newstring(p.getbuf(), p.length()-1);
+    return newscriptstr(p.getbuf(), p.length()-1);
 }
 ICOMMAND(listdel, "ss", (char *list, char *del), commandret->setstr(listdel(list, del)));
 
@@ -3042,7 +3742,7 @@ void listsplice(const char *s, const char *vals, int *skip, int *count)
             break;
     }
     p.add('\0');
-    commandret->setstr(newstring(p.getbuf(), p.length()-1));
+    commandret->setstr(newscriptstr(p.getbuf(), p.length()-1));
 }
 COMMAND(listsplice, "ssii");
 
@@ -3061,10 +3761,11 @@ ICOMMAND(loopfiles, "rsse", (ident *id, char *dir, char *ext, uint *body),
     }
     loopv(files)
     {
-        char *file = files[i];
+        char *file = newscriptstr(files[i]);
+        delete[] files[i];
         if(i)
         {
-            if(id->valtype == VAL_STR) delete[] id->val.s;
+            if(id->valtype == VAL_STR) freescriptstr(id->val.s);
             else id->valtype = VAL_STR;
             id->val.s = file;
         }
@@ -3122,7 +3823,8 @@ void sortlist(char *list, ident *x, ident *y, uint *body)
 
     vector<sortitem> items;
     int macrolen = strlen(list), total = 0;
-    char *macros = newstring(list, macrolen);
+    char *macros = newscriptstr(macrolen);
+    memcpy(macros, list, macrolen+1);
     const char *curlist = list, *start, *end, *quotestart, *quoteend;
     while(parselist(curlist, start, end, quotestart, quoteend))
     {
@@ -3146,8 +3848,8 @@ void sortlist(char *list, ident *x, ident *y, uint *body)
     int sortedlen = total + max(items.length() - 1, 0);
     if(macrolen < sortedlen)
     {
-        delete[] macros;
-        sorted = newstring(sortedlen);
+        freescriptstr(macros);
+        sorted = newscriptstr(sortedlen);
     }
 
     int offset = 0;
@@ -3314,7 +4016,7 @@ ICOMMAND(rnd, "ii", (int *a, int *b), intret(*a - *b > 0 ? rnd(*a - *b) + *b : *
 ICOMMAND(rndstr, "i", (int *len),
 {
     int n = clamp(*len, 0, 10000);
-    char *s = newstring(n);
+    char *s = newscriptstr(n);
     for(int i = 0; i < n;)
     {
         uint r = randomMT();
@@ -3340,9 +4042,9 @@ ICOMMAND(error, "C", (char *s), conoutf(CON_ERROR, "%s", s));
 ICOMMAND(strstr, "ss", (char *a, char *b), { char *s = strstr(a, b); intret(s ? s-a : -1); });
 ICOMMAND(strlen, "s", (char *s), intret(strlen(s)));
 ICOMMAND(strcode, "si", (char *s, int *i), intret(*i > 0 ? (memchr(s, 0, *i) ? 0 : uchar(s[*i])) : uchar(s[0])));
-ICOMMAND(codestr, "i", (int *i), { char *s = newstring(1); s[0] = char(*i); s[1] = '\0'; stringret(s); });
+ICOMMAND(codestr, "i", (int *i), { char *s = newscriptstr(1); s[0] = char(*i); s[1] = '\0'; stringret(s); });
 ICOMMAND(struni, "si", (char *s, int *i), intret(*i > 0 ? (memchr(s, 0, *i) ? 0 : cube2uni(s[*i])) : cube2uni(s[0])));
-ICOMMAND(unistr, "i", (int *i), { char *s = newstring(1); s[0] = uni2cube(*i); s[1] = '\0'; stringret(s); });
+ICOMMAND(unistr, "i", (int *i), { char *s = newscriptstr(1); s[0] = uni2cube(*i); s[1] = '\0'; stringret(s); });
 
 int naturalsort(const char *a, const char *b)
 {
@@ -3374,7 +4076,7 @@ ICOMMAND(naturalsort, "ss", (char *a, char *b), intret(naturalsort(a,b)<=0));
     ICOMMAND(name, "s", (char *s), \
     { \
         int len = strlen(s); \
-        char *m = newstring(len); \
+        char *m = newscriptstr(len); \
         loopi(len) m[i] = map(s[i]); \
         m[len] = '\0'; \
         stringret(m); \
@@ -3388,7 +4090,7 @@ char *strreplace(const char *s, const char *oldval, const char *newval)
     vector<char> buf;
 
     int oldlen = strlen(oldval);
-    if(!oldlen) return newstring(s);
+    if(!oldlen) return newscriptstr(s);
     for(;;)
     {
         const char *found = strstr(s, oldval);
@@ -3402,7 +4104,7 @@ char *strreplace(const char *s, const char *oldval, const char *newval)
         {
             while(*s) buf.add(*s++);
             buf.add('\0');
-            return newstring(buf.getbuf(), buf.length());
+            return newscriptstr(buf.getbuf(), buf.length()-1);
         }
     }
 }
@@ -3414,7 +4116,7 @@ void strsplice(const char *s, const char *vals, int *skip, int *count)
     int slen = strlen(s), vlen = strlen(vals),
         offset = clamp(*skip, 0, slen),
         len = clamp(*count, 0, slen - offset);
-    char *p = newstring(slen - len + vlen);
+    char *p = newscriptstr(slen - len + vlen);
     if(offset) memcpy(p, s, offset);
     if(vlen) memcpy(&p[offset], vals, vlen);
     if(offset + len < slen) memcpy(&p[offset + vlen], &s[offset + len], slen - (offset + len));
@@ -365,7 +365,7 @@ vector<releaseaction> releaseactions;
 
 const char *addreleaseaction(char *s)
 {
-    if(!keypressed) { delete[] s; return NULL; }
+    if(!keypressed) { freescriptstr(s); return NULL; }
     releaseaction &ra = releaseactions.add();
     ra.key = keypressed;
     ra.action = s;
@@ -374,7 +374,7 @@ const char *addreleaseaction(char *s)
 
 void onrelease(const char *s)
 {
-    addreleaseaction(newstring(s));
+    addreleaseaction(newscriptstr(s));
 }
 
 COMMAND(onrelease, "s");
@@ -387,7 +387,7 @@ void execbind(keym &k, bool isdown)
         if(ra.key==&k)
         {
             if(!isdown) execute(ra.action);
-            delete[] ra.action;
+            freescriptstr(ra.action);
             releaseactions.remove(i--);
         }
     }
@@ -86,6 +86,10 @@ extern bool reloadtexture(Texture &tex);
 extern bool reloadtexture(const char *name);
 extern void setuptexcompress();
 extern void clearslots();
+extern int preloadslottextures();
+extern void updatetexjobs();
+extern bool flushtexjobs();
+extern int gettexjobwait();
 extern void compacteditvslots();
 extern void compactmruvslots();
 extern void compactvslots(cube *c, int n = 8);
@@ -114,6 +118,9 @@ extern void guessshadowdir();
 extern void clearpvs();
 extern bool pvsoccluded(const ivec &bbmin, const ivec &bbmax);
 extern bool pvsoccludedsphere(const vec &center, float radius);
+extern bool pvsoccludedva(const vtxarray *va, bool geom);
+extern void allocpvsid(vtxarray *va);
+extern void freepvsid(int id);
 extern bool waterpvsoccluded(int height);
 extern void setviewcell(const vec &p);
 extern void savepvs(stream *f);
@@ -264,6 +271,8 @@ extern vec decodenormal(ushort norm);
 extern void guessnormals(const vec *pos, int numverts, vec *normals);
 extern void reduceslope(ivec &n);
 extern void findtjoints();
+extern void findtjoints(const ivec &bbmin, const ivec &bbmax);
+extern void queuevarebuild(const ivec &o, int size);
 extern void octarender();
 extern void allchanged(bool load = false);
 extern void clearvas(cube *c);
@@ -429,7 +438,7 @@ enum
     INIT_LOAD,
     INIT_RESET
 };
-extern int initing, numcpus;
+extern int initing, numcpus, numcores;
 
 enum
 {
@@ -473,6 +482,7 @@ extern ShadowRayCache *newshadowraycache();
 extern void freeshadowraycache(ShadowRayCache *&cache);
 extern void resetshadowraycache(ShadowRayCache *cache);
 extern float shadowray(ShadowRayCache *cache, const vec &o, const vec &ray, float radius, int mode, extentity *t = NULL);
+extern void shadowrays(ShadowRayCache *cache, int numrays, const vec *o, const vec *ray, const float *radius, int mode, float *dist, extentity *t = NULL);
 
 // world
 
@@ -2,6 +2,7 @@
 
 #define MAXLIGHTMAPTASKS 4096
 #define LIGHTMAPBUFSIZE (2*1024*1024)
+#define MAXLUMELLIGHTS 16
 
 struct lightmapinfo;
 struct lightmaptask;
@@ -25,7 +26,6 @@ struct lightmapworker
     BlendMapCache *blendmapcache;
     bool needspace, doneworking;
     SDL_cond *spacecond;
-    SDL_Thread *thread;
 
     lightmapworker();
     ~lightmapworker();
@@ -34,7 +34,7 @@ struct lightmapworker
     bool setupthread();
     void cleanupthread();
 
-    static int work(void *data);
+    static void work(void *data, int task, int thread);
 };
 
 struct lightmapinfo
@@ -68,7 +68,8 @@ static vector<lightmaptask> lightmaptasks[2];
 static vector<lightmapext> lightmapexts;
 static int packidx = 0, allocidx = 0;
 static SDL_mutex *lightlock = NULL, *tasklock = NULL;
-static SDL_cond *fullcond = NULL, *emptycond = NULL;
+static jobpool *lightjobs = NULL;
+static volatile int lightjobspending = 0;
 
 int lightmapping = 0;
 
@@ -231,7 +232,7 @@ static int lmshadows = 2, lmaa = 3, lerptjoints = 1;
 
 static uint progress = 0, taskprogress = 0;
 static GLuint progresstex = 0;
-static int progresstexticks = 0, progresslightmap = -1;
+static int progresstexticks = 0, progresslightmap = -1, progressreport = -1;
 
 bool calclight_canceled = false;
 volatile bool check_calclight_progress = false;
@@ -251,6 +252,14 @@ void show_calclight_progress()
     float bar1 = float(progress) / float(allocnodes);
     defformatstring(text1, "%d%% using %d textures", int(bar1 * 100), lightmaps.length());
 
+    if(headless)
+    {
+        // nothing to draw into, so just log every tenth of the way
+        int report = int(bar1 * 10);
+        if(report != progressreport) { progressreport = report; conoutf("calclight: %s", text1); }
+        return;
+    }
+
     if(LM_PACKW <= hwtexsize && !progresstex)
     {
         glGenTextures(1, &progresstex);
@@ -439,7 +448,7 @@ static inline uint hthash(const lightmapinfo &k)
     return hash;
 }
 
-static hashset<layoutinfo> compressed;
+static hashset<layoutinfo, openhashbase> compressed;
 
 VAR(lightcompress, 0, 3, 6);
 
@@ -516,11 +525,59 @@ static void updatelightmap(const layoutinfo &surface)
 }
 
 
+struct lumellight
+{
+    int index;
+    vec ray;
+    float radius, attenuation, angle;
+};
+
+// shadow rays of a lumel's lights are traced together as packets, then the lights are summed in their original order
+static void shadelumellights(lightmapworker *w, const vector<const extentity *> &lights, lumellight *ll, int numll, uint &lightused, float &r, float &g, float &b, vec &avgray)
+{
+    float dists[MAXLUMELLIGHTS];
+    if(lmshadows)
+    {
+        vec o[MAXLUMELLIGHTS], rays[MAXLUMELLIGHTS];
+        float radius[MAXLUMELLIGHTS];
+        loopi(numll)
+        {
+            o[i] = lights[ll[i].index]->o;
+            rays[i] = ll[i].ray;
+            radius[i] = ll[i].radius;
+        }
+        shadowrays(w->shadowraycache, numll, o, rays, radius, RAY_SHADOW | (lmshadows > 1 ? RAY_ALPHAPOLY : 0), dists);
+    }
+    loopi(numll)
+    {
+        lumellight &l = ll[i];
+        if(lmshadows && dists[i] < l.radius) continue;
+        const extentity &light = *lights[l.index];
+        lightused |= 1<<l.index;
+        float intensity;
+        switch(w->type&LM_TYPE)
+        {
+            case LM_BUMPMAP0:
+                intensity = l.attenuation;
+                avgray.add(l.ray.mul(-l.attenuation));
+                break;
+            default:
+                intensity = l.angle * l.attenuation;
+                break;
+        }
+        r += intensity * float(light.attr2);
+        g += intensity * float(light.attr3);
+        b += intensity * float(light.attr4);
+    }
+}
+
 static uint generatelumel(lightmapworker *w, const float tolerance, uint lightmask, const vector<const extentity *> &lights, const vec &target, const vec &normal, vec &sample, int x, int y)
 {
     vec avgray(0, 0, 0);
     float r = 0, g = 0, b = 0;
     uint lightused = 0;
+    lumellight ll[MAXLUMELLIGHTS];
+    int numll = 0;
     loopv(lights)
     {
         if(lightmask&(1<<i)) continue;
@@ -545,27 +602,19 @@ static uint generatelumel(lightmapworker *w, const float tolerance, uint lightma
             if(spotatten <= 0) continue;
             attenuation *= spotatten;
         }
-        if(lmshadows && mag)
+        lumellight &l = ll[numll++];
+        l.index = i;
+        l.ray = ray;
+        l.radius = mag - tolerance;
+        l.attenuation = attenuation;
+        l.angle = angle;
+        if(numll >= MAXLUMELLIGHTS)
         {
-            float dist = shadowray(w->shadowraycache, light.o, ray, mag - tolerance, RAY_SHADOW | (lmshadows > 1 ? RAY_ALPHAPOLY : 0));
-            if(dist < mag - tolerance) continue;
+            shadelumellights(w, lights, ll, numll, lightused, r, g, b, avgray);
+            numll = 0;
         }
-        lightused |= 1<<i;
-        float intensity;
-        switch(w->type&LM_TYPE)
-        {
-            case LM_BUMPMAP0:
-                intensity = attenuation;
-                avgray.add(ray.mul(-attenuation));
-                break;
-            default:
-                intensity = angle * attenuation;
-                break;
-        }
-        r += intensity * float(light.attr2);
-        g += intensity * float(light.attr3);
-        b += intensity * float(light.attr4);
     }
+    if(numll) shadelumellights(w, lights, ll, numll, lightused, r, g, b, avgray);
     if(sunlight)
     {
         float angle = sunlightdir.dot(normal);
@@ -654,9 +703,20 @@ static void calcskylight(lightmapworker *w, const vec &o, const vec &normal, flo
     flags |= RAY_SHADOW;
     if(skytexturelight) flags |= RAY_SKIPSKY | (useskytexture ? RAY_SKYTEX : 0);
     int hit = 0;
-    if(w) loopi(17)
+    if(w)
     {
-        if(normal.dot(rays[i])>=0 && shadowray(w->shadowraycache, vec(rays[i]).mul(tolerance).add(o), rays[i], 1e16f, flags, t)>1e15f) hit++;
+        vec origins[17], dirs[17];
+        float radius[17], dists[17];
+        int numrays = 0;
+        loopi(17) if(normal.dot(rays[i])>=0)
+        {
+            origins[numrays] = vec(rays[i]).mul(tolerance).add(o);
+            dirs[numrays] = rays[i];
+            radius[numrays] = 1e16f;
+            numrays++;
+        }
+        shadowrays(w->shadowraycache, numrays, origins, dirs, radius, flags, dists, t);
+        loopi(numrays) if(dists[i]>1e15f) hit++;
     }
     else loopi(17)
     {
@@ -995,33 +1055,36 @@ static int previewlightmapalpha(lightmapworker *w, float lpu, const vec &origin1
     return SURFACE_LIGHTMAP_BLEND;
 }
 
-static void clearsurfaces(cube *c)
+static void clearcubesurfaces(cube &c)
 {
-    loopi(8)
+    if(!c.ext) return;
+    loopj(6)
     {
-        if(c[i].ext)
+        surfaceinfo &surf = c.ext->surfaces[j];
+        if(!surf.used()) continue;
+        surf.clear();
+        int numverts = surf.numverts&MAXFACEVERTS;
+        if(numverts)
         {
-            loopj(6)
-            {
-                surfaceinfo &surf = c[i].ext->surfaces[j];
-                if(!surf.used()) continue;
-                surf.clear();
-                int numverts = surf.numverts&MAXFACEVERTS;
-                if(numverts)
-                {
-                    if(!(c[i].merged&(1<<j))) { surf.numverts &= ~MAXFACEVERTS; continue; }
+            if(!(c.merged&(1<<j))) { surf.numverts &= ~MAXFACEVERTS; continue; }
 
-                    vertinfo *verts = c[i].ext->verts() + surf.verts;
-                    loopk(numverts)
-                    {
-                        vertinfo &v = verts[k];
-                        v.u = 0;
-                        v.v = 0;
-                        v.norm = 0;
-                    }
-                }
+            vertinfo *verts = c.ext->verts() + surf.verts;
+            loopk(numverts)
+            {
+                vertinfo &v = verts[k];
+                v.u = 0;
+                v.v = 0;
+                v.norm = 0;
             }
         }
+    }
+}
+
+static void clearsurfaces(cube *c)
+{
+    loopi(8)
+    {
+        clearcubesurfaces(c[i]);
         if(c[i].children) clearsurfaces(c[i].children);
     }
 }
@@ -1675,30 +1738,23 @@ static lightmapinfo *setupsurfaces(lightmapworker *w, lightmaptask &task)
     return w->curlightmaps ? w->curlightmaps : (lightmapinfo *)-1;
 }
 
-int lightmapworker::work(void *data)
+// tasks are queued in order on the main thread's deque, which only ever gets stolen from the front, so each worker
+// still sees its tasks in increasing order as the lightmap buffer and the in-order packing rely on
+void lightmapworker::work(void *data, int task, int thread)
 {
-    lightmapworker *w = (lightmapworker *)data;
+    lightmapworker *w = lightmapworkers[thread-1];
     SDL_LockMutex(tasklock);
-    while(!w->doneworking)
+    if(!w->doneworking)
     {
-        if(allocidx < lightmaptasks[0].length())
-        {
-            lightmaptask &t = lightmaptasks[0][allocidx++];
-            t.worker = w;
-            SDL_UnlockMutex(tasklock);
-            lightmapinfo *l = setupsurfaces(w, t);
-            SDL_LockMutex(tasklock);
-            t.lightmaps = l;
-            packlightmaps(w);
-        }
-        else
-        {
-            if(packidx >= lightmaptasks[0].length()) SDL_CondSignal(emptycond);
-            SDL_CondWait(fullcond, tasklock);
-        }
+        lightmaptask &t = lightmaptasks[0][task];
+        t.worker = w;
+        SDL_UnlockMutex(tasklock);
+        lightmapinfo *l = setupsurfaces(w, t);
+        SDL_LockMutex(tasklock);
+        t.lightmaps = l;
+        packlightmaps(w);
     }
     SDL_UnlockMutex(tasklock);
-    return 0;
 }
 
 static bool processtasks(bool finish = false)
@@ -1712,11 +1768,13 @@ static bool processtasks(bool finish = false)
             lightmaptasks[0].setsize(0);
             lightmaptasks[0].move(lightmaptasks[1]);
             packidx = allocidx = 0;
-            if(fullcond) SDL_CondBroadcast(fullcond);
+            if(lightjobs) loopv(lightmaptasks[0]) lightjobs->add(lightjobspending, lightmapworker::work, NULL, i);
         }
         else if(lightmapping > 1)
         {
-            SDL_CondWaitTimeout(emptycond, tasklock, 250);
+            SDL_UnlockMutex(tasklock);
+            lightjobs->wait(lightjobspending, 250);
+            SDL_LockMutex(tasklock);
             CHECK_PROGRESS_LOCKED({ SDL_UnlockMutex(tasklock); return false; }, SDL_UnlockMutex(tasklock), SDL_LockMutex(tasklock));
         }
         else
@@ -1735,6 +1793,204 @@ static bool processtasks(bool finish = false)
     return true;
 }
 
+VAR(lightshards, 1, 1, 256);
+VAR(lightshard, 0, 0, 255);
+
+static int lightshardindex = -1, shardedlight = -1, shardedlightcount = 0; // shardedlight is the shard the last calclight lit, if any
+
+static inline int lighttaskfaces(cube &c, const ivec &co, int size)
+{
+    int usefacemask = 0;
+    loopj(6) if(c.texture[j] != DEFAULT_SKY && (!(c.merged&(1<<j)) || (c.ext && c.ext->surfaces[j].numverts&MAXFACEVERTS)))
+    {
+        usefacemask |= visibletris(c, j, co, size)<<(4*j);
+    }
+    return usefacemask;
+}
+
+// lighting changes since the last calclight, so that relight only has to redo the lightmaps they can reach
+#define MAXLIGHTCHANGES 256
+
+struct lightchange
+{
+    ivec bbmin, bbmax;
+    bool geometry;
+};
+
+static vector<lightchange> lightchanges, relightregions;
+static bool relighting = false;
+
+static inline bool lightboxoverlap(const ivec &amin, const ivec &amax, const ivec &bmin, const ivec &bmax)
+{
+    return amin.x < bmax.x && amax.x > bmin.x && amin.y < bmax.y && amax.y > bmin.y && amin.z < bmax.z && amax.z > bmin.z;
+}
+
+static void lightbounds(const extentity &light, ivec &bbmin, ivec &bbmax)
+{
+    int radius = light.attr1;
+    if(!radius) { bbmin = ivec(0, 0, 0); bbmax = ivec(worldsize, worldsize, worldsize); return; }
+    bbmin = ivec(vec(light.o).sub(radius)).max(0);
+    bbmax = ivec(vec(light.o).add(radius + 1)).min(worldsize);
+}
+
+void addlightchange(const ivec &bbmin, const ivec &bbmax, bool geometry)
+{
+    ivec lo = ivec(bbmin).max(0), hi = ivec(bbmax).min(worldsize);
+    if(lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) return;
+    // dragging things around produces a trail of overlapping changes, so grow those into one box
+    loopv(lightchanges)
+    {
+        lightchange &c = lightchanges[i];
+        if(c.geometry != geometry || !lightboxoverlap(lo, hi, c.bbmin, c.bbmax)) continue;
+        c.bbmin.min(lo);
+        c.bbmax.max(hi);
+        return;
+    }
+    if(lightchanges.length() >= MAXLIGHTCHANGES)
+    {
+        lightchange &c = lightchanges.last();
+        c.bbmin.min(lo);
+        c.bbmax.max(hi);
+        c.geometry = c.geometry || geometry;
+        return;
+    }
+    lightchange &c = lightchanges.add();
+    c.bbmin = lo;
+    c.bbmax = hi;
+    c.geometry = geometry;
+}
+
+void lightentchanged(const extentity &e)
+{
+    const extentity *light = e.type == ET_SPOTLIGHT ? e.attached : &e;
+    if(!light || light->type != ET_LIGHT) return;
+    ivec bbmin, bbmax;
+    lightbounds(*light, bbmin, bbmax);
+    addlightchange(bbmin, bbmax, false);
+}
+
+void clearlightchanges()
+{
+    lightchanges.setsize(0);
+}
+
+// a light change only reaches its own radius, but changed geometry also changes the shadows of every light
+// overlapping it, and of the sun and sky for everything underneath
+static void expandlightchange(const lightchange &c)
+{
+    relightregions.add(c);
+    if(!c.geometry) return;
+    const vector<extentity *> &ents = entities::getents();
+    loopv(ents)
+    {
+        const extentity &e = *ents[i];
+        if(e.type != ET_LIGHT) continue;
+        lightchange r;
+        lightbounds(e, r.bbmin, r.bbmax);
+        r.geometry = false;
+        if(lightboxoverlap(c.bbmin, c.bbmax, r.bbmin, r.bbmax)) relightregions.add(r);
+    }
+    if(sunlight)
+    {
+        vec away = vec(sunlightdir).mul(-2*worldsize);
+        lightchange r = c;
+        r.bbmin.min(ivec(vec(c.bbmin).add(away)));
+        r.bbmax.max(ivec(vec(c.bbmax).add(away)).add(1));
+        relightregions.add(r);
+    }
+    if(hasskylight())
+    {
+        // sky rays are at least 50 degrees above the horizon, so they never reach out further than down
+        lightchange r = c;
+        r.bbmin.x -= c.bbmax.z;
+        r.bbmin.y -= c.bbmax.z;
+        r.bbmin.z = 0;
+        r.bbmax.x += c.bbmax.z;
+        r.bbmax.y += c.bbmax.z;
+        relightregions.add(r);
+    }
+}
+
+// merged faces are lit by the cube that owns them, so their whole merged extent has to count
+static bool relightcube(cube &c, const ivec &co, int size)
+{
+    ivec bbmin(co), bbmax = ivec(co).add(size);
+    if(c.ext && c.merged) loopj(6) if(c.merged&(1<<j))
+    {
+        const surfaceinfo &surf = c.ext->surfaces[j];
+        int numverts = surf.numverts&MAXFACEVERTS;
+        if(!numverts) continue;
+        ivec mo(co);
+        int msz = 1<<calcmergedsize(j, mo, size, c.ext->verts() + surf.verts, numverts);
+        mo.mask(~(msz-1));
+        bbmin.min(mo);
+        bbmax.max(ivec(mo).add(msz));
+    }
+    loopv(relightregions) if(lightboxoverlap(bbmin, bbmax, relightregions[i].bbmin, relightregions[i].bbmax)) return true;
+    return false;
+}
+
+// a relit surface can't hand its lumels back to the page it was packed into, so relight empties every page
+// such a surface is on and relights everything else on those pages as well, repacking them from scratch
+static vector<uchar> relightpages;
+
+static bool onrelightpage(const cube &c)
+{
+    if(c.ext) loopj(6) loopk(2)
+    {
+        int lmid = c.ext->surfaces[j].lmid[k] - LMID_RESERVED;
+        if(relightpages.inrange(lmid) && relightpages[lmid]) return true;
+    }
+    return false;
+}
+
+static inline bool relightsurfaces(cube &c, const ivec &co, int size)
+{
+    return relightcube(c, co, size) || onrelightpage(c);
+}
+
+static bool markrelightpages(cube *c, const ivec &co, int size)
+{
+    bool marked = false;
+    loopi(8)
+    {
+        ivec o(i, co, size);
+        if(c[i].children) { if(markrelightpages(c[i].children, o, size>>1)) marked = true; }
+        else if(c[i].ext && !isempty(c[i]) && relightsurfaces(c[i], o, size)) loopj(6) loopk(2)
+        {
+            int lmid = c[i].ext->surfaces[j].lmid[k] - LMID_RESERVED;
+            if(!lightmaps.inrange(lmid)) continue;
+            // the directions of a bumpmap live on the page right after its colors
+            if((lightmaps[lmid].type&LM_TYPE) == LM_BUMPMAP1) lmid--;
+            loopl((lightmaps[lmid].type&LM_TYPE) == LM_BUMPMAP0 ? 2 : 1) if(!relightpages[lmid+l])
+            {
+                relightpages[lmid+l] = 1;
+                marked = true;
+            }
+        }
+    }
+    return marked;
+}
+
+static void emptyrelightpages()
+{
+    relightpages.setsize(0);
+    loopv(lightmaps) relightpages.add(0);
+    // marking a page pulls in the rest of its cubes, which may sit on other pages too
+    while(markrelightpages(worldroot, ivec(0, 0, 0), worldsize>>1));
+    loopv(relightpages) if(relightpages[i])
+    {
+        LightMap &lm = lightmaps[i];
+        lm.packroot.clear();
+        lm.packroot.available = min(lm.packroot.w, lm.packroot.h);
+        lm.lightmaps = lm.lumels = 0;
+        lm.unlitx = lm.unlity = -1;
+        memset(lm.data, 0, lm.bpp*LM_PACKW*LM_PACKH);
+    }
+    // lightmaps shared through the dedupe table may have been on the emptied pages
+    compressed.clear();
+}
+
 static void generatelightmaps(cube *c, const ivec &co, int size)
 {
     CHECK_PROGRESS(return);
@@ -1748,7 +2004,12 @@ static void generatelightmaps(cube *c, const ivec &co, int size)
             generatelightmaps(c[i].children, o, size >> 1);
         else if(!isempty(c[i]))
         {
-            if(c[i].ext)
+            if(relighting)
+            {
+                if(!relightsurfaces(c[i], o, size)) goto nextcube;
+                clearcubesurfaces(c[i]);
+            }
+            else if(c[i].ext)
             {
                 loopj(6)
                 {
@@ -1757,13 +2018,10 @@ static void generatelightmaps(cube *c, const ivec &co, int size)
                     surf.clear();
                 }
             }
-            int usefacemask = 0;
-            loopj(6) if(c[i].texture[j] != DEFAULT_SKY && (!(c[i].merged&(1<<j)) || (c[i].ext && c[i].ext->surfaces[j].numverts&MAXFACEVERTS)))
-            {
-                usefacemask |= visibletris(c[i], j, o, size)<<(4*j);
-            }
+            int usefacemask = lighttaskfaces(c[i], o, size);
             if(usefacemask)
             {
+                if(lightshardindex >= 0 && lightshardindex++%lightshards != lightshard) goto nextcube;
                 lightmaptask &t = lightmaptasks[1].add();
                 t.o = o;
                 t.size = size;
@@ -1980,6 +2238,7 @@ void resetlightmaps(bool fullclean)
     lightmaps.shrink(0);
     compressed.clear();
     clearlightcache();
+    shardedlight = -1;
     if(fullclean) while(lightmapworkers.length()) delete lightmapworkers.pop();
 }
 
@@ -1996,7 +2255,6 @@ lightmapworker::lightmapworker()
     blendmapcache = newblendmapcache();
     needspace = doneworking = false;
     spacecond = NULL;
-    thread = NULL;
 }
 
 lightmapworker::~lightmapworker()
@@ -2014,7 +2272,6 @@ lightmapworker::~lightmapworker()
 void lightmapworker::cleanupthread()
 {
     if(spacecond) { SDL_DestroyCond(spacecond); spacecond = NULL; }
-    thread = NULL;
 }
 
 void lightmapworker::reset()
@@ -2028,9 +2285,7 @@ void lightmapworker::reset()
 bool lightmapworker::setupthread()
 {
     if(!spacecond) spacecond = SDL_CreateCond();
-    if(!spacecond) return false;
-    thread = SDL_CreateThread(work, "lightmap worker", this);
-    return thread!=NULL;
+    return spacecond!=NULL;
 }
 
 static Uint32 calclighttimer(Uint32 interval, void *param)
@@ -2051,7 +2306,7 @@ bool setlightmapquality(int quality)
     return true;
 }
 
-VARP(lightthreads, 0, 0, 16);
+VARP(lightthreads, 0, 0, 256);
 
 #define ALLOCLOCK(name, init) { if(lightmapping > 1) name = init(); if(!name) lightmapping = 1; }
 #define FREELOCK(name, destroy) { if(name) { destroy(name); name = NULL; } }
@@ -2060,8 +2315,6 @@ static void cleanuplocks()
 {
     FREELOCK(lightlock, SDL_DestroyMutex);
     FREELOCK(tasklock, SDL_DestroyMutex);
-    FREELOCK(fullcond, SDL_DestroyCond);
-    FREELOCK(emptycond, SDL_DestroyCond);
 }
 
 static void setupthreads(int numthreads)
@@ -2074,8 +2327,6 @@ static void setupthreads(int numthreads)
     {
         ALLOCLOCK(lightlock, SDL_CreateMutex);
         ALLOCLOCK(tasklock, SDL_CreateMutex);
-        ALLOCLOCK(fullcond, SDL_CreateCond);
-        ALLOCLOCK(emptycond, SDL_CreateCond);
     }
     while(lightmapworkers.length() < lightmapping) lightmapworkers.add(new lightmapworker);
     loopi(lightmapping)
@@ -2084,9 +2335,15 @@ static void setupthreads(int numthreads)
         w->reset();
         if(lightmapping <= 1 || w->setupthread()) continue;
         w->cleanupthread();
-        lightmapping = i >= 1 ? max(i, 2) : 1;
+        lightmapping = max(i, 1);
         break;
     }
+    if(lightmapping > 1)
+    {
+        lightjobs = new jobpool(lightmapping);
+        lightmapping = lightjobs->numworkers;
+        if(lightmapping <= 1) { DELETEP(lightjobs); lightmapping = 1; }
+    }
     if(lightmapping <= 1) cleanuplocks();
 }
 
@@ -2096,19 +2353,15 @@ static void cleanupthreads()
     if(lightmapping > 1)
     {
         SDL_LockMutex(tasklock);
-        loopv(lightmapworkers) lightmapworkers[i]->doneworking = true;
-        SDL_CondBroadcast(fullcond);
         loopv(lightmapworkers)
         {
             lightmapworker *w = lightmapworkers[i];
+            w->doneworking = true;
             if(w->needspace && w->spacecond) SDL_CondSignal(w->spacecond);
         }
         SDL_UnlockMutex(tasklock);
-        loopv(lightmapworkers)
-        {
-            lightmapworker *w = lightmapworkers[i];
-            if(w->thread) SDL_WaitThread(w->thread, NULL);
-        }
+        while(!lightjobs->wait(lightjobspending, 250));
+        DELETEP(lightjobs);
     }
     loopv(lightmapexts)
     {
@@ -2127,16 +2380,23 @@ void calclight(int *quality)
         conoutf(CON_ERROR, "valid range for calclight quality is -1..1");
         return;
     }
+    if(lightshard >= lightshards)
+    {
+        conoutf(CON_ERROR, "lightshard must be less than lightshards");
+        return;
+    }
     renderbackground("computing lightmaps... (esc to abort)");
     mpremip(true);
     optimizeblendmap();
     loadlayermasks();
-    int numthreads = lightthreads > 0 ? lightthreads : numcpus;
+    int numthreads = lightthreads > 0 ? lightthreads : numcores;
     if(numthreads > 1) preloadusedmapmodels(false, true);
     resetlightmaps(false);
     clearsurfaces(worldroot);
+    clearlightchanges();
     taskprogress = progress = 0;
     progresstexticks = 0;
+    progressreport = -1;
     progresslightmap = -1;
     calclight_canceled = false;
     check_calclight_progress = false;
@@ -2145,7 +2405,10 @@ void calclight(int *quality)
     calcnormals(lerptjoints > 0);
     show_calclight_progress();
     setupthreads(numthreads);
+    int usedthreads = lightmapping;
+    lightshardindex = lightshards > 1 ? 0 : -1;
     generatelightmaps(worldroot, ivec(0, 0, 0), worldsize >> 1);
+    lightshardindex = -1;
     cleanupthreads();
     clearnormals();
     Uint32 end = SDL_GetTicks();
@@ -2165,32 +2428,234 @@ void calclight(int *quality)
     if(calclight_canceled)
         conoutf("calclight aborted");
     else
-        conoutf("generated %d lightmaps using %d%% of %d textures (%.1f seconds)",
+        conoutf("generated %d lightmaps using %d%% of %d textures (%.1f seconds, %d %s)",
             total,
             lightmaps.length() ? lumels * 100 / (lightmaps.length() * LM_PACKW * LM_PACKH) : 0,
             lightmaps.length(),
-            (end - start) / 1000.0f);
+            (end - start) / 1000.0f,
+            usedthreads, usedthreads > 1 ? "threads" : "thread");
+    if(lightshards > 1 && !calclight_canceled)
+    {
+        shardedlight = lightshard;
+        shardedlightcount = lightshards;
+        conoutf("only lit shard %d of %d, use savelightshard to keep it", lightshard, lightshards);
+    }
 }
 
 COMMAND(calclight, "i");
 
-VAR(patchnormals, 0, 0, 1);
+// calclight can be split into shards that separate processes light, each lighting every lightshards-th cube
+// in octree order; savelightshard writes out a shard's lightmaps and surfaces and mergelightshards puts them
+// back together on the same map
 
-void patchlight(int *quality)
+#define LIGHTSHARDVERSION 1
+
+static void findlightshard(cube *c, const ivec &co, int size, int &index, int shard, int numshards, vector<cube *> &cubes)
 {
-    if(noedit(true)) return;
-    if(!setlightmapquality(*quality))
+    loopi(8)
     {
-        conoutf(CON_ERROR, "valid range for patchlight quality is -1..1");
-        return;
+        ivec o(i, co, size);
+        if(c[i].children) findlightshard(c[i].children, o, size>>1, index, shard, numshards, cubes);
+        else if(!isempty(c[i]) && lighttaskfaces(c[i], o, size) && index++%numshards == shard) cubes.add(&c[i]);
+    }
+}
+
+static int surfaceverts(const cube &c)
+{
+    int numverts = 0;
+    if(c.ext) loopi(6)
+    {
+        const surfaceinfo &surf = c.ext->surfaces[i];
+        if(surf.used()) numverts = max(numverts, surf.verts + surf.totalverts());
+    }
+    return numverts;
+}
+
+void savelightshard(const char *name)
+{
+    if(shardedlight < 0) { conoutf(CON_ERROR, "no lightmap shard was generated"); return; }
+    if(!*name) { conoutf(CON_ERROR, "no lightmap shard file given"); return; }
+    stream *f = opengzfile(path(name, true), "wb");
+    if(!f) { conoutf(CON_ERROR, "could not write lightmap shard %s", name); return; }
+    vector<cube *> cubes;
+    int index = 0;
+    findlightshard(worldroot, ivec(0, 0, 0), worldsize>>1, index, shardedlight, shardedlightcount, cubes);
+    f->write("LMSH", 4);
+    f->putlil<int>(LIGHTSHARDVERSION);
+    f->putlil<int>(worldsize);
+    f->putlil<int>(shardedlight);
+    f->putlil<int>(shardedlightcount);
+    f->putlil<int>(cubes.length());
+    f->putlil<int>(lightmaps.length());
+    loopv(lightmaps)
+    {
+        LightMap &lm = lightmaps[i];
+        f->putchar(lm.type);
+        f->putchar(lm.bpp);
+        f->putlil<short>(lm.unlitx);
+        f->putlil<short>(lm.unlity);
+        f->write(lm.data, lm.bpp*LM_PACKW*LM_PACKH);
+    }
+    loopv(cubes)
+    {
+        cube &c = *cubes[i];
+        int numverts = surfaceverts(c);
+        f->putlil<ushort>(c.ext ? numverts : USHRT_MAX);
+        if(!c.ext) continue;
+        loopj(6)
+        {
+            const surfaceinfo &surf = c.ext->surfaces[j];
+            f->putchar(surf.lmid[0]);
+            f->putchar(surf.lmid[1]);
+            f->putchar(surf.verts);
+            f->putchar(surf.numverts);
+        }
+        const vertinfo *verts = c.ext->verts();
+        loopj(numverts)
+        {
+            const vertinfo &v = verts[j];
+            f->putlil<ushort>(v.x); f->putlil<ushort>(v.y); f->putlil<ushort>(v.z);
+            f->putlil<ushort>(v.u); f->putlil<ushort>(v.v); f->putlil<ushort>(v.norm);
+        }
+    }
+    delete f;
+    conoutf("saved lightmap shard %d of %d to %s (%d cubes, %d lightmaps)", shardedlight, shardedlightcount, name, cubes.length(), lightmaps.length());
+}
+
+COMMAND(savelightshard, "s");
+
+struct lightshardfile
+{
+    const char *name;
+    stream *f;
+    int numcubes, numlms;
+};
+
+// reads the rest of a shard whose header mergelightshards already checked
+static bool loadlightshard(lightshardfile &s, int shard, int numshards)
+{
+    stream *f = s.f;
+    const char *name = s.name;
+    vector<cube *> cubes;
+    int index = 0;
+    findlightshard(worldroot, ivec(0, 0, 0), worldsize>>1, index, shard, numshards, cubes);
+    if(cubes.length() != s.numcubes)
+    {
+        conoutf(CON_ERROR, "lightmap shard %s does not match this map", name);
+        return false;
+    }
+    if(LMID_RESERVED + lightmaps.length() + s.numlms > 256)
+    {
+        conoutf(CON_ERROR, "too many lightmaps to merge %s", name);
+        return false;
+    }
+    int offset = lightmaps.length();
+    loopi(s.numlms)
+    {
+        LightMap &lm = lightmaps.add();
+        lm.type = f->getchar();
+        lm.bpp = f->getchar();
+        lm.unlitx = f->getlil<short>();
+        lm.unlity = f->getlil<short>();
+        lm.data = new uchar[lm.bpp*LM_PACKW*LM_PACKH];
+        f->read(lm.data, lm.bpp*LM_PACKW*LM_PACKH);
+        lm.finalize();
+    }
+    surfaceinfo surfs[6];
+    vertinfo verts[6*2*MAXFACEVERTS];
+    loopv(cubes)
+    {
+        int numverts = f->getlil<ushort>();
+        if(numverts == USHRT_MAX) continue;
+        if(numverts > int(sizeof(verts)/sizeof(verts[0]))) { conoutf(CON_ERROR, "lightmap shard %s is corrupt", name); return false; }
+        loopj(6)
+        {
+            surfaceinfo &surf = surfs[j];
+            loopk(2)
+            {
+                surf.lmid[k] = f->getchar();
+                if(surf.lmid[k] >= LMID_RESERVED) surf.lmid[k] += offset;
+            }
+            surf.verts = f->getchar();
+            surf.numverts = f->getchar();
+        }
+        loopj(numverts)
+        {
+            vertinfo &v = verts[j];
+            v.x = f->getlil<ushort>(); v.y = f->getlil<ushort>(); v.z = f->getlil<ushort>();
+            v.u = f->getlil<ushort>(); v.v = f->getlil<ushort>(); v.norm = f->getlil<ushort>();
+        }
+        setsurfaces(*cubes[i], surfs, verts, numverts);
+    }
+    return true;
+}
+
+void mergelightshards(tagval *args, int numargs)
+{
+    if(!numargs) return;
+    // the files must be exactly the shards 0..numargs-1 of one split, in any order, before anything is replaced
+    lightshardfile *shards = new lightshardfile[numargs];
+    memset(shards, 0, numargs*sizeof(lightshardfile));
+    bool failed = false;
+    loopi(numargs)
+    {
+        const char *name = args[i].getstr();
+        stream *f = opengzfile(path(name, true), "rb");
+        if(!f) { conoutf(CON_ERROR, "could not read lightmap shard %s", name); failed = true; break; }
+        char magic[4];
+        int version = f->read(magic, 4) == 4 && !memcmp(magic, "LMSH", 4) ? f->getlil<int>() : -1,
+            size = f->getlil<int>(), shard = f->getlil<int>(), count = f->getlil<int>(), numcubes = f->getlil<int>(), numlms = f->getlil<int>();
+        if(version != LIGHTSHARDVERSION || size != worldsize || count != numargs || shard < 0 || shard >= numargs || shards[shard].f)
+        {
+            conoutf(CON_ERROR, "lightmap shard %s does not match this map or the other shards", name);
+            delete f;
+            failed = true;
+            break;
+        }
+        lightshardfile &s = shards[shard];
+        s.name = name;
+        s.f = f;
+        s.numcubes = numcubes;
+        s.numlms = numlms;
+    }
+    if(!failed)
+    {
+        renderbackground("merging lightmap shards...");
+        resetlightmaps(false);
+        clearsurfaces(worldroot);
+        clearlightchanges();
+        loopi(numargs)
+        {
+            renderprogress(float(i)/numargs, "merging lightmap shards...");
+            if(!loadlightshard(shards[i], i, numargs)) { failed = true; break; }
+        }
+        if(failed)
+        {
+            resetlightmaps(false);
+            clearsurfaces(worldroot);
+        }
+        initlights();
+        allchanged();
+        if(!failed) conoutf("merged %d lightmap shards into %d textures", numargs, lightmaps.length());
     }
-    renderbackground("patching lightmaps... (esc to abort)");
+    loopi(numargs) if(shards[i].f) delete shards[i].f;
+    delete[] shards;
+}
+
+COMMAND(mergelightshards, "V");
+
+VAR(patchnormals, 0, 0, 1);
+
+static void patchlightmaps(bool normals)
+{
+    renderbackground(relighting ? "relighting lightmaps... (esc to abort)" : "patching lightmaps... (esc to abort)");
     loadlayermasks();
-    int numthreads = lightthreads > 0 ? lightthreads : numcpus;
+    int numthreads = lightthreads > 0 ? lightthreads : numcores;
     if(numthreads > 1) preloadusedmapmodels(false, true);
     cleanuplightmaps();
     taskprogress = progress = 0;
     progresstexticks = 0;
+    progressreport = -1;
     progresslightmap = -1;
     int total = 0, lumels = 0;
     loopv(lightmaps)
@@ -2202,14 +2667,15 @@ void patchlight(int *quality)
     calclight_canceled = false;
     check_calclight_progress = false;
     SDL_TimerID timer = SDL_AddTimer(250, calclighttimer, NULL);
-    if(patchnormals) renderprogress(0, "computing normals...");
+    if(normals) renderprogress(0, "computing normals...");
     Uint32 start = SDL_GetTicks();
-    if(patchnormals) calcnormals(lerptjoints > 0);
+    if(normals) calcnormals(lerptjoints > 0);
     show_calclight_progress();
     setupthreads(numthreads);
     generatelightmaps(worldroot, ivec(0, 0, 0), worldsize >> 1);
     cleanupthreads();
-    if(patchnormals) clearnormals();
+    if(relighting) loopv(relightpages) if(relightpages[i]) insertunlit(i);
+    if(normals) clearnormals();
     Uint32 end = SDL_GetTicks();
     if(timer) SDL_RemoveTimer(timer);
     loopv(lightmaps)
@@ -2221,17 +2687,51 @@ void patchlight(int *quality)
     renderbackground("lighting done...");
     allchanged();
     if(calclight_canceled)
-        conoutf("patchlight aborted");
+        conoutf("%s aborted", relighting ? "relight" : "patchlight");
     else
-        conoutf("patched %d lightmaps using %d%% of %d textures (%.1f seconds)",
+        conoutf("%s %d lightmaps using %d%% of %d textures (%.1f seconds)",
+            relighting ? "relit" : "patched",
             total,
             lightmaps.length() ? lumels * 100 / (lightmaps.length() * LM_PACKW * LM_PACKH) : 0,
             lightmaps.length(),
             (end - start) / 1000.0f);
 }
 
+void patchlight(int *quality)
+{
+    if(noedit(true)) return;
+    if(!setlightmapquality(*quality))
+    {
+        conoutf(CON_ERROR, "valid range for patchlight quality is -1..1");
+        return;
+    }
+    patchlightmaps(patchnormals != 0);
+}
+
 COMMAND(patchlight, "i");
 
+// relights just what changed since the last calclight, along with whatever shares lightmap pages with it
+void relight(int *quality)
+{
+    if(noedit(true)) return;
+    if(!setlightmapquality(*quality))
+    {
+        conoutf(CON_ERROR, "valid range for relight quality is -1..1");
+        return;
+    }
+    if(lightchanges.empty()) { conoutf("lighting has not changed since the last calclight"); return; }
+    loopv(lightchanges) expandlightchange(lightchanges[i]);
+    relighting = true;
+    emptyrelightpages();
+    patchlightmaps(true);
+    relighting = false;
+    relightregions.setsize(0);
+    relightpages.setsize(0);
+    if(!calclight_canceled) clearlightchanges();
+}
+
+COMMAND(relight, "i");
+
 void clearlightmaps()
 {
     if(noedit(true)) return;
@@ -92,6 +92,9 @@ extern void clearlights();
 extern void initlights();
 extern void lightents(bool force = false);
 extern void clearlightcache(int id = -1);
+extern void addlightchange(const ivec &bbmin, const ivec &bbmax, bool geometry = true);
+extern void lightentchanged(const extentity &e);
+extern void clearlightchanges();
 extern void resetlightmaps(bool fullclean = true);
 extern void brightencube(cube &c);
 extern void setsurfaces(cube &c, const surfaceinfo *surfs, const vertinfo *verts, int numverts);
@@ -23,6 +23,7 @@ void cleanup()
     extern void clear_command(); clear_command();
     extern void clear_console(); clear_console();
     extern void clear_mdls();    clear_mdls();
+    extern void clear_texjobs(); clear_texjobs();
     extern void clear_sound();   clear_sound();
     closelogfile();
     #ifdef __APPLE__
@@ -1181,6 +1182,7 @@ int getclockmillis()
 }
 
 VAR(numcpus, 1, 1, 16);
+VAR(numcores, 1, 1, 1024); // numcpus without the clamp, only calclight and genpvs scale far enough to use it
 
 int main(int argc, char **argv)
 {
@@ -1249,12 +1251,14 @@ int main(int argc, char **argv)
     }
     initing = NOT_INITING;
 
-    numcpus = clamp(SDL_GetCPUCount(), 1, 16);
+    numcores = max(SDL_GetCPUCount(), 1);
+    numcpus = min(numcores, 16);
 
     if(dedicated <= 1)
     {
         logoutf("init: sdl");
-        if(SDL_Init(SDL_INIT_TIMER|SDL_INIT_VIDEO|SDL_INIT_AUDIO)<0) fatal("Unable to initialize SDL: %s", SDL_GetError());
+        // headless clients don't need a display, so they can run on machines without one
+        if(SDL_Init(SDL_INIT_TIMER|(headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO|SDL_INIT_AUDIO))<0) fatal("Unable to initialize SDL: %s", SDL_GetError());
 
 #ifdef SDL_VIDEO_DRIVER_X11
         SDL_version version;
@@ -1399,6 +1403,8 @@ int main(int argc, char **argv)
 
         if(minimized || headless) continue;
 
+        updatetexjobs();
+
         inbetweenframes = false;
         if(mainmenu) gl_drawmainmenu();
         else gl_drawframe();
@@ -10,6 +10,11 @@
 #include <signal.h>
 #include <enet/time.h>
 
+#ifdef __linux__
+#define USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #define INPUT_LIMIT 4096
 #define OUTPUT_LIMIT (64*1024)
 #define CLIENT_TIME (3*60*1000)
@@ -23,6 +28,9 @@
 #define KEEPALIVE_TIME (65*60*1000)
 #define SERVER_LIMIT 4096
 #define SERVER_DUP_LIMIT 10
+#define ACCEPT_LIMIT 64
+#define EVENT_LIMIT 256
+#define SWEEP_TIME 1000
 
 FILE *logfile = NULL;
 
@@ -49,17 +57,17 @@ void clearusers()
 }
 COMMAND(clearusers, "");
 
-vector<ipmask> bans, servbans, gbans;
+ipmaskset bans, servbans, gbans;
 
 void clearbans()
 {
-    bans.shrink(0);
-    servbans.shrink(0);
-    gbans.shrink(0);
+    bans.clear();
+    servbans.clear();
+    gbans.clear();
 }
 COMMAND(clearbans, "");
 
-void addban(vector<ipmask> &bans, const char *name)
+void addban(ipmaskset &bans, const char *name)
 {
     ipmask ban;
     ban.parse(name);
@@ -69,10 +77,19 @@ ICOMMAND(ban, "s", (char *name), addban(bans, name));
 ICOMMAND(servban, "s", (char *name), addban(servbans, name));
 ICOMMAND(gban, "s", (char *name), addban(gbans, name));
 
-bool checkban(vector<ipmask> &bans, enet_uint32 host)
+void delban(ipmaskset &bans, const char *name)
+{
+    ipmask ban;
+    ban.parse(name);
+    bans.remove(ban);
+}
+ICOMMAND(unban, "s", (char *name), delban(bans, name));
+ICOMMAND(unservban, "s", (char *name), delban(servbans, name));
+ICOMMAND(ungban, "s", (char *name), delban(gbans, name));
+
+bool checkban(ipmaskset &bans, enet_uint32 host)
 {
-    loopv(bans) if(bans[i].check(host)) return true;
-    return false;
+    return bans.check(host);
 }
 
 struct authreq
@@ -91,6 +108,7 @@ struct gameserver
 };
 vector<gameserver *> gameservers;
 
+// serialized list shared by every client it is queued on, never modified once built and freed when the last reference is sent
 struct messagebuf
 {
     vector<messagebuf *> &owner;
@@ -107,17 +125,6 @@ struct messagebuf
     {
         return buf.length() == m.buf.length() && !memcmp(buf.getbuf(), m.buf.getbuf(), buf.length());
     }
-
-    bool endswith(const messagebuf &m) const
-    {
-        return buf.length() >= m.buf.length() && !memcmp(&buf[buf.length() - m.buf.length()], m.buf.getbuf(), m.buf.length());
-    }
-
-    void concat(const messagebuf &m)
-    {
-        if(buf.length() && buf.last() == '\0') buf.pop();
-        buf.put(m.buf.getbuf(), m.buf.length());
-    }
 };
 vector<messagebuf *> gameserverlists, gbanlists;
 bool updateserverlist = true;
@@ -127,7 +134,7 @@ struct client
     ENetAddress address;
     ENetSocket socket;
     char input[INPUT_LIMIT];
-    messagebuf *message;
+    vector<messagebuf *> messages;
     vector<char> output;
     int inputpos, outputpos;
     enet_uint32 connecttime, lastinput;
@@ -136,13 +143,48 @@ struct client
     vector<authreq> authreqs;
     bool shouldpurge;
     bool registeredserver;
+    int events;
+    bool changed;
 
-    client() : message(NULL), inputpos(0), outputpos(0), servport(-1), lastauth(0), shouldpurge(false), registeredserver(false) {}
+    client() : inputpos(0), outputpos(0), servport(-1), lastauth(0), shouldpurge(false), registeredserver(false), events(0), changed(false) {}
+
+    bool haspending() const { return output.length() || messages.length(); }
+
+    void addmessage(messagebuf *m)
+    {
+        m->refs++;
+        messages.add(m);
+    }
 };
 vector<client *> clients;
 
 ENetSocket serversocket = ENET_SOCKET_NULL;
 
+#ifdef USE_EPOLL
+int epollfd = -1;
+
+void watchsocket(ENetSocket sock, void *data, int events, int op = EPOLL_CTL_ADD)
+{
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = data;
+    epoll_ctl(epollfd, op, sock, &ev);
+}
+
+// clients that got output outside of their own events, and so may need to wait for writability
+vector<client *> changedclients;
+#endif
+
+void markclient(client &c)
+{
+#ifdef USE_EPOLL
+    if(c.changed) return;
+    c.changed = true;
+    changedclients.add(&c);
+#endif
+}
+
 time_t starttime;
 enet_uint32 servtime = 0;
 
@@ -165,7 +207,10 @@ void conoutfv(int type, const char *fmt, va_list args)
 void purgeclient(int n)
 {
     client &c = *clients[n];
-    if(c.message) c.message->purge();
+    loopv(c.messages) c.messages[i]->purge();
+#ifdef USE_EPOLL
+    if(c.changed) changedclients.removeobj(&c);
+#endif
     enet_socket_destroy(c.socket);
     delete clients[n];
     clients.remove(n);
@@ -175,6 +220,7 @@ void output(client &c, const char *msg, int len = 0)
 {
     if(!len) len = strlen(msg);
     c.output.put(msg, len);
+    markclient(c);
 }
 
 void outputf(client &c, const char *fmt, ...)
@@ -221,6 +267,12 @@ void setupserver(int port, const char *ip = NULL)
         fatal("failed to make server socket non-blocking");
     if(!setuppingsocket(&address))
         fatal("failed to create ping socket");
+#ifdef USE_EPOLL
+    epollfd = epoll_create1(0);
+    if(epollfd < 0) fatal("failed to create epoll instance");
+    watchsocket(serversocket, &serversocket, EPOLLIN);
+    watchsocket(pingsocket, &pingsocket, EPOLLIN);
+#endif
 
     enet_time_set(0);
 
@@ -255,9 +307,11 @@ void gengbanlist()
     l->buf.put(header, strlen(header));
     string cmd = "addgban ";
     int cmdlen = strlen(cmd);
-    loopv(gbans)
+    vector<ipmask> masks;
+    gbans.getmasks(masks);
+    loopv(masks)
     {
-        ipmask &b = gbans[i];
+        ipmask &b = masks[i];
         l->buf.put(cmd, cmdlen + b.print(&cmd[cmdlen])); 
         l->buf.add('\n');
     }
@@ -268,20 +322,12 @@ void gengbanlist()
     }
     while(gbanlists.length() && gbanlists.last()->refs<=0)
         delete gbanlists.pop();
-    loopv(gbanlists)
-    {
-        messagebuf *m = gbanlists[i];
-        if(m->refs > 0 && !m->endswith(*l)) m->concat(*l);
-    }
     gbanlists.add(l);
+    // servers still receiving an older list get the new one queued after it
     loopv(clients)
     {
         client &c = *clients[i];
-        if(c.servport >= 0 && !c.message) 
-        {
-            c.message = l;
-            c.message->refs++;
-        }
+        if(c.servport >= 0) { c.addmessage(l); markclient(c); }
     }
 }
 
@@ -361,11 +407,7 @@ void checkserverpongs()
                     {
                         c->registeredserver = true;
                         outputf(*c, "succreg\n");
-                        if(!c->message && gbanlists.length())
-                        {
-                            c->message = gbanlists.last();
-                            c->message->refs++;
-                        }
+                        if(c->messages.empty() && gbanlists.length()) { c->addmessage(gbanlists.last()); markclient(*c); }
                     }
                 }
                 if(!s.lastpong) updateserverlist = true;
@@ -531,9 +573,8 @@ bool checkclientinput(client &c)
         if(!strncmp(c.input, "list", 4) && (!c.input[4] || c.input[4] == '\n' || c.input[4] == '\r'))
         {
             genserverlist();
-            if(gameserverlists.empty() || c.message) return false;
-            c.message = gameserverlists.last();
-            c.message->refs++;
+            if(gameserverlists.empty() || c.messages.length()) return false;
+            c.addmessage(gameserverlists.last());
             c.output.setsize(0);
             c.outputpos = 0;
             c.shouldpurge = true;
@@ -565,8 +606,143 @@ bool checkclientinput(client &c)
     return c.inputpos<(int)sizeof(c.input);
 }
 
-ENetSocketSet readset, writeset;
+// writes as much pending output as the socket takes, returns false on error
+bool flushclient(client &c)
+{
+    while(c.haspending())
+    {
+        const char *data = c.output.length() ? c.output.getbuf() : c.messages[0]->getbuf();
+        int len = c.output.length() ? c.output.length() : c.messages[0]->length();
+        ENetBuffer buf;
+        buf.data = (void *)&data[c.outputpos];
+        buf.dataLength = len-c.outputpos;
+        int res = enet_socket_send(c.socket, NULL, &buf, 1);
+        if(res < 0) return false;
+        if(!res) break;
+        c.outputpos += res;
+        if(c.outputpos < len) break;
+        if(c.output.length()) c.output.setsize(0);
+        else c.messages.remove(0)->purge();
+        c.outputpos = 0;
+    }
+    return true;
+}
+
+// returns false if the client should be purged
+bool serviceclient(client &c, bool writable, bool readable)
+{
+    if(writable && c.haspending())
+    {
+        if(!flushclient(c)) return false;
+        if(!c.haspending() && c.shouldpurge) return false;
+    }
+    if(readable)
+    {
+        ENetBuffer buf;
+        buf.data = &c.input[c.inputpos];
+        buf.dataLength = sizeof(c.input) - c.inputpos;
+        int res = enet_socket_receive(c.socket, NULL, &buf, 1);
+        if(res <= 0) return false;
+        c.inputpos += res;
+        c.input[min(c.inputpos, (int)sizeof(c.input)-1)] = '\0';
+        if(!checkclientinput(c)) return false;
+        // most replies, including whole server lists, go out in a single write without waiting for the next poll
+        if(c.haspending())
+        {
+            if(!flushclient(c)) return false;
+            if(!c.haspending() && c.shouldpurge) return false;
+        }
+    }
+    return c.output.length() <= OUTPUT_LIMIT;
+}
 
+bool checkclienttime(client &c)
+{
+    if(c.authreqs.length()) purgeauths(c);
+    if(c.output.length() > OUTPUT_LIMIT) return false;
+    return ENET_TIME_DIFFERENCE(servtime, c.lastinput) < (c.registeredserver ? KEEPALIVE_TIME : CLIENT_TIME);
+}
+
+void acceptclient()
+{
+    ENetAddress address;
+    ENetSocket clientsocket = enet_socket_accept(serversocket, &address);
+    if(clients.length()>=CLIENT_LIMIT || checkban(bans, address.host)) enet_socket_destroy(clientsocket);
+    else if(clientsocket!=ENET_SOCKET_NULL)
+    {
+        int dups = 0, oldest = -1;
+        loopv(clients) if(clients[i]->address.host == address.host)
+        {
+            dups++;
+            if(oldest<0 || clients[i]->connecttime < clients[oldest]->connecttime) oldest = i;
+        }
+        if(dups >= DUP_LIMIT) purgeclient(oldest);
+
+        enet_socket_set_option(clientsocket, ENET_SOCKOPT_NONBLOCK, 1);
+        client *c = new client;
+        c->address = address;
+        c->socket = clientsocket;
+        c->connecttime = servtime;
+        c->lastinput = servtime;
+        clients.add(c);
+#ifdef USE_EPOLL
+        c->events = EPOLLIN;
+        watchsocket(c->socket, c, c->events);
+#endif
+    }
+}
+
+#ifdef USE_EPOLL
+// only wait for writability while output is pending, and only read new requests once it has been sent
+void updateclientevents(client &c)
+{
+    int events = c.haspending() ? EPOLLOUT : EPOLLIN;
+    if(events == c.events) return;
+    c.events = events;
+    watchsocket(c.socket, &c, events, EPOLL_CTL_MOD);
+}
+
+void checkclients()
+{
+    static epoll_event events[EVENT_LIMIT];
+    static enet_uint32 lastsweep = 0;
+    while(changedclients.length())
+    {
+        client &c = *changedclients.pop();
+        c.changed = false;
+        updateclientevents(c);
+    }
+    int numevents = epoll_wait(epollfd, events, EVENT_LIMIT, SWEEP_TIME);
+    bool accepting = false;
+    loopi(numevents)
+    {
+        void *data = events[i].data.ptr;
+        if(data == &serversocket) { accepting = true; continue; }
+        if(data == &pingsocket) { checkserverpongs(); continue; }
+        client &c = *(client *)data;
+        bool ready = (events[i].events & (EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLHUP)) != 0;
+        if(!serviceclient(c, ready && c.events == EPOLLOUT, ready && c.events == EPOLLIN)) purgeclient(clients.find(&c));
+        else updateclientevents(c);
+    }
+    // accepting may purge older duplicate clients, so it must happen after their events were handled
+    if(accepting) loopi(ACCEPT_LIMIT)
+    {
+        int numclients = clients.length();
+        acceptclient();
+        if(clients.length() == numclients) break;
+    }
+
+    servtime = enet_time_get();
+    if(ENET_TIME_DIFFERENCE(servtime, lastsweep) < SWEEP_TIME) return;
+    lastsweep = servtime;
+    loopv(clients)
+    {
+        client &c = *clients[i];
+        if(!checkclienttime(c)) purgeclient(i--);
+        else updateclientevents(c);
+    }
+}
+#else
 void checkclients()
 {
     ENetSocketSet readset, writeset;
@@ -579,87 +755,22 @@ void checkclients()
     {
         client &c = *clients[i];
         if(c.authreqs.length()) purgeauths(c);
-        if(c.message || c.output.length()) ENET_SOCKETSET_ADD(writeset, c.socket);
+        if(c.haspending()) ENET_SOCKETSET_ADD(writeset, c.socket);
         else ENET_SOCKETSET_ADD(readset, c.socket);
         maxsock = max(maxsock, c.socket);
     }
-    if(enet_socketset_select(maxsock, &readset, &writeset, 1000)<=0) return;
+    if(enet_socketset_select(maxsock, &readset, &writeset, SWEEP_TIME)<=0) return;
 
     if(ENET_SOCKETSET_CHECK(readset, pingsocket)) checkserverpongs();
-    if(ENET_SOCKETSET_CHECK(readset, serversocket))
-    {
-        ENetAddress address;
-        ENetSocket clientsocket = enet_socket_accept(serversocket, &address);
-        if(clients.length()>=CLIENT_LIMIT || checkban(bans, address.host)) enet_socket_destroy(clientsocket);
-        else if(clientsocket!=ENET_SOCKET_NULL)
-        {
-            int dups = 0, oldest = -1;
-            loopv(clients) if(clients[i]->address.host == address.host)
-            {
-                dups++;
-                if(oldest<0 || clients[i]->connecttime < clients[oldest]->connecttime) oldest = i;
-            }
-            if(dups >= DUP_LIMIT) purgeclient(oldest);
-
-            client *c = new client;
-            c->address = address;
-            c->socket = clientsocket;
-            c->connecttime = servtime;
-            c->lastinput = servtime;
-            clients.add(c);
-        }
-    }
+    if(ENET_SOCKETSET_CHECK(readset, serversocket)) acceptclient();
 
     loopv(clients)
     {
         client &c = *clients[i];
-        if((c.message || c.output.length()) && ENET_SOCKETSET_CHECK(writeset, c.socket))
-        {
-            const char *data = c.output.length() ? c.output.getbuf() : c.message->getbuf();
-            int len = c.output.length() ? c.output.length() : c.message->length();
-            ENetBuffer buf;
-            buf.data = (void *)&data[c.outputpos];
-            buf.dataLength = len-c.outputpos;
-            int res = enet_socket_send(c.socket, NULL, &buf, 1);
-            if(res>=0)
-            {
-                c.outputpos += res;
-                if(c.outputpos>=len)
-                {
-                    if(c.output.length()) c.output.setsize(0);
-                    else
-                    { 
-                        c.message->purge();
-                        c.message = NULL; 
-                    }
-                    c.outputpos = 0;
-                    if(!c.message && c.output.empty() && c.shouldpurge)
-                    {
-                        purgeclient(i--);
-                        continue;
-                    }
-                }
-            }
-            else { purgeclient(i--); continue; }
-        }
-        if(ENET_SOCKETSET_CHECK(readset, c.socket))
-        {
-            ENetBuffer buf;
-            buf.data = &c.input[c.inputpos];
-            buf.dataLength = sizeof(c.input) - c.inputpos;
-            int res = enet_socket_receive(c.socket, NULL, &buf, 1);
-            if(res>0)
-            {
-                c.inputpos += res;
-                c.input[min(c.inputpos, (int)sizeof(c.input)-1)] = '\0';
-                if(!checkclientinput(c)) { purgeclient(i--); continue; }
-            }
-            else { purgeclient(i--); continue; }
-        }
-        if(c.output.length() > OUTPUT_LIMIT) { purgeclient(i--); continue; }
-        if(ENET_TIME_DIFFERENCE(servtime, c.lastinput) >= (c.registeredserver ? KEEPALIVE_TIME : CLIENT_TIME)) { purgeclient(i--); continue; }
+        if(!serviceclient(c, ENET_SOCKETSET_CHECK(writeset, c.socket), ENET_SOCKETSET_CHECK(readset, c.socket)) || !checkclienttime(c)) purgeclient(i--);
     }
 }
+#endif
 
 void banclients()
 {
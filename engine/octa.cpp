@@ -63,7 +63,7 @@ cube *newcubes(uint face, int mat)
         c->material = mat;
         c++;
     }
-    allocnodes++;
+    atomicadd(allocnodes, 1); // map loading allocates from several threads
     return c-8;
 }
 
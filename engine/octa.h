@@ -147,6 +147,7 @@ struct vtxarray
     ivec matmin, matmax;     // BB of any materials
     ivec bbmin, bbmax;       // BB of everything including children
     uchar curvfc, occluded;
+    int pvsid;               // bit index into the view cell occlusion sets
     occludequery *query;
     vector<octaentities *> mapmodels;
     vector<grasstri> grasstris;
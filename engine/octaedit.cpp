@@ -559,20 +559,19 @@ void tryedit()
 
 static bool haschanged = false;
 
-void readychanges(const ivec &bbmin, const ivec &bbmax, cube *c, const ivec &cor, int size)
+VAR(editleafvas, 0, 1, 1);
+
+// returns whether every changed cube in the box lies in a va that will be rebuilt below this level,
+// in which case the vas enclosing it are kept unless merged faces may cross into them
+bool readychanges(const ivec &bbmin, const ivec &bbmax, cube *c, const ivec &cor, int size)
 {
+    bool covered = true;
     loopoctabox(cor, size, bbmin, bbmax)
     {
         ivec o(i, cor, size);
+        bool subcovered = false;
         if(c[i].ext)
         {
-            if(c[i].ext->va)             // removes va s so that octarender will recreate
-            {
-                int hasmerges = c[i].ext->va->hasmerges;
-                destroyva(c[i].ext->va);
-                c[i].ext->va = NULL;
-                if(hasmerges) invalidatemerges(c[i], o, size, true);
-            }
             freeoctaentities(c[i]);
             c[i].ext->tjoints = -1;
         }
@@ -584,10 +583,24 @@ void readychanges(const ivec &bbmin, const ivec &bbmax, cube *c, const ivec &cor
                 discardchildren(c[i], true);
                 brightencube(c[i]);
             }
-            else readychanges(bbmin, bbmax, c[i].children, o, size/2);
+            else subcovered = readychanges(bbmin, bbmax, c[i].children, o, size/2);
         }
         else brightencube(c[i]);
+        if(c[i].ext && c[i].ext->va)
+        {
+            int hasmerges = c[i].ext->va->hasmerges;
+            if(!editleafvas || !subcovered || hasmerges)             // removes va s so that octarender will recreate
+            {
+                destroyva(c[i].ext->va);
+                c[i].ext->va = NULL;
+                if(hasmerges) invalidatemerges(c[i], o, size, true);
+                queuevarebuild(o, size);
+            }
+            subcovered = true;
+        }
+        if(!subcovered) covered = false;
     }
+    return covered;
 }
 
 void commitchanges(bool force)
@@ -610,7 +623,11 @@ void commitchanges(bool force)
 void changed(const block3 &sel, bool commit = true)
 {
     if(sel.s.iszero()) return;
-    readychanges(ivec(sel.o).sub(1), ivec(sel.s).mul(sel.grid).add(sel.o).add(1), worldroot, ivec(0, 0, 0), worldsize/2);
+    ivec bbmin = ivec(sel.o).sub(1), bbmax = ivec(sel.s).mul(sel.grid).add(sel.o).add(1);
+    readychanges(bbmin, bbmax, worldroot, ivec(0, 0, 0), worldsize/2);
+    addlightchange(bbmin, bbmax);
+    extern int filltjoints;
+    if(filltjoints) findtjoints(bbmin, bbmax);
     haschanged = true;
 
     if(commit) commitchanges();
@@ -2598,7 +2615,7 @@ ICOMMAND(getvshaderparamnames, "i", (int *tex),
         str.put(p.name, strlen(p.name));
     }
     str.add('\0');
-    stringret(newstring(str.getbuf(), str.length()-1));
+    stringret(newscriptstr(str.getbuf(), str.length()-1));
 });
 
 void mpedittex(int tex, int allfaces, selinfo &sel, bool local)
@@ -203,11 +203,30 @@ static inline uint hthash(const sortkey &k)
     return k.tex + k.lmid*9741;
 }
 
+struct mergedface
+{
+    uchar orient, lmid, numverts;
+    ushort mat, tex, envmap;
+    vertinfo *verts;
+    int tjoints;
+};
+
+#define MAXMERGELEVEL 12
+
+// a va whose geometry is built but not yet copied into the vbos, which happens on the main thread in build order
+struct pendingva
+{
+    vtxarray *va;
+    int worldtris, skytris, numelemsets;
+    vector<vertex> verts;
+    vector<ushort> elems, skyelems;
+};
+
 struct vacollect : verthash
 {
     ivec origin;
     int size;
-    hashtable<sortkey, sortval> indices;
+    hashtable<sortkey, sortval, openhashbase> indices;
     vector<sortkey> texs;
     vector<grasstri> grasstris;
     vector<materialsurface> matsurfs;
@@ -215,6 +234,16 @@ struct vacollect : verthash
     vector<ushort> skyindices, explicitskyindices;
     vector<facebounds> skyfaces[6];
     int worldtris, skytris, skymask, skyclip, skyarea;
+    vec shadowmapmin, shadowmapmax;
+
+    // state carried between the vas of one build, kept per collector so separate subtrees can be built at once
+    vector<mergedface> vamerges[MAXMERGELEVEL+1];
+    int vahasmerges, vamergemax;
+    vector<vtxarray *> varoot;
+    vector<pendingva *> pending;
+    bool threaded;
+
+    vacollect() : vahasmerges(0), vamergemax(0), threaded(false) { clear(); }
 
     void clear()
     {
@@ -395,8 +424,14 @@ struct vacollect : verthash
         if(!headless) GENVERTS(vertex, buf, { *f = v; f->norm.flip(); f->tangent.flip(); });
     }
 
-    void setupdata(vtxarray *va)
+    pendingva *setupdata(vtxarray *va)
     {
+        pendingva *p = new pendingva;
+        p->va = va;
+        p->worldtris = worldtris;
+        p->skytris = skytris;
+        p->numelemsets = texs.length();
+
         va->verts = verts.length();
         va->tris = worldtris/3;
         va->vbuf = 0;
@@ -404,18 +439,10 @@ struct vacollect : verthash
         va->minvert = 0;
         va->maxvert = va->verts-1;
         va->voffset = 0;
-        if(va->verts)
+        if(va->verts && !headless)
         {
-            if(vbosize[VBO_VBUF] + verts.length() > maxvbosize ||
-               vbosize[VBO_EBUF] + worldtris > USHRT_MAX ||
-               vbosize[VBO_SKYBUF] + skytris > USHRT_MAX)
-                flushvbo();
-
-            va->voffset = vbosize[VBO_VBUF];
-            uchar *vdata = addvbo(va, VBO_VBUF, va->verts, sizeof(vertex));
-            genverts(vdata);
-            va->minvert += va->voffset;
-            va->maxvert += va->voffset;
+            genverts(p->verts.reserve(va->verts).buf);
+            p->verts.advance(va->verts);
         }
 
         va->matbuf = NULL;
@@ -432,11 +459,8 @@ struct vacollect : verthash
         va->explicitsky = explicitskyindices.length();
         if(va->sky + va->explicitsky)
         {
-            va->skydata += vbosize[VBO_SKYBUF];
-            ushort *skydata = (ushort *)addvbo(va, VBO_SKYBUF, va->sky+va->explicitsky, sizeof(ushort));
-            memcpy(skydata, skyindices.getbuf(), va->sky*sizeof(ushort));
-            memcpy(skydata+va->sky, explicitskyindices.getbuf(), va->explicitsky*sizeof(ushort));
-            if(va->voffset) loopi(va->sky+va->explicitsky) skydata[i] += va->voffset;
+            p->skyelems.put(skyindices.getbuf(), skyindices.length());
+            p->skyelems.put(explicitskyindices.getbuf(), explicitskyindices.length());
         }
 
         va->eslist = NULL;
@@ -453,8 +477,7 @@ struct vacollect : verthash
         if(va->texs)
         {
             va->eslist = new elementset[va->texs];
-            va->edata += vbosize[VBO_EBUF];
-            ushort *edata = (ushort *)addvbo(va, VBO_EBUF, worldtris, sizeof(ushort)), *curbuf = edata;
+            ushort *edata = p->elems.reserve(worldtris).buf, *curbuf = edata;
             loopv(texs)
             {
                 const sortkey &k = texs[i];
@@ -477,7 +500,6 @@ struct vacollect : verthash
 
                         loopvj(t.tris[l])
                         {
-                            curbuf[j] += va->voffset;
                             e.minvert[l] = min(e.minvert[l], curbuf[j]);
                             e.maxvert[l] = max(e.maxvert[l], curbuf[j]);
                         }
@@ -494,33 +516,30 @@ struct vacollect : verthash
                 loopvj(slot.sts) va->texmask |= 1<<slot.sts[j].type;
                 if(!headless && slot.shader->type&SHADER_ENVMAP) va->texmask |= 1<<TEX_ENVMAP;
             }
+            p->elems.advance(curbuf - edata);
         }
 
         va->alphatris = va->alphabacktris + va->alphafronttris;
 
-        if(grasstris.length())
-        {
-            va->grasstris.move(grasstris);
-            useshaderbyname("grass");
-        }
+        if(grasstris.length()) va->grasstris.move(grasstris);
 
         if(mapmodels.length()) va->mapmodels.put(mapmodels.getbuf(), mapmodels.length());
+
+        return p;
     }
 
     bool emptyva()
     {
         return verts.empty() && matsurfs.empty() && skyindices.empty() && explicitskyindices.empty() && grasstris.empty() && mapmodels.empty();
     }
-} vc;
+};
 
 int recalcprogress = 0;
 #define progress(s)     if((recalcprogress++&0xFFF)==0) renderprogress(recalcprogress/(float)allocnodes, s);
 
 vector<tjoint> tjoints;
 
-vec shadowmapmin, shadowmapmax;
-
-int calcshadowmask(vec *pos, int numpos)
+int calcshadowmask(vacollect &vc, vec *pos, int numpos)
 {
     extern vec shadowdir;
     int mask = 0, used = 1;
@@ -539,8 +558,8 @@ int calcshadowmask(vec *pos, int numpos)
     loopk(numpos) if(used&(1<<k))
     {
         const vec &v = pos[k];
-        shadowmapmin.min(v);
-        shadowmapmax.max(v);
+        vc.shadowmapmin.min(v);
+        vc.shadowmapmax.max(v);
     }
     return mask;
 }
@@ -587,7 +606,7 @@ extern const vec orientation_bitangent[8][3] =
     { vec(0, -1,  0), vec(-1, 0,  0), vec(-1,  0, 0) },
 };
 
-void addtris(const sortkey &key, int orient, vertex *verts, int *index, int numverts, int convex, int shadowmask, int tj)
+void addtris(vacollect &vc, const sortkey &key, int orient, vertex *verts, int *index, int numverts, int convex, int shadowmask, int tj)
 {
     int &total = key.tex==DEFAULT_SKY ? vc.skytris : vc.worldtris;
     int edge = orient*(MAXFACEVERTS+1);
@@ -675,7 +694,7 @@ void addtris(const sortkey &key, int orient, vertex *verts, int *index, int numv
     }
 }
 
-void addgrasstri(int face, vertex *verts, int numv, ushort texture, ushort lmid)
+void addgrasstri(vacollect &vc, int face, vertex *verts, int numv, ushort texture, ushort lmid)
 {
     grasstri &g = vc.grasstris.add();
     int i1, i2, i3, i4;
@@ -811,10 +830,10 @@ void guessnormals(const vec *pos, int numverts, vec *normals)
     normals[3] = n2;
 }
 
-void addcubeverts(VSlot &vslot, int orient, int size, vec *pos, int convex, ushort texture, ushort lmid, vertinfo *vinfo, int numverts, int tj = -1, ushort envmap = EMID_NONE, int grassy = 0, bool alpha = false, int layer = LAYER_TOP)
+void addcubeverts(vacollect &vc, VSlot &vslot, int orient, int size, vec *pos, int convex, ushort texture, ushort lmid, vertinfo *vinfo, int numverts, int tj = -1, ushort envmap = EMID_NONE, int grassy = 0, bool alpha = false, int layer = LAYER_TOP)
 {
     int dim = dimension(orient);
-    int shadowmask = texture==DEFAULT_SKY || alpha ? 0 : calcshadowmask(pos, numverts);
+    int shadowmask = texture==DEFAULT_SKY || alpha ? 0 : calcshadowmask(vc, pos, numverts);
 
     LightMap *lm = NULL;
     LightMapTexture *lmtex = NULL;
@@ -869,7 +888,7 @@ void addcubeverts(VSlot &vslot, int orient, int size, vec *pos, int convex, usho
     if(lmid >= LMID_RESERVED) lmid = lm ? lm->tex : LMID_AMBIENT;
 
     sortkey key(texture, lmid, !vslot.scroll.iszero() ? dim : 3, layer == LAYER_BLEND ? LAYER_BLEND : LAYER_TOP, envmap, alpha ? (vslot.alphaback ? ALPHA_BACK : (vslot.alphafront ? ALPHA_FRONT : NO_ALPHA)) : NO_ALPHA);
-    addtris(key, orient, verts, index, numverts, convex, shadowmask, tj);
+    addtris(vc, key, orient, verts, index, numverts, convex, shadowmask, tj);
 
     if(grassy)
     {
@@ -878,11 +897,11 @@ void addcubeverts(VSlot &vslot, int orient, int size, vec *pos, int convex, usho
             int faces = 0;
             if(index[0]!=index[i+1] && index[i+1]!=index[i+2] && index[i+2]!=index[0]) faces |= 1;
             if(i+3 < numverts && index[0]!=index[i+2] && index[i+2]!=index[i+3] && index[i+3]!=index[0]) faces |= 2;
-            if(grassy > 1 && faces==3) addgrasstri(i, verts, 4, texture, lmid);
+            if(grassy > 1 && faces==3) addgrasstri(vc, i, verts, 4, texture, lmid);
             else
             {
-                if(faces&1) addgrasstri(i, verts, 3, texture, lmid);
-                if(faces&2) addgrasstri(i+1, verts, 3, texture, lmid);
+                if(faces&1) addgrasstri(vc, i, verts, 3, texture, lmid);
+                if(faces&2) addgrasstri(vc, i+1, verts, 3, texture, lmid);
             }
         }
     }
@@ -909,7 +928,8 @@ enum
     CE_START = 1<<0,
     CE_END   = 1<<1,
     CE_FLIP  = 1<<2,
-    CE_DUP   = 1<<3
+    CE_DUP   = 1<<3,
+    CE_CHANGED = 1<<4
 };
 
 struct cubeedge
@@ -921,9 +941,9 @@ struct cubeedge
 };
 
 vector<cubeedge> cubeedges;
-hashtable<edgegroup, int> edgegroups(1<<13);
+hashtable<edgegroup, int, openhashbase> edgegroups(1<<13);
 
-void gencubeedges(cube &c, const ivec &co, int size)
+void gencubeedges(cube &c, const ivec &co, int size, int flags = CE_CHANGED)
 {
     ivec pos[MAXFACEVERTS];
     int vis;
@@ -977,7 +997,7 @@ void gencubeedges(cube &c, const ivec &co, int size)
             ce.offset = t1;
             ce.size = t2 - t1;
             ce.index = i*(MAXFACEVERTS+1)+j;
-            ce.flags = CE_START | CE_END | (e1!=j ? CE_FLIP : 0);
+            ce.flags = CE_START | CE_END | (e1!=j ? CE_FLIP : 0) | flags;
             ce.next = -1;
 
             bool insert = true;
@@ -1038,7 +1058,34 @@ void gencubeedges(cube *c = worldroot, const ivec &co = ivec(0, 0, 0), int size
     --neighbourdepth;
 }
 
-void gencubeverts(cube &c, const ivec &co, int size, int csi)
+// only the edges of cubes inside the changed box get t-joints, the rest of the box just splits them
+static void gencubeedges(cube *c, const ivec &co, int size, const ivec &bbmin, const ivec &bbmax, const ivec &chmin, const ivec &chmax)
+{
+    neighbourstack[++neighbourdepth] = c;
+    loopoctabox(co, size, bbmin, bbmax)
+    {
+        ivec o(i, co, size);
+        bool changed = o.x < chmax.x && o.y < chmax.y && o.z < chmax.z && o.x+size > chmin.x && o.y+size > chmin.y && o.z+size > chmin.z;
+        if(changed && c[i].ext) c[i].ext->tjoints = -1;
+        if(c[i].children) gencubeedges(c[i].children, o, size>>1, bbmin, bbmax, chmin, chmax);
+        else if(!isempty(c[i])) gencubeedges(c[i], o, size, changed ? CE_CHANGED : 0);
+    }
+    --neighbourdepth;
+}
+
+static int maxcubesize(cube *c, const ivec &co, int size, const ivec &bbmin, const ivec &bbmax)
+{
+    int maxsize = 0;
+    loopoctabox(co, size, bbmin, bbmax)
+    {
+        ivec o(i, co, size);
+        if(c[i].children) maxsize = max(maxsize, maxcubesize(c[i].children, o, size>>1, bbmin, bbmax));
+        else if(!isempty(c[i])) maxsize = max(maxsize, size);
+    }
+    return maxsize;
+}
+
+void gencubeverts(vacollect &vc, cube &c, const ivec &co, int size, int csi)
 {
     if(!(c.visible&0xC0)) return;
 
@@ -1080,14 +1127,14 @@ void gencubeverts(cube &c, const ivec &co, int size, int csi)
         int hastj = tj >= 0 && tjoints[tj].edge < (i+1)*(MAXFACEVERTS+1) ? tj : -1;
         int grassy = vslot.slot->autograss && i!=O_BOTTOM ? (vis!=3 || convex ? 1 : 2) : 0;
         if(!c.ext)
-            addcubeverts(vslot, i, size, pos, convex, c.texture[i], LMID_AMBIENT, NULL, numverts, hastj, envmap, grassy, (c.material&MAT_ALPHA)!=0);
+            addcubeverts(vc, vslot, i, size, pos, convex, c.texture[i], LMID_AMBIENT, NULL, numverts, hastj, envmap, grassy, (c.material&MAT_ALPHA)!=0);
         else
         {
             const surfaceinfo &surf = c.ext->surfaces[i];
             if(!surf.numverts || surf.numverts&LAYER_TOP)
-                addcubeverts(vslot, i, size, pos, convex, c.texture[i], surf.lmid[0], verts, numverts, hastj, envmap, grassy, (c.material&MAT_ALPHA)!=0, LAYER_TOP|(surf.numverts&LAYER_BLEND));
+                addcubeverts(vc, vslot, i, size, pos, convex, c.texture[i], surf.lmid[0], verts, numverts, hastj, envmap, grassy, (c.material&MAT_ALPHA)!=0, LAYER_TOP|(surf.numverts&LAYER_BLEND));
             if(surf.numverts&LAYER_BOTTOM)
-                addcubeverts(layer ? *layer : vslot, i, size, pos, convex, vslot.layer, surf.lmid[1], surf.numverts&LAYER_DUP ? verts + numverts : verts, numverts, hastj, envmap2);
+                addcubeverts(vc, layer ? *layer : vslot, i, size, pos, convex, vslot.layer, surf.lmid[1], surf.numverts&LAYER_DUP ? verts + numverts : verts, numverts, hastj, envmap2);
         }
     }
 }
@@ -1136,7 +1183,7 @@ void minskyface(cube &cu, int orient, const ivec &co, int size, facebounds &orig
     orig.v2 = min(mincf.v2, orig.v2);
 }
 
-void genskyfaces(cube &c, const ivec &o, int size)
+void genskyfaces(vacollect &vc, cube &c, const ivec &o, int size)
 {
     int faces[6], numfaces = hasskyfaces(c, o, size, faces);
     if(!numfaces) return;
@@ -1156,7 +1203,7 @@ void genskyfaces(cube &c, const ivec &o, int size)
     }
 }
 
-void addskyverts(const ivec &o, int size)
+void addskyverts(vacollect &vc, const ivec &o, int size)
 {
     loopi(6)
     {
@@ -1201,7 +1248,7 @@ int allocva = 0;
 int wtris = 0, wverts = 0, vtris = 0, vverts = 0, glde = 0, gbatches = 0;
 vector<vtxarray *> valist, varoot;
 
-vtxarray *newva(const ivec &co, int size)
+vtxarray *newva(vacollect &vc, const ivec &co, int size)
 {
     vc.optimize();
 
@@ -1220,14 +1267,60 @@ vtxarray *newva(const ivec &co, int size)
     va->hasmerges = 0;
     va->mergelevel = -1;
 
-    vc.setupdata(va);
+    vc.pending.add(vc.setupdata(va));
+
+    return va;
+}
+
+// copies a built va's geometry into the vbos, in the same order the vas were built so the vbo layout does not depend on threading
+static void uploadva(pendingva &p)
+{
+    vtxarray *va = p.va;
+    if(va->verts)
+    {
+        if(vbosize[VBO_VBUF] + va->verts > maxvbosize ||
+           vbosize[VBO_EBUF] + p.worldtris > USHRT_MAX ||
+           vbosize[VBO_SKYBUF] + p.skytris > USHRT_MAX)
+            flushvbo();
+
+        va->voffset = vbosize[VBO_VBUF];
+        uchar *vdata = addvbo(va, VBO_VBUF, va->verts, sizeof(vertex));
+        if(!headless) memcpy(vdata, p.verts.getbuf(), va->verts*sizeof(vertex));
+        va->minvert += va->voffset;
+        va->maxvert += va->voffset;
+    }
+
+    if(va->sky + va->explicitsky)
+    {
+        va->skydata += vbosize[VBO_SKYBUF];
+        ushort *skydata = (ushort *)addvbo(va, VBO_SKYBUF, va->sky+va->explicitsky, sizeof(ushort));
+        memcpy(skydata, p.skyelems.getbuf(), (va->sky+va->explicitsky)*sizeof(ushort));
+        if(va->voffset) loopi(va->sky+va->explicitsky) skydata[i] += va->voffset;
+    }
+
+    if(p.numelemsets)
+    {
+        va->edata += vbosize[VBO_EBUF];
+        ushort *edata = (ushort *)addvbo(va, VBO_EBUF, p.worldtris, sizeof(ushort));
+        memcpy(edata, p.elems.getbuf(), p.elems.length()*sizeof(ushort));
+        if(va->voffset)
+        {
+            loopv(p.elems) edata[i] += va->voffset;
+            loopi(p.numelemsets) loopl(2)
+            {
+                elementset &e = va->eslist[i];
+                if(e.minvert[l] <= e.maxvert[l]) { e.minvert[l] += va->voffset; e.maxvert[l] += va->voffset; }
+            }
+        }
+    }
+
+    if(va->grasstris.length()) useshaderbyname("grass");
 
     wverts += va->verts;
     wtris  += va->tris + va->blends + va->alphatris;
     allocva++;
+    allocpvsid(va);
     valist.add(va);
-
-    return va;
 }
 
 void destroyva(vtxarray *va, bool reparent)
@@ -1235,6 +1328,7 @@ void destroyva(vtxarray *va, bool reparent)
     wverts -= va->verts;
     wtris -= va->tris + va->blends + va->alphatris;
     allocva--;
+    freepvsid(va->pvsid);
     valist.removeobj(va);
     if(!va->parent) varoot.removeobj(va);
     if(reparent)
@@ -1316,19 +1410,7 @@ void updatevabbs(bool force)
     loopv(varoot) updatevabb(varoot[i], force);
 }
 
-struct mergedface
-{
-    uchar orient, lmid, numverts;
-    ushort mat, tex, envmap;
-    vertinfo *verts;
-    int tjoints;
-};
-
-#define MAXMERGELEVEL 12
-static int vahasmerges = 0, vamergemax = 0;
-static vector<mergedface> vamerges[MAXMERGELEVEL+1];
-
-int genmergedfaces(cube &c, const ivec &co, int size, int minlevel = -1)
+int genmergedfaces(vacollect &vc, cube &c, const ivec &co, int size, int minlevel = -1)
 {
     if(!c.ext || isempty(c)) return -1;
     int tj = c.ext->tjoints, maxlevel = -1;
@@ -1338,7 +1420,7 @@ int genmergedfaces(cube &c, const ivec &co, int size, int minlevel = -1)
         int numverts = surf.numverts&MAXFACEVERTS;
         if(!numverts)
         {
-            if(minlevel < 0) vahasmerges |= MERGE_PART;
+            if(minlevel < 0) vc.vahasmerges |= MERGE_PART;
             continue;
         }
         mergedface mf;
@@ -1364,7 +1446,7 @@ int genmergedfaces(cube &c, const ivec &co, int size, int minlevel = -1)
                 mf.envmap = vslot.slot->texmask&(1<<TEX_ENVMAP) ? EMID_CUSTOM : closestenvmap(i, co, size);
             ushort envmap2 = !headless && layer && layer->slot->shader->type&SHADER_ENVMAP ? (layer->slot->texmask&(1<<TEX_ENVMAP) ? EMID_CUSTOM : closestenvmap(i, co, size)) : EMID_NONE;
 
-            if(surf.numverts&LAYER_TOP) vamerges[level].add(mf);
+            if(surf.numverts&LAYER_TOP) vc.vamerges[level].add(mf);
             if(surf.numverts&LAYER_BOTTOM)
             {
                 mf.tex = vslot.layer;
@@ -1372,19 +1454,19 @@ int genmergedfaces(cube &c, const ivec &co, int size, int minlevel = -1)
                 mf.lmid = surf.lmid[1];
                 mf.numverts &= ~LAYER_TOP;
                 if(surf.numverts&LAYER_DUP) mf.verts += numverts;
-                vamerges[level].add(mf);
+                vc.vamerges[level].add(mf);
             }
         }
     }
     if(maxlevel >= 0)
     {
-        vamergemax = max(vamergemax, maxlevel);
-        vahasmerges |= MERGE_ORIGIN;
+        vc.vamergemax = max(vc.vamergemax, maxlevel);
+        vc.vahasmerges |= MERGE_ORIGIN;
     }
     return maxlevel;
 }
 
-int findmergedfaces(cube &c, const ivec &co, int size, int csi, int minlevel)
+int findmergedfaces(vacollect &vc, cube &c, const ivec &co, int size, int csi, int minlevel)
 {
     if(c.ext && c.ext->va && !(c.ext->va->hasmerges&MERGE_ORIGIN)) return c.ext->va->mergelevel;
     else if(c.children)
@@ -1393,18 +1475,18 @@ int findmergedfaces(cube &c, const ivec &co, int size, int csi, int minlevel)
         loopi(8)
         {
             ivec o(i, co, size/2);
-            int level = findmergedfaces(c.children[i], o, size/2, csi-1, minlevel);
+            int level = findmergedfaces(vc, c.children[i], o, size/2, csi-1, minlevel);
             maxlevel = max(maxlevel, level);
         }
         return maxlevel;
     }
-    else if(c.ext && c.merged) return genmergedfaces(c, co, size, minlevel);
+    else if(c.ext && c.merged) return genmergedfaces(vc, c, co, size, minlevel);
     else return -1;
 }
 
-void addmergedverts(int level, const ivec &o)
+void addmergedverts(vacollect &vc, int level, const ivec &o)
 {
-    vector<mergedface> &mfl = vamerges[level];
+    vector<mergedface> &mfl = vc.vamerges[level];
     if(mfl.empty()) return;
     vec vo(ivec(o).mask(~0xFFF));
     vec pos[MAXFACEVERTS];
@@ -1419,13 +1501,13 @@ void addmergedverts(int level, const ivec &o)
         }
         VSlot &vslot = lookupvslot(mf.tex, true);
         int grassy = vslot.slot->autograss && mf.orient!=O_BOTTOM && mf.numverts&LAYER_TOP ? 2 : 0;
-        addcubeverts(vslot, mf.orient, 1<<level, pos, 0, mf.tex, mf.lmid, mf.verts, numverts, mf.tjoints, mf.envmap, grassy, (mf.mat&MAT_ALPHA)!=0, mf.numverts&LAYER_BLEND);
-        vahasmerges |= MERGE_USE;
+        addcubeverts(vc, vslot, mf.orient, 1<<level, pos, 0, mf.tex, mf.lmid, mf.verts, numverts, mf.tjoints, mf.envmap, grassy, (mf.mat&MAT_ALPHA)!=0, mf.numverts&LAYER_BLEND);
+        vc.vahasmerges |= MERGE_USE;
     }
     mfl.setsize(0);
 }
 
-void rendercube(cube &c, const ivec &co, int size, int csi, int &maxlevel)  // creates vertices and indices ready to be put into a va
+void rendercube(vacollect &vc, cube &c, const ivec &co, int size, int csi, int &maxlevel)  // creates vertices and indices ready to be put into a va
 {
     //if(size<=16) return;
     if(c.ext && c.ext->va)
@@ -1436,20 +1518,20 @@ void rendercube(cube &c, const ivec &co, int size, int csi, int &maxlevel)  // c
 
     if(c.children)
     {
-        neighbourstack[++neighbourdepth] = c.children;
+        if(!vc.threaded) neighbourstack[++neighbourdepth] = c.children;
         c.escaped = 0;
         loopi(8)
         {
             ivec o(i, co, size/2);
             int level = -1;
-            rendercube(c.children[i], o, size/2, csi-1, level);
+            rendercube(vc, c.children[i], o, size/2, csi-1, level);
             if(level >= csi)
                 c.escaped |= 1<<i;
             maxlevel = max(maxlevel, level);
         }
-        --neighbourdepth;
+        if(!vc.threaded) --neighbourdepth;
 
-        if(csi <= MAXMERGELEVEL && vamerges[csi].length()) addmergedverts(csi, co);
+        if(csi <= MAXMERGELEVEL && vc.vamerges[csi].length()) addmergedverts(vc, csi, co);
 
         if(c.ext)
         {
@@ -1458,12 +1540,12 @@ void rendercube(cube &c, const ivec &co, int size, int csi, int &maxlevel)  // c
         return;
     }
 
-    genskyfaces(c, co, size);
+    genskyfaces(vc, c, co, size);
 
     if(!isempty(c))
     {
-        gencubeverts(c, co, size, csi);
-        if(c.merged) maxlevel = max(maxlevel, genmergedfaces(c, co, size));
+        gencubeverts(vc, c, co, size, csi);
+        if(c.merged) maxlevel = max(maxlevel, genmergedfaces(vc, c, co, size));
     }
     if(c.material != MAT_AIR) genmatsurfs(c, co, size, vc.matsurfs);
 
@@ -1472,10 +1554,10 @@ void rendercube(cube &c, const ivec &co, int size, int csi, int &maxlevel)  // c
         if(c.ext->ents && c.ext->ents->mapmodels.length()) vc.mapmodels.add(c.ext->ents);
     }
 
-    if(csi <= MAXMERGELEVEL && vamerges[csi].length()) addmergedverts(csi, co);
+    if(csi <= MAXMERGELEVEL && vc.vamerges[csi].length()) addmergedverts(vc, csi, co);
 }
 
-void calcgeombb(const ivec &co, int size, ivec &bbmin, ivec &bbmax)
+void calcgeombb(vacollect &vc, const ivec &co, int size, ivec &bbmin, ivec &bbmax)
 {
     vec vmin(co), vmax = vmin;
     vmin.add(size);
@@ -1491,7 +1573,7 @@ void calcgeombb(const ivec &co, int size, ivec &bbmin, ivec &bbmax)
     bbmax = ivec(vmax.mul(8)).add(7).shr(3);
 }
 
-void calcmatbb(const ivec &co, int size, ivec &bbmin, ivec &bbmax)
+void calcmatbb(vacollect &vc, const ivec &co, int size, ivec &bbmin, ivec &bbmax)
 {
     bbmax = co;
     (bbmin = bbmax).add(size);
@@ -1523,43 +1605,43 @@ void calcmatbb(const ivec &co, int size, ivec &bbmin, ivec &bbmax)
     }
 }
 
-void setva(cube &c, const ivec &co, int size, int csi)
+void setva(vacollect &vc, cube &c, const ivec &co, int size, int csi)
 {
     ASSERT(size <= 0x1000);
 
     int vamergeoffset[MAXMERGELEVEL+1];
-    loopi(MAXMERGELEVEL+1) vamergeoffset[i] = vamerges[i].length();
+    loopi(MAXMERGELEVEL+1) vamergeoffset[i] = vc.vamerges[i].length();
 
     vc.origin = co;
     vc.size = size;
 
-    shadowmapmin = vec(co).add(size);
-    shadowmapmax = vec(co);
+    vc.shadowmapmin = vec(co).add(size);
+    vc.shadowmapmax = vec(co);
 
     int maxlevel = -1;
-    rendercube(c, co, size, csi, maxlevel);
+    rendercube(vc, c, co, size, csi, maxlevel);
 
     ivec bbmin, bbmax;
 
-    calcgeombb(co, size, bbmin, bbmax);
+    calcgeombb(vc, co, size, bbmin, bbmax);
 
-    addskyverts(co, size);
+    addskyverts(vc, co, size);
 
     if(size == min(0x1000, worldsize/2) || !vc.emptyva())
     {
-        vtxarray *va = newva(co, size);
+        vtxarray *va = newva(vc, co, size);
         ext(c).va = va;
         va->geommin = bbmin;
         va->geommax = bbmax;
-        calcmatbb(co, size, va->matmin, va->matmax);
-        va->shadowmapmin = ivec(shadowmapmin.mul(8)).shr(3);
-        va->shadowmapmax = ivec(shadowmapmax.mul(8)).add(7).shr(3);
-        va->hasmerges = vahasmerges;
-        va->mergelevel = vamergemax;
+        calcmatbb(vc, co, size, va->matmin, va->matmax);
+        va->shadowmapmin = ivec(vc.shadowmapmin.mul(8)).shr(3);
+        va->shadowmapmax = ivec(vc.shadowmapmax.mul(8)).add(7).shr(3);
+        va->hasmerges = vc.vahasmerges;
+        va->mergelevel = vc.vamergemax;
     }
     else
     {
-        loopi(MAXMERGELEVEL+1) vamerges[i].setsize(vamergeoffset[i]);
+        loopi(MAXMERGELEVEL+1) vc.vamerges[i].setsize(vamergeoffset[i]);
     }
 
     vc.clear();
@@ -1594,64 +1676,280 @@ VARF(vafacemax, 64, 384, 256*256, allchanged());
 VARF(vafacemin, 0, 96, 256*256, allchanged());
 VARF(vacubesize, 32, 128, 0x1000, allchanged());
 
-int updateva(cube *c, const ivec &co, int size, int csi)
+static int updatevachild(vacollect &vc, cube &c, const ivec &o, int size, int csi, int &cmergemax, int &chasmerges);
+
+// a subtree built on its own by a worker, whose results are spliced back in when the main pass reaches it
+struct vajob
 {
-    progress("recalculating geometry...");
-    int ccount = 0, cmergemax = vamergemax, chasmerges = vahasmerges;
-    neighbourstack[++neighbourdepth] = c;
+    cube *c;
+    ivec o;
+    int size, csi;
+    int count, mergemax, hasmerges;
+    vector<mergedface> vamerges[MAXMERGELEVEL+1];
+    vector<vtxarray *> varoot;
+    vector<pendingva *> pending;
+
+    vajob(cube *c, const ivec &o, int size, int csi) : c(c), o(o), size(size), csi(csi), count(0), mergemax(0), hasmerges(0) {}
+
+    void run(vacollect &vc)
+    {
+        count = updatevachild(vc, *c, o, size, csi, mergemax, hasmerges);
+        loopi(MAXMERGELEVEL+1) vamerges[i].move(vc.vamerges[i]);
+        varoot.move(vc.varoot);
+        pending.move(vc.pending);
+    }
+
+    int finish(vacollect &vc, int &cmergemax, int &chasmerges)
+    {
+        loopi(MAXMERGELEVEL+1) vc.vamerges[i].move(vamerges[i]);
+        vc.varoot.move(varoot);
+        vc.pending.move(pending);
+        cmergemax = max(cmergemax, mergemax);
+        chasmerges |= hasmerges;
+        return count;
+    }
+};
+
+static vector<vajob *> vajobs;
+static int vajobsize = 0, vacurjob = 0;
+
+int updateva(vacollect &vc, cube *c, const ivec &co, int size, int csi)
+{
+    if(!vc.threaded) progress("recalculating geometry...");
+    int ccount = 0, cmergemax = vc.vamergemax, chasmerges = vc.vahasmerges;
+    if(!vc.threaded) neighbourstack[++neighbourdepth] = c;
     loopi(8)                                    // counting number of semi-solid/solid children cubes
     {
-        int count = 0, childpos = varoot.length();
-        ivec o(i, co, size);
-        vamergemax = 0;
-        vahasmerges = 0;
-        if(c[i].ext && c[i].ext->va)
+        if(!vc.threaded && vajobs.inrange(vacurjob) && vajobs[vacurjob]->c == &c[i])
         {
-            varoot.add(c[i].ext->va);
-            if(c[i].ext->va->hasmerges&MERGE_ORIGIN) findmergedfaces(c[i], o, size, csi, csi);
+            ccount += vajobs[vacurjob++]->finish(vc, cmergemax, chasmerges);
+            continue;
         }
+        ivec o(i, co, size);
+        ccount += updatevachild(vc, c[i], o, size, csi, cmergemax, chasmerges);
+    }
+    if(!vc.threaded) --neighbourdepth;
+    vc.vamergemax = cmergemax;
+    vc.vahasmerges = chasmerges;
+
+    return ccount;
+}
+
+static int updatevachild(vacollect &vc, cube &c, const ivec &o, int size, int csi, int &cmergemax, int &chasmerges)
+{
+    int count = 0, childpos = vc.varoot.length();
+    vc.vamergemax = 0;
+    vc.vahasmerges = 0;
+    if(c.ext && c.ext->va)
+    {
+        vc.varoot.add(c.ext->va);
+        if(c.ext->va->hasmerges&MERGE_ORIGIN) findmergedfaces(vc, c, o, size, csi, csi);
+    }
+    else
+    {
+        if(c.children) count += updateva(vc, c.children, o, size/2, csi-1);
         else
         {
-            if(c[i].children) count += updateva(c[i].children, o, size/2, csi-1);
-            else
-            {
-                if(!isempty(c[i])) count += setcubevisibility(c[i], o, size);
-                count += hasskyfaces(c[i], o, size);
-            }
-            int tcount = count + (csi <= MAXMERGELEVEL ? vamerges[csi].length() : 0);
-            if(tcount > vafacemax || (tcount >= vafacemin && size >= vacubesize) || size == min(0x1000, worldsize/2))
+            if(!isempty(c)) count += setcubevisibility(c, o, size);
+            count += hasskyfaces(c, o, size);
+        }
+        int tcount = count + (csi <= MAXMERGELEVEL ? vc.vamerges[csi].length() : 0);
+        if(tcount > vafacemax || (tcount >= vafacemin && size >= vacubesize) || size == min(0x1000, worldsize/2))
+        {
+            if(!vc.threaded) loadprogress = clamp(recalcprogress/float(allocnodes), 0.0f, 1.0f);
+            setva(vc, c, o, size, csi);
+            if(c.ext && c.ext->va)
             {
-                loadprogress = clamp(recalcprogress/float(allocnodes), 0.0f, 1.0f);
-                setva(c[i], o, size, csi);
-                if(c[i].ext && c[i].ext->va)
+                while(vc.varoot.length() > childpos)
                 {
-                    while(varoot.length() > childpos)
-                    {
-                        vtxarray *child = varoot.pop();
-                        c[i].ext->va->children.add(child);
-                        child->parent = c[i].ext->va;
-                    }
-                    varoot.add(c[i].ext->va);
-                    if(vamergemax > size)
-                    {
-                        cmergemax = max(cmergemax, vamergemax);
-                        chasmerges |= vahasmerges&~MERGE_USE;
-                    }
-                    continue;
+                    vtxarray *child = vc.varoot.pop();
+                    c.ext->va->children.add(child);
+                    child->parent = c.ext->va;
+                }
+                vc.varoot.add(c.ext->va);
+                if(vc.vamergemax > size)
+                {
+                    cmergemax = max(cmergemax, vc.vamergemax);
+                    chasmerges |= vc.vahasmerges&~MERGE_USE;
                 }
-                else count = 0;
+                return 0;
             }
+            else count = 0;
         }
-        if(csi+1 <= MAXMERGELEVEL && vamerges[csi].length()) vamerges[csi+1].move(vamerges[csi]);
-        cmergemax = max(cmergemax, vamergemax);
-        chasmerges |= vahasmerges;
-        ccount += count;
     }
-    --neighbourdepth;
-    vamergemax = cmergemax;
-    vahasmerges = chasmerges;
+    if(csi+1 <= MAXMERGELEVEL && vc.vamerges[csi].length()) vc.vamerges[csi+1].move(vc.vamerges[csi]);
+    cmergemax = max(cmergemax, vc.vamergemax);
+    chasmerges |= vc.vahasmerges;
+    return count;
+}
 
-    return ccount;
+// splits the cubes still needing vas into subtrees of vajobsize, in the order updateva will reach them
+static void collectvajobs(cube *c, const ivec &co, int size, int csi)
+{
+    loopi(8)
+    {
+        if(c[i].ext && c[i].ext->va) continue;
+        ivec o(i, co, size);
+        if(c[i].children && size > vajobsize) collectvajobs(c[i].children, o, size/2, csi-1);
+        else vajobs.add(new vajob(&c[i], o, size, csi));
+    }
+}
+
+// slots may have to be loaded while building, which needs the main thread, so look them all up beforehand
+static void preloadvaslots(cube *c)
+{
+    loopi(8)
+    {
+        if(c[i].ext && c[i].ext->va) continue;
+        if(c[i].children) preloadvaslots(c[i].children);
+        else if(!isempty(c[i])) loopj(6)
+        {
+            VSlot &vslot = lookupvslot(c[i].texture[j], true);
+            if(vslot.layer) lookupvslot(vslot.layer, true);
+        }
+    }
+}
+
+struct varebuild
+{
+    ivec o;
+    int size;
+};
+
+static vector<varebuild> varebuilds;
+
+void queuevarebuild(const ivec &o, int size)
+{
+    varebuild &r = varebuilds.add();
+    r.o = o;
+    r.size = size;
+}
+
+// builds the va of a cube in place under an enclosing va that an edit left intact
+static void rebuildva(vacollect &vc, cube &c, const ivec &co, int size, int csi, vtxarray *parent)
+{
+    vc.vamergemax = 0;
+    vc.vahasmerges = 0;
+    if(c.children) updateva(vc, c.children, co, size/2, csi-1);
+    else if(!isempty(c)) setcubevisibility(c, co, size);
+    setva(vc, c, co, size, csi);
+    vtxarray *va = c.ext ? c.ext->va : NULL, *owner = va ? va : parent;
+    loopv(vc.varoot)
+    {
+        vtxarray *child = vc.varoot[i];
+        if(child->parent == owner) continue;
+        if(child->parent) child->parent->children.removeobj(child);
+        child->parent = owner;
+        owner->children.add(child);
+    }
+    vc.varoot.setsize(0);
+    loopi(MAXMERGELEVEL+1) vc.vamerges[i].setsize(0);
+    if(va)
+    {
+        va->parent = parent;
+        parent->children.add(va);
+    }
+    for(vtxarray *p = parent; p; p = p->parent) p->bbmin.x = -1;
+}
+
+static void rebuildvas(vacollect &vc)
+{
+    loopv(varebuilds)
+    {
+        const varebuild &r = varebuilds[i];
+        cube *c = worldroot;
+        ivec co(0, 0, 0);
+        int size = worldsize/2, csi = worldscale-1, depth = neighbourdepth;
+        vtxarray *parent = NULL;
+        neighbourstack[++neighbourdepth] = c;
+        for(;;)
+        {
+            int j = octastep(r.o.x, r.o.y, r.o.z, csi);
+            cube &cur = c[j];
+            ivec o(j, co, size);
+            if(size <= r.size)
+            {
+                // only cubes still sitting under a va need building here, the rest is left to updateva
+                if(size == r.size && o == r.o && parent && !(cur.ext && cur.ext->va))
+                    rebuildva(vc, cur, o, size, csi, parent);
+                break;
+            }
+            if(cur.ext && cur.ext->va) parent = cur.ext->va;
+            if(!cur.children) break;
+            c = cur.children;
+            co = o;
+            size /= 2;
+            csi--;
+            neighbourstack[++neighbourdepth] = c;
+        }
+        neighbourdepth = depth;
+    }
+    varebuilds.setsize(0);
+}
+
+VARP(vathreads, 0, 0, 16);
+
+static int vanextjob = 0;
+
+struct vaworker
+{
+    vacollect vc;
+    thread worker;
+
+    static int work(void *data)
+    {
+        vaworker *w = (vaworker *)data;
+        for(;;)
+        {
+            int i = atomicadd(vanextjob, 1) - 1;
+            if(i >= vajobs.length()) break;
+            vajobs[i]->run(w->vc);
+        }
+        return 0;
+    }
+};
+
+static void runvajobs(vacollect &vc, int numthreads)
+{
+    vector<vaworker *> workers;
+    vanextjob = 0;
+    loopi(numthreads-1)
+    {
+        vaworker *w = new vaworker;
+        w->vc.threaded = true;
+        if(!w->worker.start(vaworker::work, w, "va worker")) { delete w; break; }
+        workers.add(w);
+    }
+    vc.threaded = true;
+    for(;;)
+    {
+        int i = atomicadd(vanextjob, 1) - 1;
+        if(i >= vajobs.length()) break;
+        renderprogress(i/float(vajobs.length()), "recalculating geometry...");
+        vajobs[i]->run(vc);
+    }
+    vc.threaded = false;
+    loopv(workers) workers[i]->worker.join();
+    workers.deletecontents();
+}
+
+static void buildvas(vacollect &vc, int csi)
+{
+    int numthreads = vathreads > 0 ? vathreads : numcpus;
+    vajobsize = max(min(0x1000, worldsize/2)>>2, 32);
+    vacurjob = 0;
+    loopi(MAXMERGELEVEL+1) vc.vamerges[i].setsize(0);
+    vc.vamergemax = vc.vahasmerges = 0;
+    rebuildvas(vc);
+    preloadvaslots(worldroot);
+    if(numthreads > 1)
+    {
+        collectvajobs(worldroot, ivec(0, 0, 0), worldsize/2, csi-1);
+        if(vajobs.length() > 1) runvajobs(vc, numthreads);
+        else vajobs.deletecontents();
+    }
+    updateva(vc, worldroot, ivec(0, 0, 0), worldsize/2, csi-1);
+    vajobs.deletecontents();
 }
 
 void addtjoint(const edgegroup &g, const cubeedge &e, int offset)
@@ -1693,14 +1991,14 @@ void findtjoints(int cur, const edgegroup &g)
             else
             {
                 prevactive = curactive;
-                if(!(a.flags&CE_DUP))
+                if((a.flags&(CE_DUP|CE_CHANGED)) == CE_CHANGED)
                 {
                     if(e.flags&CE_START && e.offset > a.offset && e.offset < a.offset+a.size)
                         addtjoint(g, a, e.offset);
                     if(e.flags&CE_END && e.offset+e.size > a.offset && e.offset+e.size < a.offset+a.size)
                         addtjoint(g, a, e.offset+e.size);
                 }
-                if(!(e.flags&CE_DUP))
+                if((e.flags&(CE_DUP|CE_CHANGED)) == CE_CHANGED)
                 {
                     if(a.flags&CE_START && a.offset > e.offset && a.offset < e.offset+e.size)
                         addtjoint(g, e, a.offset);
@@ -1717,6 +2015,8 @@ void findtjoints(int cur, const edgegroup &g)
     }
 }
 
+static int compactedtjoints = 0; // length of tjoints after the last full search or compaction
+
 void findtjoints()
 {
     recalcprogress = 0;
@@ -1725,6 +2025,49 @@ void findtjoints()
     enumeratekt(edgegroups, edgegroup, g, int, e, findtjoints(e, g));
     cubeedges.setsize(0);
     edgegroups.clear();
+    compactedtjoints = tjoints.length();
+}
+
+// copies the chains still reachable from the octree into live, dropping the ones edits have replaced
+static void compacttjoints(cube *c, vector<tjoint> &live)
+{
+    loopi(8)
+    {
+        if(c[i].ext && c[i].ext->tjoints >= 0)
+        {
+            int prev = -1;
+            for(int tj = c[i].ext->tjoints; tj >= 0; tj = tjoints[tj].next)
+            {
+                if(prev < 0) c[i].ext->tjoints = live.length();
+                else live[prev].next = live.length();
+                prev = live.length();
+                live.add(tjoints[tj]);
+            }
+            live[prev].next = -1;
+        }
+        if(c[i].children) compacttjoints(c[i].children, live);
+    }
+}
+
+// refits the t-joints of the cubes in an edited box, using every cube whose edges could reach into it
+void findtjoints(const ivec &bbmin, const ivec &bbmax)
+{
+    int reach = maxcubesize(worldroot, ivec(0, 0, 0), worldsize>>1, bbmin, bbmax);
+    if(!reach) return;
+    gencubeedges(worldroot, ivec(0, 0, 0), worldsize>>1, ivec(bbmin).sub(reach), ivec(bbmax).add(reach), bbmin, bbmax);
+    enumeratekt(edgegroups, edgegroup, g, int, e, findtjoints(e, g));
+    cubeedges.setsize(0);
+    edgegroups.clear();
+
+    // refitted chains are appended and the ones they replace are left behind, so repack once those could make up half of the array
+    if(tjoints.length() > max(2*compactedtjoints, 4096))
+    {
+        vector<tjoint> live;
+        compacttjoints(worldroot, live);
+        tjoints.setsize(0);
+        tjoints.move(live);
+        compactedtjoints = tjoints.length();
+    }
 }
 
 void octarender()                               // creates va s for all leaf cubes that don't already have them
@@ -1732,10 +2075,14 @@ void octarender()                               // creates va s for all leaf cub
     int csi = 0;
     while(1<<csi < worldsize) csi++;
 
+    static vacollect vc;
     recalcprogress = 0;
-    varoot.setsize(0);
-    updateva(worldroot, ivec(0, 0, 0), worldsize/2, csi-1);
+    buildvas(vc, csi);
     loadprogress = 0;
+    varoot.setsize(0);
+    varoot.move(vc.varoot);
+    loopv(vc.pending) uploadva(*vc.pending[i]);
+    vc.pending.deletecontents();
     flushvbo();
 
     explicitsky = 0;
@@ -5,6 +5,9 @@
 
 #include "engine.h"
 #include "mpr.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 const int MAXCLIPPLANES = 1024;
 static clipplanes clipcache[MAXCLIPPLANES];
@@ -418,6 +421,181 @@ float shadowray(ShadowRayCache *cache, const vec &o, const vec &ray, float radiu
     }
 }
 
+// packet version of the above for lightmap generation: up to RAYPACKETSIZE rays walk the octree in lockstep,
+// so the cube lookups of neighbouring rays overlap and the next cube step is done for all of them at once,
+// while each ray still goes through exactly the same arithmetic as the scalar version
+
+#define RAYPACKETSIZE 4
+
+struct shadowraylane
+{
+    cube *levels[20];
+    ivec lo;
+    int x, y, z, lshift;
+    float dent;
+};
+
+static inline bool shadowraycube(ShadowRayCache *cache, cube &c, const ivec &lo, int lshift, const vec &v, const vec &ray, const vec &invray, const ivec &lsizemask, int &side, float dist, float radius, int mode, float &hitdist)
+{
+    if(isentirelysolid(c))
+    {
+        if(c.texture[side]==DEFAULT_SKY && mode&RAY_SKIPSKY)
+        {
+            if(mode&RAY_SKYTEX) { hitdist = radius; return true; }
+        }
+        else { hitdist = dist; return true; }
+    }
+    else
+    {
+        clipplanes &p = cache->clipcache[int(&c - worldroot)&(MAXCLIPPLANES-1)];
+        if(p.owner != &c || p.version != cache->version) { p.owner = &c; p.version = cache->version; genclipplanes(c, lo, 1<<lshift, p, false); }
+        INTERSECTPLANES(side = p.side[i], return false);
+        INTERSECTBOX(side = (i<<1) + 1 - lsizemask[i], return false);
+        if(exitdist >= 0)
+        {
+            if(c.texture[side]==DEFAULT_SKY && mode&RAY_SKIPSKY)
+            {
+                if(mode&RAY_SKYTEX) { hitdist = radius; return true; }
+            }
+            else { hitdist = dist+max(enterdist+0.1f, 0.0f); return true; }
+        }
+    }
+    return false;
+}
+
+static void shadowraypacket(ShadowRayCache *cache, int numrays, const vec *o, const vec *ray, const float *radius, int mode, float *result, extentity *t)
+{
+    shadowraylane lanes[RAYPACKETSIZE];
+    float vx[RAYPACKETSIZE], vy[RAYPACKETSIZE], vz[RAYPACKETSIZE],
+          rx[RAYPACKETSIZE], ry[RAYPACKETSIZE], rz[RAYPACKETSIZE],
+          ix[RAYPACKETSIZE], iy[RAYPACKETSIZE], iz[RAYPACKETSIZE],
+          dist[RAYPACKETSIZE];
+    int bx[RAYPACKETSIZE], by[RAYPACKETSIZE], bz[RAYPACKETSIZE],
+        sx[RAYPACKETSIZE], sy[RAYPACKETSIZE], sz[RAYPACKETSIZE],
+        side[RAYPACKETSIZE];
+    int active = 0, elvl = mode&RAY_BB ? worldscale : 0;
+    loopi(RAYPACKETSIZE)
+    {
+        vx[i] = vy[i] = vz[i] = rx[i] = ry[i] = rz[i] = ix[i] = iy[i] = iz[i] = dist[i] = 0;
+        bx[i] = by[i] = bz[i] = sx[i] = sy[i] = sz[i] = side[i] = 0;
+        if(i >= numrays) continue;
+        // rays starting outside the world are rare enough to just leave to the scalar version
+        if(!insideworld(o[i])) { result[i] = shadowray(cache, o[i], ray[i], radius[i], mode, t); continue; }
+        shadowraylane &l = lanes[i];
+        vx[i] = o[i].x; vy[i] = o[i].y; vz[i] = o[i].z;
+        rx[i] = ray[i].x; ry[i] = ray[i].y; rz[i] = ray[i].z;
+        ix[i] = ray[i].x ? 1/ray[i].x : 1e16f;
+        iy[i] = ray[i].y ? 1/ray[i].y : 1e16f;
+        iz[i] = ray[i].z ? 1/ray[i].z : 1e16f;
+        sx[i] = O_RIGHT - (ix[i]>0 ? 1 : 0);
+        sy[i] = O_FRONT - (iy[i]>0 ? 1 : 0);
+        sz[i] = O_TOP - (iz[i]>0 ? 1 : 0);
+        side[i] = O_BOTTOM;
+        l.levels[worldscale] = worldroot;
+        l.lshift = worldscale;
+        l.dent = radius[i] > 0 ? radius[i] : 1e16f;
+        l.x = int(vx[i]); l.y = int(vy[i]); l.z = int(vz[i]);
+        active |= 1<<i;
+    }
+    while(active)
+    {
+        loopi(numrays) if(active&(1<<i))
+        {
+            shadowraylane &l = lanes[i];
+            cube *lc = l.levels[l.lshift];
+            float hitdist = 0;
+            bool hit = false;
+            for(;;)
+            {
+                l.lshift--;
+                lc += octastep(l.x, l.y, l.z, l.lshift);
+                if(lc->ext && lc->ext->ents && l.lshift < elvl)
+                {
+                    float edist = shadowent(lc->ext->ents, o[i], ray[i], l.dent, mode, t);
+                    if(edist < l.dent) { hitdist = min(edist, dist[i]); hit = true; break; }
+                }
+                if(lc->children==NULL) break;
+                lc = lc->children;
+                l.levels[l.lshift] = lc;
+            }
+            ivec lsizemask(ix[i]>0 ? 1 : 0, iy[i]>0 ? 1 : 0, iz[i]>0 ? 1 : 0);
+            l.lo = ivec(l.x&(~0U<<l.lshift), l.y&(~0U<<l.lshift), l.z&(~0U<<l.lshift));
+            cube &c = *lc;
+            if(!hit && !isempty(c) && !(c.material&MAT_ALPHA))
+                hit = shadowraycube(cache, c, l.lo, l.lshift, vec(vx[i], vy[i], vz[i]), ray[i], vec(ix[i], iy[i], iz[i]), lsizemask, side[i], dist[i], radius[i], mode, hitdist);
+            if(hit) { result[i] = hitdist; active &= ~(1<<i); continue; }
+            bx[i] = l.lo.x+(lsizemask.x<<l.lshift);
+            by[i] = l.lo.y+(lsizemask.y<<l.lshift);
+            bz[i] = l.lo.z+(lsizemask.z<<l.lshift);
+        }
+        if(!active) break;
+
+        // step every lane to its next cube, same operations in the same order as FINDCLOSEST
+#ifdef __SSE2__
+        #define SELECTPS(m, a, b) _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+        #define SELECTI(m, a, b) _mm_or_si128(_mm_and_si128(_mm_castps_si128(m), a), _mm_andnot_si128(_mm_castps_si128(m), b))
+        __m128 px = _mm_loadu_ps(vx), py = _mm_loadu_ps(vy), pz = _mm_loadu_ps(vz),
+               dx = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)bx)), px), _mm_loadu_ps(ix)),
+               dy = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)by)), py), _mm_loadu_ps(iy)),
+               dz = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)bz)), pz), _mm_loadu_ps(iz)),
+               disttonext = dx, closer = _mm_cmplt_ps(dy, disttonext);
+        __m128i closest = _mm_loadu_si128((const __m128i *)sx);
+        disttonext = SELECTPS(closer, dy, disttonext);
+        closest = SELECTI(closer, _mm_loadu_si128((const __m128i *)sy), closest);
+        closer = _mm_cmplt_ps(dz, disttonext);
+        disttonext = SELECTPS(closer, dz, disttonext);
+        closest = SELECTI(closer, _mm_loadu_si128((const __m128i *)sz), closest);
+        disttonext = _mm_add_ps(disttonext, _mm_set1_ps(0.1f));
+        _mm_storeu_ps(vx, _mm_add_ps(px, _mm_mul_ps(_mm_loadu_ps(rx), disttonext)));
+        _mm_storeu_ps(vy, _mm_add_ps(py, _mm_mul_ps(_mm_loadu_ps(ry), disttonext)));
+        _mm_storeu_ps(vz, _mm_add_ps(pz, _mm_mul_ps(_mm_loadu_ps(rz), disttonext)));
+        _mm_storeu_ps(dist, _mm_add_ps(_mm_loadu_ps(dist), disttonext));
+        _mm_storeu_si128((__m128i *)side, closest);
+        #undef SELECTPS
+        #undef SELECTI
+#else
+        loopi(RAYPACKETSIZE)
+        {
+            float dx = (bx[i]-vx[i])*ix[i], dy = (by[i]-vy[i])*iy[i], dz = (bz[i]-vz[i])*iz[i];
+            float disttonext = dx;
+            side[i] = sx[i];
+            if(dy < disttonext) { disttonext = dy; side[i] = sy[i]; }
+            if(dz < disttonext) { disttonext = dz; side[i] = sz[i]; }
+            disttonext += 0.1f;
+            vx[i] += rx[i]*disttonext;
+            vy[i] += ry[i]*disttonext;
+            vz[i] += rz[i]*disttonext;
+            dist[i] += disttonext;
+        }
+#endif
+
+        loopi(numrays) if(active&(1<<i))
+        {
+            if(dist[i]>=radius[i]) { result[i] = dist[i]; active &= ~(1<<i); continue; }
+
+            shadowraylane &l = lanes[i];
+            l.x = int(vx[i]);
+            l.y = int(vy[i]);
+            l.z = int(vz[i]);
+            uint diff = uint(l.lo.x^l.x)|uint(l.lo.y^l.y)|uint(l.lo.z^l.z);
+            if(diff >= uint(worldsize)) { result[i] = radius[i]; active &= ~(1<<i); continue; }
+            diff >>= l.lshift;
+            if(!diff) { result[i] = radius[i]; active &= ~(1<<i); continue; }
+            do
+            {
+                l.lshift++;
+                diff >>= 1;
+            } while(diff);
+        }
+    }
+}
+
+void shadowrays(ShadowRayCache *cache, int numrays, const vec *o, const vec *ray, const float *radius, int mode, float *dist, extentity *t)
+{
+    for(int i = 0; i < numrays; i += RAYPACKETSIZE)
+        shadowraypacket(cache, min(numrays - i, RAYPACKETSIZE), &o[i], &ray[i], &radius[i], mode, &dist[i], t);
+}
+
 float rayent(const vec &o, const vec &ray, float radius, int mode, int size, int &orient, int &ent)
 {
     hitent = -1;
@@ -258,10 +258,24 @@ static inline bool htcmp(const pvsdata &x, const pvsdata &y)
 }
 
 static SDL_mutex *pvsmutex = NULL;
-static hashtable<pvsdata, int> pvscompress;
+static hashtable<pvsdata, int, openhashbase> pvscompress;
 static vector<pvsdata> pvs;
 
-static SDL_mutex *viewcellmutex = NULL;
+// takes the view cell data appended to pvsbuf at offset and returns the index of the matching unique view cell
+static int uniquepvs(int offset)
+{
+    pvsdata key(offset, pvsbuf.length() - offset);
+    int *val = pvscompress.access(key);
+    if(val) pvsbuf.setsize(key.offset);
+    else
+    {
+        val = &pvscompress[key];
+        *val = pvs.length();
+        pvs.add(key);
+    }
+    return *val;
+}
+
 struct viewcellrequest
 {
     int *result;
@@ -288,7 +302,7 @@ uint numwaterplanes = 0;
 
 struct pvsworker
 {
-    pvsworker() : thread(NULL), pvsnodes(new pvsnode[origpvsnodes.length()])
+    pvsworker() : pvsnodes(new pvsnode[origpvsnodes.length()])
     {
     }
     ~pvsworker()
@@ -296,7 +310,6 @@ struct pvsworker
         delete[] pvsnodes;
     }
 
-    SDL_Thread *thread;
     pvsnode *pvsnodes;
 
     shaftbb viewcellbb;
@@ -781,35 +794,12 @@ struct pvsworker
 
         if(pvsmutex) SDL_LockMutex(pvsmutex);
         numviewcells++;
-        pvsdata key(pvsbuf.length(), waterbytes + outbuf.length());
+        int offset = pvsbuf.length();
         loopi(waterbytes) pvsbuf.add((wateroccluded>>(i*8))&0xFF);
         pvsbuf.put(outbuf.getbuf(), outbuf.length());
-        int *val = pvscompress.access(key);
-        if(val) pvsbuf.setsize(key.offset);
-        else
-        {
-            val = &pvscompress[key];
-            *val = pvs.length();
-            pvs.add(key);
-        }
+        int val = uniquepvs(offset);
         if(pvsmutex) SDL_UnlockMutex(pvsmutex);
-        return *val;
-    }
-
-    static int run(void *data)
-    {
-        pvsworker *w = (pvsworker *)data;
-        SDL_LockMutex(viewcellmutex);
-        while(viewcellrequests.length())
-        {
-            viewcellrequest req = viewcellrequests.pop();
-            SDL_UnlockMutex(viewcellmutex);
-            int result = w->genviewcell(req.o, req.size);
-            SDL_LockMutex(viewcellmutex);
-            *req.result = result;
-        }
-        SDL_UnlockMutex(viewcellmutex);
-        return 0;
+        return val;
     }
 };
 
@@ -832,8 +822,31 @@ struct viewcellnode
     }
 };
 
-VARP(pvsthreads, 0, 0, 16);
+VARP(pvsthreads, 0, 0, 256);
 static vector<pvsworker *> pvsworkers;
+static jobpool *pvsjobs = NULL;
+
+// genpvs can be split into shards that separate processes generate, each taking every pvsshards-th view cell
+// in octree order; savepvsshard writes out a shard's view cells and mergepvsshards puts them back together
+VAR(pvsshards, 1, 1, 256);
+VAR(pvsshard, 0, 0, 255);
+
+#define PVSSHARDVERSION 1
+
+static int viewcellindex = -1, shardviewcellsize = 0, shardedpvs = -1, shardedpvscount = 0;
+static vector<int *> shardviewcells;
+static stream **mergeshards = NULL;
+static int nummergeshards = 0;
+static bool mergefailed = false;
+
+static int mergeviewcell(stream *f)
+{
+    int len = f->getlil<ushort>(), offset = pvsbuf.length();
+    if(f->read(pvsbuf.reserve(len).buf, len) != size_t(len)) { mergefailed = true; return -1; }
+    pvsbuf.advance(len);
+    numviewcells++;
+    return uniquepvs(offset);
+}
 
 static volatile bool check_genpvs_progress = false;
 
@@ -851,7 +864,15 @@ static void show_genpvs_progress(int unique = pvs.length(), int processed = numv
 
     defformatstring(text1, "%d%% - %d of %d view cells (%d unique)", int(bar1 * 100), processed, totalviewcells, unique);
 
-    renderprogress(bar1, text1);
+    if(headless)
+    {
+        // nothing to draw into, so just log every tenth of the way
+        static int lastreport = -1;
+        int report = int(bar1 * 10);
+        if(!processed) lastreport = -1;
+        if(report != lastreport) { lastreport = report; conoutf("genpvs: %s", text1); }
+    }
+    else renderprogress(bar1, text1);
 
     if(interceptkey(SDLK_ESCAPE)) genpvs_canceled = true;
     check_genpvs_progress = false;
@@ -929,26 +950,108 @@ static void genviewcells(viewcellnode &p, cube *c, const ivec &co, int size, int
             if(isallclip(h.children)) continue;
         }
         else if(isentirelysolid(h) || (h.material&MATF_CLIP)==MAT_CLIP) continue;
-        if(pvsworkers.length())
+        if(mergeshards)
         {
-            if(genpvs_canceled) return;
-            p.children[i].pvs = pvsworkers[0]->genviewcell(o, size);
-            if(check_genpvs_progress) show_genpvs_progress();
+            if(!mergefailed) p.children[i].pvs = mergeviewcell(mergeshards[viewcellindex++%nummergeshards]);
+            continue;
         }
-        else
+        if(viewcellindex >= 0)
         {
-            viewcellrequest &req = viewcellrequests.add();
-            req.result = &p.children[i].pvs;
-            req.o = o;
-            req.size = size;
+            if(viewcellindex++%pvsshards != pvsshard) continue;
+            shardviewcells.add(&p.children[i].pvs);
         }
+        viewcellrequest &req = viewcellrequests.add();
+        req.result = &p.children[i].pvs;
+        req.o = o;
+        req.size = size;
     }
 }
 
+// the view cell requests are in octree order, so a range of them covers whole subtrees: a job takes the range of
+// node n of an implicit binary tree over them and keeps pushing its upper half for others to steal
+static void genviewcelljob(void *data, int node, int thread)
+{
+    int lo = 0, hi = viewcellrequests.length(), depth = 0;
+    while(node>>(depth+1)) depth++;
+    for(int i = depth-1; i >= 0; i--)
+    {
+        int mid = (lo + hi)/2;
+        if(node&(1<<i)) lo = mid; else hi = mid;
+    }
+    volatile int &pending = *(volatile int *)data;
+    while(hi - lo > 1)
+    {
+        int mid = (lo + hi)/2;
+        pvsjobs->add(pending, genviewcelljob, data, 2*node+1, thread);
+        node *= 2;
+        hi = mid;
+    }
+    if(lo >= hi || genpvs_canceled) return;
+    viewcellrequest &req = viewcellrequests[lo];
+    *req.result = pvsworkers[thread]->genviewcell(req.o, req.size);
+}
+
 static viewcellnode *viewcells = NULL;
 static int lockedwaterplanes[MAXWATERPVS];
 static uchar *curpvs = NULL, *lockedpvs = NULL;
-static int curwaterpvs = 0, lockedwaterpvs = 0;
+static int curwaterpvs = 0, lockedwaterpvs = 0, curpvsindex = -1;
+
+// runtime form of a view cell: one bit per vertex array for whether its cube is hidden, as findvisiblevas tests it,
+// and one for whether its geometry is hidden; built in a single pass over valist the first time a unique view cell
+// is entered, so the per-frame va tests are a bit lookup instead of a walk down the serialized tree
+static vector<int> freepvsids;
+static int numpvsids = 0, pvsvawords = 1; // the bitsets are over-allocated so new ids usually still fit
+static vector<uint *> pvsvacache;
+static uint *curpvsva = NULL, *lockedpvsva = NULL;
+
+static void clearpvsvacache()
+{
+    loopv(pvsvacache) DELETEA(pvsvacache[i]);
+    pvsvacache.setsize(0);
+    DELETEA(lockedpvsva);
+    curpvsva = NULL;
+}
+
+static inline bool pvsoccluded(uchar *buf, const ivec &bbmin, const ivec &bbmax);
+
+static inline void setpvsvabits(uint *bits, uchar *buf, const vtxarray *va)
+{
+    int bit = 2*va->pvsid;
+    bits[bit>>5] &= ~(3<<(bit&31));
+    if(pvsoccluded(buf, va->o, ivec(va->o).add(va->size))) bits[bit>>5] |= 1<<(bit&31);
+    bit++;
+    if(pvsoccluded(buf, va->geommin, va->geommax)) bits[bit>>5] |= 1<<(bit&31);
+}
+
+// an edit only uploads a few vas, so their bits are filled into the bitsets already built instead of dropping them all
+void allocpvsid(vtxarray *va)
+{
+    va->pvsid = freepvsids.length() ? freepvsids.pop() : numpvsids++;
+    if(2*numpvsids > 32*pvsvawords)
+    {
+        clearpvsvacache();
+        pvsvawords = max(2*pvsvawords, (2*numpvsids + 31)>>5);
+        return;
+    }
+    loopv(pvsvacache) if(pvsvacache[i])
+    {
+        const pvsdata &d = pvs[i];
+        setpvsvabits(pvsvacache[i], &pvsbuf[d.offset + d.len%9], va);
+    }
+    if(lockedpvsva) setpvsvabits(lockedpvsva, lockedpvs, va);
+}
+
+void freepvsid(int id)
+{
+    freepvsids.add(id);
+    if(freepvsids.length() >= numpvsids)
+    {
+        // every va is gone, e.g. on allchanged, so rebuilding the bitsets on demand is cheaper than patching them
+        freepvsids.setsize(0);
+        numpvsids = 0;
+        clearpvsvacache();
+    }
+}
 
 static inline pvsdata *lookupviewcell(const vec &p)
 {
@@ -970,6 +1073,8 @@ static inline pvsdata *lookupviewcell(const vec &p)
 static void lockpvs_(bool lock)
 {
     if(lockedpvs) DELETEA(lockedpvs);
+    if(curpvsva == lockedpvsva) curpvsva = NULL;
+    DELETEA(lockedpvsva);
     if(!lock) return;
     pvsdata *d = lookupviewcell(camera1->o);
     if(!d) return;
@@ -994,6 +1099,8 @@ void setviewcell(const vec &p)
     {
         curpvs = lockedpvs;
         curwaterpvs = lockedwaterpvs;
+        curpvsindex = -1;
+        curpvsva = lockedpvsva;
     }
     else
     {
@@ -1003,6 +1110,8 @@ void setviewcell(const vec &p)
         if(d)
         {
             loopi(d->len%9) curwaterpvs |= *curpvs++ << (i*8);
+            curpvsindex = int(d - pvs.getbuf());
+            curpvsva = pvsvacache.inrange(curpvsindex) ? pvsvacache[curpvsindex] : NULL;
         }
     }
     if(!usepvs || !usewaterpvs) curwaterpvs = 0;
@@ -1010,10 +1119,13 @@ void setviewcell(const vec &p)
 
 void clearpvs()
 {
+    shardviewcells.setsize(0);
+    shardedpvs = -1;
     DELETEP(viewcells);
     pvs.setsize(0);
     pvsbuf.setsize(0);
     curpvs = NULL;
+    clearpvsvacache();
     numwaterplanes = 0;
     lockpvs = 0;
     lockpvs_(false);
@@ -1103,6 +1215,11 @@ void genpvs(int *viewcellsize)
         conoutf(CON_ERROR, "map is too large for PVS");
         return;
     }
+    if(pvsshard >= pvsshards)
+    {
+        conoutf(CON_ERROR, "pvsshard must be less than pvsshards");
+        return;
+    }
 
     renderbackground("generating PVS (esc to abort)");
     genpvs_canceled = false;
@@ -1121,48 +1238,46 @@ void genpvs(int *viewcellsize)
     genpvsnodes(worldroot);
 
     totalviewcells = countviewcells(worldroot, ivec(0, 0, 0), worldsize>>1, *viewcellsize>0 ? *viewcellsize : 32);
+    if(pvsshards > 1)
+    {
+        totalviewcells = (totalviewcells - pvsshard + pvsshards - 1)/pvsshards;
+        viewcellindex = 0;
+    }
     numviewcells = 0;
     genpvs_canceled = false;
     check_genpvs_progress = false;
-    SDL_TimerID timer = 0;
-    int numthreads = pvsthreads > 0 ? pvsthreads : numcpus;
-    if(numthreads<=1) 
-    {
-        pvsworkers.add(new pvsworker);
-        timer = SDL_AddTimer(500, genpvs_timer, NULL);
-    }
+    int numthreads = pvsthreads > 0 ? pvsthreads : numcores;
     viewcells = new viewcellnode;
     genviewcells(*viewcells, worldroot, ivec(0, 0, 0), worldsize>>1, *viewcellsize>0 ? *viewcellsize : 32);
-    if(numthreads<=1)
-    {
-        SDL_RemoveTimer(timer);
-    }
-    else
+    viewcellindex = -1;
+    if(numthreads > 1)
     {
         renderprogress(0, "creating threads");
         if(!pvsmutex) pvsmutex = SDL_CreateMutex();
-        if(!viewcellmutex) viewcellmutex = SDL_CreateMutex();
-        loopi(numthreads)
-        {
-            pvsworker *w = pvsworkers.add(new pvsworker);
-            w->thread = SDL_CreateThread(pvsworker::run, "pvs worker", w);
-        }
-        show_genpvs_progress(0, 0);
-        while(!genpvs_canceled)
+    }
+    // the main thread takes part as job thread 0, so it only needs numthreads-1 helpers
+    pvsjobs = new jobpool(numthreads-1);
+    loopi(pvsjobs->numworkers+1) pvsworkers.add(new pvsworker);
+    show_genpvs_progress(0, 0);
+    SDL_TimerID timer = SDL_AddTimer(500, genpvs_timer, NULL);
+    volatile int pending = 0;
+    if(viewcellrequests.length()) pvsjobs->add(pending, genviewcelljob, (void *)&pending, 1);
+    while(atomicload(pending))
+    {
+        if(!pvsjobs->help()) pvsjobs->wait(pending, 500);
+        if(check_genpvs_progress && !genpvs_canceled)
         {
-            SDL_Delay(500);
-            SDL_LockMutex(viewcellmutex);
-            int unique = pvs.length(), processed = numviewcells, remaining = viewcellrequests.length();
-            SDL_UnlockMutex(viewcellmutex);
+            if(pvsmutex) SDL_LockMutex(pvsmutex);
+            int unique = pvs.length(), processed = numviewcells;
+            if(pvsmutex) SDL_UnlockMutex(pvsmutex);
             show_genpvs_progress(unique, processed);
-            if(!remaining) break;
-        }        
-        SDL_LockMutex(viewcellmutex);
-        viewcellrequests.setsize(0);
-        SDL_UnlockMutex(viewcellmutex);
-        loopv(pvsworkers) SDL_WaitThread(pvsworkers[i]->thread, NULL);
+        }
     }
+    SDL_RemoveTimer(timer);
+    int usedthreads = pvsjobs->numworkers+1;
+    DELETEP(pvsjobs);
     pvsworkers.deletecontents();
+    viewcellrequests.setsize(0);
 
     origpvsnodes.setsize(0);
     pvscompress.clear();
@@ -1173,16 +1288,120 @@ void genpvs(int *viewcellsize)
         clearpvs();
         conoutf("genpvs aborted");
     }
-    else conoutf("generated %d unique view cells totaling %.1f kB and averaging %d B (%.1f seconds)", 
-            pvs.length(), pvsbuf.length()/1024.0f, pvsbuf.length()/max(pvs.length(), 1), (end - start) / 1000.0f);
+    else 
+    {
+        conoutf("generated %d unique view cells totaling %.1f kB and averaging %d B (%.1f seconds, %d %s)", 
+            pvs.length(), pvsbuf.length()/1024.0f, pvsbuf.length()/max(pvs.length(), 1), (end - start) / 1000.0f,
+            usedthreads, usedthreads > 1 ? "threads" : "thread");
+        if(pvsshards > 1)
+        {
+            shardedpvs = pvsshard;
+            shardedpvscount = pvsshards;
+            shardviewcellsize = *viewcellsize>0 ? *viewcellsize : 32;
+            conoutf("only generated shard %d of %d, use savepvsshard to keep it", pvsshard, pvsshards);
+        }
+    }
 }
 
 COMMAND(genpvs, "i");
 
+void savepvsshard(const char *name)
+{
+    if(shardedpvs < 0) { conoutf(CON_ERROR, "no PVS shard was generated"); return; }
+    if(!*name) { conoutf(CON_ERROR, "no PVS shard file given"); return; }
+    stream *f = opengzfile(path(name, true), "wb");
+    if(!f) { conoutf(CON_ERROR, "could not write PVS shard %s", name); return; }
+    f->write("PVSH", 4);
+    f->putlil<int>(PVSSHARDVERSION);
+    f->putlil<int>(worldsize);
+    f->putlil<int>(shardviewcellsize);
+    f->putlil<int>(shardedpvs);
+    f->putlil<int>(shardedpvscount);
+    f->putlil<int>(numwaterplanes);
+    f->putlil<int>(shardviewcells.length());
+    loopv(shardviewcells)
+    {
+        const pvsdata &d = pvs[*shardviewcells[i]];
+        f->putlil<ushort>(d.len);
+        f->write(&pvsbuf[d.offset], d.len);
+    }
+    delete f;
+    conoutf("saved PVS shard %d of %d to %s (%d view cells)", shardedpvs, shardedpvscount, name, shardviewcells.length());
+}
+
+COMMAND(savepvsshard, "s");
+
+void mergepvsshards(tagval *args, int numargs)
+{
+    if(!numargs) return;
+    if(worldsize > 1<<15)
+    {
+        conoutf(CON_ERROR, "map is too large for PVS");
+        return;
+    }
+    stream **shards = new stream *[numargs];
+    memset(shards, 0, numargs*sizeof(stream *));
+    int viewcellsize = 0, waterplanes = 0, numcells = 0;
+    bool failed = false;
+    loopi(numargs)
+    {
+        const char *name = args[i].getstr();
+        stream *f = opengzfile(path(name, true), "rb");
+        if(!f) { conoutf(CON_ERROR, "could not read PVS shard %s", name); failed = true; break; }
+        char magic[4];
+        int version = f->read(magic, 4) == 4 && !memcmp(magic, "PVSH", 4) ? f->getlil<int>() : -1,
+            size = f->getlil<int>(), cellsize = f->getlil<int>(), shard = f->getlil<int>(), count = f->getlil<int>(), water = f->getlil<int>();
+        numcells += f->getlil<int>();
+        if(version != PVSSHARDVERSION || size != worldsize || count != numargs || shard < 0 || shard >= numargs || shards[shard] ||
+           (i && (cellsize != viewcellsize || water != waterplanes)))
+        {
+            conoutf(CON_ERROR, "PVS shard %s does not match this map or the other shards", name);
+            delete f;
+            failed = true;
+            break;
+        }
+        shards[shard] = f;
+        viewcellsize = cellsize;
+        waterplanes = water;
+    }
+    if(!failed)
+    {
+        renderbackground("merging PVS shards...");
+        clearpvs();
+        calcpvsbounds();
+        findwaterplanes();
+        totalviewcells = numcells;
+        numviewcells = 0;
+        viewcells = new viewcellnode;
+        mergeshards = shards;
+        nummergeshards = numargs;
+        mergefailed = false;
+        genpvs_canceled = false;
+        viewcellindex = 0;
+        genviewcells(*viewcells, worldroot, ivec(0, 0, 0), worldsize>>1, viewcellsize);
+        viewcellindex = -1;
+        mergeshards = NULL;
+        pvscompress.clear();
+        if(mergefailed || numviewcells != numcells || int(numwaterplanes) != waterplanes)
+        {
+            conoutf(CON_ERROR, "PVS shards do not match this map");
+            clearpvs();
+        }
+        else conoutf("merged %d PVS shards into %d unique view cells totaling %.1f kB", numargs, pvs.length(), pvsbuf.length()/1024.0f);
+    }
+    loopi(numargs) if(shards[i]) delete shards[i];
+    delete[] shards;
+}
+
+COMMAND(mergepvsshards, "V");
+
 void pvsstats()
 {
     conoutf("%d unique view cells totaling %.1f kB and averaging %d B",          
         pvs.length(), pvsbuf.length()/1024.0f, pvsbuf.length()/max(pvs.length(), 1));
+    int cached = 0;
+    loopv(pvsvacache) if(pvsvacache[i]) cached++;
+    conoutf("%d view cells expanded for %d vertex arrays (%.1f kB)", cached, valist.length(), cached*pvsvawords*sizeof(uint)/1024.0f);
 }
 
 COMMAND(pvsstats, "");
@@ -1236,6 +1455,30 @@ bool pvsoccludedsphere(const vec &center, float radius)
     return pvsoccluded(curpvs, bbmin, bbmax);
 }
 
+static uint *buildpvsva(uchar *buf)
+{
+    uint *bits = new uint[pvsvawords];
+    memset(bits, 0, pvsvawords*sizeof(uint));
+    loopv(valist) setpvsvabits(bits, buf, valist[i]);
+    return bits;
+}
+
+bool pvsoccludedva(const vtxarray *va, bool geom)
+{
+    if(curpvs==NULL) return false;
+    if(!curpvsva)
+    {
+        if(curpvsindex < 0) curpvsva = lockedpvsva = buildpvsva(curpvs);
+        else
+        {
+            while(pvsvacache.length() <= curpvsindex) pvsvacache.add(NULL);
+            curpvsva = pvsvacache[curpvsindex] = buildpvsva(curpvs);
+        }
+    }
+    int bit = 2*va->pvsid + (geom ? 1 : 0);
+    return (curpvsva[bit>>5]>>(bit&31))&1;
+}
+
 bool waterpvsoccluded(int height)
 {
     if(!curwaterpvs) return false;
@@ -1799,6 +1799,7 @@ void drawtextures()
 {
     if(minimized) { deferdrawtextures = true; return; }
     deferdrawtextures = false;
+    flushtexjobs();
     genenvmaps();
     drawminimap();
 }
@@ -2322,7 +2323,7 @@ void gl_drawhud()
                         abovehud -= max(th, FONTH);
                         draw_text(editinfo, FONTH/2, abovehud);
                     }
-                    DELETEA(editinfo);
+                    freescriptstr(editinfo);
                 }
             }
             else if(char *gameinfo = execidentstr("gamehud"))
@@ -2335,7 +2336,7 @@ void gl_drawhud()
                     roffset += max(th, FONTH);
                     draw_text(gameinfo, conw-max(5*FONTH, 2*FONTH+tw), conh-FONTH/2-roffset);
                 }
-                DELETEA(gameinfo);
+                freescriptstr(gameinfo);
             }
 
             pophudmatrix();
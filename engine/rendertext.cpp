@@ -152,7 +152,7 @@ void tabify(const char *str, int *numtabs)
     int tw = max(*numtabs, 0)*FONTTAB-1, tabs = 0;
     for(float w = text_widthf(str); w <= tw; w = TEXTTAB(w)) ++tabs;
     int len = strlen(str);
-    char *tstr = newstring(len + tabs);
+    char *tstr = newscriptstr(len + tabs);
     memcpy(tstr, str, len);
     memset(&tstr[len], '\t', tabs);
     tstr[len+tabs] = '\0';
@@ -128,7 +128,7 @@ void findvisiblevas(vector<vtxarray *> &vas, bool resetocclude = false)
         v.curvfc = isvisiblecube(v.o, v.size);
         if(v.curvfc!=VFC_NOT_VISIBLE) 
         {
-            if(pvsoccluded(v.o, v.size))
+            if(pvsoccludedva(&v, false))
             {
                 v.curvfc += PVS_FULL_VISIBLE - VFC_FULL_VISIBLE;
                 continue;
@@ -1567,7 +1567,7 @@ void rendergeom(float causticspass, bool fogpass)
             va->occluded = va->query && va->query->owner == va && checkquery(va->query) ? min(va->occluded+1, int(OCCLUDE_BB)) : OCCLUDE_NOTHING;
             va->query = newquery(va);
             if((!va->query && zpass) || !va->occluded)
-                va->occluded = pvsoccluded(va->geommin, va->geommax) ? OCCLUDE_GEOM : OCCLUDE_NOTHING;
+                va->occluded = pvsoccludedva(va, true) ? OCCLUDE_GEOM : OCCLUDE_NOTHING;
             if(va->occluded >= OCCLUDE_GEOM)
             {
                 if(va->query) 
@@ -1583,7 +1583,7 @@ void rendergeom(float causticspass, bool fogpass)
         else
         {
             va->query = NULL;
-            va->occluded = pvsoccluded(va->geommin, va->geommax) ? OCCLUDE_GEOM : OCCLUDE_NOTHING;
+            va->occluded = pvsoccludedva(va, true) ? OCCLUDE_GEOM : OCCLUDE_NOTHING;
             if(va->occluded >= OCCLUDE_GEOM) continue;
         }
 
@@ -1631,7 +1631,7 @@ void rendergeom(float causticspass, bool fogpass)
             }
             else
             {
-                va->occluded = pvsoccluded(va->geommin, va->geommax) ? OCCLUDE_GEOM : OCCLUDE_NOTHING;
+                va->occluded = pvsoccludedva(va, true) ? OCCLUDE_GEOM : OCCLUDE_NOTHING;
                 if(va->occluded >= OCCLUDE_GEOM) continue;
             }
 
@@ -1717,7 +1717,7 @@ void renderalphageom(bool fogpass)
         {
             if((refracting < 0 ? va->geommin.z > reflectz : va->geommax.z <= reflectz) || va->occluded >= OCCLUDE_BB) continue;
             if(ishiddencube(va->o, va->size)) continue;
-            if(va->occluded >= OCCLUDE_GEOM && pvsoccluded(va->geommin, va->geommax)) continue;
+            if(va->occluded >= OCCLUDE_GEOM && pvsoccludedva(va, true)) continue;
         }
         else if(reflecting)
         {
@@ -1726,7 +1726,7 @@ void renderalphageom(bool fogpass)
         else 
         {
             if(va->occluded >= OCCLUDE_BB) continue;
-            if(va->occluded >= OCCLUDE_GEOM && pvsoccluded(va->geommin, va->geommax)) continue;
+            if(va->occluded >= OCCLUDE_GEOM && pvsoccludedva(va, true)) continue;
         }
         if(fogpass ? va->geommax.z <= reflectz-refractfog || !refractfog : va->curvfc==VFC_FOGGED) continue;
         alphavas.add(va);
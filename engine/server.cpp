@@ -3,6 +3,12 @@
 
 #include "engine.h"
 
+#if defined(STANDALONE) && !defined(WIN32)
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
 #define LOGSTRLEN 512
 
 static FILE *logfile = NULL;
@@ -96,6 +102,9 @@ struct client                   // server side version of "dynent" type
     int type;
     int num;
     ENetPeer *peer;
+    enet_uint32 connectid;
+    int rtt;
+    ENetAddress address;
     string hostname;
     void *info;
 };
@@ -111,6 +120,50 @@ int localclients = 0, nonlocalclients = 0;
 bool hasnonlocalclients() { return nonlocalclients!=0; }
 bool haslocalclients() { return localclients!=0; }
 
+#ifdef STANDALONE
+// threaded network I/O: the ENet host, the server info sockets and the master server connection
+// may be serviced on their own thread, which only talks to the game thread through these queues
+enum
+{
+    // network thread to game thread
+    NET_CONNECT = 0, NET_RECEIVE, NET_DISCONNECT, NET_RELEASE, NET_SERVERINFO,
+    NET_MASTERCONNECT, NET_MASTERDISCONNECT, NET_MASTERINPUT, NET_LOG,
+    // game thread to network thread
+    NET_SEND, NET_KICK, NET_FLUSH, NET_SERVERINFOREPLY, NET_MASTERREQUEST, NET_MASTERRESET
+};
+
+struct netevent
+{
+    int type, chan, rtt;
+    ENetPeer *peer;
+    enet_uint32 id;
+    ENetPacket *packet;
+    ENetAddress address;
+};
+
+static spscqueue<netevent, 4096> netin, netout;
+static vector<netevent> netoutpending;
+static bool netthreaded = false, netwake = false;
+
+static void postnetout(int type, ENetPeer *peer = NULL, enet_uint32 id = 0, int chan = 0, ENetPacket *packet = NULL, const ENetAddress *address = NULL)
+{
+    netevent e;
+    e.type = type;
+    e.chan = chan;
+    e.peer = peer;
+    e.id = id;
+    e.packet = packet;
+    if(address) e.address = *address;
+    if(netoutpending.length() || !netout.push(e)) netoutpending.add(e);
+    netwake = true;
+}
+
+static ENetPacket *netdata(const void *data, int len)
+{
+    return enet_packet_create(data, len, 0);
+}
+#endif
+
 client &addclient(int type)
 {
     client *c = NULL;
@@ -127,6 +180,7 @@ client &addclient(int type)
     }
     c->info = server::newclientinfo();
     c->type = type;
+    c->rtt = ENET_PEER_DEFAULT_ROUND_TRIP_TIME;
     switch(type)
     {
         case ST_TCPIP: nonlocalclients++; break;
@@ -153,8 +207,15 @@ void delclient(client *c)
     }
 }
 
+#ifdef STANDALONE
+static void stopnetthread();
+#endif
+
 void cleanupserver()
 {
+#ifdef STANDALONE
+    stopnetthread();
+#endif
     if(serverhost) enet_host_destroy(serverhost);
     serverhost = NULL;
 
@@ -173,7 +234,18 @@ int getservermtu() { return serverhost ? serverhost->mtu : -1; }
 void *getclientinfo(int i) { return !clients.inrange(i) || clients[i]->type==ST_EMPTY ? NULL : clients[i]->info; }
 ENetPeer *getclientpeer(int i) { return clients.inrange(i) && clients[i]->type==ST_TCPIP ? clients[i]->peer : NULL; }
 int getnumclients()        { return clients.length(); }
-uint getclientip(int n)    { return clients.inrange(n) && clients[n]->type==ST_TCPIP ? clients[n]->peer->address.host : 0; }
+uint getclientip(int n)    { return clients.inrange(n) && clients[n]->type==ST_TCPIP ? clients[n]->address.host : 0; }
+
+int getclientrtt(int n)
+{
+    if(!clients.inrange(n) || clients[n]->type!=ST_TCPIP) return ENET_PEER_DEFAULT_ROUND_TRIP_TIME;
+#ifdef STANDALONE
+    // the peer belongs to the network thread, which passes its round trip time along with every packet
+    if(netthreaded) return clients[n]->rtt;
+#endif
+    ENetPeer *peer = clients[n]->peer;
+    return peer ? peer->roundTripTime + peer->roundTripTimeVariance : ENET_PEER_DEFAULT_ROUND_TRIP_TIME;
+}
 
 void sendpacket(int n, int chan, ENetPacket *packet, int exclude)
 {
@@ -187,6 +259,15 @@ void sendpacket(int n, int chan, ENetPacket *packet, int exclude)
     {
         case ST_TCPIP:
         {
+#ifdef STANDALONE
+            if(netthreaded)
+            {
+                // held until the network thread is done sending it
+                packet->referenceCount++;
+                postnetout(NET_SEND, clients[n]->peer, clients[n]->connectid, chan, packet);
+                break;
+            }
+#endif
             enet_peer_send(clients[n]->peer, chan, packet);
             break;
         }
@@ -308,6 +389,10 @@ const char *disconnectreason(int reason)
 void disconnect_client(int n, int reason)
 {
     if(!clients.inrange(n) || clients[n]->type!=ST_TCPIP) return;
+#ifdef STANDALONE
+    if(netthreaded) postnetout(NET_KICK, clients[n]->peer, clients[n]->connectid, reason);
+    else
+#endif
     enet_peer_disconnect(clients[n]->peer, reason);
     server::clientdisconnect(n);
     delclient(clients[n]);
@@ -357,8 +442,19 @@ vector<char> masterout, masterin;
 int masteroutpos = 0, masterinpos = 0;
 VARN(updatemaster, allowupdatemaster, 0, 1, 1);
 
+extern char *mastername;
+extern int masterport;
+
 void disconnectmaster()
 {
+#ifdef STANDALONE
+    if(netthreaded)
+    {
+        postnetout(NET_MASTERRESET, NULL, masterport, 0, netdata(mastername, strlen(mastername)+1));
+        lastupdatemaster = masterconnecting = masterconnected = 0;
+        return;
+    }
+#endif
     if(mastersock != ENET_SOCKET_NULL) 
     {
         server::masterdisconnected();
@@ -410,6 +506,15 @@ ENetSocket connectmaster(bool wait)
 
 bool requestmaster(const char *req)
 {
+#ifdef STANDALONE
+    if(netthreaded)
+    {
+        if(!mastername[0]) return false;
+        if(!masterconnected && !masterconnecting) lastconnectmaster = masterconnecting = totalmillis ? totalmillis : 1;
+        postnetout(NET_MASTERREQUEST, NULL, 0, 0, netdata(req, strlen(req)));
+        return true;
+    }
+#endif
     if(mastersock == ENET_SOCKET_NULL)
     {
         mastersock = connectmaster(false);
@@ -429,6 +534,20 @@ bool requestmasterf(const char *fmt, ...)
     return requestmaster(req);
 }
 
+void processmastercommand(const char *input, const char *end)
+{
+    const char *args = input;
+    while(args < end && !iscubespace(*args)) args++;
+    int cmdlen = args - input;
+    while(args < end && iscubespace(*args)) args++;
+
+    if(matchstring(input, cmdlen, "failreg"))
+        conoutf(CON_ERROR, "master server registration failed: %s", args);
+    else if(matchstring(input, cmdlen, "succreg"))
+        conoutf("master server registration succeeded");
+    else server::processmasterinput(input, cmdlen, args);
+}
+
 void processmasterinput()
 {
     if(masterinpos >= masterin.length()) return;
@@ -438,16 +557,7 @@ void processmasterinput()
     {
         *end = '\0';
 
-        const char *args = input;
-        while(args < end && !iscubespace(*args)) args++;
-        int cmdlen = args - input;
-        while(args < end && iscubespace(*args)) args++;
-
-        if(matchstring(input, cmdlen, "failreg"))
-            conoutf(CON_ERROR, "master server registration failed: %s", args);
-        else if(matchstring(input, cmdlen, "succreg"))
-            conoutf("master server registration succeeded");
-        else server::processmasterinput(input, cmdlen, args);
+        processmastercommand(input, end);
 
         end++;
         masterinpos = end - masterin.getbuf();
@@ -464,6 +574,7 @@ void processmasterinput()
 
 void flushmasteroutput()
 {
+    profilescope prof(SPROF_MASTER);
     if(masterconnecting && totalmillis - masterconnecting >= 60000)
     {
         logoutf("could not connect to master server");
@@ -489,6 +600,7 @@ void flushmasteroutput()
 
 void flushmasterinput()
 {
+    profilescope prof(SPROF_MASTER);
     if(masterin.length() >= masterin.capacity())
         masterin.reserve(4096);
 
@@ -508,6 +620,13 @@ static ENetAddress pongaddr;
 
 void sendserverinforeply(ucharbuf &p)
 {
+#ifdef STANDALONE
+    if(netthreaded)
+    {
+        postnetout(NET_SERVERINFOREPLY, NULL, 0, 0, netdata(p.buf, p.length()), &pongaddr);
+        return;
+    }
+#endif
     ENetBuffer buf;
     buf.data = p.buf;
     buf.dataLength = p.length();
@@ -518,6 +637,7 @@ void sendserverinforeply(ucharbuf &p)
 
 void checkserversockets()        // reply all server info requests
 {
+    profilescope prof(SPROF_SOCKETS);
     static ENetSocketSet readset, writeset;
     ENET_SOCKETSET_EMPTY(readset);
     ENET_SOCKETSET_EMPTY(writeset);
@@ -579,6 +699,106 @@ void checkserversockets()        // reply all server info requests
 VAR(serveruprate, 0, 0, INT_MAX);
 SVAR(serverip, "");
 VARF(serverport, 0, server::serverport(), 0xFFFF-1, { if(!serverport) serverport = server::serverport(); });
+VAR(serverbatch, 0, 32, ENET_HOST_MAXIMUM_BATCH_SIZE);
+
+// server tick profiler: log-scale histograms of microseconds per sample, kept for the last few rolling windows
+
+VAR(serverprofile, 0, 1, 1);
+
+#define PROFILEWINDOWS 6
+#define PROFILEWINDOWMILLIS 10000
+#define PROFILEBUCKETS 124
+
+// exact below 8us, then 4 buckets per power of two
+static inline int profilebucket(uint micros)
+{
+    if(micros < 8) return micros;
+    int e = 31;
+    while(!(micros >> e)) e--;
+    return 8 + (e-3)*4 + ((micros >> (e-2))&3);
+}
+
+static inline uint profilebucketmicros(int bucket)
+{
+    if(bucket < 8) return bucket;
+    int e = 3 + (bucket-8)/4;
+    return ((4 + (bucket-8)%4) << (e-2)) + (1 << (e-2))/2;
+}
+
+struct profilehistogram
+{
+    int epoch[PROFILEWINDOWS];
+    uint maxmicros[PROFILEWINDOWS];
+    int counts[PROFILEWINDOWS][PROFILEBUCKETS];
+
+    profilehistogram() { memset(this, 0, sizeof(*this)); loopi(PROFILEWINDOWS) epoch[i] = -1; }
+
+    void add(int cur, uint micros)
+    {
+        int w = cur%PROFILEWINDOWS;
+        if(epoch[w] != cur)
+        {
+            epoch[w] = cur;
+            maxmicros[w] = 0;
+            memset(counts[w], 0, sizeof(counts[w]));
+        }
+        counts[w][profilebucket(micros)]++;
+        maxmicros[w] = max(maxmicros[w], micros);
+    }
+};
+
+static profilehistogram *profilecounters[SPROF_MAX] = { NULL };
+
+static inline int profileepoch() { return int(enet_time_get()/PROFILEWINDOWMILLIS); }
+
+int serverprofilewindow() { return PROFILEWINDOWS*PROFILEWINDOWMILLIS/1000; }
+
+void profileserver(int counter, uint micros)
+{
+    if(counter < 0 || counter >= SPROF_MAX) return;
+    profilehistogram *&h = profilecounters[counter];
+    if(!h)
+    {
+        h = new (false) profilehistogram;
+        if(!h) return;
+    }
+    h->add(profileepoch(), micros);
+}
+
+bool getserverprofile(int counter, profilestats &s)
+{
+    s.count = 0;
+    s.p50 = s.p99 = s.max = 0;
+    if(counter < 0 || counter >= SPROF_MAX || !profilecounters[counter]) return false;
+    profilehistogram &h = *profilecounters[counter];
+    int cur = profileepoch(), counts[PROFILEBUCKETS];
+    memset(counts, 0, sizeof(counts));
+    loopi(PROFILEWINDOWS) if(h.epoch[i] >= 0 && h.epoch[i] > cur - PROFILEWINDOWS)
+    {
+        loopj(PROFILEBUCKETS) counts[j] += h.counts[i][j];
+        s.max = max(s.max, h.maxmicros[i]);
+    }
+    loopi(PROFILEBUCKETS) s.count += counts[i];
+    if(s.count <= 0) return false;
+    int p50 = (s.count+1)/2, p99 = s.count - s.count/100, seen = 0;
+    loopi(PROFILEBUCKETS) if(counts[i])
+    {
+        int prev = seen;
+        seen += counts[i];
+        if(prev < p50 && seen >= p50) s.p50 = min(profilebucketmicros(i), s.max);
+        if(prev < p99 && seen >= p99) { s.p99 = min(profilebucketmicros(i), s.max); break; }
+    }
+    return true;
+}
+
+void resetserverprofile()
+{
+    loopi(SPROF_MAX) DELETEP(profilecounters[i]);
+}
+COMMAND(resetserverprofile, "");
+
+// time blocked waiting for network events, which is not counted towards the slice
+static uint profilewaitmicros = 0;
 
 #ifdef STANDALONE
 int curtime = 0, lastmillis = 0, elapsedtime = 0, totalmillis = 0;
@@ -604,6 +824,494 @@ void updatetime()
     }
 }
 
+static void connectclient(ENetPeer *peer, enet_uint32 connectid, const ENetAddress &address)
+{
+    client &c = addclient(ST_TCPIP);
+    c.peer = peer;
+    c.peer->data = &c;
+    c.connectid = connectid;
+    c.address = address;
+    string hn;
+    copystring(c.hostname, (enet_address_get_host_ip(&c.address, hn, sizeof(hn))==0) ? hn : "unknown");
+    logoutf("client connected (%s)", c.hostname);
+    int reason = server::clientconnect(c.num, c.address.host);
+    if(reason) disconnect_client(c.num, reason);
+}
+
+static void disconnectclient(ENetPeer *peer)
+{
+    client *c = (client *)peer->data;
+    if(!c) return;
+    logoutf("disconnected client (%s)", c->hostname);
+    server::clientdisconnect(c->num);
+    delclient(c);
+}
+
+static void logstatus(int sent, int received)
+{
+    if(totalmillis-laststatus>60*1000)   // display bandwidth stats, useful for server ops
+    {
+        laststatus = totalmillis;     
+        if(nonlocalclients || sent || received) logoutf("status: %d remote clients, %.1f send, %.1f rec (K/sec)", nonlocalclients, sent/60.0f/1024, received/60.0f/1024);
+        if(serverhost) serverhost->totalSentData = serverhost->totalReceivedData = 0;
+    }
+}
+
+#ifdef STANDALONE
+VAR(netthread, 0, 0, 1);
+
+static thread netiothread;
+static volatile int netquit = 0, netsentdata = 0, netreceiveddata = 0;
+static mutex netlock;
+static condition netcond;
+static vector<netevent> netinpending;
+static ENetSocket wakesock = ENET_SOCKET_NULL;
+static ENetAddress wakeaddress;
+
+static ENetSocket netmastersock = ENET_SOCKET_NULL;
+static ENetAddress netmasteraddress = { ENET_HOST_ANY, ENET_PORT_ANY };
+static string netmastername = "";
+static int netmasterport = 0, netmasteroutpos = 0;
+static enet_uint32 netmasterconnecting = 0;
+static bool netmasterconnected = false;
+static vector<char> netmasterout, netmasterin;
+
+// only called on the network thread
+static bool postnetin(int type, ENetPeer *peer = NULL, enet_uint32 id = 0, int chan = 0, ENetPacket *packet = NULL, const ENetAddress *address = NULL, bool droppable = false)
+{
+    netevent e;
+    e.type = type;
+    e.chan = chan;
+    e.rtt = peer ? peer->roundTripTime + peer->roundTripTimeVariance : ENET_PEER_DEFAULT_ROUND_TRIP_TIME;
+    e.peer = peer;
+    e.id = id;
+    e.packet = packet;
+    if(address) e.address = *address;
+    if(netinpending.empty() && netin.push(e)) return true;
+    if(droppable) return false;
+    netinpending.add(e);
+    return true;
+}
+
+static void netlogf(const char *fmt, ...)
+{
+    defvformatstring(msg, fmt, fmt);
+    postnetin(NET_LOG, NULL, 0, 0, netdata(msg, strlen(msg)+1));
+}
+
+static void releasenetpacket(ENetPacket *packet)
+{
+    postnetin(NET_RELEASE, NULL, 0, 0, (ENetPacket *)packet->userData);
+}
+
+static void netdisconnectmaster(bool notify)
+{
+    if(netmastersock != ENET_SOCKET_NULL)
+    {
+        enet_socket_destroy(netmastersock);
+        netmastersock = ENET_SOCKET_NULL;
+        notify = true;
+    }
+    if(notify) postnetin(NET_MASTERDISCONNECT);
+
+    netmasterout.setsize(0);
+    netmasterin.setsize(0);
+    netmasteroutpos = 0;
+    netmasterconnecting = 0;
+    netmasterconnected = false;
+}
+
+static bool netconnectmaster()
+{
+    if(!netmastername[0]) return false;
+    if(netmasteraddress.host == ENET_HOST_ANY)
+    {
+        netlogf("looking up %s...", netmastername);
+        netmasteraddress.port = netmasterport;
+        if(!resolverwait(netmastername, &netmasteraddress)) return false;
+    }
+    ENetSocket sock = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+    if(sock == ENET_SOCKET_NULL)
+    {
+        netlogf("could not open master server socket");
+        return false;
+    }
+    if(serveraddress.host == ENET_HOST_ANY || !enet_socket_bind(sock, &serveraddress))
+    {
+        enet_socket_set_option(sock, ENET_SOCKOPT_NONBLOCK, 1);
+        if(!enet_socket_connect(sock, &netmasteraddress))
+        {
+            netmastersock = sock;
+            netmasterconnecting = enet_time_get();
+            if(!netmasterconnecting) netmasterconnecting = 1;
+            return true;
+        }
+    }
+    enet_socket_destroy(sock);
+    netlogf("could not connect to master server");
+    return false;
+}
+
+static void netmasterinput()
+{
+    if(netmasterin.length() >= netmasterin.capacity())
+        netmasterin.reserve(4096);
+
+    ENetBuffer buf;
+    buf.data = netmasterin.getbuf() + netmasterin.length();
+    buf.dataLength = netmasterin.capacity() - netmasterin.length();
+    int recv = enet_socket_receive(netmastersock, NULL, &buf, 1);
+    if(recv <= 0) { netdisconnectmaster(true); return; }
+    netmasterin.advance(recv);
+
+    int pos = 0;
+    for(char *end; (end = (char *)memchr(&netmasterin[pos], '\n', netmasterin.length() - pos)); pos = end+1 - netmasterin.getbuf())
+    {
+        *end = '\0';
+        postnetin(NET_MASTERINPUT, NULL, 0, 0, netdata(&netmasterin[pos], end+1 - &netmasterin[pos]));
+    }
+    netmasterin.remove(0, pos);
+}
+
+static void netmasteroutput()
+{
+    if(netmasterconnecting && enet_time_get() - netmasterconnecting >= 60000)
+    {
+        netlogf("could not connect to master server");
+        netdisconnectmaster(true);
+    }
+    if(netmasterout.empty() || !netmasterconnected) return;
+
+    ENetBuffer buf;
+    buf.data = &netmasterout[netmasteroutpos];
+    buf.dataLength = netmasterout.length() - netmasteroutpos;
+    int sent = enet_socket_send(netmastersock, NULL, &buf, 1);
+    if(sent >= 0)
+    {
+        netmasteroutpos += sent;
+        if(netmasteroutpos >= netmasterout.length())
+        {
+            netmasterout.setsize(0);
+            netmasteroutpos = 0;
+        }
+    }
+    else netdisconnectmaster(true);
+}
+
+static void sendnetpacket(netevent &e)
+{
+    ENetPacket *packet = e.packet;
+    if(e.peer->connectID != e.id) { postnetin(NET_RELEASE, NULL, 0, 0, packet); return; }
+    // ENet only ever sees this copy of the header, so the game thread keeps sole ownership of the original
+    int flags = (packet->flags & ~ENET_PACKET_FLAG_SENT) | ENET_PACKET_FLAG_NO_ALLOCATE;
+    ENetPacket *copy = packet->splitData ?
+        enet_packet_create_split(packet->data, packet->splitLength, packet->splitData, packet->dataLength - packet->splitLength, flags) :
+        enet_packet_create(packet->data, packet->dataLength, flags);
+    if(!copy) { postnetin(NET_RELEASE, NULL, 0, 0, packet); return; }
+    copy->userData = packet;
+    copy->freeCallback = releasenetpacket;
+    enet_peer_send(e.peer, e.chan, copy);
+    if(!copy->referenceCount) enet_packet_destroy(copy);
+}
+
+static void processnetout()
+{
+    netevent e;
+    while(netout.pop(e)) switch(e.type)
+    {
+        case NET_SEND:
+            sendnetpacket(e);
+            break;
+
+        case NET_KICK:
+            if(e.peer->connectID == e.id) enet_peer_disconnect(e.peer, e.chan);
+            break;
+
+        case NET_FLUSH:
+            enet_host_flush(serverhost);
+            break;
+
+        case NET_SERVERINFOREPLY:
+        {
+            ENetBuffer buf;
+            buf.data = e.packet->data;
+            buf.dataLength = e.packet->dataLength;
+            enet_socket_send(pongsock, &e.address, &buf, 1);
+            enet_packet_destroy(e.packet);
+            break;
+        }
+
+        case NET_MASTERREQUEST:
+            if(netmastersock == ENET_SOCKET_NULL && !netconnectmaster()) netdisconnectmaster(true);
+            else if(netmasterout.length() < 4096) netmasterout.put((const char *)e.packet->data, e.packet->dataLength);
+            enet_packet_destroy(e.packet);
+            break;
+
+        case NET_MASTERRESET:
+            netdisconnectmaster(false);
+            copystring(netmastername, (const char *)e.packet->data);
+            netmasterport = e.id;
+            netmasteraddress.host = ENET_HOST_ANY;
+            netmasteraddress.port = ENET_PORT_ANY;
+            enet_packet_destroy(e.packet);
+            break;
+    }
+}
+
+static void servicenethost()
+{
+    ENetEvent event;
+    for(;;)
+    {
+        if(enet_host_check_events(serverhost, &event) <= 0 && enet_host_service(serverhost, &event, 0) <= 0) break;
+        switch(event.type)
+        {
+            case ENET_EVENT_TYPE_CONNECT:
+                postnetin(NET_CONNECT, event.peer, event.peer->connectID, 0, NULL, &event.peer->address);
+                break;
+            case ENET_EVENT_TYPE_RECEIVE:
+                postnetin(NET_RECEIVE, event.peer, event.peer->connectID, event.channelID, event.packet);
+                break;
+            case ENET_EVENT_TYPE_DISCONNECT:
+                postnetin(NET_DISCONNECT, event.peer);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void checknetsockets(ENetSocketSet &readset, ENetSocketSet &writeset)
+{
+    ENetBuffer buf;
+    uchar ping[MAXTRANS];
+    if(ENET_SOCKETSET_CHECK(readset, wakesock))
+    {
+        buf.data = ping;
+        buf.dataLength = sizeof(ping);
+        while(enet_socket_receive(wakesock, NULL, &buf, 1) > 0);
+    }
+    loopi(2)
+    {
+        ENetSocket sock = i ? lansock : pongsock;
+        if(sock == ENET_SOCKET_NULL || !ENET_SOCKETSET_CHECK(readset, sock)) continue;
+
+        ENetAddress addr;
+        buf.data = ping;
+        buf.dataLength = sizeof(ping);
+        int len = enet_socket_receive(sock, &addr, &buf, 1);
+        if(len < 0 || len > MAXPINGDATA) continue;
+        // server info requests are dropped rather than queued once the game thread falls behind
+        ENetPacket *req = netdata(ping, len);
+        if(!postnetin(NET_SERVERINFO, NULL, 0, 0, req, &addr, true)) enet_packet_destroy(req);
+    }
+    if(netmastersock != ENET_SOCKET_NULL)
+    {
+        if(!netmasterconnected && (ENET_SOCKETSET_CHECK(readset, netmastersock) || ENET_SOCKETSET_CHECK(writeset, netmastersock)))
+        {
+            int error = 0;
+            if(enet_socket_get_option(netmastersock, ENET_SOCKOPT_ERROR, &error) < 0 || error)
+            {
+                netlogf("could not connect to master server");
+                netdisconnectmaster(true);
+            }
+            else
+            {
+                netmasterconnecting = 0;
+                netmasterconnected = true;
+                postnetin(NET_MASTERCONNECT);
+            }
+        }
+        if(netmastersock != ENET_SOCKET_NULL && ENET_SOCKETSET_CHECK(readset, netmastersock)) netmasterinput();
+    }
+}
+
+static int netthreadmain(void *)
+{
+    ENetSocketSet readset, writeset;
+    while(!atomicload(netquit))
+    {
+        processnetout();
+
+        ENET_SOCKETSET_EMPTY(readset);
+        ENET_SOCKETSET_EMPTY(writeset);
+        ENetSocket maxsock = max(serverhost->socket, wakesock);
+        ENET_SOCKETSET_ADD(readset, serverhost->socket);
+        ENET_SOCKETSET_ADD(readset, wakesock);
+        loopi(3)
+        {
+            ENetSocket sock = i==2 ? netmastersock : (i ? lansock : pongsock);
+            if(sock == ENET_SOCKET_NULL) continue;
+            maxsock = max(maxsock, sock);
+            ENET_SOCKETSET_ADD(readset, sock);
+        }
+        if(netmastersock != ENET_SOCKET_NULL && !netmasterconnected) ENET_SOCKETSET_ADD(writeset, netmastersock);
+        int ready = enet_socketset_select(maxsock, &readset, &writeset, netinpending.empty() ? 5 : 1);
+
+        processnetout();
+        servicenethost();
+        if(ready > 0) checknetsockets(readset, writeset);
+        netmasteroutput();
+
+        atomicadd(netsentdata, serverhost->totalSentData);
+        atomicadd(netreceiveddata, serverhost->totalReceivedData);
+        serverhost->totalSentData = serverhost->totalReceivedData = 0;
+
+        int posted = 0;
+        while(posted < netinpending.length() && netin.push(netinpending[posted])) posted++;
+        if(posted) netinpending.remove(0, posted);
+        if(!netin.empty())
+        {
+            netlock.lock();
+            netcond.signal();
+            netlock.unlock();
+        }
+    }
+    return 0;
+}
+
+static void wakenetthread()
+{
+    int posted = 0;
+    while(posted < netoutpending.length() && netout.push(netoutpending[posted])) posted++;
+    if(posted) netoutpending.remove(0, posted);
+    if(!netwake) return;
+    netwake = false;
+    uchar wake = 0;
+    ENetBuffer buf;
+    buf.data = &wake;
+    buf.dataLength = 1;
+    enet_socket_send(wakesock, &wakeaddress, &buf, 1);
+}
+
+static bool startnetthread()
+{
+    wakeaddress.host = ENET_HOST_ANY;
+    wakeaddress.port = ENET_PORT_ANY;
+    enet_address_set_host(&wakeaddress, "127.0.0.1");
+    wakesock = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+    if(wakesock == ENET_SOCKET_NULL || enet_socket_bind(wakesock, &wakeaddress) < 0 || enet_socket_get_address(wakesock, &wakeaddress) < 0)
+    {
+        if(wakesock != ENET_SOCKET_NULL) enet_socket_destroy(wakesock);
+        wakesock = ENET_SOCKET_NULL;
+        return false;
+    }
+    enet_socket_set_option(wakesock, ENET_SOCKOPT_NONBLOCK, 1);
+    copystring(netmastername, mastername);
+    netmasterport = masterport;
+    atomicstore(netquit, 0);
+    if(!netiothread.start(netthreadmain, NULL, "network"))
+    {
+        enet_socket_destroy(wakesock);
+        wakesock = ENET_SOCKET_NULL;
+        return false;
+    }
+    netthreaded = true;
+    return true;
+}
+
+static void stopnetthread()
+{
+    if(!netthreaded) return;
+    atomicstore(netquit, 1);
+    wakenetthread();
+    netiothread.join();
+    netthreaded = false;
+    enet_socket_destroy(wakesock);
+    wakesock = ENET_SOCKET_NULL;
+    if(netmastersock != ENET_SOCKET_NULL) enet_socket_destroy(netmastersock);
+    netmastersock = ENET_SOCKET_NULL;
+}
+
+static void processnetin()
+{
+    netevent e;
+    while(netin.pop(e)) switch(e.type)
+    {
+        case NET_CONNECT:
+            connectclient(e.peer, e.id, e.address);
+            break;
+
+        case NET_RECEIVE:
+        {
+            client *c = (client *)e.peer->data;
+            if(c && c->connectid == e.id) { c->rtt = e.rtt; process(e.packet, c->num, e.chan); }
+            if(e.packet->referenceCount==0) enet_packet_destroy(e.packet);
+            break;
+        }
+
+        case NET_DISCONNECT:
+            disconnectclient(e.peer);
+            break;
+
+        case NET_RELEASE:
+            if(--e.packet->referenceCount <= 0) enet_packet_destroy(e.packet);
+            break;
+
+        case NET_SERVERINFO:
+        {
+            profilescope prof(SPROF_SOCKETS);
+            uchar pong[MAXTRANS];
+            int len = e.packet->dataLength;
+            memcpy(pong, e.packet->data, len);
+            enet_packet_destroy(e.packet);
+            pongaddr = e.address;
+            ucharbuf req(pong, len), p(pong, sizeof(pong));
+            p.len += len;
+            server::serverinforeply(req, p);
+            break;
+        }
+
+        case NET_MASTERCONNECT:
+            masterconnecting = 0;
+            masterconnected = totalmillis ? totalmillis : 1;
+            server::masterconnected();
+            break;
+
+        case NET_MASTERDISCONNECT:
+            server::masterdisconnected();
+            lastupdatemaster = masterconnecting = masterconnected = 0;
+            break;
+
+        case NET_MASTERINPUT:
+        {
+            profilescope prof(SPROF_MASTER);
+            processmastercommand((const char *)e.packet->data, (const char *)e.packet->data + e.packet->dataLength - 1);
+            enet_packet_destroy(e.packet);
+            break;
+        }
+
+        case NET_LOG:
+            logoutf("%s", (const char *)e.packet->data);
+            enet_packet_destroy(e.packet);
+            break;
+    }
+}
+
+static void threadedserverslice(uint timeout)
+{
+    if(!lastupdatemaster || totalmillis-lastupdatemaster>60*60*1000)       // send alive signal to masterserver every hour of uptime
+        updatemasterserver();
+
+    logstatus(atomicexchange(netsentdata, 0), atomicexchange(netreceiveddata, 0));
+
+    if(netin.empty())
+    {
+        netlock.lock();
+        if(netin.empty())
+        {
+            uint waitstart = serverprofile ? getmicros() : 0;
+            netcond.wait(netlock, timeout);
+            if(serverprofile) profilewaitmicros += getmicros() - waitstart;
+        }
+        netlock.unlock();
+    }
+    processnetin();
+    if(server::sendpackets()) postnetout(NET_FLUSH);
+    wakenetthread();
+}
+#endif
+
 void serverslice(bool dedicated, uint timeout)   // main server update, called from main loop in sp, or from below in dedicated server
 {
     if(!serverhost) 
@@ -615,6 +1323,10 @@ void serverslice(bool dedicated, uint timeout)   // main server update, called f
        
     // below is network only
 
+    bool profiling = serverprofile != 0;
+    uint slicestart = profiling ? getmicros() : 0;
+    profilewaitmicros = 0;
+
     if(dedicated) 
     {
         int millis = (int)enet_time_get();
@@ -628,7 +1340,19 @@ void serverslice(bool dedicated, uint timeout)   // main server update, called f
         totalmillis = millis;
         updatetime();
     }
-    server::serverupdate();
+    {
+        profilescope prof(SPROF_UPDATE);
+        server::serverupdate();
+    }
+
+#ifdef STANDALONE
+    if(netthreaded)
+    {
+        threadedserverslice(timeout);
+        if(profiling) profileserver(SPROF_SLICE, getmicros() - slicestart - profilewaitmicros);
+        return;
+    }
+#endif
 
     flushmasteroutput();
     checkserversockets();
@@ -636,12 +1360,7 @@ void serverslice(bool dedicated, uint timeout)   // main server update, called f
     if(!lastupdatemaster || totalmillis-lastupdatemaster>60*60*1000)       // send alive signal to masterserver every hour of uptime
         updatemasterserver();
     
-    if(totalmillis-laststatus>60*1000)   // display bandwidth stats, useful for server ops
-    {
-        laststatus = totalmillis;     
-        if(nonlocalclients || serverhost->totalSentData || serverhost->totalReceivedData) logoutf("status: %d remote clients, %.1f send, %.1f rec (K/sec)", nonlocalclients, serverhost->totalSentData/60.0f/1024, serverhost->totalReceivedData/60.0f/1024);
-        serverhost->totalSentData = serverhost->totalReceivedData = 0;
-    }
+    logstatus(serverhost->totalSentData, serverhost->totalReceivedData);
 
     ENetEvent event;
     bool serviced = false;
@@ -649,23 +1368,17 @@ void serverslice(bool dedicated, uint timeout)   // main server update, called f
     {
         if(enet_host_check_events(serverhost, &event) <= 0)
         {
-            if(enet_host_service(serverhost, &event, timeout) <= 0) break;
+            uint waitstart = serverprofile ? getmicros() : 0;
+            int status = enet_host_service(serverhost, &event, timeout);
+            if(serverprofile) profilewaitmicros += getmicros() - waitstart;
+            if(status <= 0) break;
             serviced = true;
         }
         switch(event.type)
         {
             case ENET_EVENT_TYPE_CONNECT:
-            {
-                client &c = addclient(ST_TCPIP);
-                c.peer = event.peer;
-                c.peer->data = &c;
-                string hn;
-                copystring(c.hostname, (enet_address_get_host_ip(&c.peer->address, hn, sizeof(hn))==0) ? hn : "unknown");
-                logoutf("client connected (%s)", c.hostname);
-                int reason = server::clientconnect(c.num, c.peer->address.host);
-                if(reason) disconnect_client(c.num, reason);
+                connectclient(event.peer, event.peer->connectID, event.peer->address);
                 break;
-            }
             case ENET_EVENT_TYPE_RECEIVE:
             {
                 client *c = (client *)event.peer->data;
@@ -674,23 +1387,26 @@ void serverslice(bool dedicated, uint timeout)   // main server update, called f
                 break;
             }
             case ENET_EVENT_TYPE_DISCONNECT: 
-            {
-                client *c = (client *)event.peer->data;
-                if(!c) break;
-                logoutf("disconnected client (%s)", c->hostname);
-                server::clientdisconnect(c->num);
-                delclient(c);
+                disconnectclient(event.peer);
                 break;
-            }
             default:
                 break;
         }
     }
     if(server::sendpackets()) enet_host_flush(serverhost);
+    if(profiling) profileserver(SPROF_SLICE, getmicros() - slicestart - profilewaitmicros);
 }
 
 void flushserver(bool force)
 {
+#ifdef STANDALONE
+    if(netthreaded)
+    {
+        if(server::sendpackets(force)) postnetout(NET_FLUSH);
+        wakenetthread();
+        return;
+    }
+#endif
     if(server::sendpackets(force) && serverhost) enet_host_flush(serverhost);
 }
 
@@ -984,10 +1700,21 @@ void logoutfv(const char *fmt, va_list args)
 
 #else
 
+static string logprefix = "";
+
 void logoutfv(const char *fmt, va_list args)
 {
     FILE *f = getlogfile();
-    if(f) writelogv(f, fmt, args);
+    if(!f) return;
+    if(logprefix[0])
+    {
+        char line[sizeof(logprefix) + LOGSTRLEN];
+        int prefixlen = strlen(logprefix);
+        memcpy(line, logprefix, prefixlen);
+        vformatstring(&line[prefixlen], fmt, args, LOGSTRLEN);
+        writelog(f, line);
+    }
+    else writelogv(f, fmt, args);
 }
 
 #endif
@@ -1044,6 +1771,7 @@ bool setuplistenserver(bool dedicated)
     serverhost = enet_host_create(&address, min(maxclients + server::reserveclients(), MAXCLIENTS), server::numchannels(), 0, serveruprate);
     if(!serverhost) return servererror(dedicated, "could not create server host");
     serverhost->duplicatePeers = maxdupclients ? maxdupclients : MAXCLIENTS;
+    if(serverbatch > 1 && enet_host_batch(serverhost, serverbatch) < 0) conoutf(CON_WARN, "WARNING: could not enable batched network I/O");
     address.port = server::serverinfoport(serverport > 0 ? serverport : -1);
     pongsock = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
     if(pongsock != ENET_SOCKET_NULL && enet_socket_bind(pongsock, &address) < 0)
@@ -1062,9 +1790,92 @@ bool setuplistenserver(bool dedicated)
     }
     if(lansock == ENET_SOCKET_NULL) conoutf(CON_WARN, "WARNING: could not create LAN server info socket");
     else enet_socket_set_option(lansock, ENET_SOCKOPT_NONBLOCK, 1);
+#ifdef STANDALONE
+    if(dedicated && netthread)
+    {
+        if(startnetthread()) logoutf("network I/O running on a separate thread");
+        else conoutf(CON_WARN, "WARNING: could not start network thread");
+    }
+#endif
     return true;
 }
 
+#if defined(STANDALONE) && !defined(WIN32)
+// one invocation can host several dedicated servers: the configuration is read once and then one
+// process is forked per instance, so the scripts and ban lists set up before the fork are inherited
+// instead of being loaded again by every server process. after the fork each instance has its own
+// copy of everything, so map rotations, maps sent with sendmap and later config changes are per instance.
+// instance n (counting from 0) listens on serverport + n*serverinstancestep and then runs server-init-<n>.cfg
+VAR(serverinstances, 1, 1, 64);
+VAR(serverinstancestep, 2, 10, 1000);
+
+static volatile sig_atomic_t instancequit = 0;
+
+static void stopinstances(int sig) { instancequit = 1; }
+
+// unlike signal(), this leaves out SA_RESTART so a pending waitpid returns with EINTR and instancequit gets checked
+static void setinstancesignal(int sig, void (*handler)(int))
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(sig, &sa, NULL);
+}
+
+static pid_t forkinstance(int n, int baseport)
+{
+    FILE *f = getlogfile();
+    if(f) fflush(f);
+    pid_t pid = fork();
+    if(pid < 0)
+    {
+        conoutf(CON_ERROR, "could not fork server instance on port %d: %s", baseport + n*serverinstancestep, strerror(errno));
+        return -1;
+    }
+    if(pid) return pid;
+    setinstancesignal(SIGTERM, SIG_DFL);
+    setinstancesignal(SIGINT, SIG_DFL);
+    setvar("serverport", baseport + n*serverinstancestep);
+    formatstring(logprefix, "[%d] ", serverport);
+    defformatstring(cfgname, "server-init-%d.cfg", n);
+    execfile(cfgname, false);
+    return 0;
+}
+
+static void hostinstances()
+{
+    if(serverinstances <= 1) return;
+    int baseport = serverport;
+    vector<pid_t> pids;
+    setinstancesignal(SIGTERM, stopinstances);
+    setinstancesignal(SIGINT, stopinstances);
+    loopi(serverinstances)
+    {
+        pid_t pid = forkinstance(i, baseport);
+        if(!pid) return;
+        pids.add(pid); // a failed fork keeps -1 so the slots still line up with the ports
+    }
+    logoutf("hosting %d server instances on ports %d-%d", serverinstances, baseport, baseport + (serverinstances-1)*serverinstancestep);
+    while(!instancequit)
+    {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if(pid < 0) { if(errno == EINTR) continue; break; }
+        int n = pids.find(pid);
+        if(n < 0 || instancequit) continue;
+        logoutf("server instance on port %d exited, restarting", baseport + n*serverinstancestep);
+        sleep(1);
+        pid = forkinstance(n, baseport);
+        if(!pid) return;
+        pids[n] = pid;
+    }
+    loopv(pids) if(pids[i] > 0) kill(pids[i], SIGTERM);
+    while(waitpid(-1, NULL, 0) > 0 || errno == EINTR);
+    exit(EXIT_SUCCESS);
+}
+#endif
+
 void initserver(bool listen, bool dedicated)
 {
     if(dedicated) 
@@ -1076,6 +1887,10 @@ void initserver(bool listen, bool dedicated)
     
     execfile("server-init.cfg", false);
 
+#if defined(STANDALONE) && !defined(WIN32)
+    if(dedicated) hostinstances();
+#endif
+
     if(listen) setuplistenserver(dedicated);
 
     server::serverinit();
@@ -1132,6 +1947,10 @@ bool serveroption(char *opt)
         case 'q': logoutf("Using home directory: %s", opt); sethomedir(opt+2); return true;
         case 'k': logoutf("Adding package directory: %s", opt); addpackagedir(opt+2); return true;
         case 'g': logoutf("Setting log file: %s", opt); setlogfile(opt+2); return true;
+        case 'e': setvar("netthread", opt[2] ? atoi(opt+2) : 1); return true;
+#ifndef WIN32
+        case 'h': setvar("serverinstances", atoi(opt+2)); return true;
+#endif
 #endif
         default: return false;
     }
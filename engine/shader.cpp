@@ -1074,9 +1074,27 @@ Shader *useshaderbyname(const char *name)
     return s;
 }
 
+// headless clients never compile anything, but lightmapping still needs the shader types of slots
+static void headlessshader(int type, const char *name)
+{
+    Shader *exists = shaders.access(name);
+    char *rname = exists ? exists->name : newstring(name);
+    Shader &s = shaders[rname];
+    s.name = rname;
+    DELETEA(s.defer);
+    s.type = type;
+    s.standard = standardshaders;
+    s.detailshader = &s;
+}
+
 void shader(int *type, char *name, char *vs, char *ps)
 {
-    if(headless) return;
+    if(headless)
+    {
+        if(!lookupshaderbyname(name)) headlessshader(*type, name);
+        slotparams.shrink(0);
+        return;
+    }
     if(lookupshaderbyname(name)) return;
 
     defformatstring(info, "shader %s", name);
@@ -1111,7 +1129,7 @@ void variantshader(int *type, char *name, int *row, char *vs, char *ps)
         shader(type, name, vs, ps);
         return;
     }
-    else if(*row >= MAXVARIANTROWS) return;
+    else if(*row >= MAXVARIANTROWS || headless) return;
 
     Shader *s = lookupshaderbyname(name);
     if(!s) return;
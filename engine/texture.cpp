@@ -1381,6 +1381,78 @@ VAR(usedds, 0, 1, 1);
 VAR(dbgdds, 0, 0, 1);
 VAR(scaledds, 0, 2, 4);
 
+#define PARSETEXCOMMANDS(cmds) \
+    const char *cmd = NULL, *end = NULL, *arg[4] = { NULL, NULL, NULL, NULL }; \
+    cmd = &cmds[1]; \
+    end = strchr(cmd, '>'); \
+    if(!end) break; \
+    cmds = strchr(cmd, '<'); \
+    size_t len = strcspn(cmd, ":,><"); \
+    loopi(4) \
+    { \
+        arg[i] = strchr(i ? arg[i-1] : cmd, i ? ',' : ':'); \
+        if(!arg[i] || arg[i] >= end) arg[i] = ""; \
+        else arg[i]++; \
+    }
+
+// the <cmds> transforms only touch the image, so they can run off the main thread too
+static void applytexcmds(ImageData &d, const char *cmds, int type, int *compress, int *wrap)
+{
+    while(cmds)
+    {
+        PARSETEXCOMMANDS(cmds);
+        if(d.compressed) goto compressed;
+        if(matchstring(cmd, len, "mad")) texmad(d, parsevec(arg[0]), parsevec(arg[1]));
+        else if(matchstring(cmd, len, "colorify")) texcolorify(d, parsevec(arg[0]), parsevec(arg[1]));
+        else if(matchstring(cmd, len, "colormask")) texcolormask(d, parsevec(arg[0]), *arg[1] ? parsevec(arg[1]) : vec(1, 1, 1));
+        else if(matchstring(cmd, len, "normal"))
+        {
+            int emphasis = atoi(arg[0]);
+            texnormal(d, emphasis > 0 ? emphasis : 3);
+        }
+        else if(matchstring(cmd, len, "dup")) texdup(d, atoi(arg[0]), atoi(arg[1]));
+        else if(matchstring(cmd, len, "offset")) texoffset(d, atoi(arg[0]), atoi(arg[1]));
+        else if(matchstring(cmd, len, "rotate")) texrotate(d, atoi(arg[0]), max(type, 0));
+        else if(matchstring(cmd, len, "reorient")) texreorient(d, atoi(arg[0])>0, atoi(arg[1])>0, atoi(arg[2])>0, type >= 0 ? type : TEX_DIFFUSE);
+        else if(matchstring(cmd, len, "mix")) texmix(d, *arg[0] ? atoi(arg[0]) : -1, *arg[1] ? atoi(arg[1]) : -1, *arg[2] ? atoi(arg[2]) : -1, *arg[3] ? atoi(arg[3]) : -1);
+        else if(matchstring(cmd, len, "grey")) texgrey(d);
+        else if(matchstring(cmd, len, "blur"))
+        {
+            int emphasis = atoi(arg[0]), repeat = atoi(arg[1]);
+            texblur(d, emphasis > 0 ? clamp(emphasis, 1, 2) : 1, repeat > 0 ? repeat : 1);
+        }
+        else if(matchstring(cmd, len, "premul")) texpremul(d);
+        else if(matchstring(cmd, len, "agrad")) texagrad(d, atof(arg[0]), atof(arg[1]), atof(arg[2]), atof(arg[3]));
+        else if(matchstring(cmd, len, "compress") || matchstring(cmd, len, "dds"))
+        {
+            int scale = atoi(arg[0]);
+            if(scale <= 0) scale = scaledds;
+            if(compress) *compress = scale;
+        }
+        else if(matchstring(cmd, len, "nocompress"))
+        {
+            if(compress) *compress = -1;
+        }
+        else if(matchstring(cmd, len, "thumbnail"))
+        {
+            int w = atoi(arg[0]), h = atoi(arg[1]);
+            if(w <= 0 || w > (1<<12)) w = 64;
+            if(h <= 0 || h > (1<<12)) h = w;
+            if(d.w > w || d.h > h) scaleimage(d, w, h);
+        }
+        else
+    compressed:
+        if(matchstring(cmd, len, "mirror"))
+        {
+            if(wrap) *wrap |= 0x300;
+        }
+        else if(matchstring(cmd, len, "noswizzle"))
+        {
+            if(wrap) *wrap |= 0x10000;
+        }
+    }
+}
+
 static bool texturedata(ImageData &d, const char *tname, Slot::Tex *tex = NULL, bool msg = true, int *compress = NULL, int *wrap = NULL)
 {
     const char *cmds = NULL, *file = tname;
@@ -1413,19 +1485,6 @@ static bool texturedata(ImageData &d, const char *tname, Slot::Tex *tex = NULL,
     bool raw = !usedds || !compress, dds = false, guess = false;
     for(const char *pcmds = cmds; pcmds;)
     {
-        #define PARSETEXCOMMANDS(cmds) \
-            const char *cmd = NULL, *end = NULL, *arg[4] = { NULL, NULL, NULL, NULL }; \
-            cmd = &cmds[1]; \
-            end = strchr(cmd, '>'); \
-            if(!end) break; \
-            cmds = strchr(cmd, '<'); \
-            size_t len = strcspn(cmd, ":,><"); \
-            loopi(4) \
-            { \
-                arg[i] = strchr(i ? arg[i-1] : cmd, i ? ',' : ':'); \
-                if(!arg[i] || arg[i] >= end) arg[i] = ""; \
-                else arg[i]++; \
-            }
         PARSETEXCOMMANDS(pcmds);
         if(matchstring(cmd, len, "dds")) dds = true;
         else if(matchstring(cmd, len, "thumbnail"))
@@ -1474,59 +1533,7 @@ static bool texturedata(ImageData &d, const char *tname, Slot::Tex *tex = NULL,
         d.wrap(s);
     }
 
-    while(cmds)
-    {
-        PARSETEXCOMMANDS(cmds);
-        if(d.compressed) goto compressed;
-        if(matchstring(cmd, len, "mad")) texmad(d, parsevec(arg[0]), parsevec(arg[1]));
-        else if(matchstring(cmd, len, "colorify")) texcolorify(d, parsevec(arg[0]), parsevec(arg[1]));
-        else if(matchstring(cmd, len, "colormask")) texcolormask(d, parsevec(arg[0]), *arg[1] ? parsevec(arg[1]) : vec(1, 1, 1));
-        else if(matchstring(cmd, len, "normal"))
-        {
-            int emphasis = atoi(arg[0]);
-            texnormal(d, emphasis > 0 ? emphasis : 3);
-        }
-        else if(matchstring(cmd, len, "dup")) texdup(d, atoi(arg[0]), atoi(arg[1]));
-        else if(matchstring(cmd, len, "offset")) texoffset(d, atoi(arg[0]), atoi(arg[1]));
-        else if(matchstring(cmd, len, "rotate")) texrotate(d, atoi(arg[0]), tex ? tex->type : 0);
-        else if(matchstring(cmd, len, "reorient")) texreorient(d, atoi(arg[0])>0, atoi(arg[1])>0, atoi(arg[2])>0, tex ? tex->type : TEX_DIFFUSE);
-        else if(matchstring(cmd, len, "mix")) texmix(d, *arg[0] ? atoi(arg[0]) : -1, *arg[1] ? atoi(arg[1]) : -1, *arg[2] ? atoi(arg[2]) : -1, *arg[3] ? atoi(arg[3]) : -1);
-        else if(matchstring(cmd, len, "grey")) texgrey(d);
-        else if(matchstring(cmd, len, "blur"))
-        {
-            int emphasis = atoi(arg[0]), repeat = atoi(arg[1]);
-            texblur(d, emphasis > 0 ? clamp(emphasis, 1, 2) : 1, repeat > 0 ? repeat : 1);
-        }
-        else if(matchstring(cmd, len, "premul")) texpremul(d);
-        else if(matchstring(cmd, len, "agrad")) texagrad(d, atof(arg[0]), atof(arg[1]), atof(arg[2]), atof(arg[3]));
-        else if(matchstring(cmd, len, "compress") || matchstring(cmd, len, "dds"))
-        {
-            int scale = atoi(arg[0]);
-            if(scale <= 0) scale = scaledds;
-            if(compress) *compress = scale;
-        }
-        else if(matchstring(cmd, len, "nocompress"))
-        {
-            if(compress) *compress = -1;
-        }
-        else if(matchstring(cmd, len, "thumbnail"))
-        {
-            int w = atoi(arg[0]), h = atoi(arg[1]);
-            if(w <= 0 || w > (1<<12)) w = 64;
-            if(h <= 0 || h > (1<<12)) h = w;
-            if(d.w > w || d.h > h) scaleimage(d, w, h);
-        }
-        else
-    compressed:
-        if(matchstring(cmd, len, "mirror"))
-        {
-            if(wrap) *wrap |= 0x300;
-        }
-        else if(matchstring(cmd, len, "noswizzle"))
-        {
-            if(wrap) *wrap |= 0x10000;
-        }
-    }
+    applytexcmds(d, cmds, tex ? tex->type : -1, compress, wrap);
 
     return true;
 }
@@ -2273,6 +2280,381 @@ static void mergealpha(ImageData &c, ImageData &s)
     }
 }
 
+// slot textures are decoded, transformed and mipmapped on worker threads while the main thread keeps running,
+// then uploaded from the main thread a few at a time per frame, with a placeholder bound until then
+VARP(asynctex, 0, 1, 1);
+VARP(texthreads, 0, 0, 16);
+VARP(texuploadtime, 0, 2, 100);
+
+enum { TEXJOB_QUEUED = 0, TEXJOB_RUNNING, TEXJOB_READY, TEXJOB_DONE };
+
+struct texsource
+{
+    char *name, *cmds, *data;
+    size_t len;
+    int type;
+
+    texsource() : name(NULL), cmds(NULL), data(NULL), len(0), type(TEX_DIFFUSE) {}
+    ~texsource() { DELETEA(name); DELETEA(cmds); DELETEA(data); }
+
+    // only images texturedata would decode with loadsurface are handled, the file is read here on the main thread
+    bool load(const Slot::Tex &t)
+    {
+        const char *file = t.name;
+        if(file[0] == '<')
+        {
+            if(strstr(file, "<dds") || strstr(file, "<thumbnail") || strstr(file, "<stub")) return false;
+            file = strrchr(file, '>');
+            if(!file) return false;
+            file++;
+        }
+        int flen = strlen(file);
+        if(flen < 4 || !strcasecmp(file + flen - 4, ".dds")) return false;
+        defformatstring(pname, "packages/%s", file);
+        path(pname);
+        data = loadfile(pname, &len, false);
+        if(!data) return false;
+        name = newstring(pname);
+        type = t.type;
+        cmds = t.name[0] == '<' ? newstring(t.name) : NULL;
+        return true;
+    }
+
+    bool decode(ImageData &d, string &error)
+    {
+        SDL_RWops *rw = SDL_RWFromConstMem(data, len);
+        const char *ext = strrchr(name, '.');
+        SDL_Surface *s = rw ? fixsurfaceformat(IMG_LoadTyped_RW(rw, 1, ext ? ext+1 : NULL)) : NULL;
+        DELETEA(data);
+        if(!s) { formatstring(error, "could not load texture %s", name); return false; }
+        int bpp = s->format->BitsPerPixel;
+        if(bpp%8 || !texformat(bpp/8)) { SDL_FreeSurface(s); formatstring(error, "texture must be 8, 16, 24, or 32 bpp: %s", name); return false; }
+        if(max(s->w, s->h) > (1<<12)) { SDL_FreeSurface(s); formatstring(error, "texture size exceeded %dx%d pixels: %s", 1<<12, 1<<12, name); return false; }
+        d.wrap(s);
+        return true;
+    }
+};
+
+struct texjob
+{
+    Texture *t;
+    texsource src, combined;
+    bool hascombined;
+    volatile int state;
+
+    string error;
+    int wrap, compress, filter, bpp, xs, ys, tw, th;
+    GLenum format, component;
+    bool swizzle, alpha, gpumip;
+    uchar *levels;
+
+    texjob() : t(NULL), hascombined(false), state(TEXJOB_QUEUED), wrap(0), compress(0), filter(0), bpp(0), xs(0), ys(0), tw(0), th(0),
+        format(GL_FALSE), component(GL_FALSE), swizzle(false), alpha(false), gpumip(false), levels(NULL)
+    {
+        error[0] = '\0';
+    }
+    ~texjob() { DELETEA(levels); }
+
+    // everything newtexture and uploadtexture would do before the first GL call
+    void run()
+    {
+        ImageData d;
+        if(!src.decode(d, error)) return;
+        applytexcmds(d, src.cmds, src.type, &compress, &wrap);
+        if(hascombined)
+        {
+            ImageData c;
+            string cerror;
+            if(combined.decode(c, cerror))
+            {
+                applytexcmds(c, combined.cmds, combined.type, NULL, NULL);
+                if(c.w!=d.w || c.h!=d.h) scaleimage(c, d.w, d.h);
+                switch(combined.type)
+                {
+                    case TEX_SPEC: mergespec(d, c); break;
+                    case TEX_DEPTH: mergedepth(d, c); break;
+                    case TEX_ALPHA: mergealpha(d, c); break;
+                }
+            }
+        }
+
+        swizzle = !(wrap&0x10000);
+        format = texformat(d.bpp, swizzle);
+        if(swizzle && hasTRG && !hasTSW && swizzlemask(format))
+        {
+            swizzleimage(d);
+            format = texformat(d.bpp, swizzle);
+        }
+        bpp = d.bpp;
+        alpha = alphaformat(format);
+        xs = d.w;
+        ys = d.h;
+        filter = reducefilter ? 2 : 0;
+        resizetexture(xs, ys, true, true, GL_TEXTURE_2D, compress, tw, th);
+        component = compressedformat(format, tw, th, compress);
+        gpumip = filter > 1 && max(tw, th) > 1 && gpumipmap && hasFBB && !uncompressedformat(component);
+
+        int size = 0;
+        for(int mw = tw, mh = th;;)
+        {
+            size += mw*mh*bpp;
+            if(filter <= 1 || gpumip || max(mw, mh) <= 1) break;
+            if(mw > 1) mw /= 2;
+            if(mh > 1) mh /= 2;
+        }
+        levels = new uchar[size];
+        if(xs != tw || ys != th) scaletexture(d.data, xs, ys, bpp, d.pitch, levels, tw, th);
+        else loopi(th) memcpy(&levels[i*tw*bpp], &d.data[i*d.pitch], tw*bpp);
+        uchar *src = levels;
+        for(int mw = tw, mh = th; filter > 1 && !gpumip && max(mw, mh) > 1;)
+        {
+            int srcw = mw, srch = mh;
+            if(mw > 1) mw /= 2;
+            if(mh > 1) mh /= 2;
+            uchar *dst = src + srcw*srch*bpp;
+            scaletexture(src, srcw, srch, bpp, srcw*bpp, dst, mw, mh);
+            src = dst;
+        }
+    }
+
+    void upload()
+    {
+        t->type &= ~Texture::PLACEHOLDER;
+        t->id = 0;
+        if(error[0])
+        {
+            conoutf(CON_ERROR, "%s", error);
+            t->type |= Texture::PLACEHOLDER;
+            t->id = notexture->id;
+            return;
+        }
+        t->clamp = wrap;
+        t->bpp = bpp;
+        if(alpha) t->type |= Texture::ALPHA;
+        else t->type &= ~Texture::ALPHA;
+        if(wrap&0x300) t->type |= Texture::MIRROR;
+        t->xs = xs;
+        t->ys = ys;
+        t->w = tw;
+        t->h = th;
+        glGenTextures(1, &t->id);
+        if(headless) return;
+        GLenum type = textype(component, format);
+        setuptexparameters(t->id, levels, wrap, filter, format, GL_TEXTURE_2D, swizzle);
+        if(gpumip) { uploadtexture(t->id, GL_TEXTURE_2D, component, tw, th, format, type, levels, tw, th, 0, true); return; }
+        uchar *src = levels;
+        for(int level = 0, mw = tw, mh = th;; level++)
+        {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, texalign(src, mw, bpp));
+            glTexImage2D(GL_TEXTURE_2D, level, component, mw, mh, 0, format, type, src);
+            if(filter <= 1 || max(mw, mh) <= 1) break;
+            src += mw*mh*bpp;
+            if(mw > 1) mw /= 2;
+            if(mh > 1) mh /= 2;
+        }
+    }
+};
+
+static vector<texjob *> texjobs, texjobqueue;
+static int texjobhead = 0, texjobwait = 0;
+static vector<thread *> texworkers;
+static mutex texjoblock;
+static condition texjobcond;
+static bool texworkersquit = false;
+static GLuint texplaceholders[2] = { 0, 0 };
+
+static int texjobwork(void *data)
+{
+    texjoblock.lock();
+    for(;;)
+    {
+        if(texworkersquit) break;
+        texjob *job = NULL;
+        while(texjobhead < texjobqueue.length())
+        {
+            texjob *j = texjobqueue[texjobhead++];
+            if(j->state != TEXJOB_QUEUED) continue;
+            if(j->t) { job = j; break; }
+            j->state = TEXJOB_DONE;
+        }
+        if(!job) { texjobcond.wait(texjoblock); continue; }
+        job->state = TEXJOB_RUNNING;
+        texjoblock.unlock();
+        job->run();
+        texjoblock.lock();
+        atomicstore(job->state, TEXJOB_READY);
+        texjobcond.broadcast();
+    }
+    texjoblock.unlock();
+    return 0;
+}
+
+static GLuint texplaceholder(int type)
+{
+    int i = type == TEX_NORMAL ? 1 : 0;
+    if(!texplaceholders[i])
+    {
+        static const uchar pixels[2][4] = { { 0, 0, 0, 0 }, { 128, 128, 255, 255 } };
+        glGenTextures(1, &texplaceholders[i]);
+        createtexture(texplaceholders[i], 1, 1, (void *)pixels[i], 0, 0, GL_RGBA, GL_TEXTURE_2D);
+    }
+    return texplaceholders[i];
+}
+
+// queues the texture for the workers and returns it with a placeholder bound, or NULL if it has to be loaded synchronously
+static Texture *newtexjob(const char *key, Slot::Tex &t, Slot::Tex *combined)
+{
+    if(!asynctex || t.type == TEX_ENVMAP) return NULL;
+    texjob *job = new texjob;
+    if(!job->src.load(t)) { delete job; return NULL; }
+    if(combined) job->hascombined = job->combined.load(*combined);
+
+    if(texworkers.empty())
+    {
+        IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG); // the loaders initialize themselves lazily, which isn't safe from several threads at once
+        texworkersquit = false;
+        int numthreads = texthreads > 0 ? texthreads : numcpus;
+        loopi(numthreads)
+        {
+            thread *w = new thread;
+            if(!w->start(texjobwork, NULL, "texture worker")) { delete w; break; }
+            texworkers.add(w);
+        }
+    }
+
+    char *name = newstring(key);
+    Texture *tex = &textures[name];
+    tex->name = name;
+    tex->type = Texture::IMAGE | Texture::TRANSIENT | Texture::PLACEHOLDER;
+    tex->clamp = 0;
+    tex->mipmap = true;
+    tex->canreduce = true;
+    tex->w = tex->h = tex->xs = tex->ys = 1;
+    tex->bpp = 4;
+    tex->alphamask = NULL;
+    tex->id = texplaceholder(t.type);
+    job->t = tex;
+    texjobs.add(job);
+
+    texjoblock.lock();
+    if(texjobhead >= texjobqueue.length()) { texjobqueue.setsize(0); texjobhead = 0; }
+    texjobqueue.add(job);
+    texjobcond.signal();
+    texjoblock.unlock();
+    return tex;
+}
+
+static texjob *findtexjob(Texture *t)
+{
+    if(!(t->type&Texture::PLACEHOLDER)) return NULL;
+    loopv(texjobs) if(texjobs[i]->t == t) return texjobs[i];
+    return NULL;
+}
+
+// blocks until the job is decoded, doing the work here if no worker has picked it up yet
+static void waittexjob(texjob &job)
+{
+    texjoblock.lock();
+    if(job.state == TEXJOB_QUEUED)
+    {
+        for(int i = texjobhead; i < texjobqueue.length(); i++) if(texjobqueue[i] == &job) { texjobqueue.remove(i); break; }
+        job.state = TEXJOB_RUNNING;
+        texjoblock.unlock();
+        if(job.t) job.run();
+        atomicstore(job.state, TEXJOB_READY);
+        return;
+    }
+    if(job.state == TEXJOB_RUNNING)
+    {
+        int start = SDL_GetTicks();
+        while(job.state == TEXJOB_RUNNING) texjobcond.wait(texjoblock);
+        texjobwait += SDL_GetTicks() - start;
+    }
+    texjoblock.unlock();
+}
+
+static void finishtexjob(texjob &job)
+{
+    if(atomicload(job.state) == TEXJOB_DONE) return;
+    waittexjob(job);
+    if(job.t) job.upload();
+    job.t = NULL;
+    job.state = TEXJOB_DONE;
+}
+
+static void reaptexjobs()
+{
+    loopv(texjobs) if(atomicload(texjobs[i]->state) == TEXJOB_DONE)
+    {
+        delete texjobs[i];
+        texjobs.remove(i--);
+    }
+}
+
+// uploads whatever the workers finished, within the per frame time limit
+void updatetexjobs()
+{
+    if(texjobs.empty()) return;
+    int start = SDL_GetTicks();
+    loopv(texjobs)
+    {
+        texjob &job = *texjobs[i];
+        if(atomicload(job.state) != TEXJOB_READY) continue;
+        finishtexjob(job);
+        if(int(SDL_GetTicks() - start) >= texuploadtime) break;
+    }
+    reaptexjobs();
+}
+
+// the blocking mode: everything queued is decoded and uploaded before returning, so the next frame is deterministic
+bool flushtexjobs()
+{
+    if(texjobs.empty()) return false;
+    loopv(texjobs) finishtexjob(*texjobs[i]);
+    reaptexjobs();
+    return true;
+}
+
+int gettexjobwait()
+{
+    int wait = texjobwait;
+    texjobwait = 0;
+    return wait;
+}
+
+// the placeholder id is shared, so it is only forgotten and never deleted here
+static void canceltexjob(Texture *t)
+{
+    texjob *job = findtexjob(t);
+    if(job)
+    {
+        texjoblock.lock();
+        job->t = NULL;
+        texjoblock.unlock();
+    }
+    t->type &= ~Texture::PLACEHOLDER;
+    t->id = 0;
+}
+
+void clear_texjobs()
+{
+    texjoblock.lock();
+    loopv(texjobs) texjobs[i]->t = NULL;
+    texworkersquit = true;
+    texjobcond.broadcast();
+    texjoblock.unlock();
+    texworkers.deletecontents();
+    texjobqueue.setsize(0);
+    texjobhead = 0;
+    texjobs.deletecontents();
+}
+
+static void cleanuptexjobs()
+{
+    clear_texjobs();
+    loopi(2) if(texplaceholders[i]) { glDeleteTextures(1, &texplaceholders[i]); texplaceholders[i] = 0; }
+}
+
 static void addname(vector<char> &key, Slot &slot, Slot::Tex &t, bool combined = false, const char *prefix = NULL)
 {
     if(combined) key.add('&');
@@ -2281,11 +2663,10 @@ static void addname(vector<char> &key, Slot &slot, Slot::Tex &t, bool combined =
     for(const char *s = path(tname); *s; key.add(*s++));
 }
 
-static void texcombine(Slot &s, int index, Slot::Tex &t, bool forceload = false)
+static int texcombinekey(Slot &s, int index, Slot::Tex &t, vector<char> &key, bool forceload)
 {
-    vector<char> key;
     addname(key, s, t);
-    int texmask = 0;
+    int combined = -1;
     if(!forceload) switch(t.type)
     {
         case TEX_DIFFUSE:
@@ -2293,15 +2674,29 @@ static void texcombine(Slot &s, int index, Slot::Tex &t, bool forceload = false)
         {
             int i = findtextype(s, t.type==TEX_DIFFUSE ? (s.texmask&(1<<TEX_SPEC) ? 1<<TEX_SPEC : 1<<TEX_ALPHA) : (s.texmask&(1<<TEX_DEPTH) ? 1<<TEX_DEPTH : 1<<TEX_ALPHA));
             if(i<0) break;
-            texmask |= 1<<s.sts[i].type;
             s.sts[i].combined = index;
             addname(key, s, s.sts[i], true);
+            combined = i;
             break;
         }
     }
     key.add('\0');
+    return combined;
+}
+
+static void texcombine(Slot &s, int index, Slot::Tex &t, bool forceload = false)
+{
+    vector<char> key;
+    int combined = texcombinekey(s, index, t, key, forceload);
     t.t = textures.access(key.getbuf());
-    if(t.t) return;
+    if(!t.t) t.t = newtexjob(key.getbuf(), t, combined >= 0 ? &s.sts[combined] : NULL);
+    if(t.t)
+    {
+        // the size of the first texture feeds the texture coordinates of the geometry, so it can't wait for later
+        texjob *job = index ? NULL : findtexjob(t.t);
+        if(job) finishtexjob(*job);
+        return;
+    }
     int compress = 0, wrap = 0;
     ImageData ts;
     if(!texturedata(ts, NULL, &t, true, &compress, &wrap)) { t.t = notexture; return; }
@@ -2330,6 +2725,50 @@ static void texcombine(Slot &s, int index, Slot::Tex &t, bool forceload = false)
     t.t = newtexture(NULL, key.getbuf(), ts, wrap, true, true, true, compress);
 }
 
+static void collectusedvslots(cube *c, vector<uchar> &used)
+{
+    loopi(8)
+    {
+        if(c[i].children) collectusedvslots(c[i].children, used);
+        else if(!isempty(c[i])) loopj(6)
+        {
+            int index = c[i].texture[j];
+            if(!vslots.inrange(index)) continue;
+            while(used.length() <= index) used.add(0);
+            used[index] = 1;
+        }
+    }
+}
+
+// queues the textures of every slot the map uses up front, so the workers decode them while the rest of the map loads
+int preloadslottextures()
+{
+    if(!asynctex) return 0;
+    vector<uchar> used;
+    collectusedvslots(worldroot, used);
+    loopv(used) if(used[i])
+    {
+        int layer = vslots[i]->layer;
+        if(layer <= 0 || !vslots.inrange(layer)) continue;
+        while(used.length() <= layer) used.add(0);
+        used[layer] = 1;
+    }
+    int queued = 0;
+    loopv(used) if(used[i] && vslots[i]->slot && !vslots[i]->slot->loaded)
+    {
+        Slot &slot = *vslots[i]->slot;
+        loopvj(slot.sts)
+        {
+            Slot::Tex &t = slot.sts[j];
+            if(t.combined >= 0 || t.t || t.type == TEX_ENVMAP) continue;
+            vector<char> key;
+            int combined = texcombinekey(slot, j, t, key, false);
+            if(!textures.access(key.getbuf()) && newtexjob(key.getbuf(), t, combined >= 0 ? &slot.sts[combined] : NULL)) queued++;
+        }
+    }
+    return queued;
+}
+
 static Slot &loadslot(Slot &s, bool forceload)
 {
     linkslotshader(s);
@@ -2848,12 +3287,14 @@ GLuint lookupenvmap(ushort emid)
 void cleanuptexture(Texture *t)
 {
     DELETEA(t->alphamask);
-    if(t->id) { glDeleteTextures(1, &t->id); t->id = 0; }
+    if(t->type&Texture::PLACEHOLDER) canceltexjob(t);
+    else if(t->id) { glDeleteTextures(1, &t->id); t->id = 0; }
     if(t->type&Texture::TRANSIENT) textures.remove(t->name);
 }
 
 void cleanuptextures()
 {
+    cleanuptexjobs();
     cleanupmipmaps();
     clearenvmaps();
     loopv(slots) slots[i]->cleanup();
@@ -3611,6 +4052,14 @@ void screenshot(char *filename)
         concatstring(buf, imageexts[format]);
     }
 
+    // textures still loading would show up as placeholders, so finish them and redraw the frame first
+    if(flushtexjobs() && !mainmenu)
+    {
+        inbetweenframes = false;
+        gl_drawframe();
+        inbetweenframes = true;
+    }
+
     ImageData image(screenw, screenh, 3);
     glPixelStorei(GL_PACK_ALIGNMENT, texalign(image.data, screenw, 3));
     glReadPixels(0, 0, screenw, screenh, GL_RGB, GL_UNSIGNED_BYTE, image.data);
@@ -550,6 +550,7 @@ struct Texture
         COMPRESSED = 1<<10, 
         ALPHA      = 1<<11,
         MIRROR     = 1<<12,
+        PLACEHOLDER = 1<<13, // still being loaded on another thread, the id is borrowed
         FLAGS      = 0xFF00
     };
 
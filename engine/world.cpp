@@ -169,6 +169,8 @@ static bool modifyoctaent(int flags, int id, extentity &e)
         modifyoctaentity(flags, id, e, worldroot, ivec(0, 0, 0), worldsize>>1, o, r, leafsize);
     }
     e.flags ^= EF_OCTA;
+    if(e.type == ET_LIGHT || e.type == ET_SPOTLIGHT) lightentchanged(e);
+    else if(e.type == ET_MAPMODEL) addlightchange(o, r);
     if(e.type == ET_LIGHT) clearlightcache(id);
     else if(e.type == ET_PARTICLES) clearparticleemitters();
     else if(flags&MODOE_LIGHTENT) lightent(e);
@@ -1288,6 +1290,7 @@ bool emptymap(int scale, bool force, const char *mname, bool usecfg)    // main
     }
 
     initlights();
+    clearlightchanges();
     allchanged(true);
 
     startmap(mname);
@@ -20,6 +20,22 @@ struct octaheader
     int numvars;
     int numvslots;
 };
+
+#define OCMVERSION 1            // bump if the map container format changes, see worldio.cpp
+
+struct ocmheader                // optional container holding the same contents as the .ogz, split into chunks
+{
+    char magic[4];              // "OCMC"
+    int version;                // little endian like octaheader
+    int headersize;             // sizeof(header)
+    uint crc;                   // crc32 of the uncompressed contents, same as the .ogz
+    uint size;                  // uncompressed size of the contents
+    int chunksize;
+    int numchunks;              // followed by numchunks+1 file offsets, chunks are stored raw if their stored size equals their uncompressed size
+    int octree;                 // offsets into the uncompressed contents
+    int subtrees[8];            // top-level branches, each can be decoded without inflating the ones before it; the whole octree is still built at load
+    int lightmaps;
+};
     
 struct compatheader             // map file format header
 {
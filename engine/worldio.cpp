@@ -57,13 +57,169 @@ static void fixent(entity &e, int version)
     if(version <= 31 && e.type == ET_MAPMODEL) { int yaw = (int(e.attr1)%360 + 360)%360 + 7; e.attr1 = yaw - yaw%15; }
 }
 
+struct ocmstream : stream
+{
+    mappedfile *file;
+    const uchar *data;
+    size_t datasize;
+    ocmheader hdr;
+    vector<uint> offsets;
+    uchar *chunkbuf;
+    const uchar *chunk;
+    int curchunk;
+    offset chunkstart, chunkend, pos;
+
+    ocmstream() : file(NULL), data(NULL), datasize(0), chunkbuf(NULL), chunk(NULL), curchunk(-1), chunkstart(0), chunkend(0), pos(0) {}
+    ~ocmstream() { close(); }
+
+    bool open(const char *name)
+    {
+        file = new mappedfile;
+        if(!file->open(name)) { close(); return false; }
+        data = file->data;
+        datasize = file->size;
+        if(datasize < sizeof(hdr)) { close(); return false; }
+        memcpy(&hdr, data, sizeof(hdr));
+        lilswap(&hdr.version, sizeof(hdr)/sizeof(int) - 1);
+        if(memcmp(hdr.magic, "OCMC", 4) || hdr.version != OCMVERSION || hdr.headersize != sizeof(hdr) ||
+           hdr.chunksize <= 0 || hdr.chunksize > (1<<24) || hdr.numchunks != int((hdr.size + hdr.chunksize - 1)/hdr.chunksize) ||
+           datasize < sizeof(hdr) + (hdr.numchunks+1)*sizeof(uint))
+        {
+            close();
+            return false;
+        }
+        const uchar *table = data + sizeof(hdr);
+        loopi(hdr.numchunks+1)
+        {
+            uint offset;
+            memcpy(&offset, &table[i*sizeof(uint)], sizeof(uint));
+            offset = lilswap(offset);
+            if(offset > datasize || (i ? offset < offsets.last() : offset < sizeof(hdr) + (hdr.numchunks+1)*sizeof(uint))) { close(); return false; }
+            offsets.add(offset);
+        }
+        return true;
+    }
+
+    // another independent reader of the same mapping, which must not outlive this one
+    ocmstream *view()
+    {
+        ocmstream *v = new ocmstream;
+        v->data = data;
+        v->datasize = datasize;
+        v->hdr = hdr;
+        v->offsets = offsets;
+        return v;
+    }
+
+    void close()
+    {
+        DELETEP(file);
+        data = NULL;
+        datasize = 0;
+        offsets.setsize(0);
+        DELETEA(chunkbuf);
+        chunk = NULL;
+        curchunk = -1;
+        chunkstart = chunkend = pos = 0;
+    }
+
+    // only the chunks that are actually read get inflated, and stored chunks are read straight out of the mapping
+    bool getchunk(int i)
+    {
+        if(i == curchunk) return true;
+        if(i < 0 || i >= hdr.numchunks) return false;
+        uint start = offsets[i], len = offsets[i+1] - start;
+        uLongf rawlen = min(uint(hdr.chunksize), hdr.size - uint(i)*hdr.chunksize);
+        if(len == rawlen) chunk = data + start;
+        else
+        {
+            if(!chunkbuf) chunkbuf = new uchar[hdr.chunksize];
+            uLongf destlen = rawlen;
+            if(uncompress(chunkbuf, &destlen, data + start, len) != Z_OK || destlen != rawlen) { curchunk = -1; chunk = NULL; return false; }
+            chunk = chunkbuf;
+        }
+        curchunk = i;
+        chunkstart = offset(i)*hdr.chunksize;
+        chunkend = chunkstart + rawlen;
+        return true;
+    }
+
+    bool end() { return pos >= offset(hdr.size); }
+    offset tell() { return data ? pos : offset(-1); }
+    offset size() { return data ? offset(hdr.size) : offset(-1); }
+    // crc32 of the decoded contents, so a container edited behind its header doesn't pass checkmaps
+    uint getcrc()
+    {
+        if(!data) return 0;
+        uint crc = crc32(0, NULL, 0);
+        loopi(hdr.numchunks)
+        {
+            if(!getchunk(i)) break;
+            crc = crc32(crc, chunk, uInt(chunkend - chunkstart));
+        }
+        return crc;
+    }
+    bool storedcrc(uint &crc) { if(!data) return false; crc = hdr.crc; return true; }
+
+    bool seek(offset off, int whence)
+    {
+        if(!data) return false;
+        if(whence == SEEK_END) off += hdr.size;
+        else if(whence == SEEK_CUR) off += pos;
+        if(off < 0 || off > offset(hdr.size)) return false;
+        pos = off;
+        return true;
+    }
+
+    size_t read(void *buf, size_t len)
+    {
+        if(!data) return 0;
+        uchar *dst = (uchar *)buf;
+        size_t total = 0;
+        while(total < len && pos < offset(hdr.size))
+        {
+            if((pos < chunkstart || pos >= chunkend || !chunk) && !getchunk(int(pos/hdr.chunksize))) break;
+            size_t n = min(len - total, size_t(chunkend - pos));
+            memcpy(&dst[total], &chunk[pos - chunkstart], n);
+            total += n;
+            pos += n;
+        }
+        return total;
+    }
+
+    int getchar()
+    {
+        if(chunk && pos >= chunkstart && pos < chunkend) return chunk[pos++ - chunkstart];
+        return stream::getchar();
+    }
+};
+
+// prefer the .ocm container next to the .ogz, as long as it still has the same contents
+static stream *openmap(const char *ogzname, const char *ocmname, ocmstream **container = NULL)
+{
+    if(container) *container = NULL;
+    stream *gz = opengzfile(ogzname, "rb");
+    ocmstream *ocm = new ocmstream;
+    uint crc;
+    if(!ocm->open(ocmname) || (gz && (!gz->storedcrc(crc) || crc != ocm->hdr.crc)))
+    {
+        delete ocm;
+        return gz;
+    }
+    DELETEP(gz);
+    if(container) *container = ocm;
+    return ocm;
+}
+
 bool loadents(const char *fname, vector<entity> &ents, uint *crc)
 {
-    string pakname, mapname, mcfgname, ogzname;
+    string pakname, mapname, mcfgname, ogzname, ocmname;
     getmapfilenames(fname, NULL, pakname, mapname, mcfgname);
     formatstring(ogzname, "packages/%s.ogz", mapname);
+    formatstring(ocmname, "packages/%s.ocm", mapname);
     path(ogzname);
-    stream *f = opengzfile(ogzname, "rb");
+    path(ocmname);
+    stream *f = openmap(ogzname, ocmname);
     if(!f) return false;
     octaheader hdr;
     if(f->read(&hdr, 7*sizeof(int)) != 7*sizeof(int)) { conoutf(CON_ERROR, "map %s has malformatted header", ogzname); delete f; return false; }
@@ -158,7 +314,7 @@ bool loadents(const char *fname, vector<entity> &ents, uint *crc)
         }
     }
 
-    if(crc)
+    if(crc && !f->storedcrc(*crc))
     {
         f->seek(0, SEEK_END);
         *crc = f->getcrc();
@@ -170,9 +326,10 @@ bool loadents(const char *fname, vector<entity> &ents, uint *crc)
 }
 
 #ifndef STANDALONE
-string ogzname, bakname, cfgname, picname;
+string ogzname, ocmname, bakname, cfgname, picname;
 
 VARP(savebak, 0, 2, 2);
+VARP(saveocm, 0, 0, 2);
 
 void setmapfilenames(const char *fname, const char *cname = NULL)
 {
@@ -180,12 +337,14 @@ void setmapfilenames(const char *fname, const char *cname = NULL)
     getmapfilenames(fname, cname, pakname, mapname, mcfgname);
 
     formatstring(ogzname, "packages/%s.ogz", mapname);
+    formatstring(ocmname, "packages/%s.ocm", mapname);
     if(savebak==1) formatstring(bakname, "packages/%s.BAK", mapname);
     else formatstring(bakname, "packages/%s_%d.BAK", mapname, totalmillis);
     formatstring(cfgname, "packages/%s/%s.cfg", pakname, mcfgname);
     formatstring(picname, "packages/%s.jpg", mapname);
 
     path(ogzname);
+    path(ocmname);
     path(bakname);
     path(cfgname);
     path(picname);
@@ -215,13 +374,14 @@ enum { OCTSAV_CHILDREN = 0, OCTSAV_EMPTY, OCTSAV_SOLID, OCTSAV_NORMAL, OCTSAV_LO
 
 static int savemapprogress = 0;
 
-void savec(cube *c, const ivec &o, int size, stream *f, bool nolms)
+void savec(cube *c, const ivec &o, int size, stream *f, bool nolms, int *offsets = NULL)
 {
     if((savemapprogress++&0xFFF)==0) renderprogress(float(savemapprogress)/allocnodes, "saving octree...");
 
     loopi(8)
     {
         ivec co(i, o, size);
+        if(offsets) offsets[i] = int(f->tell());
         if(c[i].children)
         {
             f->putchar(OCTSAV_CHILDREN);
@@ -874,6 +1034,70 @@ void loadvslots(stream *f, int numvslots)
     delete[] prev;
 }
 
+#define OCM_CHUNKSIZE (1<<16)
+
+// rewrites the just saved .ogz as an .ocm, optionally compressing each chunk on its own so any of them can be decoded without the rest
+static bool saveocmfile(ocmheader &hdr, bool compress)
+{
+    stream *gz = opengzfile(ogzname, "rb");
+    if(!gz) { conoutf(CON_WARN, "could not read map %s", ogzname); return false; }
+    stream::offset size = gz->size();
+    if(size <= 0 || !gz->storedcrc(hdr.crc)) { conoutf(CON_WARN, "could not read map %s", ogzname); delete gz; return false; }
+    stream *f = openfile(ocmname, "wb");
+    if(!f) { conoutf(CON_WARN, "could not write map to %s", ocmname); delete gz; return false; }
+
+    renderprogress(0, "saving map container...");
+
+    memcpy(hdr.magic, "OCMC", 4);
+    hdr.version = OCMVERSION;
+    hdr.headersize = sizeof(hdr);
+    hdr.size = uint(size);
+    hdr.chunksize = OCM_CHUNKSIZE;
+    hdr.numchunks = int((size + OCM_CHUNKSIZE - 1)/OCM_CHUNKSIZE);
+    vector<uint> offsets;
+    offsets.add(sizeof(hdr) + (hdr.numchunks+1)*sizeof(uint));
+    f->seek(offsets[0], SEEK_SET);
+
+    uchar *raw = new uchar[OCM_CHUNKSIZE];
+    uLongf packedsize = compressBound(OCM_CHUNKSIZE);
+    uchar *packed = compress ? new uchar[packedsize] : NULL;
+    bool failed = false;
+    loopi(hdr.numchunks)
+    {
+        if((i&0xF)==0) renderprogress(float(i)/hdr.numchunks, "saving map container...");
+        size_t rawlen = min(size_t(OCM_CHUNKSIZE), size_t(size - stream::offset(i)*OCM_CHUNKSIZE));
+        if(gz->read(raw, rawlen) != rawlen) { failed = true; break; }
+        uLongf len = packedsize;
+        if(packed && compress2(packed, &len, raw, rawlen, Z_BEST_COMPRESSION) == Z_OK && len < rawlen)
+        {
+            if(f->write(packed, len) != len) { failed = true; break; }
+        }
+        else if(f->write(raw, rawlen) != rawlen) { failed = true; break; }
+        else len = rawlen;
+        offsets.add(offsets.last() + len);
+    }
+    delete[] raw;
+    DELETEA(packed);
+    delete gz;
+
+    if(!failed)
+    {
+        ocmheader tmp = hdr;
+        lilswap(&tmp.version, sizeof(tmp)/sizeof(int) - 1);
+        loopv(offsets) offsets[i] = lilswap(offsets[i]);
+        failed = !f->seek(0, SEEK_SET) || f->write(&tmp, sizeof(tmp)) != sizeof(tmp) || f->write(offsets.getbuf(), offsets.length()*sizeof(uint)) != offsets.length()*sizeof(uint);
+    }
+    delete f;
+    if(failed)
+    {
+        remove(findfile(ocmname, "wb"));
+        conoutf(CON_WARN, "could not write map to %s", ocmname);
+        return false;
+    }
+    conoutf("wrote map file %s", ocmname);
+    return true;
+}
+
 bool save_world(const char *mname, bool nolms)
 {
     if(!*mname) mname = game::getclientmap();
@@ -967,9 +1191,14 @@ bool save_world(const char *mname, bool nolms)
 
     savevslots(f, numvslots);
 
+    ocmheader ocm;
+    memset(&ocm, 0, sizeof(ocm));
+    ocm.octree = int(f->tell());
+
     renderprogress(0, "saving octree...");
-    savec(worldroot, ivec(0, 0, 0), worldsize>>1, f, nolms);
+    savec(worldroot, ivec(0, 0, 0), worldsize>>1, f, nolms, ocm.subtrees);
 
+    ocm.lightmaps = int(f->tell());
     if(!nolms) 
     {
         if(lightmaps.length()) renderprogress(0, "saving lightmaps...");
@@ -991,6 +1220,7 @@ bool save_world(const char *mname, bool nolms)
 
     delete f;
     conoutf("wrote map file %s", ogzname);
+    if(saveocm) saveocmfile(ocm, saveocm > 1);
     return true;
 }
 
@@ -999,11 +1229,143 @@ static uint mapcrc = 0;
 uint getmapcrc() { return mapcrc; }
 void clearmapcrc() { mapcrc = 0; }
 
+// every stage of loading a map reports its progress through renderprogress, and is timed for the breakdown printed at the end
+struct maploadstage
+{
+    const char *name;
+    int millis;
+};
+
+static vector<maploadstage> loadstages;
+static const char *loadstagetext = NULL;
+static int loadstagestart = 0;
+
+VARP(maploadtimes, 0, 1, 1);
+
+static void endloadstage()
+{
+    if(loadstages.length()) loadstages.last().millis += SDL_GetTicks() - loadstagestart;
+}
+
+static void loadstage(const char *name, const char *text = NULL)
+{
+    endloadstage();
+    maploadstage &stage = loadstages.add();
+    stage.name = name;
+    stage.millis = 0;
+    loadstagetext = text;
+    loadstagestart = SDL_GetTicks();
+    if(text) renderprogress(0, text);
+}
+
+static void loadstep(float bar)
+{
+    if(loadstagetext) renderprogress(bar, loadstagetext);
+}
+
+static void printloadstages(const char *extra)
+{
+    endloadstage();
+    if(maploadtimes)
+    {
+        vector<char> buf;
+        int total = 0;
+        loopv(loadstages)
+        {
+            const maploadstage &stage = loadstages[i];
+            total += stage.millis;
+            defformatstring(desc, "%s%s %d", i ? ", " : "", stage.name, stage.millis);
+            buf.put(desc, strlen(desc));
+        }
+        buf.add('\0');
+        conoutf("map load times (ms): %s, total %d%s", buf.getbuf(), total, extra);
+    }
+    loadstages.setsize(0);
+    loadstagetext = NULL;
+}
+
+VARP(loadthreads, 0, 0, 16);
+
+struct subtreejob
+{
+    ocmstream *f;
+    cube *c;
+    ivec co;
+    int size;
+    bool failed;
+};
+
+static vector<subtreejob> subtreejobs;
+static volatile int subtreenext = 0;
+
+static int subtreework(void *data)
+{
+    for(;;)
+    {
+        int i = atomicadd(subtreenext, 1) - 1;
+        if(i >= subtreejobs.length()) break;
+        subtreejob &job = subtreejobs[i];
+        loadc(job.f, *job.c, job.co, job.size, job.failed);
+    }
+    return 0;
+}
+
+// decodes the top level subtrees of a container on separate threads, starting each at its offset from the header
+static cube *loadsubtrees(ocmstream *ocm, int size, bool &failed)
+{
+    const ocmheader &hdr = ocm->hdr;
+    if(ocm->tell() != hdr.octree || hdr.subtrees[0] != hdr.octree || hdr.lightmaps > int(hdr.size)) return NULL;
+    loopi(8) if(hdr.subtrees[i] >= (i < 7 ? hdr.subtrees[i+1] : hdr.lightmaps)) return NULL;
+    int numthreads = min(loadthreads > 0 ? loadthreads : numcpus, 8);
+    if(numthreads <= 1) return NULL;
+
+    cube *c = newcubes();
+    loopi(8)
+    {
+        subtreejob &job = subtreejobs.add();
+        job.f = ocm->view();
+        job.f->seek(hdr.subtrees[i], SEEK_SET);
+        job.c = &c[i];
+        job.co = ivec(i, ivec(0, 0, 0), size);
+        job.size = size;
+        job.failed = false;
+    }
+    subtreenext = 0;
+    vector<thread *> workers;
+    loopi(numthreads-1)
+    {
+        thread *t = new thread;
+        if(!t->start(subtreework, NULL, "octree loader")) { delete t; break; }
+        workers.add(t);
+    }
+    for(;;)
+    {
+        int i = atomicadd(subtreenext, 1) - 1;
+        if(i >= subtreejobs.length()) break;
+        loadstep(i/float(subtreejobs.length()));
+        subtreejob &job = subtreejobs[i];
+        loadc(job.f, *job.c, job.co, job.size, job.failed);
+    }
+    workers.deletecontents();
+    loopv(subtreejobs)
+    {
+        subtreejob &job = subtreejobs[i];
+        if(job.failed || job.f->tell() != (i < 7 ? hdr.subtrees[i+1] : hdr.lightmaps)) failed = true;
+        delete job.f;
+    }
+    subtreejobs.setsize(0);
+    ocm->seek(hdr.lightmaps, SEEK_SET);
+    return c;
+}
+
 bool load_world(const char *mname, const char *cname)        // still supports all map formats that have existed since the earliest cube betas!
 {
     int loadingstart = SDL_GetTicks();
+    loadstages.setsize(0);
+    loadstage("header");
     setmapfilenames(mname, cname);
-    stream *f = opengzfile(ogzname, "rb");
+    ocmstream *ocm = NULL;
+    stream *f = openmap(ogzname, ocmname, &ocm);
     if(!f) { conoutf(CON_ERROR, "could not read map %s", ogzname); return false; }
     octaheader hdr;
     if(f->read(&hdr, 7*sizeof(int)) != 7*sizeof(int)) { conoutf(CON_ERROR, "map %s has malformatted header", ogzname); delete f; return false; }
@@ -1062,7 +1424,7 @@ bool load_world(const char *mname, const char *cname)        // still supports a
         else lilswap(&hdr.numvslots, 1);
     }
 
-    renderprogress(0, "clearing world...");
+    loadstage("clear", "clearing world...");
 
     freeocta(worldroot);
     worldroot = NULL;
@@ -1072,7 +1434,7 @@ bool load_world(const char *mname, const char *cname)        // still supports a
     setvar("mapsize", 1<<worldscale, true, false);
     setvar("mapscale", worldscale, true, false);
 
-    renderprogress(0, "loading vars...");
+    loadstage("entities", "loading vars...");
  
     loopi(hdr.numvars)
     {
@@ -1201,17 +1563,19 @@ bool load_world(const char *mname, const char *cname)        // still supports a
         f->seek((hdr.numents-MAXENTS)*(samegame ? sizeof(entity) + einfosize : eif), SEEK_CUR);
     }
 
-    renderprogress(0, "loading slots...");
+    loadstage("slots", "loading slots...");
     loadvslots(f, hdr.numvslots);
 
-    renderprogress(0, "loading octree...");
+    loadstage("octree", "loading octree...");
     bool failed = false;
-    worldroot = loadchildren(f, ivec(0, 0, 0), hdr.worldsize>>1, failed);
+    worldroot = ocm && hdr.version == MAPVERSION ? loadsubtrees(ocm, hdr.worldsize>>1, failed) : NULL;
+    if(!worldroot) worldroot = loadchildren(f, ivec(0, 0, 0), hdr.worldsize>>1, failed);
     if(failed) conoutf(CON_ERROR, "garbage in map");
 
     renderprogress(0, "validating...");
     validatec(worldroot, hdr.worldsize>>1);
 
+    loadstage("lightmaps");
     if(!failed)
     {
         if(hdr.version >= 7) loopi(hdr.lightmaps)
@@ -1239,12 +1603,14 @@ bool load_world(const char *mname, const char *cname)        // still supports a
     }
 
     mapcrc = f->getcrc();
+    if(ocm && mapcrc != ocm->hdr.crc) conoutf(CON_WARN, "map %s does not match the crc in its header", ocmname);
     delete f;
 
     conoutf("read map %s (%.1f seconds)", ogzname, (SDL_GetTicks()-loadingstart)/1000.0f);
 
     clearmainmenu();
 
+    loadstage("config");
     identflags |= IDF_OVERRIDDEN;
     execfile("data/default_map_settings.cfg", false);
     execfile(cfgname, false);
@@ -1255,18 +1621,30 @@ bool load_world(const char *mname, const char *cname)        // still supports a
     extern void fixrotatedlightmaps();
     if(hdr.version <= 31) fixrotatedlightmaps();
 
+    // the slot textures decode in the background while models and sounds load, octarender only waits for the ones it needs
+    loadstage("prefetch");
+    int prefetched = preloadslottextures();
+    gettexjobwait();
+
+    loadstage("models");
     preloadusedmapmodels(true);
 
     game::preload();
     flushpreloadedmodels();
 
+    loadstage("sounds");
     preloadmapsounds();
 
+    loadstage("geometry");
     entitiesinoctanodes();
     attachentities();
     initlights();
+    clearlightchanges();
     allchanged(true);
 
+    defformatstring(prefetchinfo, "; %d textures prefetched, waited %d ms for them", prefetched, gettexjobwait());
+    printloadstages(prefetched ? prefetchinfo : "");
+
     renderbackground("loading...", mapshot, mname, game::getmapinfo());
 
     if(maptitle[0] && strcmp(maptitle, "Untitled Map by Unknown")) conoutf(CON_ECHO, "%s", maptitle);
@@ -49,7 +49,7 @@ namespace aiman
             if(bot)
             {
                 if(smode && bot->state.state==CS_ALIVE) smode->changeteam(bot, bot->team, t.team);
-                copystring(bot->team, t.team, MAXTEAMLEN+1);
+                setclientteam(bot, t.team);
                 sendf(-1, 1, "riisi", N_SETTEAM, bot->clientnum, bot->team, 0);
             }
             else teams.remove(0, 1);
@@ -114,11 +114,11 @@ namespace aiman
 		ci->ownernum = owner ? owner->clientnum : -1;
         if(owner) owner->bots.add(ci);
         ci->state.skill = skill <= 0 ? rnd(50) + 51 : clamp(skill, 1, 101);
-	    clients.add(ci);
-		ci->state.lasttimeplayed = lastmillis;
 		copystring(ci->name, "bot", MAXNAMELEN+1);
-		ci->state.state = CS_DEAD;
         copystring(ci->team, team, MAXTEAMLEN+1);
+	    addtoclients(ci);
+		ci->state.lasttimeplayed = lastmillis;
+		ci->state.state = CS_DEAD;
         ci->playermodel = rnd(128);
 		ci->aireinit = 2;
 		ci->connected = true;
@@ -134,7 +134,7 @@ namespace aiman
         sendf(-1, 1, "ri2", N_CDIS, ci->clientnum);
         clientinfo *owner = (clientinfo *)getclientinfo(ci->ownernum);
         if(owner) owner->bots.removeobj(ci);
-        clients.removeobj(ci);
+        removefromclients(ci);
         DELETEP(bots[cn]);
 		dorefresh = true;
 	}
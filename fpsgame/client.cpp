@@ -1961,6 +1961,12 @@ namespace game
                 break;
             }
 
+            case N_DEMOSEEK:
+                if(!demoplayback) break;
+                clearclients(false);
+                gamepaused = false;
+                break;
+
             case N_CURRENTMASTER:
             {
                 int mm = getint(p), mn;
@@ -8,6 +8,7 @@
 #define EXT_UPTIME                      0
 #define EXT_PLAYERSTATS                 1
 #define EXT_TEAMSCORE                   2
+#define EXT_PROFILE                     3
 
 /*
     Client:
@@ -15,6 +16,7 @@
     A: 0 EXT_UPTIME
     B: 0 EXT_PLAYERSTATS cn #a client number or -1 for all players#
     C: 0 EXT_TEAMSCORE
+    D: 0 EXT_PROFILE
 
     Server:  
     --------
@@ -23,10 +25,12 @@
          EXT_PLAYERSTATS_RESP_IDS pid(s) #1 packet#
          EXT_PLAYERSTATS_RESP_STATS pid playerdata #1 packet for each player#
     C: 0 EXT_TEAMSCORE EXT_ACK EXT_VERSION 0 or 1 #error, no teammode# remaining_time gamemode loop(teamdata [numbases bases] or -1)
+    D: 0 EXT_PROFILE EXT_ACK EXT_VERSION 0 or 1 #error, profiling disabled# window #in seconds# loop(counter count p50 p99 max #in microseconds#) -1
+         #as many packets as needed, counters are SPROF_* and SPROF_MESSAGE+N_* for message types#
 
     Errors:
     --------------
-    B:C:default: 0 command EXT_ACK EXT_VERSION EXT_ERROR
+    B:C:D:default: 0 command EXT_ACK EXT_VERSION EXT_ERROR
 */
 
     VAR(extinfoip, 0, 0, 1);
@@ -83,6 +87,39 @@
         loopv(scores) extinfoteamscore(p, scores[i].team, scores[i].score);
     }
 
+    VAR(extinfoprofile, 0, 1, 1);
+
+    void extinfoprofiles(ucharbuf &p)
+    {
+        if(!extinfoprofile || !serverprofile)
+        {
+            putint(p, EXT_ERROR);
+            sendserverinforeply(p);
+            return;
+        }
+        putint(p, EXT_NO_ERROR);
+        putint(p, serverprofilewindow());
+        ucharbuf q = p;
+        loopi(SPROF_MAX)
+        {
+            profilestats s;
+            if(!getserverprofile(i, s)) continue;
+            if(q.remaining() < 32)
+            {
+                putint(q, -1);
+                sendserverinforeply(q);
+                q = p;
+            }
+            putint(q, i);
+            putint(q, s.count);
+            putint(q, s.p50);
+            putint(q, s.p99);
+            putint(q, s.max);
+        }
+        putint(q, -1);
+        sendserverinforeply(q);
+    }
+
     void extserverinforeply(ucharbuf &req, ucharbuf &p)
     {
         int extcmd = getint(req); // extended commands  
@@ -134,6 +171,12 @@
                 break;
             }
 
+            case EXT_PROFILE:
+            {
+                extinfoprofiles(p);
+                return;
+            }
+
             default:
             {
                 putint(p, EXT_ERROR);
@@ -243,6 +243,7 @@ enum
     N_INITTOKENS, N_TAKETOKEN, N_EXPIRETOKENS, N_DROPTOKENS, N_DEPOSITTOKENS, N_STEALTOKENS,
     N_SERVCMD,
     N_DEMOPACKET,
+    N_DEMOSEEK,
     NUMMSG
 };
 
@@ -273,6 +274,7 @@ static const int msgsizes[] =               // size inclusive message token, 0 f
     N_INITTOKENS, 0, N_TAKETOKEN, 2, N_EXPIRETOKENS, 0, N_DROPTOKENS, 0, N_DEPOSITTOKENS, 2, N_STEALTOKENS, 0,
     N_SERVCMD, 0,
     N_DEMOPACKET, 0,
+    N_DEMOSEEK, 1,
     -1
 };
 
@@ -290,6 +292,15 @@ struct demoheader
     int version, protocol;
 };
 
+// optional keyframe index appended after the gzipped packet stream, ignored by older versions
+#define DEMO_INDEX_MAGIC "SAUERDEMO_INDEX"
+
+struct demoindexfooter
+{
+    int offset; // raw offset of the gzipped keyframe list
+    char magic[16];
+};
+
 #define MAXNAMELEN 15
 #define MAXTEAMLEN 4
 
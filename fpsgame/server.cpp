@@ -208,6 +208,14 @@ namespace server
 
     extern int gamemillis, nextexceeded;
 
+    // pending events of a client live in a ring buffer so the oldest can be popped without shifting the rest
+    struct eventqueue : queue<gameevent *, 128>
+    {
+        ~eventqueue() { deletecontents(); }
+
+        void deletecontents() { while(!empty()) delete remove(); clear(); }
+    };
+
     struct clientinfo
     {
         int clientnum, ownernum, connectmillis, sessionid, overflow;
@@ -218,7 +226,7 @@ namespace server
         bool connected, local, timesync;
         int gameoffset, lastevent, pushed, exceeded;
         gamestate state;
-        vector<gameevent *> events;
+        eventqueue events;
         vector<uchar> position, messages;
         uchar *wsdata;
         int wslen;
@@ -237,7 +245,7 @@ namespace server
         char *authkickreason;
 
         clientinfo() : getdemo(NULL), getmap(NULL), clipboard(NULL), authchallenge(NULL), authkickreason(NULL) { reset(); }
-        ~clientinfo() { events.deletecontents(); cleanclipboard(); cleanauth(); }
+        ~clientinfo() { cleanclipboard(); cleanauth(); }
 
         void addevent(gameevent *e)
         {
@@ -252,8 +260,7 @@ namespace server
 
         int calcpushrange()
         {
-            ENetPeer *peer = getclientpeer(ownernum);
-            return PUSHMILLIS + (peer ? peer->roundTripTime + peer->roundTripTimeVariance : ENET_PEER_DEFAULT_ROUND_TRIP_TIME);
+            return PUSHMILLIS + getclientrtt(ownernum);
         }
 
         bool checkpushed(int millis, int range)
@@ -397,6 +404,7 @@ namespace server
 
     vector<uint> allowedips;
     vector<ban> bannedips;
+    hashtable<int, int> bannedipcounts; // number of entries in bannedips per ip
 
     void addban(uint ip, int expire)
     {
@@ -405,11 +413,93 @@ namespace server
         b.time = totalmillis;
         b.expire = totalmillis + expire;
         b.ip = ip;
+        bannedipcounts.access(int(ip), 0)++;
         loopv(bannedips) if(bannedips[i].expire - b.expire > 0) { bannedips.insert(i, b); return; }
         bannedips.add(b);
     }
 
+    void expirebans()
+    {
+        int expired = 0;
+        while(expired < bannedips.length() && bannedips[expired].expire-totalmillis <= 0)
+        {
+            int *n = bannedipcounts.access(int(bannedips[expired].ip));
+            if(n && --*n <= 0) bannedipcounts.remove(int(bannedips[expired].ip));
+            expired++;
+        }
+        if(expired) bannedips.remove(0, expired);
+    }
+
+    void clearbans()
+    {
+        bannedips.shrink(0);
+        bannedipcounts.clear();
+    }
+
+    // number of clients using each name or team, so duplicate and membership checks don't scan all clients
+    struct nameindex
+    {
+        struct entry
+        {
+            string name;
+            int count;
+        };
+        hashnameset<entry> names;
+
+        nameindex() : names(1<<6) {}
+
+        int count(const char *name)
+        {
+            entry *e = names.access(name);
+            return e ? e->count : 0;
+        }
+
+        void add(const char *name)
+        {
+            entry *e = names.access(name);
+            if(e) { e->count++; return; }
+            entry &n = names[name];
+            copystring(n.name, name);
+            n.count = 1;
+        }
+
+        void remove(const char *name)
+        {
+            entry *e = names.access(name);
+            if(e && --e->count <= 0) names.remove(name);
+        }
+    };
+
     vector<clientinfo *> connects, clients, bots;
+    nameindex clientnames, clientteams; // only covers connected clients and bots, i.e. those in clients
+
+    void addtoclients(clientinfo *ci)
+    {
+        clients.add(ci);
+        clientnames.add(ci->name);
+        clientteams.add(ci->team);
+    }
+
+    void removefromclients(clientinfo *ci)
+    {
+        clients.removeobj(ci);
+        clientnames.remove(ci->name);
+        clientteams.remove(ci->team);
+    }
+
+    void setclientname(clientinfo *ci, const char *name)
+    {
+        if(ci->connected) clientnames.remove(ci->name);
+        copystring(ci->name, name, MAXNAMELEN+1);
+        if(ci->connected) clientnames.add(ci->name);
+    }
+
+    void setclientteam(clientinfo *ci, const char *team)
+    {
+        if(ci->connected) clientteams.remove(ci->team);
+        copystring(ci->team, team, MAXTEAMLEN+1);
+        if(ci->connected) clientteams.add(ci->team);
+    }
 
     void kickclients(uint ip, clientinfo *actor = NULL, int priv = PRIV_NONE)
     {
@@ -600,14 +690,161 @@ namespace server
 
     vector<demofile> demos;
 
+    // a keyframe marks a point where the gzipped packet stream can be restarted, along with a welcome packet
+    // that rebuilds the game state at that point, so playback can seek without reading everything before it
+    struct demokeyframe
+    {
+        int millis, rawpos, pos, snapshot, len;
+    };
+
+    vector<demokeyframe> demokeyframes;
+    vector<uchar> demosnapshots;
+
     bool demonextmatch = false;
-    stream *demotmp = NULL, *demorecord = NULL, *demoplayback = NULL;
-    int nextplayback = 0;
+    stream *demotmp = NULL, *demorecord = NULL, *demoplayback = NULL, *demoplaybackfile = NULL;
+    int nextplayback = 0, lastdemokeyframe = 0;
 
     VAR(maxdemos, 0, 5, 25);
     VAR(maxdemosize, 0, 16, 31);
     VAR(restrictdemos, 0, 1, 1);
     VARF(autorecorddemo, 0, 0, 1, demonextmatch = autorecorddemo!=0);
+    VAR(demokeyframeinterval, 0, 30, 600);
+    VAR(demothread, 0, 1, 1);
+    VAR(demobuffer, 1, 4, 64);
+
+    // compresses and writes a recording demo on a worker thread: the game thread only appends records to a ring
+    // buffer of demobuffer MB, and stalls only when the worker falls that far behind
+    struct demowriter
+    {
+        enum { SYNCPOINT = -1 };
+
+        stream *out;
+        spscbuffer buf;
+        thread worker;
+        mutex lock;
+        condition datacond, spacecond;
+        volatile int quit, waiting, stalled, rawsize;
+        vector<stream::offset> syncpoints;
+        int peak, stalls, stallmillis, written;
+
+        demowriter() : out(NULL), quit(0), waiting(0), stalled(0), rawsize(0), peak(0), stalls(0), stallmillis(0), written(0) {}
+        ~demowriter() { finish(); }
+
+        bool running() const { return worker.running(); }
+
+        bool start(stream *f, int size)
+        {
+            if(running() || !buf.init(size)) return false;
+            out = f;
+            quit = waiting = stalled = 0;
+            rawsize = int(f->rawtell());
+            syncpoints.setsize(0);
+            peak = stalls = stallmillis = written = 0;
+            if(worker.start(run, this, "demo writer")) return true;
+            out = NULL;
+            return false;
+        }
+
+        void finish()
+        {
+            if(!running()) return;
+            atomicstore(quit, 1);
+            wake();
+            worker.join();
+            out = NULL;
+        }
+
+        void wake()
+        {
+            if(!atomicload(waiting)) return;
+            lock.lock();
+            datacond.signal();
+            lock.unlock();
+        }
+
+        void put(const void *data, int len)
+        {
+            const uchar *p = (const uchar *)data;
+            enet_uint32 stallstart = 0;
+            for(;;)
+            {
+                int n = buf.write(p, len);
+                p += n;
+                len -= n;
+                if(n) wake();
+                if(len <= 0) break;
+                if(!stallstart) { stallstart = enet_time_get(); stalls++; }
+                lock.lock();
+                atomicstore(stalled, 1);
+                if(!buf.space()) spacecond.wait(lock, 5);
+                atomicstore(stalled, 0);
+                lock.unlock();
+            }
+            if(stallstart) stallmillis += enet_time_get() - stallstart;
+            peak = max(peak, buf.length());
+            written += int(p - (const uchar *)data);
+        }
+
+        void putrecord(int header) { lilswap(&header, 1); put(&header, sizeof(header)); }
+
+        void sync() { putrecord(SYNCPOINT); }
+
+        static int run(void *data) { ((demowriter *)data)->process(); return 0; }
+
+        void process()
+        {
+            int remaining = 0;
+            for(;;)
+            {
+                uchar *p;
+                int n = buf.peek(p);
+                if(n > 0 && remaining > 0)
+                {
+                    n = min(n, remaining);
+                    out->write(p, n);
+                    buf.skip(n);
+                    remaining -= n;
+                    atomicstore(rawsize, int(out->rawtell()));
+                }
+                else if(buf.length() >= int(sizeof(int)))
+                {
+                    int header;
+                    buf.read(&header, sizeof(header));
+                    lilswap(&header, 1);
+                    if(header >= 0) remaining = header;
+                    else
+                    {
+                        stream::offset pos = out->tell(), rawpos = out->syncpoint();
+                        syncpoints.add(pos);
+                        syncpoints.add(rawpos);
+                    }
+                    continue;
+                }
+                else if(atomicload(quit)) break;
+                else
+                {
+                    lock.lock();
+                    atomicstore(waiting, 1);
+                    if(!buf.length() || (!remaining && buf.length() < int(sizeof(int)))) datacond.wait(lock, 10);
+                    atomicstore(waiting, 0);
+                    lock.unlock();
+                    continue;
+                }
+                if(atomicload(stalled))
+                {
+                    lock.lock();
+                    spacecond.signal();
+                    lock.unlock();
+                }
+            }
+        }
+    } demoworker;
+
+    ICOMMAND(demostats, "", (),
+    {
+        conoutf("demo writer: %s, %d kB queued, peak %d kB of %d kB buffer", demoworker.running() ? "recording" : "idle", demoworker.buf.length()>>10, demoworker.peak>>10, demoworker.buf.size>>10);
+        conoutf("%d kB recorded, %d kB compressed, %d stalls for %d ms", demoworker.written>>10, atomicload(demoworker.rawsize)>>10, demoworker.stalls, demoworker.stallmillis);
+    });
 
     VAR(restrictpausegame, 0, 1, 1);
     VAR(restrictgamespeed, 0, 1, 1);
@@ -796,8 +1033,7 @@ namespace server
     bool duplicatename(clientinfo *ci, const char *name)
     {
         if(!name) name = ci->name;
-        loopv(clients) if(clients[i]!=ci && !strcmp(name, clients[i]->name)) return true;
-        return false;
+        return clientnames.count(name) > (ci->connected && !strcmp(name, ci->name) ? 1 : 0);
     }
 
     const char *colorname(clientinfo *ci, const char *name = NULL)
@@ -915,7 +1151,7 @@ namespace server
         teaminfos.clear();
     }
 
-    bool teamhasplayers(const char *team) { loopv(clients) if(!strcmp(clients[i]->team, team)) return true; return false; }
+    bool teamhasplayers(const char *team) { return clientteams.count(team) > 0; }
 
     bool pruneteaminfo()
     {
@@ -991,7 +1227,7 @@ namespace server
                     addteaminfo(ci->team);
                     continue;
                 }
-                copystring(ci->team, teamnames[i], MAXTEAMLEN+1);
+                setclientteam(ci, teamnames[i]);
                 sendf(-1, 1, "riisi", N_SETTEAM, ci->clientnum, teamnames[i], -1);
             }
         }
@@ -1049,7 +1285,7 @@ namespace server
     void adddemo()
     {
         if(!demotmp) return;
-        int len = (int)min(demotmp->size(), stream::offset((maxdemosize<<20) + 0x10000));
+        int len = (int)demotmp->size();
         demofile &d = demos.add();
         time_t t = time(NULL);
         char *timestr = ctime(&t), *trim = timestr + strlen(timestr);
@@ -1063,15 +1299,56 @@ namespace server
         DELETEP(demotmp);
     }
         
+    void writedemoindex()
+    {
+        if(demokeyframes.empty() || !demotmp->seek(0, SEEK_END)) return;
+        demoindexfooter footer;
+        footer.offset = int(demotmp->tell());
+        memcpy(footer.magic, DEMO_INDEX_MAGIC, sizeof(footer.magic));
+        stream *f = opengzfile(NULL, "wb", demotmp);
+        if(!f) return;
+        f->putlil<int>(demokeyframes.length());
+        loopv(demokeyframes)
+        {
+            demokeyframe &k = demokeyframes[i];
+            f->putlil<int>(k.millis);
+            f->putlil<int>(k.rawpos);
+            f->putlil<int>(k.pos);
+            f->putlil<int>(k.len);
+            f->write(&demosnapshots[k.snapshot], k.len);
+        }
+        delete f;
+        lilswap(&footer.offset, 1);
+        demotmp->write(&footer, sizeof(footer));
+    }
+
     void enddemorecord()
     {
         if(!demorecord) return;
 
+        if(demoworker.running())
+        {
+            demoworker.finish();
+            vector<stream::offset> &syncpoints = demoworker.syncpoints;
+            loopvrev(demokeyframes)
+            {
+                demokeyframe &k = demokeyframes[i];
+                stream::offset pos = 2*i+1 < syncpoints.length() ? syncpoints[2*i] : -1, rawpos = 2*i+1 < syncpoints.length() ? syncpoints[2*i+1] : -1;
+                if(pos < 0 || rawpos <= 0 || pos > INT_MAX || rawpos > INT_MAX) demokeyframes.remove(i);
+                else { k.pos = int(pos); k.rawpos = int(rawpos); }
+            }
+            if(demoworker.stalls) conoutf(CON_WARN, "demo recording stalled %d times for %d ms, consider a larger demobuffer", demoworker.stalls, demoworker.stallmillis);
+        }
+
         DELETEP(demorecord);
 
         if(!demotmp) return;
         if(!maxdemos || !maxdemosize) { DELETEP(demotmp); return; }
 
+        writedemoindex();
+        demokeyframes.setsize(0);
+        demosnapshots.setsize(0);
+
         prunedemos(1);
         adddemo();
     }
@@ -1081,6 +1358,15 @@ namespace server
         if(!demorecord) return;
         int stamp[3] = { gamemillis, chan, len };
         lilswap(stamp, 3);
+        if(demoworker.running())
+        {
+            demoworker.putrecord(sizeof(stamp) + len);
+            demoworker.put(stamp, sizeof(stamp));
+            demoworker.put(data, len);
+            // the worker only reports what it has compressed so far, so what is still queued counts at its full size
+            if(atomicload(demoworker.rawsize) + demoworker.buf.length() >= (maxdemosize<<20)) enddemorecord();
+            return;
+        }
         demorecord->write(stamp, sizeof(stamp));
         demorecord->write(data, len);
         if(demorecord->rawtell() >= (maxdemosize<<20)) enddemorecord();
@@ -1107,6 +1393,9 @@ namespace server
         sendservmsg("recording demo");
 
         demorecord = f;
+        demokeyframes.setsize(0);
+        demosnapshots.setsize(0);
+        lastdemokeyframe = gamemillis;
 
         demoheader hdr;
         memcpy(hdr.magic, DEMO_MAGIC, sizeof(hdr.magic));
@@ -1115,11 +1404,37 @@ namespace server
         lilswap(&hdr.version, 2);
         demorecord->write(&hdr, sizeof(demoheader));
 
+        if(demothread && !demoworker.start(demorecord, demobuffer<<20)) conoutf(CON_WARN, "could not start demo writer thread, compressing on the game thread");
+
         packetbuf p(MAXTRANS, ENET_PACKET_FLAG_RELIABLE);
         welcomepacket(p, NULL);
         writedemo(1, p.buf, p.len);
     }
 
+    void checkdemokeyframe()
+    {
+        if(!demorecord || !demokeyframeinterval || gamemillis - lastdemokeyframe < demokeyframeinterval*1000) return;
+        lastdemokeyframe = gamemillis;
+        stream::offset pos = -1, rawpos = -1;
+        // the worker resolves where the sync point lands once it has written everything before it
+        if(demoworker.running()) demoworker.sync();
+        else
+        {
+            pos = demorecord->tell();
+            rawpos = demorecord->syncpoint();
+            if(pos < 0 || rawpos <= 0 || pos > INT_MAX || rawpos > INT_MAX) return;
+        }
+        packetbuf p(MAXTRANS, ENET_PACKET_FLAG_RELIABLE);
+        welcomepacket(p, NULL);
+        demokeyframe &k = demokeyframes.add();
+        k.millis = gamemillis;
+        k.rawpos = int(rawpos);
+        k.pos = int(pos);
+        k.snapshot = demosnapshots.length();
+        k.len = p.len;
+        demosnapshots.put(p.buf, p.len);
+    }
+
     void listdemos(int cn)
     {
         packetbuf p(MAXTRANS, ENET_PACKET_FLAG_RELIABLE);
@@ -1177,6 +1492,9 @@ namespace server
     {
         if(!demoplayback) return;
         DELETEP(demoplayback);
+        DELETEP(demoplaybackfile);
+        demokeyframes.setsize(0);
+        demosnapshots.setsize(0);
 
         loopv(clients) sendf(clients[i]->clientnum, 1, "ri3", N_DEMOPLAYBACK, 0, clients[i]->clientnum);
 
@@ -1203,6 +1521,54 @@ namespace server
         return buf;
     }
 
+    stream *opendemo(const char *name)
+    {
+        stream *f = openfile(name, "rb");
+        if(!f) return NULL;
+        stream *gz = opengzfile(NULL, "rb", f);
+        if(!gz) { delete f; return NULL; }
+        demoplaybackfile = f;
+        return gz;
+    }
+
+    void loaddemoindex()
+    {
+        demokeyframes.setsize(0);
+        demosnapshots.setsize(0);
+        stream::offset pos = demoplaybackfile->tell();
+        demoindexfooter footer;
+        if(demoplaybackfile->seek(-stream::offset(sizeof(footer)), SEEK_END) &&
+           demoplaybackfile->read(&footer, sizeof(footer)) == sizeof(footer) &&
+           !memcmp(footer.magic, DEMO_INDEX_MAGIC, sizeof(footer.magic)))
+        {
+            lilswap(&footer.offset, 1);
+            stream *f = footer.offset > 0 && demoplaybackfile->seek(footer.offset, SEEK_SET) ? opengzfile(NULL, "rb", demoplaybackfile) : NULL;
+            if(f)
+            {
+                int numkeyframes = f->getlil<int>();
+                loopi(numkeyframes)
+                {
+                    demokeyframe k;
+                    k.millis = f->getlil<int>();
+                    k.rawpos = f->getlil<int>();
+                    k.pos = f->getlil<int>();
+                    k.len = f->getlil<int>();
+                    k.snapshot = demosnapshots.length();
+                    if(k.len <= 0 || k.len > (1<<20) || k.rawpos <= 0 || k.rawpos >= footer.offset || k.pos < 0 ||
+                       (demokeyframes.length() && k.millis < demokeyframes.last().millis) ||
+                       f->read(demosnapshots.pad(k.len), k.len) != size_t(k.len))
+                    {
+                        demosnapshots.setsize(k.snapshot);
+                        break;
+                    }
+                    demokeyframes.add(k);
+                }
+                delete f;
+            }
+        }
+        demoplaybackfile->seek(pos, SEEK_SET);
+    }
+
     void setupdemoplayback()
     {
         if(demoplayback) return;
@@ -1213,8 +1579,8 @@ namespace server
         copystring(file, smapname);
         int len = strlen(file);
         if(len < 4 || strcasecmp(&file[len-4], ".dmo")) concatstring(file, ".dmo");
-        if(const char *buf = getdemofile(file, false)) demoplayback = opengzfile(buf, "rb");
-        if(!demoplayback) demoplayback = opengzfile(file, "rb");
+        if(const char *buf = getdemofile(file, false)) demoplayback = opendemo(buf);
+        if(!demoplayback) demoplayback = opendemo(file);
         if(!demoplayback) formatstring(msg, "could not read demo \"%s\"", file);
         else if(demoplayback->read(&hdr, sizeof(demoheader))!=sizeof(demoheader) || memcmp(hdr.magic, DEMO_MAGIC, sizeof(hdr.magic)))
             formatstring(msg, "\"%s\" is not a demo file", file);
@@ -1227,10 +1593,13 @@ namespace server
         if(msg[0])
         {
             DELETEP(demoplayback);
+            DELETEP(demoplaybackfile);
             sendservmsg(msg);
             return;
         }
 
+        loaddemoindex();
+
         sendservmsgf("playing demo \"%s\"", file);
 
         sendf(-1, 1, "ri3", N_DEMOPLAYBACK, 1, -1);
@@ -1284,6 +1653,47 @@ namespace server
         else gamelimit = max(gamelimit, nextplayback + secs*1000);
     }
 
+    // jumps to the last keyframe at or before millis, or back to the start of the demo if there is none,
+    // unless just reading forward from the current position would get there as quickly
+    bool seekdemokeyframe(int millis)
+    {
+        int k = -1;
+        for(int lo = 0, hi = demokeyframes.length()-1; lo <= hi;)
+        {
+            int mid = (lo + hi)/2;
+            if(demokeyframes[mid].millis <= millis) { k = mid; lo = mid+1; }
+            else hi = mid-1;
+        }
+        if(millis >= gamemillis && (k < 0 || demokeyframes[k].millis <= gamemillis)) return false;
+        if(k >= 0 ? !demoplayback->seeksync(demokeyframes[k].rawpos, demokeyframes[k].pos) : !demoplayback->seek(sizeof(demoheader), SEEK_SET))
+        {
+            enddemoplayback();
+            return false;
+        }
+
+        // clients drop everyone they know of without leaving playback, so the snapshot starts from a clean slate
+        sendf(-1, 1, "ri", N_DEMOSEEK);
+        if(k >= 0)
+        {
+            demokeyframe &kf = demokeyframes[k];
+            ENetPacket *packet = enet_packet_create(NULL, kf.len+1, ENET_PACKET_FLAG_RELIABLE);
+            packet->data[0] = N_DEMOPACKET;
+            memcpy(packet->data+1, &demosnapshots[kf.snapshot], kf.len);
+            sendpacket(-1, 1, packet);
+            if(!packet->referenceCount) enet_packet_destroy(packet);
+        }
+
+        if(demoplayback->read(&nextplayback, sizeof(nextplayback))!=sizeof(nextplayback))
+        {
+            enddemoplayback();
+            return false;
+        }
+        lilswap(&nextplayback, 1);
+        gamemillis = k >= 0 ? demokeyframes[k].millis : 0;
+        if(interm && millis < gamelimit) interm = 0;
+        return true;
+    }
+
     void seekdemo(char *t)
     {
         if(!demoplayback) return;
@@ -1294,6 +1704,8 @@ namespace server
         else { secs = mins; mins = 0; }
         if(*t == '.') millis = strtoul(t+1, &t, 10);
         int offset = max(millis + (mins*60 + secs)*1000, 0), prevmillis = gamemillis;
+        bool jumped = seekdemokeyframe(max(rev ? gamelimit - offset : offset, 0));
+        if(!demoplayback) return;
         if(rev) while(gamelimit - offset > gamemillis)
         {
             gamemillis = gamelimit - offset;
@@ -1304,7 +1716,7 @@ namespace server
             gamemillis = offset;
             readdemo();
         }
-        if(gamemillis > prevmillis)
+        if(gamemillis > prevmillis || jumped)
         {
             if(!interm) sendf(-1, 1, "ri2", N_TIMEUP, max((gamelimit - gamemillis)/1000, 1));
 #ifndef STANDALONE
@@ -1592,7 +2004,7 @@ namespace server
         }
 
         uchar operator[](int msg) const { return msg >= 0 && msg < NUMMSG ? msgmask[msg] : 0; }
-    } msgfilter(-1, N_CONNECT, N_SERVINFO, N_INITCLIENT, N_WELCOME, N_MAPCHANGE, N_SERVMSG, N_DAMAGE, N_HITPUSH, N_SHOTFX, N_EXPLODEFX, N_DIED, N_SPAWNSTATE, N_FORCEDEATH, N_TEAMINFO, N_ITEMACC, N_ITEMSPAWN, N_TIMEUP, N_CDIS, N_CURRENTMASTER, N_PONG, N_RESUME, N_BASESCORE, N_BASEINFO, N_BASEREGEN, N_ANNOUNCE, N_SENDDEMOLIST, N_SENDDEMO, N_DEMOPLAYBACK, N_SENDMAP, N_DROPFLAG, N_SCOREFLAG, N_RETURNFLAG, N_RESETFLAG, N_INVISFLAG, N_CLIENT, N_AUTHCHAL, N_INITAI, N_EXPIRETOKENS, N_DROPTOKENS, N_STEALTOKENS, N_DEMOPACKET, -2, N_REMIP, N_NEWMAP, N_GETMAP, N_SENDMAP, N_CLIPBOARD, -3, N_EDITENT, N_EDITF, N_EDITT, N_EDITM, N_FLIP, N_COPY, N_PASTE, N_ROTATE, N_REPLACE, N_DELCUBE, N_EDITVAR, N_EDITVSLOT, N_UNDO, N_REDO, -4, N_POS, NUMMSG),
+    } msgfilter(-1, N_CONNECT, N_SERVINFO, N_INITCLIENT, N_WELCOME, N_MAPCHANGE, N_SERVMSG, N_DAMAGE, N_HITPUSH, N_SHOTFX, N_EXPLODEFX, N_DIED, N_SPAWNSTATE, N_FORCEDEATH, N_TEAMINFO, N_ITEMACC, N_ITEMSPAWN, N_TIMEUP, N_CDIS, N_CURRENTMASTER, N_PONG, N_RESUME, N_BASESCORE, N_BASEINFO, N_BASEREGEN, N_ANNOUNCE, N_SENDDEMOLIST, N_SENDDEMO, N_DEMOPLAYBACK, N_SENDMAP, N_DROPFLAG, N_SCOREFLAG, N_RETURNFLAG, N_RESETFLAG, N_INVISFLAG, N_CLIENT, N_AUTHCHAL, N_INITAI, N_EXPIRETOKENS, N_DROPTOKENS, N_STEALTOKENS, N_DEMOPACKET, N_DEMOSEEK, -2, N_REMIP, N_NEWMAP, N_GETMAP, N_SENDMAP, N_CLIPBOARD, -3, N_EDITENT, N_EDITF, N_EDITT, N_EDITM, N_FLIP, N_COPY, N_PASTE, N_ROTATE, N_REPLACE, N_DELCUBE, N_EDITVAR, N_EDITVSLOT, N_UNDO, N_REDO, -4, N_POS, NUMMSG),
       connectfilter(-1, N_CONNECT, -2, N_AUTHANS, -3, N_PING, NUMMSG);
 
     int checktype(int type, clientinfo *ci)
@@ -1633,28 +2045,34 @@ namespace server
         uchar *data;
 
         worldstate() : uses(0), len(0), data(NULL) {}
+        ~worldstate() { DELETEA(data); }
 
-        void setup(int n) { len = n; data = new uchar[n]; }
-        void cleanup() { DELETEA(data); len = 0; }
-        bool contains(const uchar *p) const { return p >= data && p < &data[len]; }
+        void setup(int n)
+        {
+            if(n > len) { DELETEA(data); len = n; data = new uchar[n]; }
+        }
     };
-    vector<worldstate> worldstates;
+    vector<worldstate *> worldstates;
     bool reliablemessages = false;
 
+    worldstate *newworldstate(int len)
+    {
+        worldstate *ws = worldstates.length() ? worldstates.pop() : new worldstate;
+        ws->uses = 0;
+        ws->setup(len);
+        return ws;
+    }
+
+    void freeworldstate(worldstate *ws)
+    {
+        if(worldstates.length() >= 4) delete ws;
+        else worldstates.add(ws);
+    }
+
     void cleanworldstate(ENetPacket *packet)
     {
-        loopv(worldstates)
-        {
-            worldstate &ws = worldstates[i];
-            if(!ws.contains(packet->data)) continue;
-            ws.uses--;
-            if(ws.uses <= 0)
-            {
-                ws.cleanup();
-                worldstates.removeunordered(i);
-            }
-            break;
-        }
+        worldstate *ws = (worldstate *)packet->userData;
+        if(ws && --ws->uses <= 0) freeworldstate(ws);
     }
 
     void flushclientposition(clientinfo &ci)
@@ -1666,28 +2084,51 @@ namespace server
         sendpacket(-1, 0, p.finalize(), ci.ownernum);
     }
 
-    static void sendpositions(worldstate &ws, ucharbuf &wsbuf)
+    static ENetPacket *worldstatepacket(clientinfo &ci, const ucharbuf &wsbuf, int flags)
     {
-        if(wsbuf.empty()) return;
         int wslen = wsbuf.length();
-        recordpacket(0, wsbuf.buf, wslen);
-        wsbuf.put(wsbuf.buf, wslen);
+        if(ci.wsdata < wsbuf.buf) return enet_packet_create(wsbuf.buf, wslen, flags | ENET_PACKET_FLAG_NO_ALLOCATE);
+        // everything after the client's own slice followed by everything before it
+        const uchar *head = ci.wsdata + ci.wslen, *tail = wsbuf.buf;
+        int headlen = wsbuf.buf + wslen - head, taillen = ci.wsdata - wsbuf.buf;
+        if(headlen + taillen <= 0) return NULL;
+        if(ci.local)
+        {
+            ENetPacket *packet = enet_packet_create(NULL, headlen + taillen, flags);
+            memcpy(packet->data, head, headlen);
+            memcpy(&packet->data[headlen], tail, taillen);
+            return packet;
+        }
+        return enet_packet_create_split(head, headlen, tail, taillen, flags);
+    }
+
+    static void sendworldstate(worldstate &ws, ucharbuf &wsbuf, int chan, int flags)
+    {
+        if(wsbuf.empty()) return;
+        recordpacket(chan, wsbuf.buf, wsbuf.length());
         loopv(clients)
         {
             clientinfo &ci = *clients[i];
             if(ci.state.aitype != AI_NONE) continue;
-            uchar *data = wsbuf.buf;
-            int size = wslen;
-            if(ci.wsdata >= wsbuf.buf) { data = ci.wsdata + ci.wslen; size -= ci.wslen; }
-            if(size <= 0) continue;
-            ENetPacket *packet = enet_packet_create(data, size, ENET_PACKET_FLAG_NO_ALLOCATE);
-            sendpacket(ci.clientnum, 0, packet);
-            if(packet->referenceCount) { ws.uses++; packet->freeCallback = cleanworldstate; }
-            else enet_packet_destroy(packet);
+            ENetPacket *packet = worldstatepacket(ci, wsbuf, flags);
+            if(!packet) continue;
+            sendpacket(ci.clientnum, chan, packet);
+            if(packet->referenceCount && packet->flags&ENET_PACKET_FLAG_NO_ALLOCATE)
+            {
+                ws.uses++;
+                packet->userData = &ws;
+                packet->freeCallback = cleanworldstate;
+            }
+            else if(!packet->referenceCount) enet_packet_destroy(packet);
         }
         wsbuf.offset(wsbuf.length());
     }
 
+    static inline void sendpositions(worldstate &ws, ucharbuf &wsbuf)
+    {
+        sendworldstate(ws, wsbuf, 0, 0);
+    }
+
     static inline void addposition(worldstate &ws, ucharbuf &wsbuf, int mtu, clientinfo &bi, clientinfo &ci)
     {
         if(bi.position.empty()) return;
@@ -1700,26 +2141,9 @@ namespace server
         else ci.wslen += len;
     }
 
-    static void sendmessages(worldstate &ws, ucharbuf &wsbuf)
+    static inline void sendmessages(worldstate &ws, ucharbuf &wsbuf)
     {
-        if(wsbuf.empty()) return;
-        int wslen = wsbuf.length();
-        recordpacket(1, wsbuf.buf, wslen);
-        wsbuf.put(wsbuf.buf, wslen);
-        loopv(clients)
-        {
-            clientinfo &ci = *clients[i];
-            if(ci.state.aitype != AI_NONE) continue;
-            uchar *data = wsbuf.buf;
-            int size = wslen;
-            if(ci.wsdata >= wsbuf.buf) { data = ci.wsdata + ci.wslen; size -= ci.wslen; }
-            if(size <= 0) continue;
-            ENetPacket *packet = enet_packet_create(data, size, (reliablemessages ? ENET_PACKET_FLAG_RELIABLE : 0) | ENET_PACKET_FLAG_NO_ALLOCATE);
-            sendpacket(ci.clientnum, 1, packet);
-            if(packet->referenceCount) { ws.uses++; packet->freeCallback = cleanworldstate; }
-            else enet_packet_destroy(packet);
-        }
-        wsbuf.offset(wsbuf.length());
+        sendworldstate(ws, wsbuf, 1, reliablemessages ? ENET_PACKET_FLAG_RELIABLE : 0);
     }
 
     static inline void addmessages(worldstate &ws, ucharbuf &wsbuf, int mtu, clientinfo &bi, clientinfo &ci)
@@ -1753,11 +2177,10 @@ namespace server
             reliablemessages = false;
             return false;
         }
-        worldstate &ws = worldstates.add();
-        ws.setup(2*wsmax);
+        worldstate &ws = *newworldstate(wsmax);
         int mtu = getservermtu() - 100;
-        if(mtu <= 0) mtu = ws.len;
-        ucharbuf wsbuf(ws.data, ws.len);
+        if(mtu <= 0) mtu = wsmax;
+        ucharbuf wsbuf(ws.data, wsmax);
         loopv(clients)
         {
             clientinfo &ci = *clients[i];
@@ -1776,8 +2199,7 @@ namespace server
         sendmessages(ws, wsbuf);
         reliablemessages = false;
         if(ws.uses) return true;
-        ws.cleanup();
-        worldstates.drop();
+        freeworldstate(&ws);
         return false;
     }
 
@@ -1786,7 +2208,12 @@ namespace server
         if(clients.empty() || (!hasnonlocalclients() && !demorecord)) return false;
         enet_uint32 curtime = enet_time_get()-lastsend;
         if(curtime<33 && !force) return false;
-        bool flush = buildworldstate();
+        bool flush;
+        {
+            profilescope prof(SPROF_WORLDSTATE);
+            flush = buildworldstate();
+        }
+        checkdemokeyframe();
         lastsend += curtime - (curtime%33);
         return flush;
     }
@@ -2424,7 +2851,7 @@ namespace server
 
     void clearevent(clientinfo *ci)
     {
-        delete ci->events.remove(0);
+        delete ci->events.remove();
     }
 
     void flushevents(clientinfo *ci, int millis)
@@ -2439,6 +2866,7 @@ namespace server
 
     void processevents()
     {
+        profilescope prof(SPROF_EVENTS);
         loopv(clients)
         {
             clientinfo *ci = clients[i];
@@ -2449,22 +2877,12 @@ namespace server
 
     void cleartimedevents(clientinfo *ci)
     {
-        int keep = 0;
-        loopv(ci->events)
+        for(int n = ci->events.length(); n > 0; n--)
         {
-            if(ci->events[i]->keepable())
-            {
-                if(keep < i)
-                {
-                    for(int j = keep; j < i; j++) delete ci->events[j];
-                    ci->events.remove(keep, i - keep);
-                    i = keep;
-                }
-                keep = i+1;
-                continue;
-            }
+            gameevent *ev = ci->events.remove();
+            if(ev->keepable()) ci->events.add(ev);
+            else delete ev;
         }
-        while(ci->events.length() > keep) delete ci->events.pop();
         ci->timesync = false;
     }
 
@@ -2501,7 +2919,7 @@ namespace server
             }
         }
 
-        while(bannedips.length() && bannedips[0].expire-totalmillis <= 0) bannedips.remove(0);
+        expirebans();
         loopv(connects) if(totalmillis-connects[i]->connectmillis>15000) disconnect_client(connects[i]->clientnum, DISC_TIMEOUT);
 
         if(nextexceeded && gamemillis > nextexceeded && (!m_timed || gamemillis < gamelimit))
@@ -2632,7 +3050,7 @@ namespace server
 
     void noclients()
     {
-        bannedips.shrink(0);
+        clearbans();
         aiman::clearai();
     }
 
@@ -2678,7 +3096,7 @@ namespace server
             ci->state.timeplayed += lastmillis - ci->state.lasttimeplayed;
             savescore(ci);
             sendf(-1, 1, "ri2", N_CDIS, n);
-            clients.removeobj(ci);
+            removefromclients(ci);
             aiman::removeai(ci);
             if(!numclients(-1, false, true)) noclients(); // bans clear when server empties
             if(ci->local) checkpausegame();
@@ -2692,21 +3110,15 @@ namespace server
 
     struct banlist
     {
-        vector<ipmask> bans;
+        ipmaskset bans;
 
-        void clear() { bans.shrink(0); }
+        void clear() { bans.clear(); }
 
-        bool check(uint ip)
-        {
-            loopv(bans) if(bans[i].check(ip)) return true;
-            return false;
-        }
+        bool check(uint ip) { return bans.check(ip); }
 
         void add(const char *ipname)
         {
-            ipmask ban;
-            ban.parse(ipname);
-            bans.add(ban);
+            bans.add(ipname);
 
             verifybans();
         }
@@ -2714,7 +3126,7 @@ namespace server
 
     bool checkbans(uint ip)
     {
-        loopv(bannedips) if(bannedips[i].ip==ip) return true;
+        if(bannedipcounts.access(int(ip))) return true;
         return ipbans.check(ip) || gbans.check(ip);
     }
 
@@ -2928,7 +3340,7 @@ namespace server
         shouldstep = true;
 
         connects.removeobj(ci);
-        clients.add(ci);
+        addtoclients(ci);
 
         ci->connectauth = 0;
         ci->connected = true;
@@ -2937,7 +3349,7 @@ namespace server
         ci->state.lasttimeplayed = lastmillis;
 
         const char *worst = m_teammode ? chooseworstteam(NULL, ci) : NULL;
-        copystring(ci->team, worst ? worst : "good", MAXTEAMLEN+1);
+        setclientteam(ci, worst ? worst : "good");
 
         sendwelcome(ci);
         if(restorescore(ci)) sendresume(ci);
@@ -2950,17 +3362,58 @@ namespace server
         if(servermotd[0]) sendf(ci->clientnum, 1, "ris", N_SERVMSG, servermotd);
     }
 
+    static const char * const profilenames[SPROF_MESSAGE] = { "slice", "update", "events", "worldstate", "sockets", "master" };
+
+    void printserverprofile(int cn)
+    {
+        string line;
+        formatstring(line, "server profile for the last %d seconds (count: p50/p99/max us)", serverprofilewindow());
+        if(cn >= 0) sendf(cn, 1, "ris", N_SERVMSG, line); else conoutf("%s", line);
+        loopi(SPROF_MAX)
+        {
+            profilestats s;
+            if(!getserverprofile(i, s)) continue;
+            if(i < SPROF_MESSAGE) formatstring(line, "%s", profilenames[i]);
+            else formatstring(line, "message %d", i - SPROF_MESSAGE);
+            concformatstring(line, " %d: %u/%u/%u", s.count, s.p50, s.p99, s.max);
+            if(cn >= 0) sendf(cn, 1, "ris", N_SERVMSG, line); else conoutf("%s", line);
+        }
+    }
+    ICOMMAND(serverprofilestats, "", (), printserverprofile(-1));
+
+    // charges the time spent parsing each message of a packet to that message type
+    struct messageprofile
+    {
+        int counter;
+        uint start;
+
+        messageprofile() : counter(-1), start(0) {}
+        ~messageprofile() { begin(-1); }
+
+        int begin(int type)
+        {
+            bool profile = serverprofile && type >= 0 && type < SPROF_MAX - SPROF_MESSAGE;
+            if(counter < 0 && !profile) return type;
+            uint now = getmicros();
+            if(counter >= 0) profileserver(counter, now - start);
+            counter = profile ? SPROF_MESSAGE + type : -1;
+            start = now;
+            return type;
+        }
+    };
+
     void parsepacket(int sender, int chan, packetbuf &p)     // has to parse exactly each byte of the packet
     {
         if(sender<0 || p.packet->flags&ENET_PACKET_FLAG_UNSEQUENCED || chan > 2) return;
         char text[MAXTRANS];
         int type;
+        messageprofile msgprof;
         clientinfo *ci = sender>=0 ? getinfo(sender) : NULL, *cq = ci, *cm = ci;
         if(ci && !ci->connected)
         {
             if(chan==0) return;
             else if(chan!=1) { disconnect_client(sender, DISC_MSGERR); return; }
-            else while(p.length() < p.maxlen) switch(checktype(getint(p), ci))
+            else while(p.length() < p.maxlen) switch(msgprof.begin(checktype(getint(p), ci)))
             {
                 case N_CONNECT:
                 {
@@ -3032,7 +3485,7 @@ namespace server
         #define QUEUE_UINT(n) QUEUE_BUF(putuint(cm->messages, n))
         #define QUEUE_STR(text) QUEUE_BUF(sendstring(text, cm->messages))
         int curmsg;
-        while((curmsg = p.length()) < p.maxlen) switch(type = checktype(getint(p), ci))
+        while((curmsg = p.length()) < p.maxlen) switch(type = msgprof.begin(checktype(getint(p), ci)))
         {
             case N_POS:
             {
@@ -3125,7 +3578,7 @@ namespace server
                 {
                     ci->state.editstate = ci->state.state;
                     ci->state.state = CS_EDITING;
-                    ci->events.setsize(0);
+                    ci->events.deletecontents();
                     ci->state.rockets.reset();
                     ci->state.grenades.reset();
                 }
@@ -3302,8 +3755,8 @@ namespace server
             {
                 QUEUE_MSG;
                 getstring(text, p);
-                filtertext(ci->name, text, false, false, MAXNAMELEN);
-                if(!ci->name[0]) copystring(ci->name, "unnamed");
+                filtertext(text, text, false, false, MAXNAMELEN);
+                setclientname(ci, text[0] ? text : "unnamed");
                 QUEUE_STR(ci->name);
                 break;
             }
@@ -3322,7 +3775,7 @@ namespace server
                 if(m_teammode && text[0] && strcmp(ci->team, text) && (!smode || smode->canchangeteam(ci, ci->team, text)) && addteaminfo(text))
                 {
                     if(ci->state.state==CS_ALIVE) suicide(ci);
-                    copystring(ci->team, text);
+                    setclientteam(ci, text);
                     aiman::changeteam(ci);
                     sendf(-1, 1, "riisi", N_SETTEAM, sender, ci->team, ci->state.state==CS_SPECTATOR ? -1 : 0);
                 }
@@ -3440,7 +3893,7 @@ namespace server
             {
                 if(ci->privilege || ci->local)
                 {
-                    bannedips.shrink(0);
+                    clearbans();
                     sendservmsg("cleared all bans");
                 }
                 break;
@@ -3480,7 +3933,7 @@ namespace server
                 if((!smode || smode->canchangeteam(wi, wi->team, text)) && addteaminfo(text))
                 {
                     if(wi->state.state==CS_ALIVE) suicide(wi);
-                    copystring(wi->team, text, MAXTEAMLEN+1);
+                    setclientteam(wi, text);
                 }
                 aiman::changeteam(wi);
                 sendf(-1, 1, "riisi", N_SETTEAM, who, wi->team, 1);
@@ -3731,6 +4184,7 @@ namespace server
 
             case N_SERVCMD:
                 getstring(text, p);
+                if((ci->privilege >= PRIV_ADMIN || ci->local) && !strcmp(text, "profile")) printserverprofile(ci->clientnum);
                 break;
                      
             #define PARSEMESSAGES 1
@@ -18,7 +18,7 @@ enum
     CODE_FORCE,
     CODE_RESULT,
     CODE_IDENT, CODE_IDENTU, CODE_IDENTARG,
-    CODE_COM, CODE_COMD, CODE_COMC, CODE_COMV,
+    CODE_COM, CODE_COMD, CODE_COMC, CODE_COMV, CODE_COMI,
     CODE_CONC, CODE_CONCW, CODE_CONCM, CODE_DOWN,
     CODE_SVAR, CODE_SVAR1,
     CODE_IVAR, CODE_IVAR1, CODE_IVAR2, CODE_IVAR3,
@@ -44,6 +44,28 @@ enum { IDF_PERSIST = 1<<0, IDF_OVERRIDE = 1<<1, IDF_HEX = 1<<2, IDF_READONLY = 1
 
 struct ident;
 
+// strings held by script values are immutable and refcounted, the header sits just in front of the characters
+// allocate them with newscriptstr, share them with refscriptstr and release them with freescriptstr, never delete[]
+struct parsedlist;
+
+struct scriptstring
+{
+    int refs;
+    int size; // bytes allocated for it, including this header
+    parsedlist *list; // its elements when parsed as a list, kept until the string is freed
+
+    char *str() { return (char *)(this+1); }
+    static scriptstring *get(const char *s) { return (scriptstring *)s - 1; }
+};
+
+extern char *newscriptstr(size_t len);
+extern char *newscriptstr(const char *s, size_t len);
+static inline char *newscriptstr(const char *s) { return newscriptstr(s, strlen(s)); }
+static inline char *refscriptstr(char *s) { scriptstring::get(s)->refs++; return s; }
+static inline bool sharedscriptstr(const char *s) { return scriptstring::get(s)->refs > 1; }
+extern void deletescriptstr(scriptstring *h);
+static inline void freescriptstr(char *s) { scriptstring *h = scriptstring::get(s); if(--h->refs <= 0) deletescriptstr(h); }
+
 struct identval
 {
     union
@@ -179,7 +201,7 @@ struct ident
  
     void forcenull()
     {
-        if(valtype==VAL_STR) delete[] val.s;
+        if(valtype==VAL_STR) freescriptstr(val.s);
         valtype = VAL_NULL;
     }
 
@@ -259,7 +281,8 @@ inline void ident::getval(tagval &v) const
 {
     switch(valtype)
     {
-        case VAL_STR: case VAL_MACRO: v.setstr(newstring(val.s)); break;
+        case VAL_STR: v.setstr(refscriptstr(val.s)); break;
+        case VAL_MACRO: v.setstr(newscriptstr(val.s)); break;
         case VAL_INT: v.setint(val.i); break;
         case VAL_FLOAT: v.setfloat(val.f); break;
         default: v.setnull(); break;
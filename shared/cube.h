@@ -52,6 +52,7 @@
 #include <zlib.h>
 
 #include "tools.h"
+#include "thread.h"
 #include "geom.h"
 #include "ents.h"
 #include "command.h"
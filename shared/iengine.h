@@ -146,6 +146,7 @@ extern void freecode(uint *p);
 extern void executeret(const uint *code, tagval &result = *commandret);
 extern void executeret(const char *p, tagval &result = *commandret);
 extern void executeret(ident *id, tagval *args, int numargs, bool lookup = false, tagval &result = *commandret);
+// the string results are script strings, release them with freescriptstr
 extern char *executestr(const uint *code);
 extern char *executestr(const char *p);
 extern char *executestr(ident *id, tagval *args, int numargs, bool lookup = false);
@@ -181,7 +182,7 @@ extern void loopend(ident *id, identstack &stack);
 #define loopstart(id, stack) if((id)->type != ID_ALIAS) return; identstack stack;
 static inline void loopiter(ident *id, identstack &stack, int i) { tagval v; v.setint(i); loopiter(id, stack, v); }
 static inline void loopiter(ident *id, identstack &stack, float f) { tagval v; v.setfloat(f); loopiter(id, stack, v); }
-static inline void loopiter(ident *id, identstack &stack, const char *s) { tagval v; v.setstr(newstring(s)); loopiter(id, stack, v); }
+static inline void loopiter(ident *id, identstack &stack, const char *s) { tagval v; v.setstr(newscriptstr(s)); loopiter(id, stack, v); }
 
 // console
 
@@ -459,6 +460,7 @@ enum { DISC_NONE = 0, DISC_EOP, DISC_LOCAL, DISC_KICK, DISC_MSGERR, DISC_IPBAN,
 
 extern void *getclientinfo(int i);
 extern ENetPeer *getclientpeer(int i);
+extern int getclientrtt(int n);
 extern ENetPacket *sendf(int cn, int chan, const char *format, ...);
 extern ENetPacket *sendfile(int cn, int chan, stream *file, const char *format = "", ...);
 extern void sendpacket(int cn, int chan, ENetPacket *packet, int exclude = -1);
@@ -480,6 +482,29 @@ extern int numservers();
 extern char *gethostname(int n);
 extern int getport(int n);
 
+// server tick profiler: rolling histograms of time spent in each part of a server slice, and per message type
+enum { SPROF_SLICE = 0, SPROF_UPDATE, SPROF_EVENTS, SPROF_WORLDSTATE, SPROF_SOCKETS, SPROF_MASTER, SPROF_MESSAGE, SPROF_MAX = SPROF_MESSAGE + 256 };
+
+struct profilestats
+{
+    int count;
+    uint p50, p99, max;
+};
+
+extern int serverprofile;
+extern void profileserver(int counter, uint micros);
+extern bool getserverprofile(int counter, profilestats &s);
+extern int serverprofilewindow();
+
+struct profilescope
+{
+    int counter;
+    uint start;
+
+    profilescope(int counter) : counter(serverprofile ? counter : -1), start(serverprofile ? getmicros() : 0) {}
+    ~profilescope() { if(counter >= 0) profileserver(counter, getmicros() - start); }
+};
+
 // client
 extern void sendclientpacket(ENetPacket *packet, int chan);
 extern void flushclient();
@@ -1,5 +1,12 @@
 #include "cube.h"
 
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 ///////////////////////////// console ////////////////////////
 
 void conoutf(const char *fmt, ...)
@@ -751,11 +758,11 @@ struct gzstream : stream
     stream *file;
     z_stream zfile;
     uchar *buf;
-    bool reading, writing, autoclose;
+    bool reading, writing, autoclose, synced;
     uint crc;
     size_t headersize;
 
-    gzstream() : file(NULL), buf(NULL), reading(false), writing(false), autoclose(false), crc(0), headersize(0)
+    gzstream() : file(NULL), buf(NULL), reading(false), writing(false), autoclose(false), synced(false), crc(0), headersize(0)
     {
         zfile.zalloc = NULL;
         zfile.zfree = NULL;
@@ -841,6 +848,7 @@ struct gzstream : stream
 
         file = f;
         crc = crc32(0, NULL, 0);
+        synced = false;
         buf = new uchar[BUFSIZE];
 
         if(reading)
@@ -855,11 +863,21 @@ struct gzstream : stream
 
     uint getcrc() { return crc; }
 
+    // the crc of the whole contents from the trailer, without inflating them
+    bool storedcrc(uint &storedcrc)
+    {
+        if(!reading || !file) return false;
+        offset pos = file->tell();
+        if(!file->seek(-8, SEEK_END)) return false;
+        storedcrc = file->getlil<uint>();
+        return file->seek(pos, SEEK_SET);
+    }
+
     void finishreading()
     {
         if(!reading) return;
 #ifndef STANDALONE
-        if(dbggz)
+        if(dbggz && !synced)
         {
             uint checkcrc = 0, checksize = 0;
             loopi(4) checkcrc |= uint(readbyte()) << (i*8);
@@ -945,7 +963,7 @@ struct gzstream : stream
         else if(pos < 0 || !file->seek(headersize, SEEK_SET)) return false;
         else
         {
-            if(zfile.next_in && zfile.total_in <= uint(zfile.next_in - buf))
+            if(!synced && zfile.next_in && zfile.total_in <= uint(zfile.next_in - buf))
             {
                 zfile.avail_in += zfile.total_in;
                 zfile.next_in -= zfile.total_in;
@@ -957,6 +975,7 @@ struct gzstream : stream
             }
             inflateReset(&zfile);
             crc = crc32(0, NULL, 0);
+            synced = false;
         }
 
         uchar skip[512];
@@ -1005,6 +1024,33 @@ struct gzstream : stream
 
     bool flush() { return flushbuf(true); }
 
+    // resets the compressor so that a reader can later start inflating at the returned raw offset with seeksync()
+    offset syncpoint()
+    {
+        if(!writing) return -1;
+        zfile.avail_in = 0;
+        for(;;)
+        {
+            if(!zfile.avail_out && !flushbuf()) { stopwriting(); return -1; }
+            int err = deflate(&zfile, Z_FULL_FLUSH);
+            if(err != Z_OK && err != Z_BUF_ERROR) { stopwriting(); return -1; }
+            if(zfile.avail_out > 0) break;
+        }
+        if(!flushbuf()) { stopwriting(); return -1; }
+        return file->tell();
+    }
+
+    bool seeksync(offset rawpos, offset pos)
+    {
+        if(!reading || !file->seek(rawpos, SEEK_SET)) return false;
+        zfile.avail_in = 0;
+        zfile.next_in = NULL;
+        inflateReset(&zfile);
+        zfile.total_out = uLong(pos);
+        synced = true;
+        return true;
+    }
+
     size_t write(const void *buf, size_t len)
     {
         if(!writing || !buf || !len) return 0;
@@ -1237,6 +1283,79 @@ stream *openutf8file(const char *filename, const char *mode, stream *file)
     return utf8;
 }
 
+bool mappedfile::open(const char *filename)
+{
+    close();
+    const char *found = findfile(filename, "rb");
+    if(found)
+    {
+#ifdef WIN32
+        HANDLE file = CreateFile(found, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(file != INVALID_HANDLE_VALUE)
+        {
+            LARGE_INTEGER len;
+            if(GetFileSizeEx(file, &len) && len.QuadPart > 0 && LONGLONG(size_t(len.QuadPart)) == len.QuadPart)
+            {
+                HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+                if(mapping)
+                {
+                    data = (uchar *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    CloseHandle(mapping);
+                    if(data) size = size_t(len.QuadPart);
+                }
+            }
+            CloseHandle(file);
+        }
+#else
+        int fd = ::open(found, O_RDONLY);
+        if(fd >= 0)
+        {
+            struct stat st;
+            if(!fstat(fd, &st) && st.st_size > 0 && off_t(size_t(st.st_size)) == st.st_size)
+            {
+                void *view = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(view != MAP_FAILED)
+                {
+                    data = (uchar *)view;
+                    size = st.st_size;
+                }
+            }
+            ::close(fd);
+        }
+#endif
+        if(data) { mapped = true; return true; }
+    }
+
+    stream *f = openfile(filename, "rb");
+    if(!f) return false;
+    stream::offset len = f->size();
+    if(len > 0 && stream::offset(size_t(len)) == len)
+    {
+        data = new (false) uchar[len];
+        if(data)
+        {
+            size = len;
+            if(f->read(data, size) != size) close();
+        }
+    }
+    delete f;
+    return data != NULL;
+}
+
+void mappedfile::close()
+{
+    if(!data) return;
+    if(!mapped) delete[] data;
+#ifdef WIN32
+    else UnmapViewOfFile(data);
+#else
+    else munmap(data, size);
+#endif
+    data = NULL;
+    size = 0;
+    mapped = false;
+}
+
 char *loadfile(const char *fn, size_t *size, bool utf8)
 {
     stream *f = openfile(fn, "rb");
@@ -0,0 +1,420 @@
+// portable threads, locks and lock-free queues for both the client and the standalone server
+
+#ifndef __THREAD_H__
+#define __THREAD_H__
+
+#if defined(STANDALONE) && !defined(WIN32)
+#include <pthread.h>
+#include <errno.h>
+#include <sys/time.h>
+#endif
+
+#if defined(__GNUC__)
+static inline int atomicload(const volatile int &v) { return __atomic_load_n(&v, __ATOMIC_ACQUIRE); }
+static inline void atomicstore(volatile int &v, int n) { __atomic_store_n(&v, n, __ATOMIC_RELEASE); }
+static inline int atomicadd(volatile int &v, int n) { return __atomic_add_fetch(&v, n, __ATOMIC_ACQ_REL); }
+static inline int atomicexchange(volatile int &v, int n) { return __atomic_exchange_n(&v, n, __ATOMIC_ACQ_REL); }
+static inline bool atomiccas(volatile int &v, int oldval, int newval) { return __atomic_compare_exchange_n(&v, &oldval, newval, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); }
+#elif defined(_MSC_VER)
+static inline int atomicload(const volatile int &v) { int n = v; _ReadWriteBarrier(); return n; }
+static inline void atomicstore(volatile int &v, int n) { _ReadWriteBarrier(); v = n; }
+static inline int atomicadd(volatile int &v, int n) { return _InterlockedExchangeAdd((volatile long *)&v, n) + n; }
+static inline int atomicexchange(volatile int &v, int n) { return _InterlockedExchange((volatile long *)&v, n); }
+static inline bool atomiccas(volatile int &v, int oldval, int newval) { return _InterlockedCompareExchange((volatile long *)&v, newval, oldval) == oldval; }
+#endif
+
+typedef int (*threadfunc)(void *);
+
+struct thread
+{
+    threadfunc func;
+    void *data;
+    int result;
+#ifndef STANDALONE
+    SDL_Thread *handle;
+#elif defined(WIN32)
+    HANDLE handle;
+
+    static DWORD WINAPI run(LPVOID t) { thread &th = *(thread *)t; th.result = th.func(th.data); return 0; }
+#else
+    pthread_t handle;
+    bool started;
+
+    static void *run(void *t) { thread &th = *(thread *)t; th.result = th.func(th.data); return NULL; }
+#endif
+
+    thread() : func(NULL), data(NULL), result(0)
+#if !defined(STANDALONE) || defined(WIN32)
+        , handle(NULL)
+#else
+        , started(false)
+#endif
+    {}
+    ~thread() { join(); }
+
+    bool start(threadfunc f, void *d, const char *name = "")
+    {
+        if(running()) return false;
+        func = f;
+        data = d;
+        result = 0;
+#ifndef STANDALONE
+        handle = SDL_CreateThread(f, name, d);
+#elif defined(WIN32)
+        handle = CreateThread(NULL, 0, run, this, 0, NULL);
+#else
+        started = !pthread_create(&handle, NULL, run, this);
+#endif
+        return running();
+    }
+
+    bool running() const
+    {
+#if !defined(STANDALONE) || defined(WIN32)
+        return handle != NULL;
+#else
+        return started;
+#endif
+    }
+
+    int join()
+    {
+        if(!running()) return result;
+#ifndef STANDALONE
+        SDL_WaitThread(handle, &result);
+        handle = NULL;
+#elif defined(WIN32)
+        WaitForSingleObject(handle, INFINITE);
+        CloseHandle(handle);
+        handle = NULL;
+#else
+        pthread_join(handle, NULL);
+        started = false;
+#endif
+        return result;
+    }
+};
+
+struct mutex
+{
+#ifndef STANDALONE
+    SDL_mutex *m;
+
+    mutex() : m(SDL_CreateMutex()) {}
+    ~mutex() { SDL_DestroyMutex(m); }
+
+    void lock() { SDL_LockMutex(m); }
+    void unlock() { SDL_UnlockMutex(m); }
+#elif defined(WIN32)
+    CRITICAL_SECTION m;
+
+    mutex() { InitializeCriticalSection(&m); }
+    ~mutex() { DeleteCriticalSection(&m); }
+
+    void lock() { EnterCriticalSection(&m); }
+    void unlock() { LeaveCriticalSection(&m); }
+#else
+    pthread_mutex_t m;
+
+    mutex() { pthread_mutex_init(&m, NULL); }
+    ~mutex() { pthread_mutex_destroy(&m); }
+
+    void lock() { pthread_mutex_lock(&m); }
+    void unlock() { pthread_mutex_unlock(&m); }
+#endif
+};
+
+struct condition
+{
+#ifndef STANDALONE
+    SDL_cond *c;
+
+    condition() : c(SDL_CreateCond()) {}
+    ~condition() { SDL_DestroyCond(c); }
+
+    void wait(mutex &m) { SDL_CondWait(c, m.m); }
+    bool wait(mutex &m, uint millis) { return SDL_CondWaitTimeout(c, m.m, millis) == 0; }
+    void signal() { SDL_CondSignal(c); }
+    void broadcast() { SDL_CondBroadcast(c); }
+#elif defined(WIN32)
+    // waiters must hold the mutex while signalling, so the waiter count stays consistent
+    HANDLE sem;
+    int waiters;
+
+    condition() : sem(CreateSemaphore(NULL, 0, INT_MAX, NULL)), waiters(0) {}
+    ~condition() { CloseHandle(sem); }
+
+    bool wait(mutex &m, uint millis = INFINITE)
+    {
+        waiters++;
+        m.unlock();
+        bool signalled = WaitForSingleObject(sem, millis) == WAIT_OBJECT_0;
+        m.lock();
+        if(!signalled && waiters > 0) waiters--;
+        return signalled;
+    }
+    void signal() { if(waiters > 0) { waiters--; ReleaseSemaphore(sem, 1, NULL); } }
+    void broadcast() { if(waiters > 0) { ReleaseSemaphore(sem, waiters, NULL); waiters = 0; } }
+#else
+    pthread_cond_t c;
+
+    condition() { pthread_cond_init(&c, NULL); }
+    ~condition() { pthread_cond_destroy(&c); }
+
+    void wait(mutex &m) { pthread_cond_wait(&c, &m.m); }
+    bool wait(mutex &m, uint millis)
+    {
+        timeval now;
+        gettimeofday(&now, NULL);
+        timespec until;
+        until.tv_sec = now.tv_sec + millis/1000;
+        until.tv_nsec = (now.tv_usec + (millis%1000)*1000)*1000;
+        if(until.tv_nsec >= 1000000000) { until.tv_sec++; until.tv_nsec -= 1000000000; }
+        return pthread_cond_timedwait(&c, &m.m, &until) != ETIMEDOUT;
+    }
+    void signal() { pthread_cond_signal(&c); }
+    void broadcast() { pthread_cond_broadcast(&c); }
+#endif
+};
+
+// single producer, single consumer ring buffer: push() may only be called from one thread and pop() from one other thread
+template<class T, int SIZE> struct spscqueue
+{
+    T data[SIZE];
+    volatile int head, tail;
+
+    spscqueue() : head(0), tail(0) {}
+
+    bool empty() const { return atomicload(head) == atomicload(tail); }
+    int length() const { int n = atomicload(tail) - atomicload(head); return n < 0 ? n + SIZE : n; }
+
+    bool push(const T &e)
+    {
+        int t = tail, next = t+1 < SIZE ? t+1 : 0;
+        if(next == atomicload(head)) return false;
+        data[t] = e;
+        atomicstore(tail, next);
+        return true;
+    }
+
+    bool pop(T &e)
+    {
+        int h = head;
+        if(h == atomicload(tail)) return false;
+        e = data[h];
+        atomicstore(head, h+1 < SIZE ? h+1 : 0);
+        return true;
+    }
+};
+
+// single producer, single consumer byte ring buffer with a capacity chosen at runtime
+struct spscbuffer
+{
+    uchar *data;
+    int size;
+    volatile int head, tail; // running totals of bytes consumed and produced, wrapping modulo 2^32
+
+    spscbuffer() : data(NULL), size(0), head(0), tail(0) {}
+    ~spscbuffer() { DELETEA(data); }
+
+    bool init(int n)
+    {
+        DELETEA(data);
+        for(size = 1<<12; size < n;) size <<= 1;
+        data = new (false) uchar[size];
+        if(!data) size = 0;
+        head = tail = 0;
+        return data != NULL;
+    }
+
+    int length() const { return int(uint(atomicload(tail)) - uint(atomicload(head))); }
+    int space() const { return size - length(); }
+
+    // producer side
+    int write(const void *buf, int len)
+    {
+        int t = tail, n = min(len, size - int(uint(t) - uint(atomicload(head))));
+        if(n <= 0) return 0;
+        int pos = t & (size-1), first = min(n, size - pos);
+        memcpy(&data[pos], buf, first);
+        if(first < n) memcpy(data, (const uchar *)buf + first, n - first);
+        atomicstore(tail, int(uint(t) + n));
+        return n;
+    }
+
+    // consumer side: contiguous readable bytes, released with skip() once used
+    int peek(uchar *&p) const
+    {
+        int h = head, n = int(uint(atomicload(tail)) - uint(h)), pos = h & (size-1);
+        p = &data[pos];
+        return min(n, size - pos);
+    }
+
+    void skip(int n) { atomicstore(head, int(uint(head) + n)); }
+
+    int read(void *buf, int len)
+    {
+        int n = min(len, length()), done = 0;
+        while(done < n)
+        {
+            uchar *p;
+            int avail = min(peek(p), n - done);
+            memcpy((uchar *)buf + done, p, avail);
+            skip(avail);
+            done += avail;
+        }
+        return n;
+    }
+};
+
+// work-stealing job pool: every thread owns a deque it pushes to and pops from at the back, while threads that run
+// out of work steal from the front of the others, so the oldest and usually biggest jobs are the ones that move;
+// jobs may add further jobs, which lets a range or subtree be split recursively as it gets stolen
+// thread 0 is the caller's own slot, worker threads are 1..numworkers
+typedef void (*jobfunc)(void *data, int arg, int thread);
+
+struct jobpool
+{
+    struct job
+    {
+        jobfunc func;
+        void *data;
+        int arg;
+        volatile int *pending;
+    };
+
+    struct jobqueue
+    {
+        jobpool *pool;
+        int index;
+        mutex lock;
+        vector<job> jobs;
+        int head;
+        volatile int size;
+        thread worker;
+
+        jobqueue() : pool(NULL), index(0), head(0), size(0) {}
+    };
+
+    jobqueue *queues;
+    volatile int numqueues;
+    int numworkers;
+    volatile int queued;
+    bool quit;
+    mutex sleeplock;
+    condition wake, done;
+
+    jobpool(int threads) : queues(new jobqueue[threads+1]), numqueues(threads+1), numworkers(0), queued(0), quit(false)
+    {
+        loopi(threads+1) { queues[i].pool = this; queues[i].index = i; }
+        while(numworkers < threads && queues[numworkers+1].worker.start(work, &queues[numworkers+1], "job worker")) numworkers++;
+        atomicstore(numqueues, numworkers+1);
+    }
+
+    ~jobpool()
+    {
+        sleeplock.lock();
+        quit = true;
+        wake.broadcast();
+        sleeplock.unlock();
+        loopi(numworkers) queues[i+1].worker.join();
+        delete[] queues;
+    }
+
+    void add(volatile int &pending, jobfunc func, void *data, int arg = 0, int thread = 0)
+    {
+        atomicadd(pending, 1);
+        jobqueue &q = queues[thread];
+        q.lock.lock();
+        job &j = q.jobs.add();
+        j.func = func;
+        j.data = data;
+        j.arg = arg;
+        j.pending = &pending;
+        atomicstore(q.size, q.jobs.length() - q.head);
+        q.lock.unlock();
+        atomicadd(queued, 1);
+        sleeplock.lock();
+        wake.signal();
+        sleeplock.unlock();
+    }
+
+    bool take(jobqueue &q, job &j, bool steal)
+    {
+        if(!atomicload(q.size)) return false;
+        q.lock.lock();
+        bool found = q.jobs.length() > q.head;
+        if(found)
+        {
+            j = steal ? q.jobs[q.head++] : q.jobs.pop();
+            if(q.head >= q.jobs.length()) { q.jobs.setsize(0); q.head = 0; }
+            atomicstore(q.size, q.jobs.length() - q.head);
+        }
+        q.lock.unlock();
+        if(found) atomicadd(queued, -1);
+        return found;
+    }
+
+    bool take(int thread, job &j)
+    {
+        if(!atomicload(queued)) return false;
+        if(take(queues[thread], j, false)) return true;
+        int n = atomicload(numqueues);
+        for(int i = 1; i < n; i++) if(take(queues[(thread + i)%n], j, true)) return true;
+        return false;
+    }
+
+    void run(const job &j, int thread)
+    {
+        j.func(j.data, j.arg, thread);
+        if(!atomicadd(*j.pending, -1))
+        {
+            sleeplock.lock();
+            done.broadcast();
+            sleeplock.unlock();
+        }
+    }
+
+    // runs one queued job on the given thread's behalf, its own newest first, otherwise stolen
+    bool help(int thread = 0)
+    {
+        job j;
+        if(!take(thread, j)) return false;
+        run(j, thread);
+        return true;
+    }
+
+    // sleeps up to millis without running anything, returns whether all the pending jobs have finished
+    bool wait(volatile int &pending, uint millis)
+    {
+        if(!atomicload(pending)) return true;
+        sleeplock.lock();
+        if(atomicload(pending)) done.wait(sleeplock, millis);
+        sleeplock.unlock();
+        return !atomicload(pending);
+    }
+
+    // helps out until all the pending jobs have finished, for use by the caller or by a job waiting on its children
+    void finish(volatile int &pending, int thread = 0)
+    {
+        while(atomicload(pending)) if(!help(thread)) wait(pending, 1);
+    }
+
+    static int work(void *data)
+    {
+        jobqueue &q = *(jobqueue *)data;
+        jobpool &p = *q.pool;
+        for(;;)
+        {
+            if(p.help(q.index)) continue;
+            p.sleeplock.lock();
+            while(!p.quit && !atomicload(p.queued)) p.wake.wait(p.sleeplock);
+            bool quit = p.quit;
+            p.sleeplock.unlock();
+            if(quit) break;
+        }
+        return 0;
+    }
+};
+
+#endif
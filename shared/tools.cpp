@@ -68,6 +68,22 @@ uint randomMT()
     return y;
 }
 
+// monotonic microsecond clock for profiling, wraps after about 71 minutes
+uint getmicros()
+{
+#ifdef WIN32
+    static LARGE_INTEGER freq = { 0 };
+    if(!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return uint((now.QuadPart / freq.QuadPart) * 1000000 + ((now.QuadPart % freq.QuadPart) * 1000000) / freq.QuadPart);
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint(now.tv_sec) * 1000000 + uint(now.tv_nsec / 1000);
+#endif
+}
+
 ///////////////////////// network ///////////////////////
 
 // all network traffic is in 32bit ints, which are then compressed using the following simple scheme (assumes that most values are small).
@@ -242,3 +258,118 @@ int ipmask::print(char *buf) const
     return int(buf-start);
 }
 
+int ipmaskset::prefixlength(enet_uint32 mask)
+{
+    enet_uint32 bits = ~ENET_NET_TO_HOST_32(mask);
+    if(bits & (bits + 1)) return -1;
+    int len = 32;
+    for(; bits; bits >>= 1) len--;
+    return len;
+}
+
+void ipmaskset::clear()
+{
+    nodes.setsize(0);
+    node &root = nodes.add();
+    root.child[0] = root.child[1] = root.count = 0;
+    unused.setsize(0);
+    sparse.setsize(0);
+    nummasks = 0;
+}
+
+void ipmaskset::add(const ipmask &m)
+{
+    nummasks++;
+    int len = prefixlength(m.mask);
+    if(len < 0) { sparse.add(m); return; }
+    enet_uint32 ip = ENET_NET_TO_HOST_32(m.ip);
+    int n = 0;
+    loopi(len)
+    {
+        int side = (ip >> (31 - i)) & 1, next = nodes[n].child[side];
+        if(!next)
+        {
+            next = unused.length() ? unused.pop() : nodes.length();
+            if(next >= nodes.length()) nodes.add();
+            node &c = nodes[next];
+            c.child[0] = c.child[1] = c.count = 0;
+            nodes[n].child[side] = next;
+        }
+        n = next;
+    }
+    nodes[n].count++;
+}
+
+bool ipmaskset::remove(const ipmask &m)
+{
+    int len = prefixlength(m.mask);
+    if(len < 0)
+    {
+        loopv(sparse) if(sparse[i].ip == m.ip && sparse[i].mask == m.mask) { sparse.remove(i); nummasks--; return true; }
+        return false;
+    }
+    enet_uint32 ip = ENET_NET_TO_HOST_32(m.ip);
+    int path[33], n = 0;
+    path[0] = 0;
+    loopi(len)
+    {
+        n = nodes[n].child[(ip >> (31 - i)) & 1];
+        if(!n) return false;
+        path[i+1] = n;
+    }
+    if(nodes[n].count <= 0) return false;
+    nodes[n].count--;
+    nummasks--;
+    // release the nodes that no longer lead to any mask
+    for(int i = len; i > 0; i--)
+    {
+        node &c = nodes[path[i]];
+        if(c.count || c.child[0] || c.child[1]) break;
+        nodes[path[i-1]].child[(ip >> (32 - i)) & 1] = 0;
+        unused.add(path[i]);
+    }
+    return true;
+}
+
+bool ipmaskset::check(enet_uint32 host) const
+{
+    enet_uint32 ip = ENET_NET_TO_HOST_32(host);
+    int n = 0;
+    if(nodes[0].count) return true;
+    loopi(32)
+    {
+        n = nodes[n].child[(ip >> (31 - i)) & 1];
+        if(!n) break;
+        if(nodes[n].count) return true;
+    }
+    loopv(sparse) if(sparse[i].check(host)) return true;
+    return false;
+}
+
+void ipmaskset::getmasks(vector<ipmask> &masks) const
+{
+    struct walk { int n, len; enet_uint32 ip; };
+    vector<walk> stack;
+    walk &root = stack.add();
+    root.n = root.len = 0;
+    root.ip = 0;
+    while(stack.length())
+    {
+        walk w = stack.pop();
+        const node &c = nodes[w.n];
+        loopi(c.count)
+        {
+            ipmask &m = masks.add();
+            m.ip = ENET_HOST_TO_NET_32(w.ip);
+            m.mask = ENET_HOST_TO_NET_32(w.len ? 0xFFffFFff << (32 - w.len) : 0);
+        }
+        for(int side = 1; side >= 0; side--) if(c.child[side])
+        {
+            walk &next = stack.add();
+            next.n = c.child[side];
+            next.len = w.len + 1;
+            next.ip = w.ip | (enet_uint32(side) << (31 - w.len));
+        }
+    }
+    loopv(sparse) masks.add(sparse[i]);
+}
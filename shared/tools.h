@@ -998,14 +998,177 @@ template<class H, class E, class K, class T> struct hashbase
         deletechunks();
     }
 
+    inline chain *enumstart(int i) const { return chains[i]; }
     static inline chain *enumnext(void *i) { return ((chain *)i)->next; }
     static inline K &enumkey(void *i) { return H::getkey(((chain *)i)->elem); }
     static inline T &enumdata(void *i) { return H::getdata(((chain *)i)->elem); }
 };
 
-template<class T> struct hashset : hashbase<hashset<T>, T, T, T>
+// open addressing with linear probing over a flat array of elements, with each slot's hash kept in a separate array so
+// probes mostly touch only the hashes; unlike hashbase, elements move when the table grows (they are relocated with memcpy,
+// so must not point into themselves), so references into it are only good until the next insert
+template<class H, class E, class K, class T> struct openhashbase
 {
-    typedef hashbase<hashset<T>, T, T, T> basetype;
+    typedef E elemtype;
+    typedef K keytype;
+    typedef T datatype;
+
+    enum { DEFAULTSIZE = 1<<10 };
+    enum { EMPTY = 0, DELETED = 1, USED = 0x80000000 };
+
+    int size;
+    int numelems, numdeleted;
+    uint *hashes;
+    E *elems;
+
+    openhashbase(int size = DEFAULTSIZE)
+    {
+        alloc(max(size, 8));
+    }
+
+    ~openhashbase()
+    {
+        destroyelems();
+        delete[] hashes;
+        delete[] (uchar *)elems;
+    }
+
+    void alloc(int n)
+    {
+        size = n;
+        numelems = numdeleted = 0;
+        hashes = new uint[n];
+        memset(hashes, 0, n*sizeof(uint));
+        elems = (E *)new uchar[n*sizeof(E)];
+    }
+
+    void destroyelems()
+    {
+        if(numelems) loopi(size) if(hashes[i]&USED) elems[i].~E();
+    }
+
+    static inline uint mixhash(uint h)
+    {
+        h *= 0x9E3779B9U;
+        return (h ^ (h>>16)) | USED;
+    }
+
+    void rehash(int newsize)
+    {
+        int oldsize = size;
+        uint *oldhashes = hashes;
+        E *oldelems = elems;
+        alloc(newsize);
+        loopi(oldsize) if(oldhashes[i]&USED)
+        {
+            uint h = oldhashes[i];
+            int j = h&(size-1);
+            while(hashes[j]) j = (j+1)&(size-1);
+            hashes[j] = h;
+            memcpy((void *)&elems[j], (void *)&oldelems[i], sizeof(E));
+            numelems++;
+        }
+        delete[] oldhashes;
+        delete[] (uchar *)oldelems;
+    }
+
+    E &insert(uint h)
+    {
+        if(4*(numelems + numdeleted + 1) > 3*size) rehash(numdeleted >= numelems ? size : 2*size);
+        int i = h&(size-1);
+        while(hashes[i]&USED) i = (i+1)&(size-1);
+        if(hashes[i] == DELETED) numdeleted--;
+        hashes[i] = h;
+        numelems++;
+        return *new (&elems[i]) E;
+    }
+
+    template<class U>
+    T &insert(uint h, const U &key)
+    {
+        E &elem = insert(h);
+        H::setkey(elem, key);
+        return H::getdata(elem);
+    }
+
+    #define OPENHTFIND(success, fail) \
+        uint h = this->mixhash(hthash(key)); \
+        for(int i = h&(this->size-1);; i = (i+1)&(this->size-1)) \
+        { \
+            uint slot = this->hashes[i]; \
+            if(slot == h) { if(htcmp(key, H::getkey(this->elems[i]))) return success H::getdata(this->elems[i]); } \
+            else if(slot == EMPTY) break; \
+        } \
+        return (fail);
+
+    template<class U>
+    T *access(const U &key)
+    {
+        OPENHTFIND(&, NULL);
+    }
+
+    template<class U, class V>
+    T &access(const U &key, const V &elem)
+    {
+        OPENHTFIND( , insert(h, key) = elem);
+    }
+
+    template<class U>
+    T &operator[](const U &key)
+    {
+        OPENHTFIND( , insert(h, key));
+    }
+
+    template<class U>
+    T &find(const U &key, T &notfound)
+    {
+        OPENHTFIND( , notfound);
+    }
+
+    template<class U>
+    const T &find(const U &key, const T &notfound)
+    {
+        OPENHTFIND( , notfound);
+    }
+
+    template<class U>
+    bool remove(const U &key)
+    {
+        uint h = mixhash(hthash(key));
+        for(int i = h&(size-1); hashes[i] != EMPTY; i = (i+1)&(size-1))
+        {
+            if(hashes[i] == h && htcmp(key, H::getkey(elems[i])))
+            {
+                elems[i].~E();
+                // a slot followed by an empty one ends no probe sequence, so it can go back to being empty
+                if(hashes[(i+1)&(size-1)] == EMPTY) hashes[i] = EMPTY;
+                else { hashes[i] = DELETED; numdeleted++; }
+                numelems--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void clear()
+    {
+        if(!numelems && !numdeleted) return;
+        destroyelems();
+        memset(hashes, 0, size*sizeof(uint));
+        numelems = numdeleted = 0;
+    }
+
+    inline E *enumstart(int i) const { return hashes[i]&USED ? &elems[i] : NULL; }
+    static inline E *enumnext(void *i) { return NULL; }
+    static inline K &enumkey(void *i) { return H::getkey(*(E *)i); }
+    static inline T &enumdata(void *i) { return H::getdata(*(E *)i); }
+};
+
+// the table implementation is picked per use: hashbase by default, or openhashbase where lookups are hot and nothing
+// keeps pointers to the elements
+template<class T, template<class, class, class, class> class B = hashbase> struct hashset : B<hashset<T, B>, T, T, T>
+{
+    typedef B<hashset<T, B>, T, T, T> basetype;
 
     hashset(int size = basetype::DEFAULTSIZE) : basetype(size) {}
 
@@ -1020,9 +1183,9 @@ template<class T> struct hashset : hashbase<hashset<T>, T, T, T>
     }
 };
 
-template<class T> struct hashnameset : hashbase<hashnameset<T>, T, const char *, T>
+template<class T, template<class, class, class, class> class B = hashbase> struct hashnameset : B<hashnameset<T, B>, T, const char *, T>
 {
-    typedef hashbase<hashnameset<T>, T, const char *, T> basetype;
+    typedef B<hashnameset<T, B>, T, const char *, T> basetype;
 
     hashnameset(int size = basetype::DEFAULTSIZE) : basetype(size) {}
 
@@ -1044,9 +1207,9 @@ template<class K, class T> struct hashtableentry
     T data;
 };
 
-template<class K, class T> struct hashtable : hashbase<hashtable<K, T>, hashtableentry<K, T>, K, T>
+template<class K, class T, template<class, class, class, class> class B = hashbase> struct hashtable : B<hashtable<K, T, B>, hashtableentry<K, T>, K, T>
 {
-    typedef hashbase<hashtable<K, T>, hashtableentry<K, T>, K, T> basetype;
+    typedef B<hashtable<K, T, B>, hashtableentry<K, T>, K, T> basetype;
     typedef typename basetype::elemtype elemtype;
 
     hashtable(int size = basetype::DEFAULTSIZE) : basetype(size) {}
@@ -1056,8 +1219,8 @@ template<class K, class T> struct hashtable : hashbase<hashtable<K, T>, hashtabl
     template<class U> static inline void setkey(elemtype &elem, const U &key) { elem.key = key; }
 };
 
-#define enumeratekt(ht,k,e,t,f,b) loopi((ht).size) for(void *ec = (ht).chains[i]; ec;) { k &e = (ht).enumkey(ec); t &f = (ht).enumdata(ec); ec = (ht).enumnext(ec); b; }
-#define enumerate(ht,t,e,b)       loopi((ht).size) for(void *ec = (ht).chains[i]; ec;) { t &e = (ht).enumdata(ec); ec = (ht).enumnext(ec); b; }
+#define enumeratekt(ht,k,e,t,f,b) loopi((ht).size) for(void *ec = (ht).enumstart(i); ec;) { k &e = (ht).enumkey(ec); t &f = (ht).enumdata(ec); ec = (ht).enumnext(ec); b; }
+#define enumerate(ht,t,e,b)       loopi((ht).size) for(void *ec = (ht).enumstart(i); ec;) { t &e = (ht).enumdata(ec); ec = (ht).enumnext(ec); b; }
 
 struct unionfind
 {
@@ -1277,6 +1440,9 @@ struct stream
     virtual bool putline(const char *str) { return putstring(str) && putchar('\n'); }
     virtual size_t printf(const char *fmt, ...) PRINTFARGS(2, 3);
     virtual uint getcrc() { return 0; }
+    virtual bool storedcrc(uint &crc) { return false; }
+    virtual offset syncpoint() { return -1; }
+    virtual bool seeksync(offset rawpos, offset pos) { return false; }
 
     template<class T> size_t put(const T *v, size_t n) { return write(v, n*sizeof(T))/sizeof(T); } 
     template<class T> bool put(T n) { return write(&n, sizeof(n)) == sizeof(n); }
@@ -1369,11 +1535,27 @@ extern stream *opentempfile(const char *filename, const char *mode);
 extern stream *opengzfile(const char *filename, const char *mode, stream *file = NULL, int level = Z_BEST_COMPRESSION);
 extern stream *openutf8file(const char *filename, const char *mode, stream *file = NULL);
 extern char *loadfile(const char *fn, size_t *size, bool utf8 = true);
+
+// a whole file mapped read-only into memory, or read into it where that is not possible such as inside zips
+struct mappedfile
+{
+    uchar *data;
+    size_t size;
+    bool mapped;
+
+    mappedfile() : data(NULL), size(0), mapped(false) {}
+    ~mappedfile() { close(); }
+
+    bool open(const char *filename);
+    void close();
+};
+
 extern bool listdir(const char *dir, bool rel, const char *ext, vector<char *> &files);
 extern int listfiles(const char *dir, const char *ext, vector<char *> &files);
 extern int listzipfiles(const char *dir, const char *ext, vector<char *> &files);
 extern void seedMT(uint seed);
 extern uint randomMT();
+extern uint getmicros();
 
 extern void putint(ucharbuf &p, int n);
 extern void putint(packetbuf &p, int n);
@@ -1404,5 +1586,33 @@ struct ipmask
     bool check(enet_uint32 host) const { return (host & mask) == ip; }
 };
 
+// set of ip masks compiled into a binary prefix trie, so matching a host costs at most 32 steps regardless of the number of masks
+struct ipmaskset
+{
+    struct node
+    {
+        int child[2], count;
+    };
+
+    vector<node> nodes; // nodes[0] is the root, count is the number of masks ending at a node
+    vector<int> unused;
+    vector<ipmask> sparse; // masks with gaps that are not a prefix, checked one by one
+    int nummasks;
+
+    ipmaskset() { clear(); }
+
+    void clear();
+    int length() const { return nummasks; }
+    bool empty() const { return !nummasks; }
+
+    void add(const ipmask &m);
+    void add(const char *name) { ipmask m; m.parse(name); add(m); }
+    bool remove(const ipmask &m);
+    bool check(enet_uint32 host) const;
+    void getmasks(vector<ipmask> &masks) const;
+
+    static int prefixlength(enet_uint32 mask);
+};
+
 #endif
 